@@ -3,21 +3,7 @@ import numpy as np
 from pathlib import Path
 from netCDF4 import Dataset
 from calendar import monthrange
-
-def find_aoi_bins(nrows, min_lat, max_lat, min_lon, max_lon):
-    row_lats = (np.arange(0,  nrows, dtype=np.double) + 0.5) * 180. / nrows - 90
-    nbins_in_row = np.floor(2 * nrows * np.cos(row_lats * np.pi / 180.) + 0.5).astype(np.int)
-    lons = []
-    lats = np.repeat(row_lats, nbins_in_row)
-
-    for i in range(0, nrows):
-        lons.extend((360. * (np.arange(0, nbins_in_row[i], dtype=np.double) + 0.5) / nbins_in_row[i] - 180.).tolist())
-
-    lats_idx = ((lats >= min_lat) & (lats <= max_lat)).nonzero()
-    lons = np.array(lons)
-    lons_idx = ((lats >= min_lon) & (lons <= max_lon)).nonzero()
-    aoi_bins = np.intersect1d(lats_idx, lons_idx)
-    return lats[aoi_bins], lons[aoi_bins], aoi_bins
+from main import find_aoi_bins
 
 def read_modis(filename):
     dataset = Dataset(filename)
@@ -33,7 +19,7 @@ def read_modis(filename):
 def main():
     dataset = Dataset("input/AQUA_MODIS.20200724.L3b.DAY.SST.nc")
     nrows = len(dataset.groups["level-3_binned_data"]["BinIndex"])
-    lats, lons, aoi_bins = find_aoi_bins(nrows, 20, 80, -180, -120)
+    lats, lons, aoi_bins, _, _ = find_aoi_bins(nrows, 20, 80, -180, -120)
     dataset.close()
     path = Path("input/")
     for month in range(6, 12):
@@ -0,0 +1,370 @@
+/*
+ * Benchmarks of every step of the single image edge detection algorithm on synthetic images of the full ISIN grid.
+ *
+ * usage: sied_bench [-r repeats] [-c cloud_fraction] [-t threads] [-s seed] [-v] [-b band_rows] [-k contour_rows]
+ *                   [nrows ...]
+ *
+ * Each resolution given as a number of rows, 2160 and 4320 by default, is timed with the original int steps of the
+ * algorithm and with the optimized steps of cayula(). The best time of the repeats is reported along with the bins
+ * processed per second and, for the steps that work on windows, the time per window. -v runs the context with the
+ * spans of bins containing data. -b also times a stream with bands of the given number of rows, following contours
+ * -k rows around each band.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "synth.h"
+#include "cayula.h"
+#include "stream.h"
+#include "filter.h"
+#include "helpers.h"
+#include "histogram.h"
+#include "cohesion.h"
+#include "contour.h"
+
+#define BENCH_MAX_RESOLUTIONS 16
+
+typedef struct bench_options {
+    int repeats;
+    int nthreads;
+    int valid_spans;
+    int band_rows;
+    int contour_rows;
+    SynthOptions synth;
+} BenchOptions;
+
+static inline int min(int a, int b) {
+    return a < b ? a : b;
+}
+
+static inline int max(int a, int b) {
+    return a > b ? a : b;
+}
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double) t.tv_sec + (double) t.tv_nsec * 1e-9;
+}
+
+/*
+ * Function:  report
+ * --------------------
+ * Prints the time of a step with its throughput in bins and, if nwindows is positive, the time per window.
+ */
+static void report(const char *step, double seconds, long nbins, long nwindows) {
+    printf("%-24s %10.4f %12.2f", step, seconds, nbins / seconds * 1e-6);
+    if (nwindows > 0) {
+        printf(" %12.1f", seconds / nwindows * 1e9);
+    }
+    printf("\n");
+}
+
+/*
+ * The windows of a scan with non-overlapping windows of WINDOW_WIDTH bins, as cayula() visits them.
+ */
+typedef struct window_list {
+    int nwindows;
+    int *bins;
+    int *rows;
+} WindowList;
+
+/*
+ * Function:  list_windows
+ * --------------------
+ * Finds the center bins of the windows of a scan of the field.
+ */
+static WindowList list_windows(const SynthField *field) {
+    WindowList list = {0, NULL, NULL};
+    int half_step = WINDOW_WIDTH / 2;
+    int capacity = field->nbins / (WINDOW_WIDTH * WINDOW_WIDTH) + field->nrows;
+    list.bins = malloc(capacity * sizeof(int));
+    list.rows = malloc(capacity * sizeof(int));
+    if (list.bins == NULL || list.rows == NULL) return list;
+    const int *n_bins_in_row = field->n_bins_in_row;
+    for (int i = half_step - 1; i < field->nrows - half_step; i += WINDOW_WIDTH) {
+        if (n_bins_in_row[max(i - WINDOW_WIDTH + 1, 0)] < WINDOW_WIDTH ||
+            n_bins_in_row[min(i + WINDOW_WIDTH, field->nrows - 1)] < WINDOW_WIDTH) {
+            continue;
+        }
+        for (int j = half_step - 1; j < n_bins_in_row[i] - half_step && list.nwindows < capacity; j += WINDOW_WIDTH) {
+            list.bins[list.nwindows] = field->basebins[i] + j;
+            list.rows[list.nwindows] = i;
+            list.nwindows++;
+        }
+    }
+    return list;
+}
+
+/*
+ * Function:  bench_original_steps
+ * --------------------
+ * Times the original int implementation of each step: the median filter over the whole field, the histogram analysis,
+ * cohesion test and edge location of every window of a scan, and contour following on the edges found.
+ */
+static void bench_original_steps(const SynthField *field, const BenchOptions *options) {
+    int nbins = field->nbins;
+    int *filtered = malloc(nbins * sizeof(int));
+    int *edges = calloc(nbins, sizeof(int));
+    int *out = malloc(nbins * sizeof(int));
+    int *thresholds = NULL;
+    WindowList list = list_windows(field);
+    int window[WINDOW_AREA];
+    int window_bins[WINDOW_AREA];
+    int window_edges[WINDOW_AREA];
+    if (filtered == NULL || edges == NULL || out == NULL || list.bins == NULL || list.rows == NULL) {
+        fprintf(stderr, "out of memory\n");
+        goto done;
+    }
+    thresholds = malloc(list.nwindows * sizeof(int));
+    if (thresholds == NULL) {
+        fprintf(stderr, "out of memory\n");
+        goto done;
+    }
+
+    double best = 1e30;
+    for (int r = 0; r < options->repeats; r++) {
+        double start = now();
+        median_filter(field->data, filtered, nbins, field->nrows, field->n_bins_in_row, field->basebins);
+        best = best < now() - start ? best : now() - start;
+    }
+    report("median_filter", best, nbins, 0);
+
+    /*
+     * The windows are gathered outside the timed loops so only the step itself is timed
+     */
+    double histogram = 1e30, cohesion = 1e30, edge = 1e30;
+    long ncohesive = 0, nthresholds = 0;
+    for (int r = 0; r < options->repeats; r++) {
+        double histogram_time = 0, cohesion_time = 0, edge_time = 0;
+        ncohesive = 0;
+        nthresholds = 0;
+        for (int w = 0; w < list.nwindows; w++) {
+            get_window(list.bins[w], list.rows[w], WINDOW_WIDTH, filtered, field->n_bins_in_row, field->basebins,
+                       window);
+            double start = now();
+            thresholds[w] = histogram_analysis(window);
+            histogram_time += now() - start;
+            if (thresholds[w] <= 0) continue;
+            nthresholds++;
+            start = now();
+            int is_cohesive = cohesive(window, thresholds[w]);
+            cohesion_time += now() - start;
+            if (!is_cohesive) continue;
+            ncohesive++;
+            start = now();
+            find_edge(window, window_edges, thresholds[w]);
+            edge_time += now() - start;
+            if (r == 0) {
+                get_bin_window(list.bins[w], list.rows[w], WINDOW_WIDTH, field->n_bins_in_row, field->basebins,
+                               window_bins);
+                for (int k = 0; k < WINDOW_AREA; k++) {
+                    if (window_edges[k]) edges[window_bins[k]] = 1;
+                }
+            }
+        }
+        histogram = histogram < histogram_time ? histogram : histogram_time;
+        cohesion = cohesion < cohesion_time ? cohesion : cohesion_time;
+        edge = edge < edge_time ? edge : edge_time;
+    }
+    report("histogram_analysis", histogram, (long) list.nwindows * WINDOW_AREA, list.nwindows);
+    report("cohesive", cohesion, nthresholds * WINDOW_AREA, nthresholds);
+    report("find_edge", edge, ncohesive * WINDOW_AREA, ncohesive);
+
+    best = 1e30;
+    for (int r = 0; r < options->repeats; r++) {
+        double start = now();
+        contour(edges, filtered, out, nbins, field->nrows, field->n_bins_in_row, field->basebins);
+        best = best < now() - start ? best : now() - start;
+    }
+    report("contour", best, nbins, 0);
+
+done:
+    free(filtered);
+    free(edges);
+    free(out);
+    free(thresholds);
+    free(list.bins);
+    free(list.rows);
+}
+
+/*
+ * Function:  bench_pipeline
+ * --------------------
+ * Times cayula() end to end, then a reused context with stats to break the optimized pipeline down into its steps.
+ */
+static void bench_pipeline(const SynthField *field, const BenchOptions *options) {
+    int nbins = field->nbins;
+    int *out = malloc(nbins * sizeof(int));
+    if (out == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return;
+    }
+
+    double best = 1e30;
+    for (int r = 0; r < options->repeats; r++) {
+        double start = now();
+        cayula(field->data, out, nbins, field->nrows, field->n_bins_in_row, field->basebins);
+        best = best < now() - start ? best : now() - start;
+    }
+    report("cayula", best, nbins, 0);
+
+    CayulaStats stats, best_stats = {0};
+    CayulaOptions ctx_options = cayula_default_options();
+    ctx_options.nthreads = options->nthreads;
+    ctx_options.valid_spans = options->valid_spans;
+    ctx_options.stats = &stats;
+    CayulaCtx *ctx = cayula_ctx_create(nbins, field->nrows, field->n_bins_in_row, field->basebins, &ctx_options);
+    if (ctx == NULL) {
+        fprintf(stderr, "out of memory\n");
+        free(out);
+        return;
+    }
+    best = 1e30;
+    for (int r = 0; r < options->repeats; r++) {
+        double start = now();
+        cayula_ctx_run(ctx, field->data, out);
+        double seconds = now() - start;
+        if (seconds < best) {
+            best = seconds;
+            best_stats = stats;
+        }
+    }
+    report("ctx run", best, nbins, 0);
+    report("  median filter", best_stats.filter_wall, nbins, 0);
+    report("  window scan", best_stats.scan_wall, nbins, best_stats.windows);
+    report("  contour", best_stats.contour_wall, nbins, 0);
+    printf("%ld windows, %ld without a threshold, %ld not cohesive, %ld edge pixels, %ld of %ld contours kept, "
+           "%.1f MB\n", best_stats.windows, best_stats.rejected_histogram, best_stats.rejected_cohesion,
+           best_stats.edge_pixels, best_stats.contours_kept, best_stats.contours_started,
+           best_stats.bytes_allocated / 1e6);
+    cayula_ctx_destroy(ctx);
+    free(out);
+}
+
+/*
+ * Output of a stream gathered into the layout of the whole image.
+ */
+typedef struct stream_output {
+    const SynthField *field;
+    int *out;
+} StreamOutput;
+
+static void gather_rows(void *arg, int first_row, int nrows, const int *out_data) {
+    StreamOutput *output = arg;
+    const SynthField *field = output->field;
+    int last = first_row + nrows - 1;
+    memcpy(output->out + field->basebins[first_row], out_data,
+           (field->basebins[last] + field->n_bins_in_row[last] - field->basebins[first_row]) * sizeof(int));
+}
+
+/*
+ * Function:  bench_stream
+ * --------------------
+ * Times a stream pushed one row at a time and counts the contours it cut and the bins whose output differs from
+ * cayula().
+ */
+static void bench_stream(const SynthField *field, const BenchOptions *options) {
+    int nbins = field->nbins;
+    int *expected = malloc(nbins * sizeof(int));
+    StreamOutput output = {field, malloc(nbins * sizeof(int))};
+    if (expected == NULL || output.out == NULL) {
+        fprintf(stderr, "out of memory\n");
+        goto done;
+    }
+    cayula(field->data, expected, nbins, field->nrows, field->n_bins_in_row, field->basebins);
+
+    CayulaOptions ctx_options = cayula_default_options();
+    ctx_options.nthreads = options->nthreads;
+    ctx_options.valid_spans = options->valid_spans;
+    double best = 1e30;
+    int halo = 0;
+    long ncut = 0;
+    for (int r = 0; r < options->repeats; r++) {
+        double start = now();
+        CayulaStream *stream = cayula_stream_create(field->nrows, field->n_bins_in_row, options->band_rows,
+                                                    options->contour_rows, &ctx_options, gather_rows, &output);
+        if (stream == NULL) {
+            fprintf(stderr, "out of memory\n");
+            goto done;
+        }
+        halo = cayula_stream_halo(stream);
+        for (int i = 0; i < field->nrows; i++) {
+            if (cayula_stream_push(stream, field->data + field->basebins[i], 1) != 0) {
+                fprintf(stderr, "stream failed\n");
+                cayula_stream_destroy(stream);
+                goto done;
+            }
+        }
+        ncut = cayula_stream_cut(stream);
+        cayula_stream_destroy(stream);
+        best = best < now() - start ? best : now() - start;
+    }
+    report("stream", best, nbins, 0);
+    long ndifferent = 0;
+    for (int i = 0; i < nbins; i++) ndifferent += expected[i] != output.out[i];
+    printf("bands of %d rows with %d halo rows, %ld contours cut, %ld bins differ from cayula\n", options->band_rows,
+           halo, ncut, ndifferent);
+
+done:
+    free(expected);
+    free(output.out);
+}
+
+int main(int argc, char **argv) {
+    BenchOptions options;
+    options.repeats = 3;
+    options.nthreads = 0;
+    options.valid_spans = 0;
+    options.band_rows = 0;
+    options.contour_rows = 0;
+    options.synth = synth_default_options();
+    int resolutions[BENCH_MAX_RESOLUTIONS];
+    int nresolutions = 0;
+
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-r") == 0 && a + 1 < argc) {
+            options.repeats = max(atoi(argv[++a]), 1);
+        } else if (strcmp(argv[a], "-c") == 0 && a + 1 < argc) {
+            options.synth.cloud_fraction = atof(argv[++a]);
+        } else if (strcmp(argv[a], "-t") == 0 && a + 1 < argc) {
+            options.nthreads = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "-s") == 0 && a + 1 < argc) {
+            options.synth.seed = (unsigned int) strtoul(argv[++a], NULL, 10);
+        } else if (strcmp(argv[a], "-v") == 0) {
+            options.valid_spans = 1;
+        } else if (strcmp(argv[a], "-b") == 0 && a + 1 < argc) {
+            options.band_rows = max(atoi(argv[++a]), 1);
+        } else if (strcmp(argv[a], "-k") == 0 && a + 1 < argc) {
+            options.contour_rows = atoi(argv[++a]);
+        } else if (argv[a][0] != '-' && nresolutions < BENCH_MAX_RESOLUTIONS && atoi(argv[a]) > 0) {
+            resolutions[nresolutions++] = atoi(argv[a]);
+        } else {
+            fprintf(stderr, "usage: %s [-r repeats] [-c cloud_fraction] [-t threads] [-s seed] [-v] [-b band_rows] "
+                    "[-k contour_rows] [nrows ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (nresolutions == 0) {
+        resolutions[nresolutions++] = 2160;
+        resolutions[nresolutions++] = 4320;
+    }
+
+    for (int n = 0; n < nresolutions; n++) {
+        double start = now();
+        SynthField *field = synth_field_create(resolutions[n], &options.synth);
+        if (field == NULL) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+        printf("\nISIN %d rows, %d bins, %.0f%% cloud, seed %u, generated in %.2f s, best of %d\n", field->nrows,
+               field->nbins, options.synth.cloud_fraction * 100, options.synth.seed, now() - start, options.repeats);
+        printf("%-24s %10s %12s %12s\n", "step", "seconds", "Mbins/s", "ns/window");
+        bench_original_steps(field, &options);
+        bench_pipeline(field, &options);
+        if (options.band_rows > 0) bench_stream(field, &options);
+        synth_field_destroy(field);
+    }
+    return 0;
+}
@@ -0,0 +1,8 @@
+#!/bin/bash
+gcc -std=gnu99 -O2 -g -pthread -I../src -o sied_bench bench.c ../src/filter.c ../src/cayula.c ../src/helpers.c \
+    ../src/cohesion.c ../src/contour.c ../src/histogram.c ../src/grid.c ../src/pool.c ../src/arena.c \
+    ../src/gradient.c ../src/synth.c ../src/isin.c ../src/spans.c ../src/stream.c -lm
+gcc -std=gnu99 -O2 -g -pthread -I../src -I../test/support -o sied_golden golden.c ../test/support/golden.c \
+    ../test/support/reference.c ../src/filter.c ../src/cayula.c ../src/helpers.c ../src/cohesion.c ../src/contour.c \
+    ../src/histogram.c ../src/grid.c ../src/pool.c ../src/arena.c ../src/gradient.c ../src/synth.c ../src/isin.c \
+    ../src/spans.c -lm
@@ -0,0 +1,79 @@
+/*
+ * Checks that every step of a context run on large synthetic and random ISIN images gives the same result as the
+ * original implementation of the algorithm.
+ *
+ * usage: sied_golden [-c cloud_fraction] [-t threads] [-b contour_band_rows] [-g] [-s seed] [nrows ...]
+ *
+ * Each resolution given as a number of rows, 2160 by default, is checked on a synthetic image and on an image of
+ * uniform random values. The number of mismatches of each step is printed with the bin and row of the first one, and
+ * the exit status is 1 if any step differs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "synth.h"
+#include "cayula.h"
+#include "golden.h"
+
+#define GOLDEN_MAX_RESOLUTIONS 16
+
+static int check(const char *name, const SynthField *field, const CayulaOptions *options) {
+    GoldenReport report;
+    printf("\n%s, ISIN %d rows, %d bins\n", name, field->nrows, field->nbins);
+    long mismatches = golden_compare(field->data, field->nbins, field->nrows, field->n_bins_in_row, field->basebins,
+                                     options, &report);
+    if (mismatches < 0) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    golden_print(&report, stdout);
+    return mismatches != 0;
+}
+
+int main(int argc, char **argv) {
+    SynthOptions synth = synth_default_options();
+    CayulaOptions options = cayula_default_options();
+    int resolutions[GOLDEN_MAX_RESOLUTIONS];
+    int nresolutions = 0;
+
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-c") == 0 && a + 1 < argc) {
+            synth.cloud_fraction = atof(argv[++a]);
+        } else if (strcmp(argv[a], "-t") == 0 && a + 1 < argc) {
+            options.nthreads = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "-b") == 0 && a + 1 < argc) {
+            options.contour_band_rows = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "-g") == 0) {
+            options.gradient_field = 1;
+        } else if (strcmp(argv[a], "-s") == 0 && a + 1 < argc) {
+            synth.seed = (unsigned int) strtoul(argv[++a], NULL, 10);
+        } else if (argv[a][0] != '-' && nresolutions < GOLDEN_MAX_RESOLUTIONS && atoi(argv[a]) > 0) {
+            resolutions[nresolutions++] = atoi(argv[a]);
+        } else {
+            fprintf(stderr, "usage: %s [-c cloud_fraction] [-t threads] [-b contour_band_rows] [-g] [-s seed] "
+                            "[nrows ...]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (nresolutions == 0) {
+        resolutions[nresolutions++] = 2160;
+    }
+
+    int failed = 0;
+    for (int n = 0; n < nresolutions; n++) {
+        SynthField *field = synth_field_create(resolutions[n], &synth);
+        if (field == NULL) {
+            fprintf(stderr, "out of memory\n");
+            return 2;
+        }
+        failed |= check("synthetic", field, &options);
+
+        srand(synth.seed);
+        for (int i = 0; i < field->nbins; i++) {
+            field->data[i] = (double) rand() / RAND_MAX < synth.cloud_fraction ? FILL_VALUE : rand() % 256;
+        }
+        failed |= check("random", field, &options);
+        synth_field_destroy(field);
+    }
+    return failed;
+}
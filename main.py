@@ -6,73 +6,302 @@ import pandas as pd
 from multiprocessing import Pool, cpu_count
 
 
+class CayulaStats(ctypes.Structure):
+    """
+    Mirror of CayulaStats in src/cayula.h
+    """
+    _fields_ = [("filter_wall", ctypes.c_double),
+                ("filter_cpu", ctypes.c_double),
+                ("scan_wall", ctypes.c_double),
+                ("scan_cpu", ctypes.c_double),
+                ("contour_wall", ctypes.c_double),
+                ("contour_cpu", ctypes.c_double),
+                ("windows", ctypes.c_long),
+                ("rejected_histogram", ctypes.c_long),
+                ("rejected_cohesion", ctypes.c_long),
+                ("edge_pixels", ctypes.c_long),
+                ("contours_started", ctypes.c_long),
+                ("contour_points", ctypes.c_long),
+                ("contours_kept", ctypes.c_long),
+                ("bytes_allocated", ctypes.c_long)]
+
+    def as_dict(self):
+        return {name: getattr(self, name) for name, _ in self._fields_}
+
+
+class CayulaOptions(ctypes.Structure):
+    """
+    Mirror of CayulaOptions in src/cayula.h
+    """
+    _fields_ = [("nthreads", ctypes.c_int),
+                ("window_width", ctypes.c_int),
+                ("stride", ctypes.c_int),
+                ("filter_size", ctypes.c_int),
+                ("gradient_field", ctypes.c_int),
+                ("contour_band_rows", ctypes.c_int),
+                ("min_valid_fraction", ctypes.c_double),
+                ("min_variance", ctypes.c_double),
+                ("min_range", ctypes.c_int),
+                ("levels", ctypes.c_int),
+                ("valid_spans", ctypes.c_int),
+                ("stats", ctypes.POINTER(CayulaStats))]
+
+
+class IsinAoi(ctypes.Structure):
+    """
+    Mirror of IsinAoi in src/isin.h
+    """
+    _fields_ = [("nbins", ctypes.c_int),
+                ("nrows", ctypes.c_int),
+                ("n_bins_in_row", ctypes.POINTER(ctypes.c_int)),
+                ("basebins", ctypes.POINTER(ctypes.c_int)),
+                ("grid_nrows", ctypes.c_int),
+                ("grid_rows", ctypes.POINTER(ctypes.c_int)),
+                ("grid_n_bins_in_row", ctypes.POINTER(ctypes.c_int)),
+                ("grid_cols", ctypes.POINTER(ctypes.c_int)),
+                ("grid_basebins", ctypes.POINTER(ctypes.c_int))]
+
+
+class GridFileHeader(ctypes.Structure):
+    """
+    Mirror of GridFileHeader in src/gridfile.h
+    """
+    _fields_ = [("magic", ctypes.c_char * 8),
+                ("version", ctypes.c_uint32),
+                ("layout", ctypes.c_uint32),
+                ("value_type", ctypes.c_uint32),
+                ("nbins", ctypes.c_int32),
+                ("nrows", ctypes.c_int32),
+                ("nspans", ctypes.c_int32),
+                ("nvalues", ctypes.c_int64),
+                ("geometry_hash", ctypes.c_uint64),
+                ("reserved", ctypes.c_uint64 * 2)]
+
+
+class GridFile(ctypes.Structure):
+    """
+    Mirror of GridFile in src/gridfile.h
+    """
+    _fields_ = [("header", ctypes.POINTER(GridFileHeader)),
+                ("spans", ctypes.POINTER(ctypes.c_int32)),
+                ("values", ctypes.c_void_p),
+                ("valid", ctypes.POINTER(ctypes.c_uint64)),
+                ("map", ctypes.c_void_p),
+                ("size", ctypes.c_size_t)]
+
+
+FILL_VALUE = -999
+GRID_FILE_DENSE = 0
+GRID_FILE_SPANS = 1
+
+_library = None
+
+
+def load_library(path=None):
+    """
+    Loads sied.so once per process and declares the arguments of the functions used by EdgeDetector. Arrays are passed
+    as NumPy arrays of C ints without being copied, and ctypes releases the GIL for the duration of every call
+    :param path: path of the library. Defaults to sied.so next to this file
+    :return: the loaded library
+    """
+    global _library
+    if _library is None:
+        if path is None:
+            path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "sied.so")
+        library = ctypes.CDLL(path)
+        in_array = np.ctypeslib.ndpointer(dtype=np.intc, ndim=1, flags="C_CONTIGUOUS")
+        out_array = np.ctypeslib.ndpointer(dtype=np.intc, ndim=1, flags="C_CONTIGUOUS,WRITEABLE")
+        library.cayula_default_options.argtypes = ()
+        library.cayula_default_options.restype = CayulaOptions
+        library.cayula_ctx_create.argtypes = (ctypes.c_int, ctypes.c_int, in_array, in_array,
+                                              ctypes.POINTER(CayulaOptions))
+        library.cayula_ctx_create.restype = ctypes.c_void_p
+        library.cayula_ctx_run.argtypes = (ctypes.c_void_p, in_array, out_array)
+        library.cayula_ctx_run.restype = None
+        library.cayula_ctx_set_bin_numbers.argtypes = (ctypes.c_void_p, in_array)
+        library.cayula_ctx_set_bin_numbers.restype = ctypes.c_int
+        library.cayula_ctx_run_sparse.argtypes = (ctypes.c_void_p, in_array,
+                                                  np.ctypeslib.ndpointer(dtype=np.double, ndim=1,
+                                                                         flags="C_CONTIGUOUS"),
+                                                  ctypes.c_int,
+                                                  np.ctypeslib.ndpointer(dtype=np.int8, ndim=1,
+                                                                         flags="C_CONTIGUOUS,WRITEABLE"))
+        library.cayula_ctx_run_sparse.restype = ctypes.c_int
+        library.cayula_ctx_destroy.argtypes = (ctypes.c_void_p,)
+        library.cayula_ctx_destroy.restype = None
+        library.isin_aoi_create.argtypes = (ctypes.c_int, ctypes.c_double, ctypes.c_double, ctypes.c_double,
+                                            ctypes.c_double)
+        library.isin_aoi_create.restype = ctypes.POINTER(IsinAoi)
+        library.isin_aoi_bins.argtypes = (ctypes.POINTER(IsinAoi), out_array)
+        library.isin_aoi_bins.restype = None
+        double_array = np.ctypeslib.ndpointer(dtype=np.double, ndim=1, flags="C_CONTIGUOUS,WRITEABLE")
+        library.isin_aoi_lat_lon.argtypes = (ctypes.POINTER(IsinAoi), double_array, double_array)
+        library.isin_aoi_lat_lon.restype = None
+        library.isin_aoi_destroy.argtypes = (ctypes.POINTER(IsinAoi),)
+        library.isin_aoi_destroy.restype = None
+        int8_array = np.ctypeslib.ndpointer(dtype=np.int8, ndim=1, flags="C_CONTIGUOUS,WRITEABLE")
+        library.grid_file_write_output.argtypes = (ctypes.c_char_p, ctypes.c_int, in_array, ctypes.c_int,
+                                                   np.ctypeslib.ndpointer(dtype=np.int8, ndim=1,
+                                                                          flags="C_CONTIGUOUS"))
+        library.grid_file_write_output.restype = ctypes.c_int
+        library.grid_file_open.argtypes = (ctypes.c_char_p,)
+        library.grid_file_open.restype = ctypes.POINTER(GridFile)
+        library.grid_file_matches.argtypes = (ctypes.POINTER(GridFile), ctypes.c_int, in_array)
+        library.grid_file_matches.restype = ctypes.c_int
+        library.grid_file_read_output.argtypes = (ctypes.POINTER(GridFile), int8_array)
+        library.grid_file_read_output.restype = ctypes.c_int
+        library.grid_file_close.argtypes = (ctypes.POINTER(GridFile),)
+        library.grid_file_close.restype = None
+        _library = library
+    return _library
+
+
+def find_aoi_bins(nrows, min_lat, max_lat, min_lon, max_lon, lat_lon=True):
+    """
+    Finds the bins of the ISIN grid whose centers are inside a box of latitude and longitude, edges included
+    :param nrows: number of rows of the grid
+    :param lat_lon: if False, the latitude and longitude of each bin are not computed and None is returned for both
+    :return: latitude and longitude of the center of each bin of the area, bin number within the grid of each bin of
+    the area, number of bins in each row of the area and bin number within the area of the first bin of each row
+    """
+    library = load_library()
+    aoi = library.isin_aoi_create(nrows, min_lat, max_lat, min_lon, max_lon)
+    if not aoi:
+        raise MemoryError("could not allocate the area of interest")
+    try:
+        nbins = aoi.contents.nbins
+        naoi_rows = aoi.contents.nrows
+        nbins_in_row = np.ctypeslib.as_array(aoi.contents.n_bins_in_row, shape=(naoi_rows,)).copy()
+        basebins = np.ctypeslib.as_array(aoi.contents.basebins, shape=(naoi_rows,)).copy()
+        aoi_bins = np.empty(nbins, dtype=np.intc)
+        library.isin_aoi_bins(aoi, aoi_bins)
+        lats, lons = None, None
+        if lat_lon:
+            lats = np.empty(nbins, dtype=np.double)
+            lons = np.empty(nbins, dtype=np.double)
+            library.isin_aoi_lat_lon(aoi, lats, lons)
+    finally:
+        library.isin_aoi_destroy(aoi)
+    return lats, lons, aoi_bins, nbins_in_row, basebins
+
+
+def write_grid(path, nbins_in_row, out_data, spans=True):
+    """
+    Writes the output of EdgeDetector.detect to a grid file, which is read back without parsing by read_grid or by
+    the C library
+    :param nbins_in_row: number of bins in each row of the area the output is for
+    :param spans: if True, only the bins with data are stored, which keeps files of cloudy images small
+    """
+    library = load_library()
+    nbins_in_row = np.ascontiguousarray(nbins_in_row, dtype=np.intc)
+    out_data = np.ascontiguousarray(out_data, dtype=np.int8)
+    layout = GRID_FILE_SPANS if spans else GRID_FILE_DENSE
+    if library.grid_file_write_output(os.fsencode(path), len(nbins_in_row), nbins_in_row, layout, out_data) != 0:
+        raise OSError("could not write " + str(path))
+
+
+def read_grid(path, nbins_in_row=None):
+    """
+    Reads a grid file written by write_grid
+    :param nbins_in_row: if given, the file must hold an image of an area with these numbers of bins in each row
+    :return: NumPy array of int8 with an element for each bin. Fronts are 1, other bins with data 0 and bins without
+    data -1
+    """
+    library = load_library()
+    grid_file = library.grid_file_open(os.fsencode(path))
+    if not grid_file:
+        raise OSError("could not open " + str(path) + " as a grid file")
+    try:
+        if nbins_in_row is not None:
+            nbins_in_row = np.ascontiguousarray(nbins_in_row, dtype=np.intc)
+            if not library.grid_file_matches(grid_file, len(nbins_in_row), nbins_in_row):
+                raise ValueError(str(path) + " holds an image of another area")
+        out_data = np.empty(grid_file.contents.header.contents.nbins, dtype=np.int8)
+        if library.grid_file_read_output(grid_file, out_data) != 0:
+            raise ValueError(str(path) + " does not hold the output of an edge detector")
+    finally:
+        library.grid_file_close(grid_file)
+    return out_data
+
+
 class EdgeDetector:
 
-    def __find_aoi_bins(self):
-        row_lats= (np.arange(0,  self.nrows, dtype=np.double) + 0.5) * 180. / self.nrows - 90
-        nbins_in_row = np.floor(2 * self.nrows * np.cos(row_lats * np.pi / 180.) + 0.5).astype(np.int)
-        lons = []
-        lats = np.repeat(row_lats, nbins_in_row)
-
-        for i in range(0, self.nrows):
-            lons.extend((360. * (np.arange(0, nbins_in_row[i], dtype=np.double) + 0.5) / nbins_in_row[i] - 180.).tolist())
-
-        lats_idx = ((lats >= self.min_lat) & (lats <= self.max_lat)).nonzero()
-        lons = np.array(lons)
-        lons_idx = ((lats >= self.min_lon) & (lons <= self.max_lon)).nonzero()
-        aoi_bins = np.intersect1d(lats_idx, lons_idx)
-        _, nbins_in_row = np.unique(lats[aoi_bins], return_counts=True)
-        basebins = np.cumsum(nbins_in_row) - nbins_in_row
-        basebins = (ctypes.c_int * self.num_aoi_rows)(*basebins)
-        nbins_in_row = (ctypes.c_int * self.num_aoi_rows)(*nbins_in_row)
-        aoi_bins = (ctypes.c_int * self.num_aoi_bins)(aoi_bins)
-        return lats[aoi_bins], lons[aoi_bins], basebins, nbins_in_row, aoi_bins
-
-    def __init__(self, nbins, nrows, min_lat, min_lon, max_lat, max_lon):
+    def __init__(self, nbins, nrows, min_lat, min_lon, max_lat, max_lon, levels=256, window_width=32,
+                 collect_stats=False, valid_spans=True):
+        """
+        :param levels: number of levels the data is quantized to. More than 256 levels runs on 16 bit data, which keeps
+        fronts weaker than the range of the data divided by 256
+        :param window_width: width in bins of the windows fronts are searched for in, up to 64
+        :param collect_stats: if True, the timings and counts of every call to sied are left in self.stats
+        :param valid_spans: if True, rows and windows without data are skipped, which makes cloudy images faster to
+        run without changing the fronts found
+        """
+        self.levels = levels
+        self.window_width = window_width
+        self.collect_stats = collect_stats
+        self.valid_spans = valid_spans
+        self.stats = CayulaStats()
         self.nbins = nbins
         self.nrows = nrows
         self.min_lat = min_lat
         self.min_lon = min_lon
         self.max_lat = max_lat
         self.max_lon = max_lon
-        self.num_aoi_bins = nbins
-        self.num_aoi_rows =  nrows
-        self.lats, self.lons, self.basebins, self.nbins_in_row, self.aoi_bins = self.__find_aoi_bins()
-
-    def initialize(self, data, data_bins):
-        min_val = np.min(data)
-        max_val = np.max(data)
-        int_data = np.floor(255 * (data + abs(min_val)) / abs(max_val - min_val)).astype(np.int)
-        index = range(0, len(self.aoi_bins))
-        aoi_bins = np.array(self.aoi_bins[:])
-        sorted_index = np.searchsorted(aoi_bins, data_bins)
+        self.lats, self.lons, self.aoi_bins, self.nbins_in_row, self.basebins = find_aoi_bins(nrows, min_lat, max_lat,
+                                                                                             min_lon, max_lon)
+        self.num_aoi_bins = len(self.aoi_bins)
+        self.num_aoi_rows = len(self.nbins_in_row)
 
-        yindex = np.take(index, sorted_index, mode="clip")
-        mask = aoi_bins[yindex] == data_bins
+        self._library = load_library()
+        options = self._library.cayula_default_options()
+        options.levels = self.levels
+        options.window_width = self.window_width
+        options.valid_spans = int(self.valid_spans)
+        if self.collect_stats:
+            options.stats = ctypes.pointer(self.stats)
+        self._ctx = self._library.cayula_ctx_create(self.num_aoi_bins, self.num_aoi_rows, self.nbins_in_row,
+                                                    self.basebins, ctypes.byref(options))
+        if not self._ctx:
+            raise MemoryError("could not create the edge detection context")
+        if self._library.cayula_ctx_set_bin_numbers(self._ctx, self.aoi_bins) != 0:
+            self.close()
+            raise MemoryError("could not store the bin numbers of the area of interest")
 
-        aoi_idx = yindex[mask]
+    def close(self):
+        """
+        Frees the buffers and threads held for the grid. The detector cannot be used afterwards
+        """
+        if getattr(self, "_ctx", None):
+            self._library.cayula_ctx_destroy(self._ctx)
+            self._ctx = None
 
-        index = range(0, len(data_bins))
-        sorted_index = np.searchsorted(data_bins, aoi_bins)
+    def __del__(self):
+        self.close()
 
-        yindex = np.take(index, sorted_index, mode="clip")
-        mask = data_bins[yindex] == aoi_bins
+    def __enter__(self):
+        return self
 
-        data_idx = yindex[mask]
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.close()
 
-        aoi_data = np.full(self.num_aoi_bins, -999)
-        aoi_data[aoi_idx] = int_data[data_idx]
-        return aoi_data
+    def detect(self, data, data_bins):
+        """
+        Runs the edge detection on the data of one image
+        :param data: data value of each bin containing data. Values are quantized to the levels of the detector between
+        the smallest and largest value, and values that are not finite count as missing
+        :param data_bins: bin number of each value in data, sorted as in the BinList of level 3 binned files. Bins
+        outside the area of interest are ignored
+        :return: NumPy array of int8 with an element for each bin of the area of interest. Fronts are 1, other bins
+        with data 0 and bins without data -1
+        """
+        data = np.ascontiguousarray(data, dtype=np.double)
+        data_bins = np.ascontiguousarray(data_bins, dtype=np.intc)
+        out_data = np.empty(self.num_aoi_bins, dtype=np.int8)
+        self._library.cayula_ctx_run_sparse(self._ctx, data_bins, data, len(data), out_data)
+        return out_data
 
     def sied(self, data, data_bins):
-        _cayula = ctypes.CDLL('./sied.so')
-        aoi_data = self.initialize(data, data_bins)
-        aoi_data_arr = (ctypes.c_int * self.num_aoi_bins)(*aoi_data)
-        _cayula.cayula.argtypes = (ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int),
-                                   ctypes.c_int, ctypes.c_int, ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int))
-        out_data = (ctypes.c_int * self.num_aoi_bins)()
-        _cayula.cayula(aoi_data_arr, out_data, self.num_aoi_bins, self.num_aoi_rows, self.nbins_in_row, self.basebins)
-        df = pd.DataFrame(data={"Data": out_data[:self.num_aoi_bins]})
+        df = pd.DataFrame(data={"Data": self.detect(data, data_bins)})
         df["Latitude"] = self.lats
         df["Longitude"] = self.lons
         return df
@@ -97,7 +326,7 @@ def get_params_modis(dataset, data_str):
 
     return total_bins, nrows, bins, data, date
 
-def map_files(directory, latmin, latmax, lonmin, lonmax):
+def map_files(directory, latmin, latmax, lonmin, lonmax, output_format="csv"):
     """
     Takes a directory of netCDF4 files of binned satellite data and creates shapefiles containing the values from
     the edge detection algorithm for each bin
@@ -106,7 +335,10 @@ def map_files(directory, latmin, latmax, lonmin, lonmax):
     :param latmax: maximum latitude to include in output
     :param lonmin: minimum longitude to include in output
     :param lonmax: maximum longitude to include in output
+    :param output_format: "csv" for a file of the latitude, longitude and output of every bin with data or "grid" for
+    a grid file of the output of every bin, written by write_grid
     """
+    extension = "." + output_format
     cwd = os.getcwd()
     files = []
     outfiles = []
@@ -114,21 +346,21 @@ def map_files(directory, latmin, latmax, lonmin, lonmax):
         os.makedirs(cwd + "/out")
     for root, dirs, file_names in os.walk(cwd + "/out"):
         for file in file_names:
-            if file.endswith(".csv"):
+            if file.endswith(extension):
                 outfiles.append(file)
     outfiles.sort()
     for file in os.listdir(directory):
         if 'ENVISAT' in file:
-            year = file[17:21] + '-' + file[21:23] + '-' + file[23:25] + 'meris_chlor.csv'
+            year = file[17:21] + '-' + file[21:23] + '-' + file[23:25] + 'meris_chlor' + extension
         elif 'V20' in file:
             dataset = Dataset(directory + '/' + file)
             date = dataset.time_coverage_start[:10]
-            year = date + 'viirs_chlor.csv'
+            year = date + 'viirs_chlor' + extension
             dataset.close()
         elif file.endswith(".nc"):
             dataset = Dataset(directory + '/' + file)
             date = dataset.time_coverage_start[:10]
-            year = date + '_sst.csv'
+            year = date + '_sst' + extension
             dataset.close()
         if file.endswith(".nc"):
             if year not in outfiles:
@@ -141,25 +373,31 @@ def map_files(directory, latmin, latmax, lonmin, lonmax):
     for file in files:
         dataset = Dataset(file)
         ntotal_bins, nrows, data_bins, data, date = get_params_modis(dataset, "sst")
-        df = detector.sied(data, data_bins)
-        df = df[df["Data"] > -1]
-
-        print(df.groupby("Data").count())
+        if output_format == "grid":
+            out_data = detector.detect(data, data_bins)
+            print(np.bincount(out_data + 1, minlength=3)[1:])
+        else:
+            df = detector.sied(data, data_bins)
+            df = df[df["Data"] > -1]
+            print(df.groupby("Data").count())
 
         year_month = dataset.time_coverage_start[:4]
         date = dataset.time_coverage_start[:10]
         if "SNPP" in file:
-            outfile = date + "viirs_chlor.csv"
+            outfile = date + "viirs_chlor" + extension
         elif "SEASTAR" in file:
-            outfile = date + "seawifs_chlor.csv"
+            outfile = date + "seawifs_chlor" + extension
         elif "ENVISAT_MERIS" in file:
-            outfile = date + "meris_chlor.csv"
+            outfile = date + "meris_chlor" + extension
         else:
-            outfile = date + '_sst.csv'
+            outfile = date + '_sst' + extension
         dataset.close()
         if not os.path.exists(cwd + "/out/" + year_month):
             os.makedirs(cwd + "/out/" + year_month)
-        df.to_csv(cwd + "/out/" + year_month + "/" + outfile, index=False)
+        if output_format == "grid":
+            write_grid(cwd + "/out/" + year_month + "/" + outfile, detector.nbins_in_row, out_data)
+        else:
+            df.to_csv(cwd + "/out/" + year_month + "/" + outfile, index=False)
         print("Saving " + outfile)
 
 
@@ -0,0 +1,103 @@
+/*
+ * Bump allocation from a reusable list of blocks.
+ */
+#include <stdlib.h>
+#include "arena.h"
+
+#define ARENA_ALIGNMENT 16
+
+struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+    char *memory;
+};
+
+/*
+ * Function:  arena_create
+ * --------------------
+ * Creates an empty arena. No blocks are allocated until the first allocation.
+ *
+ * args:
+ *      size_t block_size: the size of the blocks memory is taken from. Larger allocations get a block of their own
+ *
+ * returns:
+ *      Arena *: the new arena or NULL if memory could not be allocated
+ */
+Arena * arena_create(size_t block_size) {
+    Arena *arena = calloc(1, sizeof(Arena));
+    if (arena == NULL) return NULL;
+    arena->block_size = block_size;
+    return arena;
+}
+
+/*
+ * Function:  arena_alloc
+ * --------------------
+ * Allocates memory from the arena. The memory stays valid until the arena is reset or destroyed.
+ *
+ * args:
+ *      Arena *arena: the arena to allocate from
+ *      size_t size: the number of bytes to allocate
+ *
+ * returns:
+ *      void *: pointer to the memory or NULL if memory could not be allocated
+ */
+void * arena_alloc(Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1);
+    struct arena_block *block = arena->current;
+    while (block != NULL && block->used + size > block->size) {
+        block = block->next;
+        if (block != NULL) block->used = 0;
+    }
+    if (block == NULL) {
+        size_t block_size = size > arena->block_size ? size : arena->block_size;
+        block = malloc(sizeof(struct arena_block) + block_size + ARENA_ALIGNMENT);
+        if (block == NULL) return NULL;
+        arena->allocated += sizeof(struct arena_block) + block_size + ARENA_ALIGNMENT;
+        block->size = block_size;
+        block->used = 0;
+        block->memory = (char *) (((size_t) (block + 1) + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1));
+        /*
+         * New blocks go after the current one so that the blocks that were skipped because they were too small are
+         * used again after the next reset
+         */
+        if (arena->current == NULL) {
+            block->next = arena->first;
+            arena->first = block;
+        } else {
+            block->next = arena->current->next;
+            arena->current->next = block;
+        }
+    }
+    arena->current = block;
+    void *memory = block->memory + block->used;
+    block->used += size;
+    return memory;
+}
+
+/*
+ * Function:  arena_reset
+ * --------------------
+ * Frees everything allocated from the arena at once while keeping its blocks for later allocations.
+ */
+void arena_reset(Arena *arena) {
+    arena->current = arena->first;
+    if (arena->first != NULL) arena->first->used = 0;
+}
+
+/*
+ * Function:  arena_destroy
+ * --------------------
+ * Frees the arena and all of its blocks.
+ */
+void arena_destroy(Arena *arena) {
+    if (arena == NULL) return;
+    struct arena_block *block = arena->first;
+    while (block != NULL) {
+        struct arena_block *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
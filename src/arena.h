@@ -0,0 +1,22 @@
+#include <stddef.h>
+
+#ifndef SIED_ARENA_H
+#define SIED_ARENA_H
+
+/*
+ * A bump allocator for many small objects that are all freed at the same time. Memory is taken from a list of blocks
+ * that is kept when the arena is reset, so an arena reused for every image stops allocating once it has grown to the
+ * size the images need.
+ */
+typedef struct arena {
+    struct arena_block *first;
+    struct arena_block *current;
+    size_t block_size;
+    size_t allocated;   // bytes of all blocks of the arena
+} Arena;
+
+Arena * arena_create(size_t block_size);
+void * arena_alloc(Arena *arena, size_t size);
+void arena_reset(Arena *arena);
+void arena_destroy(Arena *arena);
+#endif //SIED_ARENA_H
@@ -0,0 +1,113 @@
+#include <stdint.h>
+
+#ifndef SIED_BITSET_H
+#define SIED_BITSET_H
+
+/*
+ * One bit per bin flags stored in 64 bit words. Bit i of the set is bit i % 64 of word i / 64.
+ */
+
+static inline int bitset_words(int n) {
+    return (n + 63) >> 6;
+}
+
+static inline int bitset_get(const uint64_t *set, int i) {
+    return (int) ((set[i >> 6] >> (i & 63)) & 1);
+}
+
+static inline void bitset_set(uint64_t *set, int i) {
+    set[i >> 6] |= (uint64_t) 1 << (i & 63);
+}
+
+static inline void bitset_clear(uint64_t *set, int i) {
+    set[i >> 6] &= ~((uint64_t) 1 << (i & 63));
+}
+
+static inline void bitset_flip(uint64_t *set, int i) {
+    set[i >> 6] ^= (uint64_t) 1 << (i & 63);
+}
+
+/*
+ * Sets bit i from a thread while other threads may be setting other bits of the same word.
+ */
+static inline void bitset_set_atomic(uint64_t *set, int i) {
+    __atomic_fetch_or(&set[i >> 6], (uint64_t) 1 << (i & 63), __ATOMIC_RELAXED);
+}
+
+/*
+ * Reads bit i while other threads may be setting other bits of the same word.
+ */
+static inline int bitset_get_atomic(const uint64_t *set, int i) {
+    return (int) ((__atomic_load_n(&set[i >> 6], __ATOMIC_RELAXED) >> (i & 63)) & 1);
+}
+
+/*
+ * Returns the n bits starting at bit first as the low bits of a word, for n from 1 to 64.
+ */
+static inline uint64_t bitset_bits(const uint64_t *set, int first, int n) {
+    int shift = first & 63;
+    uint64_t bits = set[first >> 6] >> shift;
+    if (shift + n > 64) bits |= set[(first >> 6) + 1] << (64 - shift);
+    return n == 64 ? bits : bits & (((uint64_t) 1 << n) - 1);
+}
+
+/*
+ * Returns 1 if the n bits starting at bit first are all set.
+ */
+static inline int bitset_all(const uint64_t *set, int first, int n) {
+    while (n > 0) {
+        int shift = first & 63;
+        int count = n < 64 - shift ? n : 64 - shift;
+        uint64_t mask = count == 64 ? ~(uint64_t) 0 : (((uint64_t) 1 << count) - 1) << shift;
+        if ((set[first >> 6] & mask) != mask) return 0;
+        first += count;
+        n -= count;
+    }
+    return 1;
+}
+
+/*
+ * Sets the n bits starting at bit first.
+ */
+static inline void bitset_set_range(uint64_t *set, int first, int n) {
+    while (n > 0) {
+        int shift = first & 63;
+        int count = n < 64 - shift ? n : 64 - shift;
+        uint64_t mask = count == 64 ? ~(uint64_t) 0 : (((uint64_t) 1 << count) - 1) << shift;
+        set[first >> 6] |= mask;
+        first += count;
+        n -= count;
+    }
+}
+
+/*
+ * Returns the first set bit from bit i to bit end - 1, or end if none of them is set. Words without a set bit are
+ * skipped whole.
+ */
+static inline int bitset_next_set(const uint64_t *set, int i, int end) {
+    while (i < end) {
+        uint64_t word = set[i >> 6] & (~(uint64_t) 0 << (i & 63));
+        if (word) {
+            i = (i & ~63) + __builtin_ctzll(word);
+            return i < end ? i : end;
+        }
+        i = (i & ~63) + 64;
+    }
+    return end;
+}
+
+/*
+ * Returns the first clear bit from bit i to bit end - 1, or end if all of them are set.
+ */
+static inline int bitset_next_clear(const uint64_t *set, int i, int end) {
+    while (i < end) {
+        uint64_t word = ~set[i >> 6] & (~(uint64_t) 0 << (i & 63));
+        if (word) {
+            i = (i & ~63) + __builtin_ctzll(word);
+            return i < end ? i : end;
+        }
+        i = (i & ~63) + 64;
+    }
+    return end;
+}
+#endif //SIED_BITSET_H
@@ -5,6 +5,16 @@ gcc -std=gnu99 -c -g -fPIC -pthread -o helpers.o helpers.c
 gcc -std=gnu99 -c -g -fPIC -pthread -o cohesion.o cohesion.c
 gcc -std=gnu99 -c -g -fPIC -pthread -o contour.o contour.c
 gcc -std=gnu99 -c -g -fPIC -pthread -o histogram.o histogram.c
+gcc -std=gnu99 -c -g -fPIC -pthread -o grid.o grid.c
+gcc -std=gnu99 -c -g -fPIC -pthread -o pool.o pool.c
+gcc -std=gnu99 -c -g -fPIC -pthread -o arena.o arena.c
+gcc -std=gnu99 -c -g -fPIC -pthread -o gradient.o gradient.c
+gcc -std=gnu99 -c -g -fPIC -pthread -o synth.o synth.c
+gcc -std=gnu99 -c -g -fPIC -pthread -o isin.o isin.c
+gcc -std=gnu99 -c -g -fPIC -pthread -o spans.o spans.c
+gcc -std=gnu99 -c -g -fPIC -pthread -o stream.o stream.c
+gcc -std=gnu99 -c -g -fPIC -pthread -o gridfile.o gridfile.c
 
-gcc -shared -fPIC -pthread -g -o ../sied.so filter.o cayula.o helpers.o cohesion.o contour.o histogram.o
+gcc -shared -fPIC -pthread -g -o ../sied.so filter.o cayula.o helpers.o cohesion.o contour.o histogram.o grid.o pool.o arena.o gradient.o synth.o isin.o spans.o stream.o \
+    gridfile.o
 
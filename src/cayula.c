@@ -1,57 +1,1249 @@
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include "histogram.h"
 #include "helpers.h"
 #include "cohesion.h"
 #include "contour.h"
 #include "filter.h"
+#include "grid.h"
+#include "pool.h"
+#include "bitset.h"
+#include "gradient.h"
+#include "spans.h"
 #include "cayula.h"
 
-void cayula(int *data, int *out_data, int n_bins, int nrows, int *n_bins_in_row, int *basebins) {
-    int *filtered_data = malloc(n_bins * sizeof(int));
+/*
+ * Bins kept before and after the filtered data. Windows near the first and last rows of a grid whose rows change
+ * length can reach past either end of the data, and the padding is never valid so those bins count as missing.
+ */
+#define SCAN_PADDING WINDOW_MAX_WIDTH
 
-    median_filter(data, filtered_data, n_bins, nrows, n_bins_in_row, basebins);
-    int *edge_pixels = malloc(n_bins * sizeof(int));
+#define STAGE_FILTER 0
+#define STAGE_SCAN 1
+#define STAGE_CONTOUR 2
 
-    for (int i = 0; i < n_bins; i++) {
-        if (data[i] == FILL_VALUE) {
-            out_data[i] = -1;
-        } else {
-            out_data[i] = 0;
+/*
+ * A window of a sweep that has a threshold dividing it into large enough groups, with the statistics the critical
+ * values are compared to and its edge pixels, which do not depend on the critical values.
+ */
+typedef struct sweep_window {
+    double theta;           // ratio of the between group variance to the total variance
+    double cohesion[3];     // fractions of same side neighbors below the threshold, above it and overall
+    int first_edge;         // index of the first edge pixel of the window in the edges of its SweepList
+    int nedges;
+} SweepWindow;
+
+/*
+ * The windows of a sweep found by one thread of the scan.
+ */
+typedef struct sweep_list {
+    SweepWindow *windows;
+    int nwindows;
+    int window_capacity;
+    int *edges;
+    int nedges;
+    int edge_capacity;
+    int failed;             // 1 if a window could not be stored
+} SweepList;
+
+/*
+ * Wall clock and CPU time at the start of a step of the algorithm.
+ */
+typedef struct stage_clock {
+    struct timespec wall;
+    struct timespec cpu;
+} StageClock;
+
+/*
+ * Buffers and geometry for running the algorithm on images of a single binning scheme. Everything proportional to the
+ * size of the image is allocated once when the context is created. Data is kept as 8 bit values, or 16 bit values when
+ * the context has more than 256 levels, with one bit per bin flagging the bins that contain data, and the per-bin
+ * flags of the later steps are bitsets as well.
+ */
+struct cayula_ctx {
+    IsinGrid *grid;
+    CayulaOptions options;
+    ThreadPool *pool;
+    uint8_t *data;
+    uint64_t *valid;
+    uint8_t *filtered_data;
+    uint16_t *data16;
+    uint16_t *filtered_data16;
+    uint64_t *filtered_valid;
+    WindowHistogram16 **histograms16;
+    int n_histograms16;
+    int *median_counts;     // histogram of the median filter for 16 bit data and kernels larger than 3x3
+    SweepList *sweep_lists;
+    int n_sweep_lists;
+    int sweeping;
+    uint64_t *edge_pixels;
+    uint64_t *in_contour;
+    uint64_t *fronts;
+    int *thresholds;
+    int *window_offsets;
+    ValidSpans *spans;      // spans of the bins containing data of the image being run when options.valid_spans is set
+    int spans_ready;        // 1 if spans holds the spans of the image being run
+    int *bin_numbers;       // bin number in the full grid of every bin, set by cayula_ctx_set_bin_numbers
+    GradientField *gradients;
+    ContourBands *bands;
+    Arena *arena;           // points of the contours traced by cayula_ctx_run_rows, created by its first call
+    ContourMap map;
+    WindowScreen screen;
+    CayulaScreenCounts counts;
+    int n_window_rows;
+    int next_window_row;
+    int next_band;
+};
+
+static inline int min(int a, int b) {
+    return a < b ? a : b;
+}
+
+static inline int max(int a, int b) {
+    return a > b ? a : b;
+}
+
+/*
+ * Function:  padded_calloc
+ * --------------------
+ * Allocates a zeroed array of n elements with pad more on each side.
+ *
+ * returns:
+ *      void *: pointer to the first of the n elements or NULL if the allocation failed. Must be freed with padded_free
+ */
+static void * padded_calloc(size_t n, size_t size, size_t pad) {
+    char *base = calloc(n + 2 * pad, size);
+    return base != NULL ? base + pad * size : NULL;
+}
+
+/*
+ * Function:  padded_free
+ * --------------------
+ * Frees an array allocated with padded_calloc with the same element size and padding.
+ */
+static void padded_free(void *p, size_t size, size_t pad) {
+    if (p != NULL) free((char *) p - pad * size);
+}
+
+/*
+ * Function:  cayula_default_options
+ * --------------------
+ * Returns the options used by cayula(): 8 bit data, a 3x3 median filter and non-overlapping windows scanned with one
+ * thread per online processor. Windows are only skipped before the histogram analysis when they cannot have a
+ * threshold.
+ */
+CayulaOptions cayula_default_options(void) {
+    CayulaOptions options;
+    options.nthreads = 0;
+    options.window_width = WINDOW_WIDTH;
+    options.stride = 0;
+    options.filter_size = 3;
+    options.gradient_field = 0;
+    options.contour_band_rows = 0;
+    options.min_valid_fraction = 0;
+    options.min_variance = 0;
+    options.min_range = 0;
+    options.levels = 256;
+    options.valid_spans = 0;
+    options.stats = NULL;
+    return options;
+}
+
+/*
+ * Function:  stage_start
+ * --------------------
+ * Starts timing a step of the algorithm if the context collects stats.
+ */
+static void stage_start(const CayulaCtx *ctx, StageClock *clock) {
+    if (ctx->options.stats == NULL) return;
+    clock_gettime(CLOCK_MONOTONIC, &clock->wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &clock->cpu);
+}
+
+/*
+ * Function:  seconds_since
+ * --------------------
+ * Returns the seconds elapsed on a clock since the given time.
+ */
+static double seconds_since(clockid_t id, const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(id, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+/*
+ * Function:  stage_stop
+ * --------------------
+ * Adds the time since stage_start to the wall clock and CPU time of a step if the context collects stats.
+ *
+ * args:
+ *      CayulaCtx *ctx: the context being run
+ *      StageClock *clock: pointer to the clock started by stage_start
+ *      int stage: STAGE_FILTER, STAGE_SCAN or STAGE_CONTOUR
+ */
+static void stage_stop(const CayulaCtx *ctx, const StageClock *clock, int stage) {
+    CayulaStats *stats = ctx->options.stats;
+    if (stats == NULL) return;
+    double wall = seconds_since(CLOCK_MONOTONIC, &clock->wall);
+    double cpu = seconds_since(CLOCK_PROCESS_CPUTIME_ID, &clock->cpu);
+    switch (stage) {
+        case STAGE_FILTER:
+            stats->filter_wall += wall;
+            stats->filter_cpu += cpu;
+            break;
+        case STAGE_SCAN:
+            stats->scan_wall += wall;
+            stats->scan_cpu += cpu;
+            break;
+        default:
+            stats->contour_wall += wall;
+            stats->contour_cpu += cpu;
+            break;
+    }
+}
+
+/*
+ * Function:  ctx_bytes
+ * --------------------
+ * Returns the number of bytes held by the context and everything it owns.
+ */
+static size_t ctx_bytes(const CayulaCtx *ctx) {
+    size_t nbins = ctx->grid->nbins;
+    size_t nrows = ctx->grid->nrows;
+    size_t bitset = bitset_words(ctx->grid->nbins) * sizeof(uint64_t);
+    size_t padding = 2 * SCAN_PADDING;
+    size_t bytes = sizeof(CayulaCtx) + sizeof(IsinGrid) + nrows * 2 * sizeof(int) + nbins * 2 * sizeof(int8_t);
+    bytes += sizeof(ThreadPool) + ctx->pool->nthreads * sizeof(pthread_t);
+    bytes += 5 * bitset + 2 * bitset_words(SCAN_PADDING) * sizeof(uint64_t);
+    bytes += (ctx->window_offsets[ctx->n_window_rows] + ctx->n_window_rows + 1) * sizeof(int);
+    if (ctx->data16 != NULL) {
+        bytes += (2 * nbins + padding) * sizeof(uint16_t);
+    } else {
+        bytes += 2 * nbins + padding;
+    }
+    for (int t = 0; t < ctx->n_histograms16; t++) {
+        const WindowHistogram16 *h = ctx->histograms16[t];
+        bytes += sizeof(WindowHistogram16) + h->levels * sizeof(uint16_t) + bitset_words(h->levels) * sizeof(uint64_t);
+    }
+    if (ctx->median_counts != NULL) {
+        bytes += MEDIAN_FILTER_COUNTS(ctx->options.levels) * sizeof(int);
+    }
+    for (int t = 0; t < ctx->n_sweep_lists; t++) {
+        bytes += sizeof(SweepList) + ctx->sweep_lists[t].window_capacity * sizeof(SweepWindow) +
+                 ctx->sweep_lists[t].edge_capacity * sizeof(int);
+    }
+    if (ctx->bin_numbers != NULL) {
+        bytes += nbins * sizeof(int);
+    }
+    if (ctx->gradients != NULL) {
+        bytes += sizeof(GradientField) + 2 * nbins * sizeof(int32_t);
+    }
+    if (ctx->arena != NULL) {
+        bytes += sizeof(Arena) + ctx->arena->allocated;
+    }
+    return bytes + contour_bands_bytes(ctx->bands) + valid_spans_bytes(ctx->spans);
+}
+
+/*
+ * Function:  cayula_default_sweep_point
+ * --------------------
+ * Returns the critical values used by cayula(). A sweep point with these values gives the same fronts as a run.
+ */
+CayulaSweepPoint cayula_default_sweep_point(void) {
+    CayulaSweepPoint point;
+    point.crit_value = CRIT_VALUE;
+    point.crit_c1 = CRIT_C1;
+    point.crit_c2 = CRIT_C2;
+    point.crit_c = CRIT_C;
+    return point;
+}
+
+/*
+ * Function:  sweep_record
+ * --------------------
+ * Stores a window of a sweep in the list of the thread that scanned it.
+ *
+ * args:
+ *      SweepList *list: pointer to the list of the thread
+ *      double theta: the ratio of the between group variance to the total variance of the window
+ *      WindowMask *mask: pointer to the window divided by its threshold
+ *      uint64_t *edges: pointer to the edge pixels of the window as found by find_edge_mask
+ *      int *starts: pointer to an array containing the first bin of each window row
+ */
+static void sweep_record(SweepList *list, double theta, const WindowMask *mask, const uint64_t *edges,
+                         const int *starts) {
+    int nedges = 0;
+    for (int k = 0; k < mask->width; k++) {
+        nedges += __builtin_popcountll(edges[k]);
+    }
+    if (list->nwindows == list->window_capacity) {
+        int capacity = max(2 * list->window_capacity, 64);
+        SweepWindow *windows = realloc(list->windows, capacity * sizeof(SweepWindow));
+        if (windows == NULL) {
+            list->failed = 1;
+            return;
+        }
+        list->windows = windows;
+        list->window_capacity = capacity;
+    }
+    if (list->nedges + nedges > list->edge_capacity) {
+        int capacity = max(2 * list->edge_capacity, list->nedges + nedges);
+        int *bins = realloc(list->edges, capacity * sizeof(int));
+        if (bins == NULL) {
+            list->failed = 1;
+            return;
+        }
+        list->edges = bins;
+        list->edge_capacity = capacity;
+    }
+
+    SweepWindow *window = &list->windows[list->nwindows++];
+    window->theta = theta;
+    cohesion_ratios(mask, window->cohesion);
+    window->first_edge = list->nedges;
+    window->nedges = nedges;
+    for (int k = 0; k < mask->width; k++) {
+        uint64_t row = edges[k];
+        while (row) {
+            list->edges[list->nedges++] = starts[k] + __builtin_ctzll(row);
+            row &= row - 1;
         }
-        edge_pixels[i] = 0;
     }
+}
+
+/*
+ * Function:  add_screen_counts
+ * --------------------
+ * Adds the screen counts of a window row to the counts of the run from any thread.
+ */
+static void add_screen_counts(CayulaCtx *ctx, const CayulaScreenCounts *counts) {
+    __atomic_fetch_add(&ctx->counts.windows, counts->windows, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ctx->counts.rejected_valid, counts->rejected_valid, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ctx->counts.rejected_variance, counts->rejected_variance, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ctx->counts.rejected_range, counts->rejected_range, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ctx->counts.rejected_histogram, counts->rejected_histogram, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ctx->counts.rejected_cohesion, counts->rejected_cohesion, __ATOMIC_RELAXED);
+}
+
+/*
+ * Function:  window_empty
+ * --------------------
+ * Returns 1 if no bin of the window centered on a bin has a filtered value, reading a word of the filtered bitset for
+ * each row of the window instead of counting its bins.
+ */
+static int window_empty(const CayulaCtx *ctx, int bin, int row) {
+    int width = ctx->options.window_width;
+    int starts[WINDOW_MAX_WIDTH];
+    get_window_starts(bin, row, width, ctx->grid->n_bins_in_row, ctx->grid->basebins, starts);
+    for (int r = 0; r < width; r++) {
+        if (bitset_bits(ctx->filtered_valid, starts[r], width) != 0) return 0;
+    }
+    return 1;
+}
+
+/*
+ * Function:  scan_window_row
+ * --------------------
+ * Runs the screening, histogram, cohesion and edge location steps on every window centered on the given row and marks
+ * the edge pixels that are found. The histogram is carried from one window to the next, so overlapping windows only count
+ * the bins they do not share with the previous window. Overlapping windows on different window rows can mark the same
+ * edge pixel from different threads, which is why the marks are stored atomically. 16 bit data is counted in the
+ * two level histogram of the thread. With the spans of the image, window rows whose rows have no data and windows
+ * without a filtered value are counted as rejected without building their histogram.
+ *
+ * args:
+ *      CayulaCtx *ctx: the context being run
+ *      int i: the row the windows are centered on
+ *      int thread: the index of the thread in the pool
+ */
+static void scan_window_row(CayulaCtx *ctx, int i, int thread) {
+    const int *n_bins_in_row = ctx->grid->n_bins_in_row;
+    const int *basebins = ctx->grid->basebins;
+    int width = ctx->options.window_width;
+    int half_step = width / 2;
+    WindowHistogram h;
+    WindowHistogram16 *h16 = ctx->histograms16 != NULL ? ctx->histograms16[thread] : NULL;
+    const int *starts = h16 != NULL ? h16->starts : h.starts;
+    WindowMask mask;
+    uint64_t edges[WINDOW_MAX_WIDTH];
+
+    int k = (i - (half_step - 1)) / ctx->options.stride;
+    int *thresholds = ctx->thresholds + ctx->window_offsets[k];
+    for (int w = 0; w < ctx->window_offsets[k + 1] - ctx->window_offsets[k]; w++) thresholds[w] = -1;
 
-    int half_step = WINDOW_WIDTH / 2;
-    int *edge_window = malloc(WINDOW_AREA * sizeof(int));
-    int *window = malloc(WINDOW_AREA * sizeof(int));
-    int *bin_window = malloc(WINDOW_AREA * sizeof(int));
-    for (int i = half_step - 1; i < nrows - half_step; i += WINDOW_WIDTH) {
-        for (int j = half_step - 1; j < n_bins_in_row[i] - half_step; j += WINDOW_WIDTH) {
-            if (n_bins_in_row[i - WINDOW_WIDTH + 1] < WINDOW_WIDTH || n_bins_in_row[i + WINDOW_WIDTH] < WINDOW_WIDTH) {
+    if (n_bins_in_row[max(i - width + 1, 0)] < width || n_bins_in_row[min(i + width, ctx->grid->nrows - 1)] < width) {
+        return;
+    }
+    CayulaScreenCounts counts = {0};
+    int offset = width % 2 == 0 ? half_step - 1 : half_step;
+    if (ctx->spans_ready && valid_spans_rows_empty(ctx->spans, i - offset, i - offset + width - 1)) {
+        /*
+         * No window of the row has data, which the screen would reject every window for
+         */
+        counts.windows = ctx->window_offsets[k + 1] - ctx->window_offsets[k];
+        counts.rejected_valid = counts.windows;
+        add_screen_counts(ctx, &counts);
+        return;
+    }
+    int fresh = 1;
+    for (int j = half_step - 1, w = 0; j < n_bins_in_row[i] - half_step; j += ctx->options.stride, w++) {
+        int screen;
+        if (ctx->spans_ready && window_empty(ctx, basebins[i] + j, i)) {
+            counts.windows++;
+            counts.rejected_valid++;
+            fresh = 1;
+            continue;
+        }
+        if (h16 != NULL) {
+            if (fresh) {
+                window_histogram16_init(h16, basebins[i] + j, i, width, ctx->filtered_data16,
+                                        ctx->filtered_valid, n_bins_in_row, basebins);
+            } else {
+                window_histogram16_move(h16, basebins[i] + j, i, ctx->filtered_data16, ctx->filtered_valid,
+                                        n_bins_in_row, basebins);
+            }
+            screen = window_histogram16_screen(h16, &ctx->screen);
+        } else {
+            if (fresh) {
+                window_histogram_init(&h, basebins[i] + j, i, width, ctx->filtered_data, ctx->filtered_valid,
+                                      n_bins_in_row, basebins);
+            } else {
+                window_histogram_move(&h, basebins[i] + j, i, ctx->filtered_data, ctx->filtered_valid, n_bins_in_row,
+                                      basebins);
+            }
+            screen = window_histogram_screen(&h, &ctx->screen);
+        }
+        fresh = 0;
+        counts.windows++;
+        switch (screen) {
+            case SCREEN_REJECT_VALID:
+                counts.rejected_valid++;
                 continue;
+            case SCREEN_REJECT_VARIANCE:
+                counts.rejected_variance++;
+                continue;
+            case SCREEN_REJECT_RANGE:
+                counts.rejected_range++;
+                continue;
+            default:
+                break;
+        }
+        int threshold;
+        double theta = 0;
+        if (ctx->sweeping) {
+            threshold = h16 != NULL ? window_histogram16_theta(h16, &theta) : window_histogram_theta(&h, &theta);
+        } else {
+            threshold = h16 != NULL ? window_histogram16_threshold(h16) : window_histogram_threshold(&h);
+        }
+        if (threshold <= 0) {
+            counts.rejected_histogram++;
+            continue;
+        }
+        thresholds[w] = threshold;
+        if (h16 != NULL) {
+            window_mask_u16(&mask, width, starts, ctx->filtered_data16, ctx->filtered_valid, threshold);
+        } else {
+            window_mask_u8(&mask, width, starts, ctx->filtered_data, ctx->filtered_valid, threshold);
+        }
+        if (ctx->sweeping) {
+            find_edge_mask(&mask, edges);
+            sweep_record(&ctx->sweep_lists[thread], theta, &mask, edges, starts);
+            continue;
+        }
+        if (!cohesive_mask(&mask)) {
+            counts.rejected_cohesion++;
+            continue;
+        }
+        find_edge_mask(&mask, edges);
+        for (int k = 0; k < width; k++) {
+            uint64_t row = edges[k];
+            while (row) {
+                bitset_set_atomic(ctx->edge_pixels, starts[k] + __builtin_ctzll(row));
+                row &= row - 1;
             }
-            get_window(basebins[i] + j, i, WINDOW_WIDTH, filtered_data, n_bins_in_row, basebins, window);
-            int threshold = histogram_analysis(window);
-            if (threshold > 0) {
-                get_bin_window(basebins[i] + j, i, WINDOW_WIDTH, n_bins_in_row, basebins, bin_window);
-                if (cohesive(window, threshold)) {
-                    find_edge(window, edge_window, threshold);
-                    for (int k = 0; k < WINDOW_WIDTH; k++) {
-                        for (int m = 0; m < WINDOW_WIDTH; m++) {
-                            if (edge_window[k * WINDOW_WIDTH + m]) {
-                                edge_pixels[bin_window[k * WINDOW_WIDTH + m]] = edge_window[k * WINDOW_WIDTH + m];
-                            }
-                        }
-                    }
+        }
+    }
+    add_screen_counts(ctx, &counts);
+}
+
+/*
+ * Function:  scan_task
+ * --------------------
+ * Thread pool task for the window scan. Window rows are handed out one at a time so that threads stay busy when some
+ * rows are mostly cloud and finish early.
+ *
+ * args:
+ *      void *arg: pointer to the CayulaCtx being run
+ *      int thread: the index of the thread in the pool
+ */
+static void scan_task(void *arg, int thread) {
+    CayulaCtx *ctx = arg;
+    int half_step = ctx->options.window_width / 2;
+
+    int k;
+    while ((k = __atomic_fetch_add(&ctx->next_window_row, 1, __ATOMIC_RELAXED)) < ctx->n_window_rows) {
+        scan_window_row(ctx, half_step - 1 + k * ctx->options.stride, thread);
+    }
+}
+
+/*
+ * Function:  contour_task
+ * --------------------
+ * Thread pool task for following contours. Bands are handed out one at a time like the window rows of the scan.
+ *
+ * args:
+ *      void *arg: pointer to the CayulaCtx being run
+ *      int thread: the index of the thread in the pool
+ */
+static void contour_task(void *arg, int thread) {
+    CayulaCtx *ctx = arg;
+    (void) thread;
+
+    int b;
+    while ((b = __atomic_fetch_add(&ctx->next_band, 1, __ATOMIC_RELAXED)) < contour_bands_count(ctx->bands)) {
+        contour_bands_trace(ctx->bands, b, &ctx->map, ctx->fronts);
+    }
+}
+
+/*
+ * Function:  cayula_ctx_create
+ * --------------------
+ * Creates a context for running the algorithm on any number of images of the same binning scheme. The context holds
+ * the precomputed neighbors of the binning scheme, the threads for the window scan and every buffer the algorithm
+ * needs, so running it does not allocate memory proportional to the size of the image.
+ *
+ * args:
+ *      int n_bins: the number of bins in the binning scheme
+ *      int nrows: the number of rows in the binning scheme
+ *      int *n_bins_in_row: pointer to an array containing the number of bins in each row
+ *      int *basebins: pointer to an array containing the bin number of the first bin in each row
+ *      CayulaOptions *options: options controlling how the algorithm is run. NULL uses cayula_default_options()
+ *
+ * returns:
+ *      CayulaCtx *: the new context or NULL if it could not be created
+ */
+CayulaCtx * cayula_ctx_create(int n_bins, int nrows, const int *n_bins_in_row, const int *basebins,
+                              const CayulaOptions *options) {
+    CayulaCtx *ctx = calloc(1, sizeof(CayulaCtx));
+    if (ctx == NULL) return NULL;
+    ctx->options = options != NULL ? *options : cayula_default_options();
+    if (ctx->options.window_width <= 0) {
+        ctx->options.window_width = WINDOW_WIDTH;
+    }
+    /*
+     * Windows are centered between bins, which the scan and get_window_starts only place for even widths
+     */
+    ctx->options.window_width = (max(min(ctx->options.window_width, WINDOW_MAX_WIDTH), 2) + 1) & ~1;
+    if (ctx->options.stride <= 0) {
+        ctx->options.stride = ctx->options.window_width;
+    }
+    if (ctx->options.filter_size <= 0) {
+        ctx->options.filter_size = 3;
+    }
+    ctx->options.filter_size |= 1;
+    if (ctx->options.levels <= 0) {
+        ctx->options.levels = 256;
+    }
+    ctx->options.levels = min(ctx->options.levels, HISTOGRAM_MAX_LEVELS);
+    ctx->screen.min_valid_fraction = ctx->options.min_valid_fraction;
+    ctx->screen.min_variance = ctx->options.min_variance;
+    ctx->screen.min_range = ctx->options.min_range;
+    int half_step = ctx->options.window_width / 2;
+    ctx->n_window_rows = max((nrows - half_step - (half_step - 1) + ctx->options.stride - 1) / ctx->options.stride, 0);
+
+    ctx->grid = grid_create(n_bins, nrows, n_bins_in_row, basebins);
+    ctx->pool = pool_create(ctx->options.nthreads);
+    if (ctx->grid != NULL) {
+        ctx->bands = contour_bands_create(ctx->grid, ctx->options.contour_band_rows);
+    }
+    int nwords = bitset_words(n_bins);
+    int wide = ctx->options.levels > 256;
+    ctx->valid = malloc(nwords * sizeof(uint64_t));
+    ctx->filtered_valid = padded_calloc(nwords, sizeof(uint64_t), bitset_words(SCAN_PADDING));
+    if (wide) {
+        ctx->data16 = malloc(n_bins * sizeof(uint16_t));
+        ctx->filtered_data16 = padded_calloc(n_bins, sizeof(uint16_t), SCAN_PADDING);
+        if (ctx->pool != NULL) {
+            ctx->histograms16 = calloc(ctx->pool->nthreads, sizeof(WindowHistogram16 *));
+            ctx->n_histograms16 = ctx->histograms16 != NULL ? ctx->pool->nthreads : 0;
+        }
+        for (int t = 0; t < ctx->n_histograms16; t++) {
+            ctx->histograms16[t] = window_histogram16_create(ctx->options.levels);
+            if (ctx->histograms16[t] == NULL) {
+                cayula_ctx_destroy(ctx);
+                return NULL;
+            }
+        }
+        if (ctx->options.filter_size > 3) {
+            ctx->median_counts = malloc(MEDIAN_FILTER_COUNTS(ctx->options.levels) * sizeof(int));
+            if (ctx->median_counts == NULL) {
+                cayula_ctx_destroy(ctx);
+                return NULL;
+            }
+        }
+    } else {
+        ctx->data = malloc(n_bins);
+        ctx->filtered_data = padded_calloc(n_bins, 1, SCAN_PADDING);
+    }
+    ctx->edge_pixels = malloc(nwords * sizeof(uint64_t));
+    ctx->in_contour = malloc(nwords * sizeof(uint64_t));
+    ctx->fronts = malloc(nwords * sizeof(uint64_t));
+    ctx->window_offsets = malloc((ctx->n_window_rows + 1) * sizeof(int));
+    if (ctx->window_offsets != NULL) {
+        ctx->window_offsets[0] = 0;
+        for (int k = 0; k < ctx->n_window_rows; k++) {
+            int last = n_bins_in_row[half_step - 1 + k * ctx->options.stride] - half_step - 1;
+            int nwindows = last >= half_step - 1 ? (last - (half_step - 1)) / ctx->options.stride + 1 : 0;
+            ctx->window_offsets[k + 1] = ctx->window_offsets[k] + nwindows;
+        }
+        ctx->thresholds = malloc(max(ctx->window_offsets[ctx->n_window_rows], 1) * sizeof(int));
+    }
+    if (ctx->options.valid_spans) {
+        ctx->spans = valid_spans_create(nrows);
+        if (ctx->spans == NULL) {
+            cayula_ctx_destroy(ctx);
+            return NULL;
+        }
+    }
+    if (ctx->options.gradient_field) {
+        ctx->gradients = gradient_field_create(n_bins);
+        if (ctx->gradients == NULL) {
+            cayula_ctx_destroy(ctx);
+            return NULL;
+        }
+    }
+    if (ctx->grid == NULL || ctx->pool == NULL || ctx->bands == NULL || ctx->valid == NULL ||
+        ctx->filtered_valid == NULL || ctx->edge_pixels == NULL || ctx->in_contour == NULL || ctx->fronts == NULL ||
+        ctx->window_offsets == NULL || ctx->thresholds == NULL ||
+        (wide ? ctx->data16 == NULL || ctx->filtered_data16 == NULL || ctx->histograms16 == NULL :
+                ctx->data == NULL || ctx->filtered_data == NULL)) {
+        cayula_ctx_destroy(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+/*
+ * Function:  find_edges
+ * --------------------
+ * Runs the median filter and window scan steps and leaves the edge pixels in ctx->edge_pixels, or the windows in
+ * ctx->sweep_lists during a sweep. The data is 16 bit in a context with more than 256 levels and 8 bit otherwise.
+ *
+ * args:
+ *      CayulaCtx *ctx: the context to run
+ *      uint8_t *data, uint16_t *data16: pointer to the array containing the data for every bin. Only the one matching
+ *      the context is read
+ *      uint64_t *valid: pointer to the bitset of bins containing data
+ */
+static void find_edges(CayulaCtx *ctx, const uint8_t *data, const uint16_t *data16, const uint64_t *valid) {
+    CayulaStats *stats = ctx->options.stats;
+    StageClock clock;
+    if (stats != NULL) memset(stats, 0, sizeof(CayulaStats));
+
+    stage_start(ctx, &clock);
+    /*
+     * Without memory for the spans the image is run like any other
+     */
+    ctx->spans_ready = ctx->spans != NULL && valid_spans_build(ctx->spans, ctx->grid, valid) == 0;
+    int filter_spans = ctx->spans_ready && ctx->options.filter_size == 3;
+    if (ctx->histograms16 != NULL) {
+        if (filter_spans) {
+            median_filter_spans_u16(ctx->grid, ctx->spans, data16, valid, ctx->filtered_data16, ctx->filtered_valid);
+        } else {
+            median_filter_size_u16(ctx->grid, ctx->options.filter_size, ctx->options.levels, data16, valid,
+                                   ctx->filtered_data16, ctx->filtered_valid, ctx->median_counts);
+        }
+    } else if (filter_spans) {
+        median_filter_spans_u8(ctx->grid, ctx->spans, data, valid, ctx->filtered_data, ctx->filtered_valid);
+    } else {
+        median_filter_size_u8(ctx->grid, ctx->options.filter_size, data, valid, ctx->filtered_data,
+                              ctx->filtered_valid);
+    }
+    stage_stop(ctx, &clock, STAGE_FILTER);
+
+    stage_start(ctx, &clock);
+    memset(ctx->edge_pixels, 0, bitset_words(ctx->grid->nbins) * sizeof(uint64_t));
+    memset(&ctx->counts, 0, sizeof(CayulaScreenCounts));
+    ctx->next_window_row = 0;
+    pool_run(ctx->pool, scan_task, ctx);
+    stage_stop(ctx, &clock, STAGE_SCAN);
+    if (stats != NULL) {
+        stats->windows = ctx->counts.windows;
+        stats->rejected_histogram = ctx->counts.rejected_histogram;
+        stats->rejected_cohesion = ctx->counts.rejected_cohesion;
+    }
+
+    stage_start(ctx, &clock);
+    if (ctx->gradients != NULL) {
+        if (ctx->histograms16 != NULL) {
+            gradient_field_compute_u16(ctx->gradients, ctx->grid, ctx->filtered_data16, ctx->filtered_valid);
+        } else {
+            gradient_field_compute(ctx->gradients, ctx->grid, ctx->filtered_data, ctx->filtered_valid);
+        }
+    }
+    stage_stop(ctx, &clock, STAGE_CONTOUR);
+}
+
+/*
+ * Function:  follow_contours
+ * --------------------
+ * Runs the contour step on the edge pixels in ctx->edge_pixels and leaves the fronts in ctx->fronts.
+ */
+static void follow_contours(CayulaCtx *ctx) {
+    CayulaStats *stats = ctx->options.stats;
+    StageClock clock;
+    stage_start(ctx, &clock);
+    memset(ctx->fronts, 0, bitset_words(ctx->grid->nbins) * sizeof(uint64_t));
+    ctx->map = (ContourMap) {.grid = ctx->grid, .edges = ctx->edge_pixels, .filtered_data = ctx->filtered_data,
+                             .filtered_valid = ctx->filtered_valid, .in_contour = ctx->in_contour,
+                             .gradients = ctx->gradients, .row_begin = 0, .row_end = ctx->grid->nrows,
+                             .filtered_data16 = ctx->filtered_data16};
+    contour_bands_begin(ctx->bands, &ctx->map);
+    ctx->next_band = 0;
+    pool_run(ctx->pool, contour_task, ctx);
+    contour_bands_merge(ctx->bands, &ctx->map, ctx->fronts);
+    stage_stop(ctx, &clock, STAGE_CONTOUR);
+
+    if (stats != NULL) {
+        ContourStats contours;
+        contour_bands_stats(ctx->bands, &contours);
+        for (int i = 0; i < bitset_words(ctx->grid->nbins); i++) {
+            stats->edge_pixels += __builtin_popcountll(ctx->edge_pixels[i]);
+        }
+        stats->contours_started += contours.started;
+        stats->contour_points += contours.points;
+        stats->contours_kept += contours.kept;
+        stats->bytes_allocated = (long) ctx_bytes(ctx);
+    }
+}
+
+/*
+ * Function:  find_fronts
+ * --------------------
+ * Runs every step of the algorithm and leaves the fronts in ctx->fronts, with the same arguments as find_edges.
+ */
+static void find_fronts(CayulaCtx *ctx, const uint8_t *data, const uint16_t *data16, const uint64_t *valid) {
+    find_edges(ctx, data, data16, valid);
+    follow_contours(ctx);
+}
+
+/*
+ * Function:  sweep_windows
+ * --------------------
+ * Runs the median filter and window scan steps of a sweep, storing every window with a threshold in ctx->sweep_lists
+ * whatever its theta and cohesion. Takes the same arguments as find_edges.
+ *
+ * returns:
+ *      int: 0 on success or -1 if the windows could not be stored
+ */
+static int sweep_windows(CayulaCtx *ctx, const uint8_t *data, const uint16_t *data16, const uint64_t *valid) {
+    if (ctx->sweep_lists == NULL) {
+        ctx->sweep_lists = calloc(ctx->pool->nthreads, sizeof(SweepList));
+        if (ctx->sweep_lists == NULL) return -1;
+        ctx->n_sweep_lists = ctx->pool->nthreads;
+    }
+    for (int t = 0; t < ctx->n_sweep_lists; t++) {
+        ctx->sweep_lists[t].nwindows = 0;
+        ctx->sweep_lists[t].nedges = 0;
+        ctx->sweep_lists[t].failed = 0;
+    }
+    ctx->sweeping = 1;
+    find_edges(ctx, data, data16, valid);
+    ctx->sweeping = 0;
+    for (int t = 0; t < ctx->n_sweep_lists; t++) {
+        if (ctx->sweep_lists[t].failed) return -1;
+    }
+    return 0;
+}
+
+/*
+ * Function:  sweep_fronts
+ * --------------------
+ * Marks the edge pixels of the windows of the last sweep that pass the critical values of a sweep point and runs the
+ * contour step on them, leaving the fronts in ctx->fronts.
+ */
+static void sweep_fronts(CayulaCtx *ctx, const CayulaSweepPoint *point) {
+    memset(ctx->edge_pixels, 0, bitset_words(ctx->grid->nbins) * sizeof(uint64_t));
+    for (int t = 0; t < ctx->n_sweep_lists; t++) {
+        const SweepList *list = &ctx->sweep_lists[t];
+        for (int w = 0; w < list->nwindows; w++) {
+            const SweepWindow *window = &list->windows[w];
+            if (window->theta >= point->crit_value && window->cohesion[0] >= point->crit_c1 &&
+                window->cohesion[1] >= point->crit_c2 && window->cohesion[2] >= point->crit_c) {
+                for (int k = window->first_edge; k < window->first_edge + window->nedges; k++) {
+                    bitset_set(ctx->edge_pixels, list->edges[k]);
                 }
             }
         }
     }
-    free(edge_window);
-    free(window);
-    free(bin_window);
-    contour(edge_pixels, filtered_data, out_data, n_bins, nrows, n_bins_in_row, basebins);
-    free(filtered_data);
-    free(edge_pixels);
+    follow_contours(ctx);
+}
+
+/*
+ * Function:  write_output
+ * --------------------
+ * Writes the fronts of the last run to an output array of int8_t.
+ */
+static void write_output(const CayulaCtx *ctx, const uint64_t *valid, int8_t *out_data) {
+    for (int i = 0; i < ctx->grid->nbins; i++) {
+        if (!bitset_get(valid, i)) {
+            out_data[i] = -1;
+        } else {
+            out_data[i] = (int8_t) bitset_get(ctx->fronts, i);
+        }
+    }
+}
+
+/*
+ * Function:  write_output_int
+ * --------------------
+ * Writes the fronts of the last run to an output array of int.
+ */
+static void write_output_int(const CayulaCtx *ctx, const uint64_t *valid, int *out_data) {
+    for (int i = 0; i < ctx->grid->nbins; i++) {
+        if (!bitset_get(valid, i)) {
+            out_data[i] = -1;
+        } else {
+            out_data[i] = bitset_get(ctx->fronts, i);
+        }
+    }
+}
+
+/*
+ * Function:  load_int_data
+ * --------------------
+ * Copies data in the int format of cayula() into the buffers of the context, clamping values to the range 0 to
+ * levels - 1 and flagging the bins that do not contain FILL_VALUE in ctx->valid.
+ */
+static void load_int_data(CayulaCtx *ctx, const int *data) {
+    int n_bins = ctx->grid->nbins;
+    int top = ctx->options.levels - 1;
+    memset(ctx->valid, 0, bitset_words(n_bins) * sizeof(uint64_t));
+    for (int i = 0; i < n_bins; i++) {
+        int value = data[i] != FILL_VALUE ? min(max(data[i], 0), top) : 0;
+        if (ctx->data16 != NULL) {
+            ctx->data16[i] = (uint16_t) value;
+        } else {
+            ctx->data[i] = (uint8_t) value;
+        }
+        if (data[i] != FILL_VALUE) bitset_set(ctx->valid, i);
+    }
+}
+
+/*
+ * Function:  load_u8_data
+ * --------------------
+ * Widens 8 bit data into the buffer of a context with more than 256 levels. A context with up to 256 levels reads the
+ * data directly.
+ */
+static void load_u8_data(CayulaCtx *ctx, const uint8_t *data) {
+    if (ctx->data16 != NULL) {
+        for (int i = 0; i < ctx->grid->nbins; i++) {
+            ctx->data16[i] = (uint16_t) min(data[i], ctx->options.levels - 1);
+        }
+    }
+}
+
+/*
+ * Function:  cayula_ctx_run
+ * --------------------
+ * Runs the single image edge detection algorithm on an image of the binning scheme of the context. Data values are
+ * clamped to the range 0 to levels - 1 the algorithm works in.
+ *
+ * args:
+ *      CayulaCtx *ctx: the context to run
+ *      int *data: pointer to the array containing the data for every bin. Bins without data contain FILL_VALUE
+ *      int *out_data: pointer to an output array with an element for every bin. Fronts are 1, other valid bins 0 and
+ *      bins without data -1
+ */
+void cayula_ctx_run(CayulaCtx *ctx, const int *data, int *out_data) {
+    load_int_data(ctx, data);
+    find_fronts(ctx, ctx->data, ctx->data16, ctx->valid);
+    write_output_int(ctx, ctx->valid, out_data);
+}
+
+/*
+ * Function:  cayula_ctx_run_rows
+ * --------------------
+ * Runs the algorithm like cayula_ctx_run, except that the contour step carries on a scan of a larger image that the
+ * rows of the context are part of. Only the contours starting in rows scan_begin to scan_end - 1 are traced, on the
+ * calling thread and through rows row_begin to row_end - 1, with the bins claimed by the contours started before them
+ * taken from in_contour. Contours that are not cut are those of a run of the larger image, which lets a stream run an
+ * image a band of rows at a time.
+ *
+ * args:
+ *      CayulaCtx *ctx: the context to run
+ *      int *data: pointer to the array containing the data for every bin. Bins without data contain FILL_VALUE
+ *      int scan_begin: the first row to start contours from
+ *      int scan_end: the row after the last row to start contours from
+ *      int row_begin: the first row contours are followed through
+ *      int row_end: the row after the last row contours are followed through
+ *      uint64_t *in_contour: pointer to a bitset of the bins already in a contour, which the bins without filtered
+ *      data and the bins of the traced contours are added to
+ *      uint64_t *fronts: pointer to a bitset that the pixels of the fronts found are added to
+ *
+ * returns:
+ *      int: the number of contours cut at row_begin or row_end - 1 as trace_contour_rows counts them, or -1 if
+ *      memory could not be allocated
+ */
+int cayula_ctx_run_rows(CayulaCtx *ctx, const int *data, int scan_begin, int scan_end, int row_begin, int row_end,
+                        uint64_t *in_contour, uint64_t *fronts) {
+    if (ctx->arena == NULL) {
+        ctx->arena = arena_create(CONTOUR_ARENA_BLOCK_SIZE);
+        if (ctx->arena == NULL) return -1;
+    }
+    load_int_data(ctx, data);
+    find_edges(ctx, ctx->data, ctx->data16, ctx->valid);
+
+    StageClock clock;
+    stage_start(ctx, &clock);
+    for (int i = 0; i < bitset_words(ctx->grid->nbins); i++) {
+        in_contour[i] |= ~ctx->filtered_valid[i];
+    }
+    ctx->map = (ContourMap) {.grid = ctx->grid, .edges = ctx->edge_pixels, .filtered_data = ctx->filtered_data,
+                             .filtered_valid = ctx->filtered_valid, .in_contour = in_contour, .arena = ctx->arena,
+                             .gradients = ctx->gradients, .row_begin = row_begin, .row_end = row_end,
+                             .filtered_data16 = ctx->filtered_data16};
+    int ncut = trace_contour_rows(&ctx->map, scan_begin, scan_end, fronts);
+    stage_stop(ctx, &clock, STAGE_CONTOUR);
+    return ncut;
+}
+
+/*
+ * Function:  cayula_ctx_run_u8
+ * --------------------
+ * Runs the single image edge detection algorithm on 8 bit data. A context with up to 256 levels runs on the data
+ * without converting it first.
+ *
+ * args:
+ *      CayulaCtx *ctx: the context to run
+ *      uint8_t *data: pointer to the array containing the data for every bin
+ *      uint64_t *valid: pointer to a bitset with a bit for every bin, set for the bins containing data. Bit i is bit
+ *      i % 64 of element i / 64
+ *      int8_t *out_data: pointer to an output array with an element for every bin. Fronts are 1, other valid bins 0
+ *      and bins without data -1
+ */
+void cayula_ctx_run_u8(CayulaCtx *ctx, const uint8_t *data, const uint64_t *valid, int8_t *out_data) {
+    load_u8_data(ctx, data);
+    find_fronts(ctx, data, ctx->data16, valid);
+    write_output(ctx, valid, out_data);
+}
+
+/*
+ * Function:  find_bin_number
+ * --------------------
+ * Finds the first bin of the context whose bin number in the full grid is not less than a bin number, galloping
+ * forward from the bin found for the previous value. Bin lists are sorted, so each value is usually found a few bins
+ * after the previous one, and a value smaller than the previous one is searched for from the start.
+ */
+static int find_bin_number(const int *bin_numbers, int n_bins, int bin, int start) {
+    if (start > 0 && bin_numbers[start - 1] >= bin) start = 0;
+    int low = start;
+    int high = start;
+    int step = 1;
+    while (high < n_bins && bin_numbers[high] < bin) {
+        low = high + 1;
+        high += step;
+        step <<= 1;
+    }
+    high = min(high, n_bins);
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (bin_numbers[mid] < bin) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
 }
 
+/*
+ * Function:  load_sparse_data
+ * --------------------
+ * Scatters the values of a list of bins into the buffers of the context, quantizing them to the levels of the context
+ * between the smallest and largest value of the list. Bins missing from the list, and values that are not finite,
+ * are flagged as not containing data.
+ */
+static void load_sparse_data(CayulaCtx *ctx, const int *bins, const double *values, int nvalues) {
+    int n_bins = ctx->grid->nbins;
+    int top = ctx->options.levels - 1;
+    double low = INFINITY;
+    double high = -INFINITY;
+    for (int k = 0; k < nvalues; k++) {
+        if (!isfinite(values[k])) continue;
+        low = values[k] < low ? values[k] : low;
+        high = values[k] > high ? values[k] : high;
+    }
+    memset(ctx->valid, 0, bitset_words(n_bins) * sizeof(uint64_t));
+    if (ctx->data16 != NULL) {
+        memset(ctx->data16, 0, n_bins * sizeof(uint16_t));
+    } else {
+        memset(ctx->data, 0, n_bins);
+    }
+    int i = 0;
+    for (int k = 0; k < nvalues; k++) {
+        if (!isfinite(values[k])) continue;
+        i = find_bin_number(ctx->bin_numbers, n_bins, bins[k], i);
+        if (i == n_bins || ctx->bin_numbers[i] != bins[k]) continue;
+        int value = high > low ? (int) floor(top * (values[k] - low) / (high - low)) : 0;
+        value = min(max(value, 0), top);
+        if (ctx->data16 != NULL) {
+            ctx->data16[i] = (uint16_t) value;
+        } else {
+            ctx->data[i] = (uint8_t) value;
+        }
+        bitset_set(ctx->valid, i);
+    }
+}
+
+/*
+ * Function:  cayula_ctx_set_bin_numbers
+ * --------------------
+ * Sets the bin number in the full grid of every bin of the context, so images can be run from the sparse bin lists of
+ * level 3 binned files with cayula_ctx_run_sparse. The numbers are copied.
+ *
+ * args:
+ *      CayulaCtx *ctx: the context
+ *      int *bin_numbers: pointer to an array with the bin number of every bin of the context, strictly increasing
+ *
+ * returns: 0 on success, -1 if the numbers are not increasing or could not be stored
+ */
+int cayula_ctx_set_bin_numbers(CayulaCtx *ctx, const int *bin_numbers) {
+    int n_bins = ctx->grid->nbins;
+    for (int i = 1; i < n_bins; i++) {
+        if (bin_numbers[i] <= bin_numbers[i - 1]) return -1;
+    }
+    if (ctx->bin_numbers == NULL) {
+        ctx->bin_numbers = malloc(n_bins * sizeof(int));
+        if (ctx->bin_numbers == NULL) return -1;
+    }
+    memcpy(ctx->bin_numbers, bin_numbers, n_bins * sizeof(int));
+    return 0;
+}
+
+/*
+ * Function:  cayula_ctx_run_sparse
+ * --------------------
+ * Runs the single image edge detection algorithm on the bins of an image listed with their values, as stored in level
+ * 3 binned files. Values are quantized to the levels of the context, the smallest value of the list to 0 and the
+ * largest to levels - 1, and written straight into the buffers of the context, so no dense copy of the image is
+ * needed. Listed bins that are not in the context are ignored, and bins of the context that are not listed or whose
+ * value is not finite do not contain data. Lists sorted by bin number are scattered in a single pass.
+ *
+ * args:
+ *      CayulaCtx *ctx: the context to run, with its bin numbers set by cayula_ctx_set_bin_numbers
+ *      int *bins: pointer to an array with the bin number in the full grid of each value
+ *      double *values: pointer to an array with the value of each listed bin
+ *      int nvalues: number of listed bins
+ *      int8_t *out_data: pointer to an output array with an element for every bin. Fronts are 1, other valid bins 0
+ *      and bins without data -1
+ *
+ * returns: 0 on success, -1 if the bin numbers of the context were not set
+ */
+int cayula_ctx_run_sparse(CayulaCtx *ctx, const int *bins, const double *values, int nvalues, int8_t *out_data) {
+    if (ctx->bin_numbers == NULL) return -1;
+    load_sparse_data(ctx, bins, values, nvalues);
+    find_fronts(ctx, ctx->data, ctx->data16, ctx->valid);
+    write_output(ctx, ctx->valid, out_data);
+    return 0;
+}
+
+/*
+ * Function:  cayula_ctx_run_u16
+ * --------------------
+ * Runs the single image edge detection algorithm on 16 bit data. A context with 65536 levels runs on the data without
+ * converting it first. Otherwise values are clamped to the levels of the context.
+ *
+ * args:
+ *      CayulaCtx *ctx: the context to run
+ *      uint16_t *data: pointer to the array containing the data for every bin
+ *      uint64_t *valid: pointer to a bitset with a bit for every bin, set for the bins containing data. Bit i is bit
+ *      i % 64 of element i / 64
+ *      int8_t *out_data: pointer to an output array with an element for every bin. Fronts are 1, other valid bins 0
+ *      and bins without data -1
+ */
+void cayula_ctx_run_u16(CayulaCtx *ctx, const uint16_t *data, const uint64_t *valid, int8_t *out_data) {
+    int top = ctx->options.levels - 1;
+    if (ctx->data16 == NULL) {
+        for (int i = 0; i < ctx->grid->nbins; i++) {
+            ctx->data[i] = (uint8_t) min(data[i], top);
+        }
+    } else if (top < HISTOGRAM_MAX_LEVELS - 1) {
+        for (int i = 0; i < ctx->grid->nbins; i++) {
+            ctx->data16[i] = (uint16_t) min(data[i], top);
+        }
+        data = ctx->data16;
+    }
+    find_fronts(ctx, ctx->data, data, valid);
+    write_output(ctx, valid, out_data);
+}
+
+/*
+ * Function:  cayula_ctx_sweep
+ * --------------------
+ * Runs the algorithm on an image for each of a set of critical values at a fraction of the cost of a run for each.
+ * The median filter and window scan run once, keeping the theta and cohesion of every window with a threshold along
+ * with its edge pixels, and only the contour step is repeated for each sweep point.
+ *
+ * args:
+ *      CayulaCtx *ctx: the context to run
+ *      int *data: pointer to the array containing the data for every bin. Bins without data contain FILL_VALUE
+ *      CayulaSweepPoint *points: pointer to an array of the critical values to find fronts with
+ *      int npoints: the number of sweep points
+ *      int *out_data: pointer to an output array of npoints images of an element for every bin, in the order of the
+ *      sweep points. Fronts are 1, other valid bins 0 and bins without data -1
+ *
+ * returns:
+ *      int: 0 on success or -1 if the windows could not be stored
+ */
+int cayula_ctx_sweep(CayulaCtx *ctx, const int *data, const CayulaSweepPoint *points, int npoints, int *out_data) {
+    load_int_data(ctx, data);
+    if (sweep_windows(ctx, ctx->data, ctx->data16, ctx->valid) != 0) return -1;
+    for (int p = 0; p < npoints; p++) {
+        sweep_fronts(ctx, &points[p]);
+        write_output_int(ctx, ctx->valid, out_data + (size_t) p * ctx->grid->nbins);
+    }
+    return 0;
+}
+
+/*
+ * Function:  cayula_ctx_sweep_u8
+ * --------------------
+ * Runs cayula_ctx_sweep on 8 bit data.
+ *
+ * args:
+ *      CayulaCtx *ctx: the context to run
+ *      uint8_t *data: pointer to the array containing the data for every bin
+ *      uint64_t *valid: pointer to a bitset with a bit for every bin, set for the bins containing data
+ *      CayulaSweepPoint *points: pointer to an array of the critical values to find fronts with
+ *      int npoints: the number of sweep points
+ *      int8_t *out_data: pointer to an output array of npoints images of an element for every bin, in the order of
+ *      the sweep points. Fronts are 1, other valid bins 0 and bins without data -1
+ *
+ * returns:
+ *      int: 0 on success or -1 if the windows could not be stored
+ */
+int cayula_ctx_sweep_u8(CayulaCtx *ctx, const uint8_t *data, const uint64_t *valid, const CayulaSweepPoint *points,
+                        int npoints, int8_t *out_data) {
+    load_u8_data(ctx, data);
+    if (sweep_windows(ctx, data, ctx->data16, valid) != 0) return -1;
+    for (int p = 0; p < npoints; p++) {
+        sweep_fronts(ctx, &points[p]);
+        write_output(ctx, valid, out_data + (size_t) p * ctx->grid->nbins);
+    }
+    return 0;
+}
+
+/*
+ * Function:  cayula_ctx_screen_counts
+ * --------------------
+ * Returns the number of windows rejected at each step of the window scan during the last run of the context. After a
+ * sweep windows with a threshold are not counted as rejected by the histogram analysis or cohesion whatever their
+ * theta and cohesion.
+ */
+CayulaScreenCounts cayula_ctx_screen_counts(const CayulaCtx *ctx) {
+    return ctx->counts;
+}
+
+/*
+ * Function:  cayula_ctx_intermediates
+ * --------------------
+ * Returns the buffers holding the filtered data, window thresholds, edge pixels and fronts of the last run of the
+ * context. The buffers belong to the context and are overwritten by its next run. After a sweep the edge pixels and
+ * fronts are those of the last sweep point.
+ */
+CayulaIntermediates cayula_ctx_intermediates(const CayulaCtx *ctx) {
+    CayulaIntermediates intermediates;
+    intermediates.filtered_data = ctx->filtered_data;
+    intermediates.filtered_data16 = ctx->filtered_data16;
+    intermediates.filtered_valid = ctx->filtered_valid;
+    intermediates.thresholds = ctx->thresholds;
+    intermediates.window_offsets = ctx->window_offsets;
+    intermediates.n_window_rows = ctx->n_window_rows;
+    intermediates.edge_pixels = ctx->edge_pixels;
+    intermediates.fronts = ctx->fronts;
+    return intermediates;
+}
+
+/*
+ * Function:  cayula_ctx_destroy
+ * --------------------
+ * Stops the threads of the context and frees it along with its buffers.
+ */
+void cayula_ctx_destroy(CayulaCtx *ctx) {
+    if (ctx == NULL) return;
+    grid_destroy(ctx->grid);
+    pool_destroy(ctx->pool);
+    free(ctx->data);
+    free(ctx->valid);
+    padded_free(ctx->filtered_data, 1, SCAN_PADDING);
+    free(ctx->data16);
+    padded_free(ctx->filtered_data16, sizeof(uint16_t), SCAN_PADDING);
+    for (int t = 0; t < ctx->n_histograms16; t++) {
+        window_histogram16_destroy(ctx->histograms16[t]);
+    }
+    free(ctx->histograms16);
+    free(ctx->median_counts);
+    for (int t = 0; t < ctx->n_sweep_lists; t++) {
+        free(ctx->sweep_lists[t].windows);
+        free(ctx->sweep_lists[t].edges);
+    }
+    free(ctx->sweep_lists);
+    padded_free(ctx->filtered_valid, sizeof(uint64_t), bitset_words(SCAN_PADDING));
+    free(ctx->edge_pixels);
+    free(ctx->in_contour);
+    free(ctx->fronts);
+    free(ctx->thresholds);
+    free(ctx->window_offsets);
+    free(ctx->bin_numbers);
+    valid_spans_destroy(ctx->spans);
+    contour_bands_destroy(ctx->bands);
+    arena_destroy(ctx->arena);
+    gradient_field_destroy(ctx->gradients);
+    free(ctx);
+}
+
+/*
+ * Function:  cayula
+ * --------------------
+ * Runs cayula_with_options with cayula_default_options(), returning its status.
+ */
+int cayula(int *data, int *out_data, int n_bins, int nrows, int *n_bins_in_row, int *basebins) {
+    CayulaOptions options = cayula_default_options();
+    return cayula_with_options(data, out_data, n_bins, nrows, n_bins_in_row, basebins, &options);
+}
+
+/*
+ * Function:  cayula_with_options
+ * --------------------
+ * Runs the single image edge detection algorithm on the given map of binned data. When running the algorithm on many
+ * images of the same binning scheme, creating a context with cayula_ctx_create and reusing it is faster.
+ *
+ * args:
+ *      int *data: pointer to the array containing the data for every bin. Bins without data contain FILL_VALUE
+ *      int *out_data: pointer to an output array of n_bins elements. Fronts are 1, other valid bins 0 and bins
+ *      without data -1
+ *      int n_bins: the number of bins in the binning scheme
+ *      int nrows: the number of rows in the binning scheme
+ *      int *n_bins_in_row: pointer to an array containing the number of bins in each row
+ *      int *basebins: pointer to an array containing the bin number of the first bin in each row
+ *      CayulaOptions *options: options controlling how the algorithm is run. The output depends on the stride but
+ *      not on the number of threads
+ *
+ * returns:
+ *      int: 0 on success or -1 if the context could not be created, in which case every element of out_data is -1
+ */
+int cayula_with_options(int *data, int *out_data, int n_bins, int nrows, int *n_bins_in_row, int *basebins,
+                        const CayulaOptions *options) {
+    CayulaCtx *ctx = cayula_ctx_create(n_bins, nrows, n_bins_in_row, basebins, options);
+    if (ctx == NULL) {
+        for (int i = 0; i < n_bins; i++) out_data[i] = -1;
+        return -1;
+    }
+    cayula_ctx_run(ctx, data, out_data);
+    cayula_ctx_destroy(ctx);
+    return 0;
+}
@@ -4,9 +4,110 @@
 
 #ifndef CAYULA_H
 #define CAYULA_H
+#include <stdint.h>
 
 #define WINDOW_WIDTH 32
 #define WINDOW_AREA 1024
+#define WINDOW_MAX_WIDTH 64
 #define FILL_VALUE -999
-void cayula(int *data, int *out_data, int n_bins, int nrows, int *n_bins_in_row, int *basebins);
+
+/*
+ * Timings and counts of a run of a context, filled when CayulaOptions.stats is set. Times are in seconds, with CPU
+ * times summed over every thread of the process. After a sweep the contour step is summed over the sweep points.
+ */
+typedef struct cayula_stats {
+    double filter_wall;         // median filter
+    double filter_cpu;
+    double scan_wall;           // window scan
+    double scan_cpu;
+    double contour_wall;        // contour step, including the gradient field
+    double contour_cpu;
+    long windows;               // windows examined by the scan
+    long rejected_histogram;    // windows without a threshold from the histogram analysis
+    long rejected_cohesion;     // windows whose groups were not cohesive
+    long edge_pixels;           // edge pixels found by the scan
+    long contours_started;      // contours started from an edge pixel
+    long contour_points;        // points added to contours
+    long contours_kept;         // contours long enough to be fronts
+    long bytes_allocated;       // bytes held by the context, including buffers grown to fit the images run
+} CayulaStats;
+
+typedef struct cayula_options {
+    int nthreads;   // threads used for the window scan. 0 uses one thread per online processor
+    int window_width; // width of the windows of the scan, up to WINDOW_MAX_WIDTH. Odd widths are rounded up to the
+                      // next even width. 0 uses WINDOW_WIDTH
+    int stride;     // distance between the centers of neighboring windows. Less than the window width overlaps windows.
+                    // 0 uses the window width
+    int filter_size; // width of the median filter kernel. Even sizes are rounded up to the next odd size
+    int gradient_field; // 1 to compute the gradient of every bin once for contour following instead of on demand
+    int contour_band_rows; // rows per band for following contours on several threads. 0 follows them serially
+    double min_valid_fraction; // windows with a smaller fraction of bins containing data are skipped
+    double min_variance;    // windows whose values do not have a larger variance are skipped
+    int min_range;          // windows whose largest and smallest value differ by less are skipped
+    int levels;             // number of levels of the data. Up to 256 runs on 8 bit data and up to 65536 on 16 bit
+    int valid_spans;        // 1 to find the runs of bins containing data of each row and skip the rows and windows
+                            // without data in the 3x3 median filter and the window scan. The results are the same
+    CayulaStats *stats;     // filled by every run of a context when not NULL. Nothing is measured when NULL
+} CayulaOptions;
+
+/*
+ * Number of windows of the last run of a context that were rejected at each step before edges were located in them.
+ */
+typedef struct cayula_screen_counts {
+    long windows;               // windows scanned
+    long rejected_valid;        // too few bins containing data
+    long rejected_variance;     // variance too small
+    long rejected_range;        // range too small
+    long rejected_histogram;    // no threshold from the histogram analysis
+    long rejected_cohesion;     // groups divided by the threshold not cohesive
+} CayulaScreenCounts;
+
+/*
+ * Critical values of the histogram analysis and cohesion steps for one point of a sweep.
+ */
+typedef struct cayula_sweep_point {
+    double crit_value;  // smallest ratio of the between group variance to the total variance of a window
+    double crit_c1;     // smallest fraction of the neighbors of bins below the threshold that are also below it
+    double crit_c2;     // smallest fraction of the neighbors of bins above the threshold that are also above it
+    double crit_c;      // smallest fraction of the neighbors of all bins that are on the same side
+} CayulaSweepPoint;
+
+/*
+ * The buffers holding the result of each step of the last run of a context, for checking the steps against other
+ * implementations. Windows of the scan are numbered row by row in the order their centers appear in the data, and
+ * window row k starts at thresholds[window_offsets[k]].
+ */
+typedef struct cayula_intermediates {
+    const uint8_t *filtered_data;       // filtered 8 bit data or NULL for a context with more than 256 levels
+    const uint16_t *filtered_data16;    // filtered 16 bit data or NULL for a context with up to 256 levels
+    const uint64_t *filtered_valid;     // bitset of the bins with filtered data
+    const int *thresholds;              // threshold of every window of the scan, -1 for windows without one
+    const int *window_offsets;          // n_window_rows + 1 entries
+    int n_window_rows;
+    const uint64_t *edge_pixels;        // bitset of the edge pixels found by the scan
+    const uint64_t *fronts;             // bitset of the fronts
+} CayulaIntermediates;
+
+typedef struct cayula_ctx CayulaCtx;
+
+CayulaOptions cayula_default_options(void);
+CayulaCtx * cayula_ctx_create(int n_bins, int nrows, const int *n_bins_in_row, const int *basebins,
+                              const CayulaOptions *options);
+void cayula_ctx_run(CayulaCtx *ctx, const int *data, int *out_data);
+int cayula_ctx_run_rows(CayulaCtx *ctx, const int *data, int scan_begin, int scan_end, int row_begin, int row_end,
+                        uint64_t *in_contour, uint64_t *fronts);
+void cayula_ctx_run_u8(CayulaCtx *ctx, const uint8_t *data, const uint64_t *valid, int8_t *out_data);
+void cayula_ctx_run_u16(CayulaCtx *ctx, const uint16_t *data, const uint64_t *valid, int8_t *out_data);
+int cayula_ctx_set_bin_numbers(CayulaCtx *ctx, const int *bin_numbers);
+int cayula_ctx_run_sparse(CayulaCtx *ctx, const int *bins, const double *values, int nvalues, int8_t *out_data);
+CayulaSweepPoint cayula_default_sweep_point(void);
+int cayula_ctx_sweep(CayulaCtx *ctx, const int *data, const CayulaSweepPoint *points, int npoints, int *out_data);
+int cayula_ctx_sweep_u8(CayulaCtx *ctx, const uint8_t *data, const uint64_t *valid, const CayulaSweepPoint *points,
+                        int npoints, int8_t *out_data);
+CayulaScreenCounts cayula_ctx_screen_counts(const CayulaCtx *ctx);
+CayulaIntermediates cayula_ctx_intermediates(const CayulaCtx *ctx);
+void cayula_ctx_destroy(CayulaCtx *ctx);
+int cayula(int *data, int *out_data, int n_bins, int nrows, int *n_bins_in_row, int *basebins);
+int cayula_with_options(int *data, int *out_data, int n_bins, int nrows, int *n_bins_in_row, int *basebins,
+                        const CayulaOptions *options);
 #endif //CAYULA_H
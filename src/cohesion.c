@@ -1,10 +1,8 @@
+#include <stddef.h>
 #include "cohesion.h"
+#include "bitset.h"
 #include "cayula.h"
 
-#define CRIT_C1 0.90
-#define CRIT_C2 0.90
-#define CRIT_C 0.92
-
 static inline int squarei(int a) {
     return a * a;
 }
@@ -24,34 +22,50 @@ static inline int max(int a, int b) {
  * Compares each bin to its neighbors to see if members of each group are near other members.
  *
  * args:
- *      int *window: pointer to an array containing the data window
+ *      int *window: pointer to an array containing the WINDOW_WIDTH x WINDOW_WIDTH data window
  *      int threshold: the threshold to separate the two groups by
  *
  * returns:
  *      int: 1 if the threshold results in cohesive groups 0 if it does not
  */
 int cohesive(const int *window, int threshold) {
-    int copy[1024] = {0};
-
+    return cohesive_width(window, WINDOW_WIDTH, threshold);
+}
 
-    for (int i = 0; i < 1024; i++) {
+/*
+ * Function:  cohesive_width
+ * --------------------
+ * Performs the test of cohesive on a window of any width.
+ *
+ * args:
+ *      int *window: pointer to an array containing the width x width data window
+ *      int width: the width of the window
+ *      int threshold: the threshold to separate the two groups by
+ *
+ * returns:
+ *      int: 1 if the threshold results in cohesive groups 0 if it does not
+ */
+int cohesive_width(const int *window, int width, int threshold) {
+    int area = squarei(width);
+    int copy[area];
+    for (int i = 0; i < area; i++) {
         copy[i] = window[i] == FILL_VALUE ? FILL_VALUE : window[i] >= threshold;
     }
     double r1 = 0, t1 = 0, r2 = 0, t2 = 0;
-    for (int i = 0; i < WINDOW_WIDTH; i++) {
-        for (int j = 0; j < WINDOW_WIDTH; j++) {
+    for (int i = 0; i < width; i++) {
+        for (int j = 0; j < width; j++) {
             int sum = 0;
             int count = 0;
-            if (copy[i * WINDOW_WIDTH + j] != FILL_VALUE) {
-                for (int k = max(i - 1, 0); k < min(i + 2, WINDOW_WIDTH); k++) {
-                    for (int l = max(j - 1, 0); l < min(j + 2, WINDOW_WIDTH); l++) {
-                        if (k != i && l != j && copy[k * WINDOW_WIDTH + l] != FILL_VALUE) {
-                            sum += copy[k * WINDOW_WIDTH + l];
+            if (copy[i * width + j] != FILL_VALUE) {
+                for (int k = max(i - 1, 0); k < min(i + 2, width); k++) {
+                    for (int l = max(j - 1, 0); l < min(j + 2, width); l++) {
+                        if (k != i && l != j && copy[k * width + l] != FILL_VALUE) {
+                            sum += copy[k * width + l];
                             count++;
                         }
                     }
                 }
-                if (copy[i * WINDOW_WIDTH + j] == 0) {
+                if (copy[i * width + j] == 0) {
                     r1 += count - sum;
                     t1 += count;
                 } else {
@@ -75,17 +89,18 @@ int cohesive(const int *window, int threshold) {
  * args:
  *      int *window: pointer to an array containing the data. Elements should be 0 if they are below the threshold
  *      and 1 if they are above the threshold
+ *      int width: the width of the window
  *      int row: the row the element of interest can be found in
  *      int col: the column the element of interest can be found in
  *
  * returns:
  *      int: 1 if at least one of the neighbors is different and 0 if all of its valid neighbors are the same
  */
-int neighbor_is_different(const int *window, int row, int col) {
-    int center = window[row * WINDOW_WIDTH + col];
-    for (int i = max(row - 1, 0); i < min(row + 2, WINDOW_WIDTH); i++) {
-        for (int j = max(col - 1, 0); j < min(col + 2, WINDOW_WIDTH); j++) {
-            if (window[i * WINDOW_WIDTH + j] != FILL_VALUE && center != window[i * WINDOW_WIDTH + j]) {
+int neighbor_is_different(const int *window, int width, int row, int col) {
+    int center = window[row * width + col];
+    for (int i = max(row - 1, 0); i < min(row + 2, width); i++) {
+        for (int j = max(col - 1, 0); j < min(col + 2, width); j++) {
+            if (window[i * width + j] != FILL_VALUE && center != window[i * width + j]) {
                 return 1;
             }
         }
@@ -111,18 +126,219 @@ int neighbor_is_different(const int *window, int row, int col) {
  *
  */
 void find_edge(const int *window, int *out, int threshold) {
-    int bodies[1024];
-    for (int i = 0; i < squarei(WINDOW_WIDTH); i++) {
+    find_edge_width(window, WINDOW_WIDTH, out, threshold);
+}
+
+/*
+ * Function:  find_edge_width
+ * --------------------
+ * Locates the edge pixels of find_edge in a window of any width.
+ *
+ * args:
+ *      int *window: pointer to an array containing the width x width data window
+ *      int width: the width of the window
+ *      int *out: pointer to an array of same size as the input array for the edge pixels
+ *      int threshold: threshold value of the window determined by earlier steps of the algorithm
+ */
+void find_edge_width(const int *window, int width, int *out, int threshold) {
+    int area = squarei(width);
+    int bodies[area];
+    for (int i = 0; i < area; i++) {
         bodies[i] = window[i] == FILL_VALUE ? FILL_VALUE : window[i] >= threshold;
     }
 
-    for (int i = 0; i < WINDOW_WIDTH; i++) {
-        for (int j = 0; j < WINDOW_WIDTH; j++) {
-            if (bodies[i * WINDOW_WIDTH + j] != FILL_VALUE) {
-                out[i * WINDOW_WIDTH + j] = neighbor_is_different(bodies, i, j);
+    for (int i = 0; i < width; i++) {
+        for (int j = 0; j < width; j++) {
+            if (bodies[i * width + j] != FILL_VALUE) {
+                out[i * width + j] = neighbor_is_different(bodies, width, i, j);
             } else {
-                out[i * WINDOW_WIDTH + j] = 0;
+                out[i * width + j] = 0;
+            }
+        }
+    }
+}
+
+/*
+ * The mask kernels below are written once as inline functions of the window width. Each public function dispatches
+ * the widths in common use to a copy of the kernel where the width is a constant, which the compiler unrolls and
+ * vectorizes, and every other width to a copy that takes the width at run time.
+ */
+#define WINDOW_KERNEL_DISPATCH(width, kernel, ...) \
+    switch (width) { \
+        case 16: kernel(16, __VA_ARGS__); break; \
+        case 32: kernel(32, __VA_ARGS__); break; \
+        case 64: kernel(64, __VA_ARGS__); break; \
+        default: kernel(width, __VA_ARGS__); break; \
+    }
+
+/*
+ * Function:  mask_rows
+ * --------------------
+ * Divides the rows of a window by the threshold for window_mask_u8 and window_mask_u16. The values are read from
+ * data8 if it is not NULL and from data16 otherwise.
+ */
+static inline __attribute__((always_inline)) void mask_rows(int width, WindowMask *mask, const int *starts,
+                                                            const uint8_t *data8, const uint16_t *data16,
+                                                            const uint64_t *valid, int threshold) {
+    mask->width = width;
+    for (int i = 0; i < width; i++) {
+        uint64_t above = 0;
+        if (data8 != NULL) {
+            const uint8_t *row = data8 + starts[i];
+            for (int j = 0; j < width; j++) {
+                above |= (uint64_t) (row[j] >= threshold) << j;
+            }
+        } else {
+            const uint16_t *row = data16 + starts[i];
+            for (int j = 0; j < width; j++) {
+                above |= (uint64_t) (row[j] >= threshold) << j;
+            }
+        }
+        mask->valid[i] = bitset_bits(valid, starts[i], width);
+        mask->above[i] = above & mask->valid[i];
+    }
+}
+
+/*
+ * Function:  window_mask_u8
+ * --------------------
+ * Divides a width x width window of 8 bit data by the threshold.
+ *
+ * args:
+ *      WindowMask *mask: pointer to the mask to write
+ *      int width: the width of the window. Must not be greater than WINDOW_MAX_WIDTH
+ *      int *starts: pointer to an array containing the first bin of each window row, as found by get_window_starts
+ *      uint8_t *data: pointer to the array containing the data for every bin
+ *      uint64_t *valid: pointer to the bitset of bins containing data
+ *      int threshold: the threshold to divide the window by
+ */
+void window_mask_u8(WindowMask *mask, int width, const int *starts, const uint8_t *data, const uint64_t *valid,
+                    int threshold) {
+    WINDOW_KERNEL_DISPATCH(width, mask_rows, mask, starts, data, NULL, valid, threshold)
+}
+
+/*
+ * Function:  window_mask_u16
+ * --------------------
+ * Divides a width x width window of 16 bit data by the threshold, like window_mask_u8.
+ *
+ * args:
+ *      WindowMask *mask: pointer to the mask to write
+ *      int width: the width of the window. Must not be greater than WINDOW_MAX_WIDTH
+ *      int *starts: pointer to an array containing the first bin of each window row, as found by get_window_starts
+ *      uint16_t *data: pointer to the array containing the data for every bin
+ *      uint64_t *valid: pointer to the bitset of bins containing data
+ *      int threshold: the threshold to divide the window by
+ */
+void window_mask_u16(WindowMask *mask, int width, const int *starts, const uint16_t *data, const uint64_t *valid,
+                     int threshold) {
+    WINDOW_KERNEL_DISPATCH(width, mask_rows, mask, starts, NULL, data, valid, threshold)
+}
+
+/*
+ * Function:  count_cohesion
+ * --------------------
+ * Counts the diagonal neighbors on the same side of the threshold for cohesive_mask. Rows are at most 64 bins wide,
+ * so shifting a row out of the top of its word drops the bin that has no neighbor there.
+ */
+static inline __attribute__((always_inline)) void count_cohesion(int width, const WindowMask *mask, int *counts) {
+    int r1 = 0, t1 = 0, r2 = 0, t2 = 0;
+    for (int i = 0; i < width; i++) {
+        uint64_t above = mask->above[i];
+        uint64_t below = mask->valid[i] & ~above;
+        for (int k = i - 1; k <= i + 1; k += 2) {
+            if (k < 0 || k >= width) continue;
+            uint64_t neighbors[2] = {mask->valid[k] << 1, mask->valid[k] >> 1};
+            uint64_t neighbors_above[2] = {mask->above[k] << 1, mask->above[k] >> 1};
+            for (int l = 0; l < 2; l++) {
+                t1 += __builtin_popcountll(below & neighbors[l]);
+                r1 += __builtin_popcountll(below & neighbors[l] & ~neighbors_above[l]);
+                t2 += __builtin_popcountll(above & neighbors[l]);
+                r2 += __builtin_popcountll(above & neighbors_above[l]);
             }
         }
     }
-}
\ No newline at end of file
+    counts[0] = r1;
+    counts[1] = t1;
+    counts[2] = r2;
+    counts[3] = t2;
+}
+
+/*
+ * Function:  cohesive_mask
+ * --------------------
+ * Same test as cohesive on a window mask. Each bin is compared to its diagonal neighbors like in cohesive, with the
+ * neighbors of a whole window row found by shifting the rows above and below it one bin left and right.
+ *
+ * args:
+ *      WindowMask *mask: pointer to the window divided by the threshold
+ *
+ * returns:
+ *      int: 1 if the threshold results in cohesive groups 0 if it does not
+ */
+int cohesive_mask(const WindowMask *mask) {
+    double ratios[3];
+    cohesion_ratios(mask, ratios);
+    return (ratios[0] >= CRIT_C1 && ratios[1] >= CRIT_C2 && ratios[2] >= CRIT_C);
+}
+
+/*
+ * Function:  cohesion_ratios
+ * --------------------
+ * Calculates the fractions of the neighbors of the bins below the threshold, of the bins above it and of all bins
+ * that are on the same side as the bin, which cohesive_mask compares to CRIT_C1, CRIT_C2 and CRIT_C. A group without
+ * any valid neighbors gives NaN, which fails every comparison.
+ *
+ * args:
+ *      WindowMask *mask: pointer to the window divided by the threshold
+ *      double *ratios: pointer to an output array of the 3 fractions
+ */
+void cohesion_ratios(const WindowMask *mask, double *ratios) {
+    int counts[4];
+    WINDOW_KERNEL_DISPATCH(mask->width, count_cohesion, mask, counts)
+    double r1 = counts[0], t1 = counts[1], r2 = counts[2], t2 = counts[3];
+    ratios[0] = r1 / t1;
+    ratios[1] = r2 / t2;
+    ratios[2] = (r1 + r2) / (t1 + t2);
+}
+
+/*
+ * Function:  spread
+ * --------------------
+ * Returns the bins of a window row along with both of their neighbors in the row.
+ */
+static inline uint64_t spread(uint64_t row) {
+    return row | row << 1 | row >> 1;
+}
+
+/*
+ * Function:  edge_rows
+ * --------------------
+ * Finds the edge pixels of every row of the window for find_edge_mask.
+ */
+static inline __attribute__((always_inline)) void edge_rows(int width, const WindowMask *mask, uint64_t *edges) {
+    for (int i = 0; i < width; i++) {
+        uint64_t near_above = 0, near_below = 0;
+        for (int k = max(i - 1, 0); k < min(i + 2, width); k++) {
+            near_above |= spread(mask->above[k]);
+            near_below |= spread(mask->valid[k] & ~mask->above[k]);
+        }
+        uint64_t above = mask->above[i];
+        uint64_t below = mask->valid[i] & ~above;
+        edges[i] = (above & near_below) | (below & near_above);
+    }
+}
+
+/*
+ * Function:  find_edge_mask
+ * --------------------
+ * Same as find_edge on a window mask. A bin is an edge pixel if any valid bin in its 3x3 neighborhood is on the other
+ * side of the threshold.
+ *
+ * args:
+ *      WindowMask *mask: pointer to the window divided by the threshold
+ *      uint64_t *edges: pointer to an output array with a word for every row of the window with the edge pixels set
+ */
+void find_edge_mask(const WindowMask *mask, uint64_t *edges) {
+    WINDOW_KERNEL_DISPATCH(mask->width, edge_rows, mask, edges)
+}
@@ -1,7 +1,34 @@
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifndef SIED_COHESION_H
 #define SIED_COHESION_H
+#include "cayula.h"
+
+#define CRIT_C1 0.90
+#define CRIT_C2 0.90
+#define CRIT_C 0.92
+
+/*
+ * A window divided by a threshold stored as one word per window row. Bit j of row i is the bin in column j of the
+ * window row. Bins above the threshold are only set in above if they are also set in valid.
+ */
+typedef struct window_mask {
+    int width;
+    uint64_t above[WINDOW_MAX_WIDTH];
+    uint64_t valid[WINDOW_MAX_WIDTH];
+} WindowMask;
+
 int cohesive(const int window[], int threshold);
+int cohesive_width(const int window[], int width, int threshold);
+int neighbor_is_different(const int *window, int width, int row, int col);
 void find_edge(const int window[], int *out,  int threshold);
+void find_edge_width(const int window[], int width, int *out, int threshold);
+void window_mask_u8(WindowMask *mask, int width, const int *starts, const uint8_t *data, const uint64_t *valid,
+                    int threshold);
+void window_mask_u16(WindowMask *mask, int width, const int *starts, const uint16_t *data, const uint64_t *valid,
+                     int threshold);
+int cohesive_mask(const WindowMask *mask);
+void cohesion_ratios(const WindowMask *mask, double *ratios);
+void find_edge_mask(const WindowMask *mask, uint64_t *edges);
 #endif //SIED_COHESION_H
@@ -3,6 +3,10 @@
 #include <string.h>
 #include <math.h>
 #include "helpers.h"
+#include "grid.h"
+#include "bitset.h"
+#include "arena.h"
+#include "gradient.h"
 #include "cayula.h"
 
 static inline double square(double a) {
@@ -121,6 +125,94 @@ double gradient_ratio(const int *window) {
     return sqrt(square(sum_x) + square(sum_y)) / sum_magnitude;
 }
 
+/*
+ * Function:  map_value
+ * --------------------
+ * Reads the filtered value of a bin of the map like map_window, giving FILL_VALUE to bins without data and bins
+ * before the first or after the last bin of the map.
+ */
+static inline int map_value(const ContourMap *map, int bin) {
+    if (bin < 0 || bin >= map->grid->nbins || !bitset_get(map->filtered_valid, bin)) return FILL_VALUE;
+    return map->filtered_data16 != NULL ? map->filtered_data16[bin] : map->filtered_data[bin];
+}
+
+/*
+ * Function:  field_gradient
+ * --------------------
+ * Finds the gradient gradient would compute for a bin whose neighbors above and below are the bins up and down. The
+ * gradient is read from the precomputed field when those are the neighbors the field used, which are the neighbors
+ * of the grid for bins that are not on the edge of their row. A window centered on another bin can place different
+ * bins above and below where the number of bins changes between rows, and the gradient is then computed from the
+ * filtered data so that it is the same as the one gradient_ratio reads from its window.
+ *
+ * args:
+ *      ContourMap *map: the map with the precomputed gradient field
+ *      int bin: the bin to find the gradient of
+ *      int row: the row of the bin
+ *      int up: the bin above it
+ *      int down: the bin below it
+ *
+ * returns:
+ *      Vector: the vector gradient
+ */
+static Vector field_gradient(const ContourMap *map, int bin, int row, int up, int down) {
+    const IsinGrid *grid = map->grid;
+    int col = bin - grid->basebins[row];
+    Vector g;
+    if (row > 0 && row < grid->nrows - 1 && col > 0 && col < grid->n_bins_in_row[row] - 1 &&
+        up == grid_neighbor(grid, bin, row, 1) && down == grid_neighbor(grid, bin, row, 7)) {
+        g.x = (double) map->gradients->dx[bin] / 2;
+        g.y = (double) map->gradients->dy[bin] / 2;
+        return g;
+    }
+    int window[9] = {0, map_value(map, up), 0,
+                     map_value(map, bin - 1), map_value(map, bin), map_value(map, bin + 1),
+                     0, map_value(map, down), 0};
+    return gradient(window);
+}
+
+/*
+ * Function:  grid_gradient
+ * --------------------
+ * Finds the gradient of a bin with its neighbors from the grid, which is the gradient of the 3x3 window map_window
+ * selects for it.
+ */
+static inline Vector grid_gradient(const ContourMap *map, int bin, int row) {
+    return field_gradient(map, bin, row, grid_neighbor(map->grid, bin, row, 1), grid_neighbor(map->grid, bin, row, 7));
+}
+
+/*
+ * Function:  field_gradient_ratio
+ * --------------------
+ * Calculates the ratio of gradient_ratio with the gradients read from a precomputed gradient field. The bins of the
+ * 3x3 window and the neighbors each of their gradients is taken from are the bins of the 5x5 window gradient_ratio
+ * reads, so the ratio is the same.
+ *
+ * args:
+ *      ContourMap *map: the map with the precomputed gradient field
+ *      int bin: the center bin
+ *      int row: the row of the center bin
+ *
+ * returns:
+ *      double: the ratio between the magnitude of the sum of the gradient vectors and the sum of their magnitudes
+ */
+static double field_gradient_ratio(const ContourMap *map, int bin, int row) {
+    const IsinGrid *grid = map->grid;
+    int starts[5];
+    get_window_starts(bin, row, 5, grid->n_bins_in_row, grid->basebins, starts);
+    double sum_magnitude = 0, sum_x = 0, sum_y = 0;
+    for (int i = -1; i < 2; i++) {
+        for (int j = -1; j < 2; j++) {
+            Vector g = field_gradient(map, starts[2 + i] + 2 + j, row + i, starts[1 + i] + 2 + j,
+                                      starts[3 + i] + 2 + j);
+            sum_magnitude += sqrt(square(g.x) + square(g.y));
+            sum_x += g.x;
+            sum_y += g.y;
+        }
+    }
+    return sqrt(square(sum_x) + square(sum_y)) / sum_magnitude;
+}
+
 Contour *new_contour(Contour *prev, int bin) {
     Contour *n = malloc(sizeof(Contour));
     n->prev = prev;
@@ -191,56 +283,58 @@ ContourPoint * new_contour_point(ContourPoint *prev, int bin, int angle) {
 }
 
 /*
- * Function:  get_bin_number
+ * Function:  arena_contour_point
  * --------------------
- * Returns a bin number provided the index of a 9 element array representing a 3x3 window centered on the given bin
- * number.
- *
- * args:
- *      int bin: the center bin number in the window of interest
- *      int i: the index for the desired bin in the window of interest
- *      int row: the row number of the center bin
- *      int *basebins: pointer to an array containing the bin number for the first bin of each row
- *      int *nbins_in_row: pointer to an array containing the number of bins in each row
+ * Same as new_contour_point with the point allocated from an arena.
  *
  * returns:
- *      int: bin number of the desired bin
- */
-static int get_bin_number(int bin, int i, int row, const int *basebins, const int *nbins_in_row) {
-    double ratio;
-    int next_bin;
-    switch(i) {
-        case 0:
-            ratio = (bin - basebins[row]) / (double) nbins_in_row[row];
-            next_bin = (int) (ratio * nbins_in_row[row - 1] + 0.5)  + basebins[row - 1] - 1;
-            break;
-        case 1:
-            ratio = (bin - basebins[row]) / (double) nbins_in_row[row];
-            next_bin = (int) (ratio * nbins_in_row[row - 1] + 0.5)  + basebins[row - 1];
-            break;
-        case 2:
-            ratio = (bin - basebins[row]) / (double) nbins_in_row[row];
-            next_bin = (int) (ratio * nbins_in_row[row - 1] + 0.5)  + basebins[row - 1] + 1;
-            break;
-        case 3:
-            next_bin = bin - 1;
-            break;
-        case 5:
-            next_bin = bin + 1;
-        case 6:
-            ratio = (bin - basebins[row]) / (double) nbins_in_row[row];
-            next_bin = (int) (ratio * nbins_in_row[row + 1] + 0.5)  + basebins[row + 1] - 1;
-            break;
-        case 7:
-            ratio = (bin - basebins[row]) / (double) nbins_in_row[row];
-            next_bin = (int) (ratio * nbins_in_row[row + 1] + 0.5)  + basebins[row + 1];
-            break;
-        case 8:
-            ratio = (bin - basebins[row]) / (double) nbins_in_row[row];
-            next_bin = (int) (ratio * nbins_in_row[row + 1] + 0.5)  + basebins[row + 1] + 1;
-            break;
+ *      ContourPoint *: the new point or NULL if memory could not be allocated, in which case the contour is unchanged
+ */
+static ContourPoint * arena_contour_point(Arena *arena, ContourPoint *prev, int bin, int angle) {
+    ContourPoint *c = arena_alloc(arena, sizeof(ContourPoint));
+    if (c == NULL) return NULL;
+    c->bin = bin;
+    c->angle = angle;
+    c->prev = prev;
+    c->next = NULL;
+    if (prev != NULL)     prev->next = c;
+    return c;
+}
+
+/*
+ * Function:  map_window
+ * --------------------
+ * Selects the width x width window of filtered data centered on a bin of the map, from the 16 bit filtered data when
+ * the map has it and the 8 bit filtered data otherwise. A width of 3 uses the neighbors of the grid and other widths
+ * get_window.
+ */
+static void map_window(const ContourMap *map, int bin, int row, int width, int window[]) {
+    const IsinGrid *grid = map->grid;
+    if (width == 3) {
+        if (map->filtered_data16 != NULL) {
+            grid_window3_u16(grid, bin, row, map->filtered_data16, map->filtered_valid, window);
+        } else {
+            grid_window3_u8(grid, bin, row, map->filtered_data, map->filtered_valid, window);
+        }
+    } else if (map->filtered_data16 != NULL) {
+        get_window_u16(bin, row, width, map->filtered_data16, map->filtered_valid, grid->n_bins_in_row,
+                       grid->basebins, window);
+    } else {
+        get_window_u8(bin, row, width, map->filtered_data, map->filtered_valid, grid->n_bins_in_row, grid->basebins,
+                      window);
     }
-    return next_bin;
+}
+
+/*
+ * Function:  claimed
+ * --------------------
+ * Checks if a bin is already part of a contour. Bins outside the rows the map is limited to belong to another band
+ * that may be traced at the same time, so they are never treated as claimed, which keeps the result independent of
+ * the order the bands are traced in.
+ */
+static inline int claimed(const ContourMap *map, int bin, int row) {
+    if (row < map->row_begin || row >= map->row_end) return 0;
+    return bitset_get_atomic(map->in_contour, bin);
 }
 
 /*
@@ -255,24 +349,21 @@ static int get_bin_number(int bin, int i, int row, const int *basebins, const in
  *
  * args:
  *      ContourPoint *prev: the last edge pixel in the current contour
- *      int *data: pointer to a boolean array representing the pixels status as an edge pixel
+ *      ContourMap *map: the edge pixels and filtered data of the map
  *      int row: the row of the last edge pixel in the current contour
- *      int *basebins: pointer to an array containing the index of the first bin of each row
- *      int *nbins_in_row: pointer to an array containing the number of bins in each row
  *
  * returns:
- *      ContourPoint *: the selected point to add to the contour. Pointer will be NULL if there is no previously
- *      identified edge pixel to add to the contour.
+ *      ContourPoint *: the selected point to add to the contour, allocated from map->arena. Pointer will be NULL if
+ *      there is no previously identified edge pixel to add to the contour.
  */
-ContourPoint * find_best_front(ContourPoint *prev, const int *data,  int row, const int *basebins, const int *nbins_in_row) {
-    int edge_window[9];
-    get_window(prev->bin, row, 3, data, nbins_in_row, basebins, edge_window);
+ContourPoint * find_best_front(ContourPoint *prev, const ContourMap *map, int row) {
     int next_bin = -1;
     int min_dtheta = 180;
     int next_angle;
     for (int i = 0; i < 9; i++) {
         int dtheta = 180;
-        if (i != 4 && edge_window[i]) {
+        int bin = grid_neighbor(map->grid, prev->bin, row, i);
+        if (i != 4 && bitset_get(map->edges, bin)) {
             if (prev->prev == NULL) {
                 dtheta = 0;
             } else {
@@ -284,80 +375,94 @@ ContourPoint * find_best_front(ContourPoint *prev, const int *data,  int row, co
             if (dtheta == 0 || dtheta < min_dtheta) {
                 min_dtheta = dtheta;
                 next_angle = ANGLES[i];
-                next_bin = get_bin_number(prev->bin, i, row, basebins, nbins_in_row);
+                next_bin = bin;
             }
         }
     }
 
     if (next_bin != -1 && (prev->prev == NULL || !turn_too_sharp(prev, next_angle))) {
-        return new_contour_point(prev, next_bin, next_angle);
+        return arena_contour_point(map->arena, prev, next_bin, next_angle);
     } else {
         return NULL;
     }
 }
 
 /*
- * Function:  find_best_front
+ * Function:  follow_contour
  * --------------------
- * Recursive function for growing the contour using the previously detected edge pixels and gradients.
+ * Grows the contour using the previously detected edge pixels and gradients until no point can be added or the
+ * contour reaches the edge of the map or of the rows the map is limited to. The points are allocated from map->arena.
+ * If the contour stops because its next point is outside the rows of the map, that point is not added and its bin
+ * and row are written to map->exit_bin and map->exit_row, which are otherwise left unchanged.
  *
  * args:
  *      ContourPoint *prev: the last edge pixel in the current contour
- *      int *data: pointer to a boolean array representing the pixels status as an edge pixel
- *      int *filtered_data: point to an array containing the data that resulted from applying a median filter to
- *      the original data
+ *      ContourMap *map: the edge pixels and filtered data of the map along with the pixels already in a contour
  *      int row: the row of the last edge pixel in the current contour
- *      int nrows: the number of rows in the binning scheme
- *      int *basebins: pointer to an array containing the index of the first bin of each row
- *      int *nbins_in_row: pointer to an array containing the number of bins in each row
  *
  * returns:
  *      int: the number of points in the contour that are contained in the segment of the contour starting with
  *      the current point
  */
-int follow_contour(ContourPoint *prev, const int *data, const int *filtered_data, int *pixel_in_contour, int row, int nrows, const int *basebins, const int *nbins_in_row) {
-    ContourPoint *next_point;
-    next_point = find_best_front(prev, data, row, basebins,nbins_in_row);
+int follow_contour(ContourPoint *prev, ContourMap *map, int row) {
+    const IsinGrid *grid = map->grid;
+    const int *basebins = grid->basebins;
+    int nrows = grid->nrows;
     int count = 1;
-    double ratio = 0;
-    int max_bin;
-    if (next_point == NULL) {
-        int outer_window[25];
-        get_window(prev->bin, row, 5, filtered_data, nbins_in_row, basebins, outer_window);
-        double ratio = gradient_ratio(outer_window);
-        if (ratio > 0.7) {
-            int bin_window[9];
-            double max_product = -1;
-            int max_idx = -1;
-            get_window(prev->bin, row, 3, filtered_data, nbins_in_row, basebins, bin_window);
-            Vector gradient0 = gradient(bin_window);
-            for (int i = 0; i < 3; i++) {
-                for (int j = 0; j < 3; j++) {
-                    if (i != 1 || j != 1) {
-                        int bin = get_bin_number(prev->bin, i * 3 + j, row,basebins, nbins_in_row);
-                        if (!pixel_in_contour[bin]) {
-                            get_window(bin, row + j - 1, 3, filtered_data, nbins_in_row, basebins, bin_window);
-                            Vector gradient1 = gradient(bin_window);
-                            double product = dot(gradient0, gradient1);
-                            if (product > max_product) {
-                                max_product = product;
-                                max_idx = i * 3 + j;
-                                max_bin = bin;
+    while (1) {
+        ContourPoint *next_point = find_best_front(prev, map, row);
+        int max_bin;
+        if (next_point == NULL) {
+            double ratio;
+            if (map->gradients != NULL) {
+                ratio = field_gradient_ratio(map, prev->bin, row);
+            } else {
+                int outer_window[25];
+                map_window(map, prev->bin, row, 5, outer_window);
+                ratio = gradient_ratio(outer_window);
+            }
+            if (ratio > 0.7) {
+                int bin_window[9];
+                double max_product = -1;
+                int max_idx = -1;
+                Vector gradient0;
+                if (map->gradients != NULL) {
+                    gradient0 = grid_gradient(map, prev->bin, row);
+                } else {
+                    map_window(map, prev->bin, row, 3, bin_window);
+                    gradient0 = gradient(bin_window);
+                }
+                for (int i = 0; i < 3; i++) {
+                    for (int j = 0; j < 3; j++) {
+                        if (i != 1 || j != 1) {
+                            int bin = grid_neighbor(grid, prev->bin, row, i * 3 + j);
+                            if (!claimed(map, bin, row + i - 1)) {
+                                Vector gradient1;
+                                if (map->gradients != NULL) {
+                                    gradient1 = grid_gradient(map, bin, row + i - 1);
+                                } else {
+                                    map_window(map, bin, row + i - 1, 3, bin_window);
+                                    gradient1 = gradient(bin_window);
+                                }
+                                double product = dot(gradient0, gradient1);
+                                if (product > max_product) {
+                                    max_product = product;
+                                    max_idx = i * 3 + j;
+                                    max_bin = bin;
+                                }
                             }
                         }
                     }
-
                 }
-            }
-            if (max_product > 0) {
-                next_point = new_contour_point(prev, max_bin, ANGLES[max_idx]);
+                if (max_product > 0) {
+                    next_point = arena_contour_point(map->arena, prev, max_bin, ANGLES[max_idx]);
+                }
             }
         }
-    }
 
-    if (next_point != NULL && !pixel_in_contour[next_point->bin]) {
+        if (next_point == NULL) break;
+
         int next_row;
-        pixel_in_contour[next_point->bin] = 1;
         switch(next_point->angle) {
             case 0:
             case 180:
@@ -375,14 +480,28 @@ int follow_contour(ContourPoint *prev, const int *data, const int *filtered_data
         }
 
         /*
-         * If the next point is too close to the edge of the map, we still need to increment the counter, but we don't
-         * want to try following the contour any further
+         * A point in the rows of another band ends the contour in this band. The bin is kept so the contour can be
+         * joined with the contour of the other band that contains it.
+         */
+        if (next_row < map->row_begin || next_row >= map->row_end) {
+            prev->next = NULL;
+            map->exit_bin = next_point->bin;
+            map->exit_row = next_row;
+            break;
+        }
+        if (bitset_get_atomic(map->in_contour, next_point->bin)) break;
+        bitset_set_atomic(map->in_contour, next_point->bin);
+        count++;
+
+        /*
+         * If the next point is too close to the edge of the map, it is still counted, but we don't want to try
+         * following the contour any further
          */
         if (next_row < nrows - 2 && next_row > 1 && next_point->bin > basebins[next_row] + 1 && next_point->bin < basebins[next_row + 1] - 2) {
-            count += follow_contour(next_point, data, filtered_data, pixel_in_contour, next_row, nrows, basebins,
-                                    nbins_in_row);
+            prev = next_point;
+            row = next_row;
         } else {
-            count++;
+            break;
         }
     }
 
@@ -406,40 +525,634 @@ int follow_contour(ContourPoint *prev, const int *data, const int *filtered_data
  *
  */
 void contour(int *data, int *filtered_data, int *out_data, int nbins, int nrows, const int *nbins_in_row, const int *basebins) {
-    int *pixel_in_contour = malloc(sizeof(int) * nbins);
-    for (int i = 0; i < nbins; i++) {
-        pixel_in_contour[i] = filtered_data[i] == FILL_VALUE ? 1 : 0;
-    }
-    Contour *head = NULL;
-    Contour *current = NULL;
-    for (int i = 2; i < nrows - 2; i++) {
-        for (int j = basebins[i] + 2; j < basebins[i] + nbins_in_row[i] - 2; j++) {
-            if (data[j] && !pixel_in_contour[j]) {
-                pixel_in_contour[j] = 1;
-                ContourPoint * point = new_contour_point(NULL, j, 0);
-                int length = follow_contour(point, data, filtered_data, pixel_in_contour, i, nrows, basebins, nbins_in_row);
-                if (head == NULL) {
-                    current = new_contour(NULL, j);
-                    current->length = length;
-                    current->first_point = point;
-                    head = current;
+    int nwords = bitset_words(nbins);
+    IsinGrid *grid = grid_create(nbins, nrows, nbins_in_row, basebins);
+    uint64_t *edges = calloc(nwords, sizeof(uint64_t));
+    uint64_t *filtered_valid = calloc(nwords, sizeof(uint64_t));
+    uint64_t *in_contour = calloc(nwords, sizeof(uint64_t));
+    uint64_t *fronts = calloc(nwords, sizeof(uint64_t));
+    uint8_t *filtered = malloc(nbins);
+    if (grid != NULL && edges != NULL && filtered_valid != NULL && in_contour != NULL && fronts != NULL &&
+        filtered != NULL) {
+        for (int i = 0; i < nbins; i++) {
+            if (data[i]) bitset_set(edges, i);
+            if (filtered_data[i] != FILL_VALUE) bitset_set(filtered_valid, i);
+            filtered[i] = (uint8_t) filtered_data[i];
+        }
+        ContourMap map = {.grid = grid, .edges = edges, .filtered_data = filtered, .filtered_valid = filtered_valid,
+                          .in_contour = in_contour, .row_begin = 0, .row_end = nrows};
+        trace_contours(&map, fronts);
+        for (int i = 0; i < nbins; i++) {
+            if (bitset_get(fronts, i)) out_data[i] = 1;
+        }
+    }
+    grid_destroy(grid);
+    free(edges);
+    free(filtered_valid);
+    free(in_contour);
+    free(fronts);
+    free(filtered);
+}
+
+/*
+ * Function:  trace_contours
+ * --------------------
+ * Creates and extends contours like contour using the edge pixels and filtered data of the map. Bins without
+ * filtered data are never added to a contour. The whole map is traced as a single band on the calling thread.
+ *
+ * args:
+ *      ContourMap *map: the edge pixels and filtered data of the map. The pixels already in a contour are written to
+ *      map->in_contour, which does not need to be initialized
+ *      uint64_t *fronts: pointer to a bitset that every pixel of a contour long enough to be a front is added to
+ */
+void trace_contours(ContourMap *map, uint64_t *fronts) {
+    ContourBands *bands = contour_bands_create(map->grid, 0);
+    if (bands == NULL) return;
+    contour_bands_begin(bands, map);
+    contour_bands_trace(bands, 0, map, fronts);
+    contour_bands_merge(bands, map, fronts);
+    contour_bands_destroy(bands);
+}
+
+/*
+ * A contour traced within one band while the other bands are traced, which is checked against the contours of the
+ * bands before it when the bands are merged.
+ */
+typedef struct contour_segment {
+    int first;          // index of the first bin of the segment in the bins of its band
+    int count;          // number of bins in the segment, including a last bin that was already in a contour
+    int length;         // length of the segment as counted by follow_contour, which is the number of bins it claimed
+    int row;            // row of the first bin
+    int row_min;        // first row with a bin of the segment
+    int row_max;        // last row with a bin of the segment
+    int row_last;       // row of the last bin
+    int exited;         // 1 if the segment stopped at the edge of its band
+} ContourSegment;
+
+struct contour_band {
+    int row_begin;
+    int row_end;
+    Arena *arena;
+    int *bins;
+    int16_t *angles;    // angle of each bin from the bin before it in its segment
+    int nbins;
+    int bins_capacity;
+    ContourSegment *segments;
+    int nsegments;
+    int segments_capacity;
+    int complete;       // 0 if a segment could not be kept, in which case the band is traced again by the merge
+};
+
+struct contour_bands {
+    const IsinGrid *grid;
+    int nbands;
+    struct contour_band *bands;
+    uint64_t *differ;   // bins claimed either by the segments the merge has gone through or by the merged contours
+    int *row_differ;    // number of bins of each row in differ
+    Arena *arena;       // points of the contours traced by the merge
+    ContourStats stats; // contours of the merged map
+};
+
+/*
+ * Function:  contour_bands_create
+ * --------------------
+ * Divides the rows of a binning scheme into bands that can be traced independently of each other. The bands only
+ * depend on the grid and the band height, and the merge gives the contours a serial scan of the map would, so the
+ * fronts found are the same whatever the number of threads tracing the bands.
+ *
+ * args:
+ *      IsinGrid *grid: the grid of the binning scheme
+ *      int band_rows: the number of rows in each band. 0 makes the whole map a single band, which needs no merge.
+ *      Bands have at least 4 rows
+ *
+ * returns:
+ *      ContourBands *: the new bands or NULL if memory could not be allocated
+ */
+ContourBands * contour_bands_create(const IsinGrid *grid, int band_rows) {
+    int nrows = grid->nrows;
+    if (band_rows <= 0 || band_rows > nrows) band_rows = nrows;
+    if (band_rows < 4) band_rows = 4;
+    ContourBands *bands = calloc(1, sizeof(ContourBands));
+    if (bands == NULL) return NULL;
+    bands->grid = grid;
+    bands->nbands = (nrows + band_rows - 1) / band_rows;
+    bands->bands = calloc(bands->nbands, sizeof(struct contour_band));
+    if (bands->bands == NULL) {
+        contour_bands_destroy(bands);
+        return NULL;
+    }
+    if (bands->nbands > 1) {
+        bands->differ = malloc(bitset_words(grid->nbins) * sizeof(uint64_t));
+        bands->row_differ = malloc(nrows * sizeof(int));
+        bands->arena = arena_create(CONTOUR_ARENA_BLOCK_SIZE);
+        if (bands->differ == NULL || bands->row_differ == NULL || bands->arena == NULL) {
+            contour_bands_destroy(bands);
+            return NULL;
+        }
+    }
+    for (int b = 0; b < bands->nbands; b++) {
+        struct contour_band *band = &bands->bands[b];
+        band->row_begin = b * band_rows;
+        band->row_end = band->row_begin + band_rows < nrows ? band->row_begin + band_rows : nrows;
+        band->arena = arena_create(CONTOUR_ARENA_BLOCK_SIZE);
+        if (band->arena == NULL) {
+            contour_bands_destroy(bands);
+            return NULL;
+        }
+    }
+    return bands;
+}
+
+/*
+ * Function:  contour_bands_count
+ * --------------------
+ * Returns the number of bands.
+ */
+int contour_bands_count(const ContourBands *bands) {
+    return bands->nbands;
+}
+
+/*
+ * Function:  contour_bands_begin
+ * --------------------
+ * Prepares the bands and map->in_contour for tracing a new image. Must be called before the bands are traced.
+ */
+void contour_bands_begin(ContourBands *bands, ContourMap *map) {
+    const IsinGrid *grid = bands->grid;
+    for (int i = 0; i < bitset_words(grid->nbins); i++) {
+        map->in_contour[i] = ~map->filtered_valid[i];
+    }
+    bands->stats = (ContourStats) {0, 0, 0};
+    for (int b = 0; b < bands->nbands; b++) {
+        struct contour_band *band = &bands->bands[b];
+        band->nbins = 0;
+        band->nsegments = 0;
+        band->complete = 1;
+    }
+}
+
+/*
+ * Function:  point_row
+ * --------------------
+ * Finds the row of the point of a contour that follows a point in the given row, which is that row or the one above
+ * or below it.
+ */
+static inline int point_row(const IsinGrid *grid, int bin, int row) {
+    if (bin < grid->basebins[row]) return row - 1;
+    if (row + 1 < grid->nrows && bin >= grid->basebins[row + 1]) return row + 1;
+    return row;
+}
+
+/*
+ * Function:  band_add_segment
+ * --------------------
+ * Keeps a contour traced in a band for the merge step.
+ *
+ * returns:
+ *      int: 1 if the segment was kept, 0 if memory could not be allocated
+ */
+static int band_add_segment(struct contour_band *band, const IsinGrid *grid, ContourPoint *point, int row,
+                            int length, int exited) {
+    int count = 0;
+    for (ContourPoint *p = point; p != NULL; p = p->next) count++;
+    if (band->nsegments == band->segments_capacity) {
+        int capacity = band->segments_capacity > 0 ? 2 * band->segments_capacity : 64;
+        ContourSegment *segments = realloc(band->segments, capacity * sizeof(ContourSegment));
+        if (segments == NULL) return 0;
+        band->segments = segments;
+        band->segments_capacity = capacity;
+    }
+    if (band->nbins + count > band->bins_capacity) {
+        int capacity = band->bins_capacity > 0 ? band->bins_capacity : 1024;
+        while (capacity < band->nbins + count) capacity *= 2;
+        int *bins = realloc(band->bins, capacity * sizeof(int));
+        if (bins == NULL) return 0;
+        band->bins = bins;
+        int16_t *angles = realloc(band->angles, capacity * sizeof(int16_t));
+        if (angles == NULL) return 0;
+        band->angles = angles;
+        band->bins_capacity = capacity;
+    }
+    ContourSegment *segment = &band->segments[band->nsegments++];
+    segment->first = band->nbins;
+    segment->count = count;
+    segment->length = length;
+    segment->row = row;
+    segment->row_min = row;
+    segment->row_max = row;
+    segment->exited = exited;
+    for (; point != NULL; point = point->next) {
+        row = point_row(grid, point->bin, row);
+        if (row < segment->row_min) segment->row_min = row;
+        if (row > segment->row_max) segment->row_max = row;
+        band->bins[band->nbins] = point->bin;
+        band->angles[band->nbins++] = (int16_t) point->angle;
+    }
+    segment->row_last = row;
+    return 1;
+}
+
+/*
+ * Function:  contour_bands_trace
+ * --------------------
+ * Traces the contours that start in one band without leaving its rows. With a single band these are the contours of
+ * the map, and those long enough are added to the fronts. With several bands every contour is kept for
+ * contour_bands_merge, which decides which of them are contours of the map. Different bands can be traced on
+ * different threads at the same time.
+ *
+ * args:
+ *      ContourBands *bands: the bands of the map
+ *      int b: the index of the band to trace
+ *      ContourMap *map: the edge pixels and filtered data of the map
+ *      uint64_t *fronts: pointer to a bitset that every pixel of a contour long enough to be a front is added to
+ */
+void contour_bands_trace(ContourBands *bands, int b, const ContourMap *map, uint64_t *fronts) {
+    const IsinGrid *grid = bands->grid;
+    struct contour_band *band = &bands->bands[b];
+    int nrows = grid->nrows;
+    const int *nbins_in_row = grid->n_bins_in_row;
+    const int *basebins = grid->basebins;
+    ContourMap band_map = *map;
+    band_map.arena = band->arena;
+    band_map.row_begin = band->row_begin;
+    band_map.row_end = band->row_end;
+
+    int row_begin = band->row_begin > 2 ? band->row_begin : 2;
+    int row_end = band->row_end < nrows - 2 ? band->row_end : nrows - 2;
+    for (int i = row_begin; i < row_end; i++) {
+        /*
+         * Only the edge pixels are visited, skipping whole words of the bitset, so stretches without edges cost
+         * next to nothing
+         */
+        int last = basebins[i] + nbins_in_row[i] - 2;
+        for (int j = bitset_next_set(map->edges, basebins[i] + 2, last); j < last;
+             j = bitset_next_set(map->edges, j + 1, last)) {
+            if (!bitset_get_atomic(map->in_contour, j)) {
+                bitset_set_atomic(map->in_contour, j);
+                ContourPoint *point = arena_contour_point(band->arena, NULL, j, 0);
+                if (point == NULL) {
+                    band->complete = 0;
+                    continue;
+                }
+                band_map.exit_bin = -1;
+                int length = follow_contour(point, &band_map, i);
+                if (bands->nbands > 1) {
+                    if (!band_add_segment(band, grid, point, i, length, band_map.exit_bin >= 0)) band->complete = 0;
                 } else {
-                    current = new_contour(current, j);
-                    current->length = length;
-                    current->first_point = point;
+                    bands->stats.started++;
+                    bands->stats.points += length;
+                    if (length >= 15) {
+                        bands->stats.kept++;
+                        for (; point != NULL; point = point->next) {
+                            bitset_set(fronts, point->bin);
+                        }
+                    }
+                }
+                arena_reset(band->arena);
+            }
+        }
+    }
+}
+
+/*
+ * Function:  flip_claimed
+ * --------------------
+ * Flips the bins of bands->differ claimed by a contour in only one of the two claimed states of the merge and keeps
+ * the count of each row up to date. Only the first length bins of a contour are claimed by it.
+ */
+static void flip_claimed(ContourBands *bands, const int *bins, int length, int row) {
+    for (int k = 0; k < length; k++) {
+        row = point_row(bands->grid, bins[k], row);
+        bitset_flip(bands->differ, bins[k]);
+        bands->row_differ[row] += bitset_get(bands->differ, bins[k]) ? 1 : -1;
+    }
+}
+
+/*
+ * Function:  any_set
+ * --------------------
+ * Checks if any of the 3 bins starting at bin first is set, ignoring bins before the first or after the last bin of
+ * the map.
+ */
+static inline int any_set(const uint64_t *set, int first, int nbins) {
+    int begin = first > 0 ? first : 0;
+    int end = first + 3 < nbins ? first + 3 : nbins;
+    return end > begin && bitset_bits(set, begin, end - begin) != 0;
+}
+
+/*
+ * Function:  segment_is_contour
+ * --------------------
+ * Checks if a segment traced in a band is the contour a serial scan of the map gives from the same bin, or for a
+ * segment that stopped at the edge of its band, the start of that contour. The segment only depends on which bins
+ * around its bins were already in a contour. Within the band these were the bins claimed by the segments before it,
+ * and outside of it none were, so it is the contour of the map if none of the bins around it differ between the
+ * segments and the merged contours and none outside the band are in a merged contour. The bins around the last bin
+ * of a segment that stopped at the edge of its band do not matter, as the merge follows the contour on from there.
+ *
+ * args:
+ *      ContourBands *bands: the bands being merged
+ *      struct contour_band *band: the band of the segment
+ *      ContourSegment *segment: the segment
+ *      uint64_t *in_contour: the bins claimed by the merged contours
+ *
+ * returns:
+ *      int: 1 if the segment is the contour of the map or its start, 0 if the contour has to be traced again
+ */
+static int segment_is_contour(const ContourBands *bands, const struct contour_band *band,
+                              const ContourSegment *segment, const uint64_t *in_contour) {
+    const IsinGrid *grid = bands->grid;
+    int inside = segment->row_min > band->row_begin && segment->row_max < band->row_end - 1;
+    if (inside) {
+        int clean = 1;
+        for (int r = segment->row_min - 1; clean && r <= segment->row_max + 1; r++) {
+            if (bands->row_differ[r] != 0) clean = 0;
+        }
+        if (clean) return 1;
+    }
+
+    int row = segment->row;
+    int end = segment->first + segment->count - segment->exited;
+    for (int k = segment->first; k < end; k++) {
+        int bin = band->bins[k];
+        row = point_row(grid, bin, row);
+        for (int i = 0; i < 9; i += 3) {
+            int r = row + i / 3 - 1;
+            const uint64_t *set = inside || (r >= band->row_begin && r < band->row_end) ? bands->differ : in_contour;
+            if (any_set(set, grid_neighbor(grid, bin, row, i), grid->nbins)) return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Function:  add_contour
+ * --------------------
+ * Counts a contour of the merged map and adds its bins to the fronts if it is long enough.
+ */
+static void add_contour(ContourBands *bands, const int *bins, int count, int length, uint64_t *fronts) {
+    bands->stats.started++;
+    bands->stats.points += length;
+    if (length >= 15) {
+        bands->stats.kept++;
+        for (int k = 0; k < count; k++) bitset_set(fronts, bins[k]);
+    }
+}
+
+/*
+ * Function:  follow_merged
+ * --------------------
+ * Follows a contour of the merged map on from its last point on the calling thread, claiming the bins it adds in
+ * map->in_contour, and adds the whole contour like add_contour.
+ *
+ * args:
+ *      ContourBands *bands: the bands being merged
+ *      ContourMap *map: the merged map
+ *      ContourPoint *first: the first point of the contour
+ *      ContourPoint *last: the last point of the contour, which is followed on from
+ *      int row: the row of the last point
+ *      int length: the number of bins already claimed by the contour
+ *      uint64_t *fronts: pointer to a bitset that every pixel of a contour long enough to be a front is added to
+ */
+static void follow_merged(ContourBands *bands, ContourMap *map, ContourPoint *first, ContourPoint *last, int row,
+                          int length, uint64_t *fronts) {
+    int added = follow_contour(last, map, row) - 1;
+    int count = 0, known = 0;
+    for (ContourPoint *p = first; p != NULL; p = p->next) {
+        count++;
+        if (p == last) known = count;
+    }
+    int *bins = arena_alloc(map->arena, count * sizeof(int));
+    if (bins != NULL) {
+        count = 0;
+        for (ContourPoint *p = first; p != NULL; p = p->next) bins[count++] = p->bin;
+        flip_claimed(bands, bins + known, added, row);
+        add_contour(bands, bins, count, length + added, fronts);
+    }
+    arena_reset(map->arena);
+}
+
+/*
+ * Function:  merge_start
+ * --------------------
+ * Takes the contour of the merged map starting from an edge pixel that was not in a contour when the scan reached
+ * it. The contour is the segment the band traced from the same bin when that is the contour, and is followed on
+ * from the end of the segment when the segment is its start. Otherwise it is traced again.
+ */
+static void merge_start(ContourBands *bands, const struct contour_band *band, const ContourSegment *segment,
+                        ContourMap *merged, int bin, int row, uint64_t *fronts) {
+    if (segment != NULL && segment_is_contour(bands, band, segment, merged->in_contour)) {
+        const int *bins = band->bins + segment->first;
+        for (int k = 0; k < segment->length; k++) bitset_set(merged->in_contour, bins[k]);
+        if (!segment->exited) {
+            add_contour(bands, bins, segment->count, segment->length, fronts);
+            return;
+        }
+        ContourPoint *first = NULL, *last = NULL;
+        for (int k = 0; k < segment->count; k++) {
+            last = arena_contour_point(merged->arena, last, bins[k], band->angles[segment->first + k]);
+            if (last == NULL) break;
+            if (first == NULL) first = last;
+        }
+        if (last != NULL) {
+            follow_merged(bands, merged, first, last, segment->row_last, segment->length, fronts);
+        } else {
+            arena_reset(merged->arena);
+        }
+        return;
+    }
+    bitset_set(merged->in_contour, bin);
+    ContourPoint *point = arena_contour_point(merged->arena, NULL, bin, 0);
+    if (point != NULL) {
+        bitset_flip(bands->differ, bin);
+        bands->row_differ[row] += bitset_get(bands->differ, bin) ? 1 : -1;
+        follow_merged(bands, merged, point, point, row, 1, fronts);
+    }
+    if (segment != NULL) flip_claimed(bands, band->bins + segment->first, segment->length, segment->row);
+}
+
+/*
+ * Function:  contour_bands_merge
+ * --------------------
+ * Finds the contours of the map from the segments traced in the bands, giving the same contours as a serial scan of
+ * the map. The bands are gone through in order on a single thread after every band has been traced. A contour of the
+ * map is taken from the segment the band traced from the same bin when that segment is the contour, which is the case
+ * unless bins next to it were claimed differently by the merged contours than by the segments. The contours crossing
+ * into another band are followed on from the end of their segment. The edge pixels where a contour of the map starts
+ * are those where a segment starts, unless they are already in a merged contour, and those only the segments had
+ * claimed, so only the bins in bands->differ are scanned between the segments. Nothing is done for a single band,
+ * whose contours are already those of the map.
+ *
+ * args:
+ *      ContourBands *bands: the traced bands of the map
+ *      ContourMap *map: the map the bands were traced from. map->in_contour is reset to the bins claimed by the
+ *      contours of the map
+ *      uint64_t *fronts: pointer to a bitset that every pixel of a contour long enough to be a front is added to
+ */
+void contour_bands_merge(ContourBands *bands, ContourMap *map, uint64_t *fronts) {
+    if (bands->nbands == 1) return;
+    const IsinGrid *grid = bands->grid;
+    const int *nbins_in_row = grid->n_bins_in_row;
+    const int *basebins = grid->basebins;
+    int nrows = grid->nrows;
+    for (int i = 0; i < bitset_words(grid->nbins); i++) {
+        map->in_contour[i] = ~map->filtered_valid[i];
+        bands->differ[i] = 0;
+    }
+    memset(bands->row_differ, 0, nrows * sizeof(int));
+    ContourMap merged = *map;
+    merged.arena = bands->arena;
+    merged.row_begin = 0;
+    merged.row_end = nrows;
+
+    for (int b = 0; b < bands->nbands; b++) {
+        struct contour_band *band = &bands->bands[b];
+        int row_begin = band->row_begin > 2 ? band->row_begin : 2;
+        int row_end = band->row_end < nrows - 2 ? band->row_end : nrows - 2;
+        if (row_begin >= row_end) continue;
+        if (!band->complete) {
+            for (int i = row_begin; i < row_end; i++) {
+                int last = basebins[i] + nbins_in_row[i] - 2;
+                for (int j = bitset_next_set(map->edges, basebins[i] + 2, last); j < last;
+                     j = bitset_next_set(map->edges, j + 1, last)) {
+                    if (!bitset_get(map->in_contour, j)) merge_start(bands, band, NULL, &merged, j, i, fronts);
+                }
+            }
+            continue;
+        }
+
+        int end = basebins[row_end - 1] + nbins_in_row[row_end - 1];
+        int row = row_begin;
+        int j = basebins[row_begin];
+        for (int s = 0; s <= band->nsegments; s++) {
+            const ContourSegment *segment = s < band->nsegments ? &band->segments[s] : NULL;
+            int next = segment != NULL ? band->bins[segment->first] : end;
+            for (j = bitset_next_set(bands->differ, j, next); j < next; j = bitset_next_set(bands->differ, j + 1, next)) {
+                while (j >= basebins[row] + nbins_in_row[row]) row++;
+                if (bitset_get(map->edges, j) && !bitset_get(map->in_contour, j) && j >= basebins[row] + 2 &&
+                    j < basebins[row] + nbins_in_row[row] - 2) {
+                    merge_start(bands, band, NULL, &merged, j, row, fronts);
                 }
             }
+            if (segment == NULL) break;
+            while (next >= basebins[row] + nbins_in_row[row]) row++;
+            if (!bitset_get(map->in_contour, next)) {
+                merge_start(bands, band, segment, &merged, next, row, fronts);
+            } else {
+                flip_claimed(bands, band->bins + segment->first, segment->length, segment->row);
+            }
+            j = next + 1;
         }
     }
-    free(pixel_in_contour);
-    while (head != NULL) {
-        if (head->length >= 15) {
-            ContourPoint *point = head->first_point;
-            while (point != NULL) {
-                out_data[point->bin] = 1;
-                point = point->next;
+}
+
+/*
+ * Function:  contour_bands_stats
+ * --------------------
+ * Counts the contours of the map since contour_bands_begin. Must be called after contour_bands_merge.
+ *
+ * args:
+ *      ContourBands *bands: the merged bands of the map
+ *      ContourStats *stats: pointer to the output for the counts
+ */
+void contour_bands_stats(const ContourBands *bands, ContourStats *stats) {
+    *stats = bands->stats;
+}
+
+/*
+ * Function:  contour_bands_bytes
+ * --------------------
+ * Returns the number of bytes held by the bands, which grow to fit the contours of the largest image traced.
+ */
+size_t contour_bands_bytes(const ContourBands *bands) {
+    size_t bytes = sizeof(ContourBands) + bands->nbands * sizeof(struct contour_band);
+    if (bands->nbands > 1) {
+        bytes += bitset_words(bands->grid->nbins) * sizeof(uint64_t) + bands->grid->nrows * sizeof(int);
+        bytes += bands->arena->allocated + sizeof(Arena);
+    }
+    for (int b = 0; b < bands->nbands; b++) {
+        const struct contour_band *band = &bands->bands[b];
+        bytes += band->arena->allocated + sizeof(Arena);
+        bytes += (size_t) band->bins_capacity * (sizeof(int) + sizeof(int16_t));
+        bytes += (size_t) band->segments_capacity * sizeof(ContourSegment);
+    }
+    return bytes;
+}
+
+/*
+ * Function:  contour_bands_destroy
+ * --------------------
+ * Frees the bands.
+ */
+void contour_bands_destroy(ContourBands *bands) {
+    if (bands == NULL) return;
+    if (bands->bands != NULL) {
+        for (int b = 0; b < bands->nbands; b++) {
+            struct contour_band *band = &bands->bands[b];
+            arena_destroy(band->arena);
+            free(band->bins);
+            free(band->angles);
+            free(band->segments);
+        }
+    }
+    free(bands->bands);
+    free(bands->differ);
+    free(bands->row_differ);
+    arena_destroy(bands->arena);
+    free(bands);
+}
+
+/*
+ * Function:  trace_contour_rows
+ * --------------------
+ * Traces on the calling thread the contours starting from the edge pixels of rows scan_begin to scan_end - 1 that are
+ * not already in a contour, in the order a scan of the whole map starts them. The contours are followed through rows
+ * map->row_begin to map->row_end - 1 only, so a contour reaching the first or last of these rows is counted as cut
+ * unless that row is the edge of the map: it could have gone on, and the bins around it outside the rows were taken
+ * as not in a contour. Every contour that
+ * is not cut is the contour a scan of the whole map gives, provided map->in_contour holds the bins claimed by the
+ * contours started before it.
+ *
+ * args:
+ *      ContourMap *map: the edge pixels and filtered data of the map. The bins of the traced contours are added to
+ *      map->in_contour, which must already hold the bins without filtered data
+ *      int scan_begin: the first row to start contours from
+ *      int scan_end: the row after the last row to start contours from
+ *      uint64_t *fronts: pointer to a bitset that every pixel of a contour long enough to be a front is added to
+ *
+ * returns:
+ *      int: the number of contours cut
+ */
+int trace_contour_rows(ContourMap *map, int scan_begin, int scan_end, uint64_t *fronts) {
+    const IsinGrid *grid = map->grid;
+    const int *nbins_in_row = grid->n_bins_in_row;
+    const int *basebins = grid->basebins;
+    int ncut = 0;
+    if (scan_begin < 2) scan_begin = 2;
+    if (scan_end > grid->nrows - 2) scan_end = grid->nrows - 2;
+    for (int i = scan_begin; i < scan_end; i++) {
+        int last = basebins[i] + nbins_in_row[i] - 2;
+        for (int j = bitset_next_set(map->edges, basebins[i] + 2, last); j < last;
+             j = bitset_next_set(map->edges, j + 1, last)) {
+            if (bitset_get(map->in_contour, j)) continue;
+            bitset_set(map->in_contour, j);
+            ContourPoint *point = arena_contour_point(map->arena, NULL, j, 0);
+            if (point == NULL) {
+                ncut++;
+                continue;
             }
+            map->exit_bin = -1;
+            int length = follow_contour(point, map, i);
+            int cut = map->exit_bin >= 0;
+            int row = i;
+            for (ContourPoint *p = point; p != NULL; p = p->next) {
+                row = point_row(grid, p->bin, row);
+                if ((row == map->row_begin && row > 0) || (row == map->row_end - 1 && row < grid->nrows - 1)) cut = 1;
+                if (length >= 15) bitset_set(fronts, p->bin);
+            }
+            ncut += cut;
+            arena_reset(map->arena);
         }
-        head = del_contour(head);
     }
-}
\ No newline at end of file
+    return ncut;
+}
@@ -1,5 +1,11 @@
 #ifndef SIED_CONTOUR_H
 #define SIED_CONTOUR_H
+#include <stdint.h>
+#include "grid.h"
+#include "arena.h"
+#include "gradient.h"
+
+#define CONTOUR_ARENA_BLOCK_SIZE 65536
 typedef struct contour_point {
     int bin;
     int angle;
@@ -14,10 +20,56 @@ struct contour {
     int length;
 } typedef Contour;
 
+/*
+ * The inputs of contour following for a whole map along with the pixels that have already been added to a contour
+ * and the arena the points of the contours are allocated from. When gradients is not NULL, the gradients used to
+ * bridge gaps between edge pixels are read from it instead of being computed from the filtered data. Contours are only
+ * followed through rows row_begin to row_end - 1. When filtered_data16 is not NULL, the filtered data is 16 bit and read
+ * from it instead of filtered_data.
+ */
+typedef struct contour_map {
+    const IsinGrid *grid;
+    const uint64_t *edges;
+    const uint8_t *filtered_data;
+    const uint64_t *filtered_valid;
+    uint64_t *in_contour;
+    Arena *arena;
+    const GradientField *gradients;
+    int row_begin;
+    int row_end;
+    int exit_bin;
+    int exit_row;
+    const uint16_t *filtered_data16;
+} ContourMap;
+
+/*
+ * The rows of a map divided into bands that are traced independently and then merged.
+ */
+typedef struct contour_bands ContourBands;
+
+/*
+ * Counts of the contours traced by the bands for one image.
+ */
+typedef struct contour_stats {
+    long started;   // contours started from an edge pixel that was not already in a contour
+    long points;    // points added to contours
+    long kept;      // contours long enough to be fronts
+} ContourStats;
+
 Contour * del_contour(Contour *n);
 double gradient_ratio(const int *window);
 ContourPoint * new_contour_point(ContourPoint *prev, int bin, int angle);
-ContourPoint * find_best_front(ContourPoint *prev, const int *data,  int row, const int *basebins, const int *nbins_in_row);
-int follow_contour(ContourPoint *prev, const int *data, const int *filtered_data, int *pixel_in_contour, int row, int nrows, const int *basebins, const int *nbins_in_row);
+ContourPoint * find_best_front(ContourPoint *prev, const ContourMap *map, int row);
+int follow_contour(ContourPoint *prev, ContourMap *map, int row);
 void contour(int *data, int *filtered_data, int *out_data, int nbins, int nrows, const int *nbins_in_row, const int *basebins);
+void trace_contours(ContourMap *map, uint64_t *fronts);
+int trace_contour_rows(ContourMap *map, int scan_begin, int scan_end, uint64_t *fronts);
+ContourBands * contour_bands_create(const IsinGrid *grid, int band_rows);
+int contour_bands_count(const ContourBands *bands);
+void contour_bands_begin(ContourBands *bands, ContourMap *map);
+void contour_bands_trace(ContourBands *bands, int b, const ContourMap *map, uint64_t *fronts);
+void contour_bands_merge(ContourBands *bands, ContourMap *map, uint64_t *fronts);
+void contour_bands_stats(const ContourBands *bands, ContourStats *stats);
+size_t contour_bands_bytes(const ContourBands *bands);
+void contour_bands_destroy(ContourBands *bands);
 #endif //SIED_CONTOUR_H
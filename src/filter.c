@@ -1,10 +1,20 @@
 /*
-* Functions for applying the median filter to an array of bins using sliding 3x3 window
+* Functions for applying the median filter to an array of bins. The 3x3 kernel finds the median of each window with a
+* sorting network, which on x86 runs on whole spans of aligned bins with SSE2 or AVX2 for 8 bit data and SSE4.1 or
+* AVX2 for 16 bit data when the processor has them. Larger kernels use a histogram that slides along each row.
 */
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include "filter.h"
+#include "grid.h"
 #include "helpers.h"
+#include "bitset.h"
 #include "cayula.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIED_X86_SIMD
+#endif
 
 #define BIN_SORT(a,b) { if ((a)>(b)) BIN_SWAP((a),(b)); }
 #define BIN_SWAP(a,b) { int temp=(a);(a)=(b);(b)=temp; }
@@ -95,6 +105,26 @@ static int medianN(int * p, int n_invalid) {
  *      int *basebins: pointer to an array containing the bin number of the first bin in each row
  */
 void median_filter(int *data, int *filtered_data, int nbins, int nrows, int *nbins_in_row, int *basebins) {
+    IsinGrid *grid = grid_create(nbins, nrows, nbins_in_row, basebins);
+    if (grid == NULL) return;
+    median_filter_grid(grid, data, filtered_data);
+    grid_destroy(grid);
+}
+
+/*
+ * Function:  median_filter_grid
+ * --------------------
+ * Applies the median filter of median_filter using the precomputed neighbors of the grid.
+ *
+ * args:
+ *      IsinGrid *grid: the grid of the binning scheme
+ *      int *data: pointer to array containing the data to be filtered
+ *      int *filtered_data: pointer to output array
+ */
+void median_filter_grid(const IsinGrid *grid, const int *data, int *filtered_data) {
+    int nrows = grid->nrows;
+    const int *nbins_in_row = grid->n_bins_in_row;
+    const int *basebins = grid->basebins;
     int last_row = nrows - 1;
     /*
      * Fill in the first and last row with fill values. Then iterate through the remaining rows while filling the
@@ -111,9 +141,589 @@ void median_filter(int *data, int *filtered_data, int nbins, int nrows, int *nbi
                 filtered_data[j] = FILL_VALUE;
             } else {
                 int window[9];
-                int n_invalid = get_window(j, i, 3, data, nbins_in_row, basebins, window);
+                int n_invalid = grid_window3(grid, j, i, data, window);
                 filtered_data[j] = n_invalid == 0 ? median9(window) : medianN(window, n_invalid);
             }
         }
     }
-}
\ No newline at end of file
+}
+
+/*
+ * Runs the median9 network on n adjacent bins of a span where the rows above and below are aligned with the row of the
+ * span, writing the median of the 3x3 window of bin k to out[k]. up, mid and down point at the bins of each row that
+ * are in the same column of the window as the first bin. Returns the number of bins that were filtered, which may be
+ * less than n when the remainder is too short for the vector width.
+ */
+typedef int (*Median9Span)(const uint8_t *up, const uint8_t *mid, const uint8_t *down, uint8_t *out, int n);
+typedef int (*Median9SpanU16)(const uint16_t *up, const uint16_t *mid, const uint16_t *down, uint16_t *out, int n);
+
+#ifdef SIED_X86_SIMD
+#define VEC_SORT(min, max, a, b) { __typeof__(a) t = (a); (a) = min((a), (b)); (b) = max(t, (b)); }
+
+/*
+ * Same network as median9, on every byte of the vectors at once.
+ */
+#define VEC_MEDIAN9(min, max, p) \
+    VEC_SORT(min, max, p[1], p[2]); VEC_SORT(min, max, p[4], p[5]); VEC_SORT(min, max, p[7], p[8]); \
+    VEC_SORT(min, max, p[0], p[1]); VEC_SORT(min, max, p[3], p[4]); VEC_SORT(min, max, p[6], p[7]); \
+    VEC_SORT(min, max, p[1], p[2]); VEC_SORT(min, max, p[4], p[5]); VEC_SORT(min, max, p[7], p[8]); \
+    VEC_SORT(min, max, p[0], p[3]); VEC_SORT(min, max, p[5], p[8]); VEC_SORT(min, max, p[4], p[7]); \
+    VEC_SORT(min, max, p[3], p[6]); VEC_SORT(min, max, p[1], p[4]); VEC_SORT(min, max, p[2], p[5]); \
+    VEC_SORT(min, max, p[4], p[7]); VEC_SORT(min, max, p[4], p[2]); VEC_SORT(min, max, p[6], p[4]); \
+    VEC_SORT(min, max, p[4], p[2]);
+
+__attribute__((target("sse2")))
+static int median9_span_sse2(const uint8_t *up, const uint8_t *mid, const uint8_t *down, uint8_t *out, int n) {
+    const uint8_t *rows[3] = {up, mid, down};
+    int k = 0;
+    for (; k + 16 <= n; k += 16) {
+        __m128i p[9];
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                p[i * 3 + j] = _mm_loadu_si128((const __m128i *) (rows[i] + k + j - 1));
+            }
+        }
+        VEC_MEDIAN9(_mm_min_epu8, _mm_max_epu8, p)
+        _mm_storeu_si128((__m128i *) (out + k), p[4]);
+    }
+    return k;
+}
+
+__attribute__((target("avx2")))
+static int median9_span_avx2(const uint8_t *up, const uint8_t *mid, const uint8_t *down, uint8_t *out, int n) {
+    const uint8_t *rows[3] = {up, mid, down};
+    int k = 0;
+    for (; k + 32 <= n; k += 32) {
+        __m256i p[9];
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                p[i * 3 + j] = _mm256_loadu_si256((const __m256i *) (rows[i] + k + j - 1));
+            }
+        }
+        VEC_MEDIAN9(_mm256_min_epu8, _mm256_max_epu8, p)
+        _mm256_storeu_si256((__m256i *) (out + k), p[4]);
+    }
+    return k + median9_span_sse2(up + k, mid + k, down + k, out + k, n - k);
+}
+
+__attribute__((target("sse4.1")))
+static int median9_span_u16_sse41(const uint16_t *up, const uint16_t *mid, const uint16_t *down, uint16_t *out, int n) {
+    const uint16_t *rows[3] = {up, mid, down};
+    int k = 0;
+    for (; k + 8 <= n; k += 8) {
+        __m128i p[9];
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                p[i * 3 + j] = _mm_loadu_si128((const __m128i *) (rows[i] + k + j - 1));
+            }
+        }
+        VEC_MEDIAN9(_mm_min_epu16, _mm_max_epu16, p)
+        _mm_storeu_si128((__m128i *) (out + k), p[4]);
+    }
+    return k;
+}
+
+__attribute__((target("avx2")))
+static int median9_span_u16_avx2(const uint16_t *up, const uint16_t *mid, const uint16_t *down, uint16_t *out, int n) {
+    const uint16_t *rows[3] = {up, mid, down};
+    int k = 0;
+    for (; k + 16 <= n; k += 16) {
+        __m256i p[9];
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                p[i * 3 + j] = _mm256_loadu_si256((const __m256i *) (rows[i] + k + j - 1));
+            }
+        }
+        VEC_MEDIAN9(_mm256_min_epu16, _mm256_max_epu16, p)
+        _mm256_storeu_si256((__m256i *) (out + k), p[4]);
+    }
+    return k + median9_span_u16_sse41(up + k, mid + k, down + k, out + k, n - k);
+}
+#endif
+
+/*
+ * Function:  select_median9_span
+ * --------------------
+ * Picks the widest vector implementation of the median9 network the processor supports.
+ *
+ * returns:
+ *      Median9Span: the implementation to use or NULL if there is none and every bin is filtered on its own
+ */
+static Median9Span select_median9_span(void) {
+#ifdef SIED_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return median9_span_avx2;
+    if (__builtin_cpu_supports("sse2")) return median9_span_sse2;
+#endif
+    return NULL;
+}
+
+/*
+ * Function:  select_median9_span_u16
+ * --------------------
+ * Picks the widest vector implementation of the median9 network on 16 bit values the processor supports.
+ *
+ * returns:
+ *      Median9SpanU16: the implementation to use or NULL if there is none and every bin is filtered on its own
+ */
+static Median9SpanU16 select_median9_span_u16(void) {
+#ifdef SIED_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return median9_span_u16_avx2;
+    if (__builtin_cpu_supports("sse4.1")) return median9_span_u16_sse41;
+#endif
+    return NULL;
+}
+
+/*
+ * Function:  median_filter_bin_u8
+ * --------------------
+ * Applies the median filter to a single bin of 8 bit data, using medianN when the window contains bins without data.
+ */
+static void median_filter_bin_u8(const IsinGrid *grid, int bin, int row, const uint8_t *data, const uint64_t *valid,
+                                 uint8_t *filtered_data, uint64_t *filtered_valid) {
+    if (bitset_get(valid, bin)) {
+        int window[9];
+        int n_invalid = grid_window3_u8(grid, bin, row, data, valid, window);
+        filtered_data[bin] = (uint8_t) (n_invalid == 0 ? median9(window) : medianN(window, n_invalid));
+        bitset_set(filtered_valid, bin);
+    }
+}
+
+/*
+ * Function:  median_filter_row_u8
+ * --------------------
+ * Applies the median filter of median_filter_u8 to bins first to last - 1 of row i, which must be neither the first
+ * nor the last row nor include the first or last bin of the row.
+ */
+static void median_filter_row_u8(const IsinGrid *grid, int i, int first, int last, Median9Span median9_span,
+                                 const uint8_t *data, const uint64_t *valid, uint8_t *filtered_data,
+                                 uint64_t *filtered_valid) {
+    int j = first;
+    while (j < last) {
+        int span_end = j + 1;
+        while (span_end < last && grid->above[span_end] == grid->above[j] && grid->below[span_end] == grid->below[j]) {
+            span_end++;
+        }
+        /*
+         * Windows on the second and last but one rows can reach past either end of the map, so those rows are
+         * filtered one bin at a time
+         */
+        if (median9_span != NULL && i > 1 && i < grid->nrows - 2) {
+            int up = grid_neighbor(grid, j, i, 1);
+            int down = grid_neighbor(grid, j, i, 7);
+            while (j < span_end) {
+                int n = 0;
+                while (j + n < span_end && bitset_all(valid, up + n - 1, 3) && bitset_all(valid, j + n - 1, 3) &&
+                       bitset_all(valid, down + n - 1, 3)) {
+                    n++;
+                }
+                int done = n > 0 ? median9_span(data + up, data + j, data + down, filtered_data + j, n) : 0;
+                bitset_set_range(filtered_valid, j, done);
+                /*
+                 * The end of the run that is too short for the vector code and the bin after the run, which has
+                 * fill values in its window, are filtered one at a time
+                 */
+                int stop = j + n + 1 < span_end ? j + n + 1 : span_end;
+                for (int k = j + done; k < stop; k++) {
+                    median_filter_bin_u8(grid, k, i, data, valid, filtered_data, filtered_valid);
+                }
+                up += stop - j;
+                down += stop - j;
+                j = stop;
+            }
+        } else {
+            for (; j < span_end; j++) {
+                median_filter_bin_u8(grid, j, i, data, valid, filtered_data, filtered_valid);
+            }
+        }
+        j = span_end;
+    }
+}
+
+/*
+ * Function:  median_filter_u8
+ * --------------------
+ * Applies the median filter of median_filter to data stored as 8 bit values with a separate set of valid bins. Bins
+ * that are filled with FILL_VALUE by median_filter are left out of the filtered set of valid bins instead.
+ *
+ * Each row is split into spans of bins whose neighbors in the rows above and below are at a constant offset, which
+ * covers almost all of a row wherever the number of bins changes slowly from row to row. Runs of bins in these spans
+ * whose windows contain only valid bins are filtered with vector instructions when the processor supports them. All
+ * other bins are filtered one at a time. Both give the same result.
+ *
+ * args:
+ *      IsinGrid *grid: the grid of the binning scheme
+ *      uint8_t *data: pointer to array containing the data to be filtered
+ *      uint64_t *valid: pointer to the bitset of bins containing data
+ *      uint8_t *filtered_data: pointer to output array
+ *      uint64_t *filtered_valid: pointer to the output bitset of bins with a filtered value
+ */
+void median_filter_u8(const IsinGrid *grid, const uint8_t *data, const uint64_t *valid, uint8_t *filtered_data,
+                      uint64_t *filtered_valid) {
+    Median9Span median9_span = select_median9_span();
+    memset(filtered_valid, 0, bitset_words(grid->nbins) * sizeof(uint64_t));
+    memset(filtered_data, 0, grid->nbins);
+
+    for (int i = 1; i < grid->nrows - 1; i++) {
+        int first = grid->basebins[i] + 1;
+        int last = grid->basebins[i] + grid->n_bins_in_row[i] - 1;
+        median_filter_row_u8(grid, i, first, last, median9_span, data, valid, filtered_data, filtered_valid);
+    }
+}
+
+/*
+ * Function:  median_filter_spans_u8
+ * --------------------
+ * Applies the median filter of median_filter_u8 to the spans of bins containing data only. Bins outside the spans have
+ * no data and so no filtered value, and rows without data are skipped entirely, so the result is the same as
+ * median_filter_u8 at a cost that follows the amount of data rather than the size of the grid.
+ *
+ * args:
+ *      IsinGrid *grid: the grid of the binning scheme
+ *      ValidSpans *spans: the spans of the bins set in valid
+ *      uint8_t *data: pointer to array containing the data to be filtered
+ *      uint64_t *valid: pointer to the bitset of bins containing data
+ *      uint8_t *filtered_data: pointer to output array
+ *      uint64_t *filtered_valid: pointer to the output bitset of bins with a filtered value
+ */
+void median_filter_spans_u8(const IsinGrid *grid, const ValidSpans *spans, const uint8_t *data,
+                            const uint64_t *valid, uint8_t *filtered_data, uint64_t *filtered_valid) {
+    Median9Span median9_span = select_median9_span();
+    memset(filtered_valid, 0, bitset_words(grid->nbins) * sizeof(uint64_t));
+    memset(filtered_data, 0, grid->nbins);
+
+    for (int i = 1; i < grid->nrows - 1; i++) {
+        int row_first = grid->basebins[i] + 1;
+        int row_last = grid->basebins[i] + grid->n_bins_in_row[i] - 1;
+        for (int k = spans->row_offsets[i]; k < spans->row_offsets[i + 1]; k++) {
+            int first = spans->begin[k] > row_first ? spans->begin[k] : row_first;
+            int last = spans->end[k] < row_last ? spans->end[k] : row_last;
+            median_filter_row_u8(grid, i, first, last, median9_span, data, valid, filtered_data, filtered_valid);
+        }
+    }
+}
+
+/*
+ * Function:  median_filter_bin_u16
+ * --------------------
+ * Applies the median filter to a single bin of 16 bit data, using medianN when the window contains bins without data.
+ */
+static void median_filter_bin_u16(const IsinGrid *grid, int bin, int row, const uint16_t *data, const uint64_t *valid,
+                                  uint16_t *filtered_data, uint64_t *filtered_valid) {
+    if (bitset_get(valid, bin)) {
+        int window[9];
+        int n_invalid = grid_window3_u16(grid, bin, row, data, valid, window);
+        filtered_data[bin] = (uint16_t) (n_invalid == 0 ? median9(window) : medianN(window, n_invalid));
+        bitset_set(filtered_valid, bin);
+    }
+}
+
+/*
+ * Function:  median_filter_row_u16
+ * --------------------
+ * Applies the median filter of median_filter_u16 to bins first to last - 1 of row i, like median_filter_row_u8.
+ */
+static void median_filter_row_u16(const IsinGrid *grid, int i, int first, int last, Median9SpanU16 median9_span,
+                                  const uint16_t *data, const uint64_t *valid, uint16_t *filtered_data,
+                                  uint64_t *filtered_valid) {
+    int j = first;
+    while (j < last) {
+        int span_end = j + 1;
+        while (span_end < last && grid->above[span_end] == grid->above[j] && grid->below[span_end] == grid->below[j]) {
+            span_end++;
+        }
+        if (median9_span != NULL && i > 1 && i < grid->nrows - 2) {
+            int up = grid_neighbor(grid, j, i, 1);
+            int down = grid_neighbor(grid, j, i, 7);
+            while (j < span_end) {
+                int n = 0;
+                while (j + n < span_end && bitset_all(valid, up + n - 1, 3) && bitset_all(valid, j + n - 1, 3) &&
+                       bitset_all(valid, down + n - 1, 3)) {
+                    n++;
+                }
+                int done = n > 0 ? median9_span(data + up, data + j, data + down, filtered_data + j, n) : 0;
+                bitset_set_range(filtered_valid, j, done);
+                int stop = j + n + 1 < span_end ? j + n + 1 : span_end;
+                for (int k = j + done; k < stop; k++) {
+                    median_filter_bin_u16(grid, k, i, data, valid, filtered_data, filtered_valid);
+                }
+                up += stop - j;
+                down += stop - j;
+                j = stop;
+            }
+        } else {
+            for (; j < span_end; j++) {
+                median_filter_bin_u16(grid, j, i, data, valid, filtered_data, filtered_valid);
+            }
+        }
+        j = span_end;
+    }
+}
+
+/*
+ * Function:  median_filter_u16
+ * --------------------
+ * Applies the median filter of median_filter_u8 to data stored as 16 bit values, with the same split into spans and
+ * vector instructions on 16 bit lanes.
+ *
+ * args:
+ *      IsinGrid *grid: the grid of the binning scheme
+ *      uint16_t *data: pointer to array containing the data to be filtered
+ *      uint64_t *valid: pointer to the bitset of bins containing data
+ *      uint16_t *filtered_data: pointer to output array
+ *      uint64_t *filtered_valid: pointer to the output bitset of bins with a filtered value
+ */
+void median_filter_u16(const IsinGrid *grid, const uint16_t *data, const uint64_t *valid, uint16_t *filtered_data,
+                       uint64_t *filtered_valid) {
+    Median9SpanU16 median9_span = select_median9_span_u16();
+    memset(filtered_valid, 0, bitset_words(grid->nbins) * sizeof(uint64_t));
+    memset(filtered_data, 0, grid->nbins * sizeof(uint16_t));
+
+    for (int i = 1; i < grid->nrows - 1; i++) {
+        int first = grid->basebins[i] + 1;
+        int last = grid->basebins[i] + grid->n_bins_in_row[i] - 1;
+        median_filter_row_u16(grid, i, first, last, median9_span, data, valid, filtered_data, filtered_valid);
+    }
+}
+
+/*
+ * Function:  median_filter_spans_u16
+ * --------------------
+ * Applies the median filter of median_filter_u16 to the spans of bins containing data only, like
+ * median_filter_spans_u8.
+ *
+ * args:
+ *      IsinGrid *grid: the grid of the binning scheme
+ *      ValidSpans *spans: the spans of the bins set in valid
+ *      uint16_t *data: pointer to array containing the data to be filtered
+ *      uint64_t *valid: pointer to the bitset of bins containing data
+ *      uint16_t *filtered_data: pointer to output array
+ *      uint64_t *filtered_valid: pointer to the output bitset of bins with a filtered value
+ */
+void median_filter_spans_u16(const IsinGrid *grid, const ValidSpans *spans, const uint16_t *data,
+                             const uint64_t *valid, uint16_t *filtered_data, uint64_t *filtered_valid) {
+    Median9SpanU16 median9_span = select_median9_span_u16();
+    memset(filtered_valid, 0, bitset_words(grid->nbins) * sizeof(uint64_t));
+    memset(filtered_data, 0, grid->nbins * sizeof(uint16_t));
+
+    for (int i = 1; i < grid->nrows - 1; i++) {
+        int row_first = grid->basebins[i] + 1;
+        int row_last = grid->basebins[i] + grid->n_bins_in_row[i] - 1;
+        for (int k = spans->row_offsets[i]; k < spans->row_offsets[i + 1]; k++) {
+            int first = spans->begin[k] > row_first ? spans->begin[k] : row_first;
+            int last = spans->end[k] < row_last ? spans->end[k] : row_last;
+            median_filter_row_u16(grid, i, first, last, median9_span, data, valid, filtered_data, filtered_valid);
+        }
+    }
+}
+
+/*
+ * Histogram of the valid values in a median filter kernel, with a coarse histogram of 1 << shift values per bucket so
+ * that finding a value by its rank only looks at a few counts of the fine histogram. 8 bit data uses buckets of 16
+ * values and 16 bit data buckets of 256 values.
+ */
+typedef struct median_histogram {
+    int *fine;
+    int *coarse;
+    int nfine;
+    int shift;
+    int count;
+} MedianHistogram;
+
+/*
+ * Function:  median_histogram_clear
+ * --------------------
+ * Removes every value from the histogram.
+ */
+static void median_histogram_clear(MedianHistogram *h) {
+    memset(h->fine, 0, h->nfine * sizeof(int));
+    memset(h->coarse, 0, (((h->nfine - 1) >> h->shift) + 1) * sizeof(int));
+    h->count = 0;
+}
+
+/*
+ * Function:  median_histogram_update
+ * --------------------
+ * Adds the valid bins from first to last - 1 to the histogram when delta is 1 or removes them when delta is -1,
+ * ignoring bins before the first or after the last of the nbins bins of the map. The values are read from data8 if it
+ * is not NULL and from data16 otherwise.
+ */
+static void median_histogram_update(MedianHistogram *h, const uint8_t *data8, const uint16_t *data16,
+                                    const uint64_t *valid, int nbins, int first, int last, int delta) {
+    if (first < 0) first = 0;
+    if (last > nbins) last = nbins;
+    for (int k = first; k < last; k++) {
+        if (bitset_get(valid, k)) {
+            int value = data8 != NULL ? data8[k] : data16[k];
+            h->fine[value] += delta;
+            h->coarse[value >> h->shift] += delta;
+            h->count += delta;
+        }
+    }
+}
+
+/*
+ * Function:  median_histogram_rank
+ * --------------------
+ * Finds the value with the given rank, starting from 0 for the smallest value in the histogram.
+ */
+static int median_histogram_rank(const MedianHistogram *h, int rank) {
+    int bucket = 0;
+    while (rank >= h->coarse[bucket]) {
+        rank -= h->coarse[bucket];
+        bucket++;
+    }
+    int value = bucket << h->shift;
+    while (rank >= h->fine[value]) {
+        rank -= h->fine[value];
+        value++;
+    }
+    return value;
+}
+
+/*
+ * Function:  median_histogram_median
+ * --------------------
+ * Determines the median of the values in the histogram the same way medianN does. The histogram must not be empty.
+ */
+static int median_histogram_median(const MedianHistogram *h) {
+    int n = h->count;
+    if (n & 1) return median_histogram_rank(h, (n - 1) >> 1);
+    return (median_histogram_rank(h, (n >> 1) - 1) + median_histogram_rank(h, n >> 1) + 1) >> 1;
+}
+
+/*
+ * Function:  median_filter_histogram
+ * --------------------
+ * Applies a median filter with a size x size kernel using a histogram that slides along each row. The kernel of a bin
+ * covers the same bins as get_window. Moving to the next bin of a row only adds and removes the bins at the ends of
+ * each kernel row, so the cost per bin grows with the size of the kernel instead of its area.
+ *
+ * Bins without data are ignored like in medianN. Like the 3x3 kernel of median_filter_u8, a kernel row reaching past
+ * the end of its row of the map reads on into the next row, and only bins before the first or after the last bin of
+ * the map are left out, so every valid bin at least size / 2 rows and bins from the edges of the map is filtered.
+ * Bins without data and the bins closer to the edges are left out of the filtered set of valid bins. The data and
+ * output are 8 bit when data8 is not NULL and 16 bit otherwise.
+ *
+ * args:
+ *      IsinGrid *grid: the grid of the binning scheme
+ *      int size: the width of the kernel. Must be odd
+ *      uint8_t *data8, uint16_t *data16: pointer to array containing the data to be filtered
+ *      uint64_t *valid: pointer to the bitset of bins containing data
+ *      uint8_t *filtered8, uint16_t *filtered16: pointer to output array
+ *      uint64_t *filtered_valid: pointer to the output bitset of bins with a filtered value
+ *      MedianHistogram *h: histogram with room for every value of the data
+ */
+static void median_filter_histogram(const IsinGrid *grid, int size, const uint8_t *data8, const uint16_t *data16,
+                                    const uint64_t *valid, uint8_t *filtered8, uint16_t *filtered16,
+                                    uint64_t *filtered_valid, MedianHistogram *h) {
+    int nrows = grid->nrows;
+    int nbins = grid->nbins;
+    const int *nbins_in_row = grid->n_bins_in_row;
+    const int *basebins = grid->basebins;
+    int half = size >> 1;
+    int starts[size];
+    int prev_starts[size];
+    memset(filtered_valid, 0, bitset_words(grid->nbins) * sizeof(uint64_t));
+    if (data8 != NULL) {
+        memset(filtered8, 0, grid->nbins);
+    } else {
+        memset(filtered16, 0, grid->nbins * sizeof(uint16_t));
+    }
+
+    for (int i = half; i < nrows - half; i++) {
+        int have_histogram = 0;
+        for (int j = basebins[i] + half; j < basebins[i] + nbins_in_row[i] - half; j++) {
+            get_window_starts(j, i, size, nbins_in_row, basebins, starts);
+            if (!have_histogram) {
+                median_histogram_clear(h);
+                for (int r = 0; r < size; r++) {
+                    median_histogram_update(h, data8, data16, valid, nbins, starts[r], starts[r] + size, 1);
+                }
+                have_histogram = 1;
+            } else {
+                for (int r = 0; r < size; r++) {
+                    int old = prev_starts[r];
+                    int new = starts[r];
+                    if (new > old) {
+                        median_histogram_update(h, data8, data16, valid, nbins, old,
+                                                old + size < new ? old + size : new, -1);
+                        median_histogram_update(h, data8, data16, valid, nbins, old + size > new ? old + size : new,
+                                                new + size, 1);
+                    } else if (new < old) {
+                        median_histogram_update(h, data8, data16, valid, nbins, new + size > old ? new + size : old,
+                                                old + size, -1);
+                        median_histogram_update(h, data8, data16, valid, nbins, new,
+                                                new + size < old ? new + size : old, 1);
+                    }
+                }
+            }
+            memcpy(prev_starts, starts, sizeof(starts));
+
+            if (bitset_get(valid, j) && h->count > 0) {
+                int median = median_histogram_median(h);
+                if (data8 != NULL) {
+                    filtered8[j] = (uint8_t) median;
+                } else {
+                    filtered16[j] = (uint16_t) median;
+                }
+                bitset_set(filtered_valid, j);
+            }
+        }
+    }
+}
+
+/*
+ * Function:  median_filter_size_u8
+ * --------------------
+ * Applies a median filter with a kernel of the given size to 8 bit data. The 3x3 kernel uses median_filter_u8 and
+ * larger kernels a sliding histogram.
+ *
+ * args:
+ *      IsinGrid *grid: the grid of the binning scheme
+ *      int size: the width of the kernel. Must be odd
+ *      uint8_t *data: pointer to array containing the data to be filtered
+ *      uint64_t *valid: pointer to the bitset of bins containing data
+ *      uint8_t *filtered_data: pointer to output array
+ *      uint64_t *filtered_valid: pointer to the output bitset of bins with a filtered value
+ */
+void median_filter_size_u8(const IsinGrid *grid, int size, const uint8_t *data, const uint64_t *valid,
+                           uint8_t *filtered_data, uint64_t *filtered_valid) {
+    if (size == 3) {
+        median_filter_u8(grid, data, valid, filtered_data, filtered_valid);
+    } else {
+        int fine[256];
+        int coarse[16];
+        MedianHistogram h = {fine, coarse, 256, 4, 0};
+        median_filter_histogram(grid, size, data, NULL, valid, filtered_data, NULL, filtered_valid, &h);
+    }
+}
+
+/*
+ * Function:  median_filter_size_u16
+ * --------------------
+ * Applies a median filter with a kernel of the given size to 16 bit data. The 3x3 kernel uses median_filter_u16 and
+ * larger kernels a sliding histogram of the given number of levels, kept in an array the caller allocates once so that
+ * filtering does not allocate.
+ *
+ * args:
+ *      IsinGrid *grid: the grid of the binning scheme
+ *      int size: the width of the kernel. Must be odd
+ *      int levels: the number of levels of the data. Every value must be less than it
+ *      uint16_t *data: pointer to array containing the data to be filtered
+ *      uint64_t *valid: pointer to the bitset of bins containing data
+ *      uint16_t *filtered_data: pointer to output array
+ *      uint64_t *filtered_valid: pointer to the output bitset of bins with a filtered value
+ *      int *counts: pointer to an array of MEDIAN_FILTER_COUNTS(levels) ints for the histogram. Not read for the 3x3
+ *      kernel, where it can be NULL
+ */
+void median_filter_size_u16(const IsinGrid *grid, int size, int levels, const uint16_t *data, const uint64_t *valid,
+                            uint16_t *filtered_data, uint64_t *filtered_valid, int *counts) {
+    if (size == 3) {
+        median_filter_u16(grid, data, valid, filtered_data, filtered_valid);
+    } else {
+        MedianHistogram h = {counts, counts + levels, levels, 8, 0};
+        median_filter_histogram(grid, size, NULL, data, valid, NULL, filtered_data, filtered_valid, &h);
+    }
+}
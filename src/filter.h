@@ -1,7 +1,28 @@
 
 #ifndef SIED_FILTER_H
 #define SIED_FILTER_H
+#include "grid.h"
+#include "spans.h"
+
+/*
+ * Number of ints in the histogram median_filter_size_u16 filters data of the given number of levels with: a count for
+ * every value and for every bucket of 256 values.
+ */
+#define MEDIAN_FILTER_COUNTS(levels) ((levels) + (((levels) - 1) >> 8) + 1)
 
 void median_filter(int *data, int *filtered_data, int nbins, int nrows,
                    int *nbins_in_row, int *basebins);
+void median_filter_grid(const IsinGrid *grid, const int *data, int *filtered_data);
+void median_filter_u8(const IsinGrid *grid, const uint8_t *data, const uint64_t *valid, uint8_t *filtered_data,
+                      uint64_t *filtered_valid);
+void median_filter_spans_u8(const IsinGrid *grid, const ValidSpans *spans, const uint8_t *data,
+                            const uint64_t *valid, uint8_t *filtered_data, uint64_t *filtered_valid);
+void median_filter_size_u8(const IsinGrid *grid, int size, const uint8_t *data, const uint64_t *valid,
+                           uint8_t *filtered_data, uint64_t *filtered_valid);
+void median_filter_u16(const IsinGrid *grid, const uint16_t *data, const uint64_t *valid, uint16_t *filtered_data,
+                       uint64_t *filtered_valid);
+void median_filter_spans_u16(const IsinGrid *grid, const ValidSpans *spans, const uint16_t *data,
+                             const uint64_t *valid, uint16_t *filtered_data, uint64_t *filtered_valid);
+void median_filter_size_u16(const IsinGrid *grid, int size, int levels, const uint16_t *data, const uint64_t *valid,
+                            uint16_t *filtered_data, uint64_t *filtered_valid, int *counts);
 #endif //SIED_FILTER_H
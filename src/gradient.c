@@ -0,0 +1,169 @@
+/*
+ * Precomputed gradients of a filtered image for contour following.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "gradient.h"
+#include "bitset.h"
+#include "cayula.h"
+
+/*
+ * Function:  gradient_field_create
+ * --------------------
+ * Allocates a gradient field for a binning scheme with the given number of bins.
+ *
+ * returns:
+ *      GradientField *: the new field or NULL if memory could not be allocated
+ */
+GradientField * gradient_field_create(int nbins) {
+    GradientField *field = calloc(1, sizeof(GradientField));
+    if (field == NULL) return NULL;
+    field->nbins = nbins;
+    field->dx = malloc(nbins * sizeof(int32_t));
+    field->dy = malloc(nbins * sizeof(int32_t));
+    if (field->dx == NULL || field->dy == NULL) {
+        gradient_field_destroy(field);
+        return NULL;
+    }
+    return field;
+}
+
+/*
+ * Function:  expand_row
+ * --------------------
+ * Copies a row of 8 or 16 bit data along with the bin before and after it to an int32_t row with FILL_VALUE in the
+ * bins without data. The values are read from data8 if it is not NULL and from data16 otherwise. Bin first of the row
+ * is copied to out[1].
+ */
+static void expand_row(int32_t *out, const uint8_t *data8, const uint16_t *data16, const uint64_t *valid, int first,
+                       int n, int nbins) {
+    for (int k = -1; k <= n; k++) {
+        int bin = first + k;
+        if (bin >= 0 && bin < nbins && bitset_get(valid, bin)) {
+            out[k + 1] = data8 != NULL ? data8[bin] : data16[bin];
+        } else {
+            out[k + 1] = FILL_VALUE;
+        }
+    }
+}
+
+/*
+ * Function:  gradient_span
+ * --------------------
+ * Computes the central differences of n adjacent bins. Neighbors without data are replaced
+ * with the value of the center bin like in gradient. Written without branches so the compiler can vectorize it.
+ *
+ * args:
+ *      int32_t *up: pointer to the expanded value of the bin above the first bin
+ *      int32_t *mid: pointer to the expanded value of the first bin
+ *      int32_t *down: pointer to the expanded value of the bin below the first bin
+ *      int32_t *dx, int32_t *dy: pointers to the outputs for the first bin
+ *      int n: the number of bins
+ */
+static void gradient_span(const int32_t *up, const int32_t *mid, const int32_t *down, int32_t *dx, int32_t *dy,
+                          int n) {
+    for (int k = 0; k < n; k++) {
+        int center = mid[k];
+        int left = mid[k - 1] == FILL_VALUE ? center : mid[k - 1];
+        int right = mid[k + 1] == FILL_VALUE ? center : mid[k + 1];
+        int above = up[k] == FILL_VALUE ? center : up[k];
+        int below = down[k] == FILL_VALUE ? center : down[k];
+        dx[k] = right - left;
+        dy[k] = below - above;
+    }
+}
+
+/*
+ * Function:  compute_field
+ * --------------------
+ * Computes the gradient of every bin that is not in the first or last row or column of its row. Like
+ * median_filter_u8, each row is split into spans of bins whose neighbors above and below are at a constant offset,
+ * and each span is computed at once from the expanded values of the three rows. The values are read from data8 if it
+ * is not NULL and from data16 otherwise.
+ */
+static void compute_field(GradientField *field, const IsinGrid *grid, const uint8_t *data8, const uint16_t *data16,
+                          const uint64_t *valid) {
+    int nrows = grid->nrows;
+    const int *nbins_in_row = grid->n_bins_in_row;
+    const int *basebins = grid->basebins;
+    int max_row = 0;
+    for (int i = 0; i < nrows; i++) {
+        if (nbins_in_row[i] > max_row) max_row = nbins_in_row[i];
+    }
+    int width = max_row + 2;
+    int32_t *rows = malloc(3 * width * sizeof(int32_t));
+    if (rows == NULL) return;
+    int32_t *above = rows, *center = rows + width, *below = rows + 2 * width;
+    memset(field->dx, 0, field->nbins * sizeof(int32_t));
+    memset(field->dy, 0, field->nbins * sizeof(int32_t));
+
+    if (nrows >= 3) {
+        expand_row(center, data8, data16, valid, basebins[0], nbins_in_row[0], field->nbins);
+        expand_row(below, data8, data16, valid, basebins[1], nbins_in_row[1], field->nbins);
+    }
+    for (int i = 1; i < nrows - 1; i++) {
+        int32_t *tmp = above;
+        above = center;
+        center = below;
+        below = tmp;
+        expand_row(below, data8, data16, valid, basebins[i + 1], nbins_in_row[i + 1], field->nbins);
+
+        int end = basebins[i] + nbins_in_row[i] - 1;
+        int j = basebins[i] + 1;
+        while (j < end) {
+            int span_end = j + 1;
+            while (span_end < end && grid->above[span_end] == grid->above[j] && grid->below[span_end] == grid->below[j]) {
+                span_end++;
+            }
+            int up = grid_neighbor(grid, j, i, 1) - basebins[i - 1] + 1;
+            int down = grid_neighbor(grid, j, i, 7) - basebins[i + 1] + 1;
+            gradient_span(above + up, center + j - basebins[i] + 1, below + down, field->dx + j, field->dy + j,
+                          span_end - j);
+            j = span_end;
+        }
+    }
+    free(rows);
+}
+
+/*
+ * Function:  gradient_field_compute
+ * --------------------
+ * Computes the gradient of every bin of 8 bit data that is not in the first or last row or column of its row.
+ *
+ * args:
+ *      GradientField *field: the field to write
+ *      IsinGrid *grid: the grid of the binning scheme
+ *      uint8_t *data: pointer to the array containing the filtered data for every bin
+ *      uint64_t *valid: pointer to the bitset of bins with a filtered value
+ */
+void gradient_field_compute(GradientField *field, const IsinGrid *grid, const uint8_t *data, const uint64_t *valid) {
+    compute_field(field, grid, data, NULL, valid);
+}
+
+/*
+ * Function:  gradient_field_compute_u16
+ * --------------------
+ * Computes the gradient field of 16 bit data like gradient_field_compute.
+ *
+ * args:
+ *      GradientField *field: the field to write
+ *      IsinGrid *grid: the grid of the binning scheme
+ *      uint16_t *data: pointer to the array containing the filtered data for every bin
+ *      uint64_t *valid: pointer to the bitset of bins with a filtered value
+ */
+void gradient_field_compute_u16(GradientField *field, const IsinGrid *grid, const uint16_t *data,
+                                const uint64_t *valid) {
+    compute_field(field, grid, NULL, data, valid);
+}
+
+/*
+ * Function:  gradient_field_destroy
+ * --------------------
+ * Frees the gradient field.
+ */
+void gradient_field_destroy(GradientField *field) {
+    if (field == NULL) return;
+    free(field->dx);
+    free(field->dy);
+    free(field);
+}
@@ -0,0 +1,23 @@
+#include <stdint.h>
+
+#ifndef SIED_GRADIENT_H
+#define SIED_GRADIENT_H
+#include "grid.h"
+
+/*
+ * The gradient of every bin of a filtered image, computed the same way as gradient in contour.c. The central
+ * differences are stored without halving them, which keeps them exact as integers, and the magnitude is left to the
+ * reader so that it is rounded the same way as in gradient_ratio.
+ */
+typedef struct gradient_field {
+    int nbins;
+    int32_t *dx;
+    int32_t *dy;
+} GradientField;
+
+GradientField * gradient_field_create(int nbins);
+void gradient_field_compute(GradientField *field, const IsinGrid *grid, const uint8_t *data, const uint64_t *valid);
+void gradient_field_compute_u16(GradientField *field, const IsinGrid *grid, const uint16_t *data,
+                                 const uint64_t *valid);
+void gradient_field_destroy(GradientField *field);
+#endif //SIED_GRADIENT_H
@@ -0,0 +1,228 @@
+/*
+ * Precomputed neighbor lookups for binning schemes where the number of bins changes from row to row.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "grid.h"
+#include "bitset.h"
+#include "cayula.h"
+
+/*
+ * Function:  neighbor_offset
+ * --------------------
+ * Finds the offset between the column of a bin and the column of the bin in another row that is at the same relative
+ * position within its row. Uses the same arithmetic as get_window so that both select the same bins.
+ *
+ * args:
+ *      int col: the column of the bin within its row
+ *      int n_bins: the number of bins in the row of the bin
+ *      int n_bins_other: the number of bins in the other row
+ *
+ * returns:
+ *      int: the column in the other row minus col
+ */
+static int neighbor_offset(int col, int n_bins, int n_bins_other) {
+    double ratio = (double) col / n_bins;
+    return (int) (ratio * n_bins_other + 0.5) - col;
+}
+
+/*
+ * Function:  grid_create
+ * --------------------
+ * Creates the grid for a binning scheme and precomputes the column of the neighbors of every bin in the rows above
+ * and below it. The arrays describing the binning scheme are copied, so they do not need to outlive the grid.
+ *
+ * args:
+ *      int nbins: the number of bins in the binning scheme
+ *      int nrows: the number of rows in the binning scheme
+ *      int *n_bins_in_row: pointer to an array containing the number of bins in each row
+ *      int *basebins: pointer to an array containing the bin number for the first bin in each row
+ *
+ * returns:
+ *      IsinGrid *: the new grid or NULL if memory could not be allocated or the number of bins changes too abruptly
+ *      between two rows for the offsets to be stored
+ */
+IsinGrid * grid_create(int nbins, int nrows, const int *n_bins_in_row, const int *basebins) {
+    IsinGrid *grid = calloc(1, sizeof(IsinGrid));
+    if (grid == NULL) return NULL;
+    grid->nbins = nbins;
+    grid->nrows = nrows;
+    grid->n_bins_in_row = malloc(nrows * sizeof(int));
+    grid->basebins = malloc(nrows * sizeof(int));
+    grid->above = calloc(nbins, sizeof(int8_t));
+    grid->below = calloc(nbins, sizeof(int8_t));
+    if (grid->n_bins_in_row == NULL || grid->basebins == NULL || grid->above == NULL || grid->below == NULL) {
+        grid_destroy(grid);
+        return NULL;
+    }
+    memcpy(grid->n_bins_in_row, n_bins_in_row, nrows * sizeof(int));
+    memcpy(grid->basebins, basebins, nrows * sizeof(int));
+
+    for (int i = 0; i < nrows; i++) {
+        for (int col = 0; col < n_bins_in_row[i]; col++) {
+            int above = i > 0 ? neighbor_offset(col, n_bins_in_row[i], n_bins_in_row[i - 1]) : 0;
+            int below = i < nrows - 1 ? neighbor_offset(col, n_bins_in_row[i], n_bins_in_row[i + 1]) : 0;
+            if (above < INT8_MIN || above > INT8_MAX || below < INT8_MIN || below > INT8_MAX) {
+                grid_destroy(grid);
+                return NULL;
+            }
+            grid->above[basebins[i] + col] = (int8_t) above;
+            grid->below[basebins[i] + col] = (int8_t) below;
+        }
+    }
+    return grid;
+}
+
+/*
+ * Function:  grid_destroy
+ * --------------------
+ * Frees the grid and its neighbor tables.
+ */
+void grid_destroy(IsinGrid *grid) {
+    if (grid == NULL) return;
+    free(grid->n_bins_in_row);
+    free(grid->basebins);
+    free(grid->above);
+    free(grid->below);
+    free(grid);
+}
+
+/*
+ * Function:  grid_window3
+ * --------------------
+ * Selects the 3x3 window of data values centered on the given bin. Gives the same result as get_window with a width
+ * of 3 without any floating point arithmetic, except that bins before the first or after the last bin of the map are
+ * given FILL_VALUE rather than read out of bounds. The bin must not be in the first or last row.
+ *
+ * args:
+ *      IsinGrid *grid: the grid of the binning scheme
+ *      int bin: bin number of the center bin in the window
+ *      int row: the row number of the center bin
+ *      int *data: pointer to the array containing the data for every bin
+ *      int *window: pointer to a 9 element output array for the window
+ *
+ * returns:
+ *      int: the number of fill values contained in the window
+ */
+int grid_window3(const IsinGrid *grid, int bin, int row, const int *data, int window[]) {
+    int col = bin - grid->basebins[row];
+    int up = grid->basebins[row - 1] + col + grid->above[bin];
+    int down = grid->basebins[row + 1] + col + grid->below[bin];
+    int first[3] = {up - 1, bin - 1, down - 1};
+
+    int nfill_values = 0;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            int k = first[i] + j;
+            window[i * 3 + j] = k >= 0 && k < grid->nbins ? data[k] : FILL_VALUE;
+            if (window[i * 3 + j] == FILL_VALUE) nfill_values++;
+        }
+    }
+    return nfill_values;
+}
+
+/*
+ * Function:  grid_window3_u8
+ * --------------------
+ * Selects the same window as grid_window3 from data stored as 8 bit values with a separate set of valid bins. Bins
+ * that are not valid are given FILL_VALUE in the window.
+ *
+ * args:
+ *      IsinGrid *grid: the grid of the binning scheme
+ *      int bin: bin number of the center bin in the window
+ *      int row: the row number of the center bin
+ *      uint8_t *data: pointer to the array containing the data for every bin
+ *      uint64_t *valid: pointer to the bitset of bins containing data
+ *      int *window: pointer to a 9 element output array for the window
+ *
+ * returns:
+ *      int: the number of fill values contained in the window
+ */
+int grid_window3_u8(const IsinGrid *grid, int bin, int row, const uint8_t *data, const uint64_t *valid, int window[]) {
+    int col = bin - grid->basebins[row];
+    int first[3];
+    first[0] = grid->basebins[row - 1] + col + grid->above[bin] - 1;
+    first[1] = bin - 1;
+    first[2] = grid->basebins[row + 1] + col + grid->below[bin] - 1;
+
+    int nfill_values = 0;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            int k = first[i] + j;
+            if (k >= 0 && k < grid->nbins && bitset_get(valid, k)) {
+                window[i * 3 + j] = data[k];
+            } else {
+                window[i * 3 + j] = FILL_VALUE;
+                nfill_values++;
+            }
+        }
+    }
+    return nfill_values;
+}
+
+/*
+ * Function:  grid_window3_u16
+ * --------------------
+ * Selects the same window as grid_window3_u8 from data stored as 16 bit values.
+ *
+ * args:
+ *      IsinGrid *grid: the grid of the binning scheme
+ *      int bin: bin number of the center bin in the window
+ *      int row: the row number of the center bin
+ *      uint16_t *data: pointer to the array containing the data for every bin
+ *      uint64_t *valid: pointer to the bitset of bins containing data
+ *      int *window: pointer to a 9 element output array for the window
+ *
+ * returns:
+ *      int: the number of fill values contained in the window
+ */
+int grid_window3_u16(const IsinGrid *grid, int bin, int row, const uint16_t *data, const uint64_t *valid,
+                     int window[]) {
+    int col = bin - grid->basebins[row];
+    int first[3];
+    first[0] = grid->basebins[row - 1] + col + grid->above[bin] - 1;
+    first[1] = bin - 1;
+    first[2] = grid->basebins[row + 1] + col + grid->below[bin] - 1;
+
+    int nfill_values = 0;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            int k = first[i] + j;
+            if (k >= 0 && k < grid->nbins && bitset_get(valid, k)) {
+                window[i * 3 + j] = data[k];
+            } else {
+                window[i * 3 + j] = FILL_VALUE;
+                nfill_values++;
+            }
+        }
+    }
+    return nfill_values;
+}
+
+/*
+ * Function:  grid_neighbor
+ * --------------------
+ * Returns the bin number of a bin in the 3x3 window centered on the given bin, i.e. the bin whose value grid_window3
+ * places at index i of the window.
+ *
+ * args:
+ *      IsinGrid *grid: the grid of the binning scheme
+ *      int bin: the center bin number in the window of interest
+ *      int row: the row number of the center bin
+ *      int i: the index for the desired bin in the window of interest
+ *
+ * returns:
+ *      int: bin number of the desired bin
+ */
+int grid_neighbor(const IsinGrid *grid, int bin, int row, int i) {
+    int col = bin - grid->basebins[row];
+    int offset = i % 3 - 1;
+    switch (i / 3) {
+        case 0:
+            return grid->basebins[row - 1] + col + grid->above[bin] + offset;
+        case 2:
+            return grid->basebins[row + 1] + col + grid->below[bin] + offset;
+        default:
+            return bin + offset;
+    }
+}
@@ -0,0 +1,27 @@
+#include <stdint.h>
+
+#ifndef SIED_GRID_H
+#define SIED_GRID_H
+
+/*
+ * Geometry of a binning scheme along with the column of each bin's neighbors in the rows above and below. The
+ * neighbor columns are stored as offsets from the bin's own column, which stay within a few bins for any binning
+ * scheme where the number of bins changes gradually from row to row.
+ */
+typedef struct isin_grid {
+    int nbins;
+    int nrows;
+    int *n_bins_in_row;
+    int *basebins;
+    int8_t *above;
+    int8_t *below;
+} IsinGrid;
+
+IsinGrid * grid_create(int nbins, int nrows, const int *n_bins_in_row, const int *basebins);
+void grid_destroy(IsinGrid *grid);
+int grid_window3(const IsinGrid *grid, int bin, int row, const int *data, int window[]);
+int grid_window3_u8(const IsinGrid *grid, int bin, int row, const uint8_t *data, const uint64_t *valid, int window[]);
+int grid_window3_u16(const IsinGrid *grid, int bin, int row, const uint16_t *data, const uint64_t *valid,
+                     int window[]);
+int grid_neighbor(const IsinGrid *grid, int bin, int row, int i);
+#endif //SIED_GRID_H
@@ -0,0 +1,317 @@
+/*
+ * A binary file format for images of a binning scheme that is used in place after being mapped into memory.
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "gridfile.h"
+#include "bitset.h"
+
+static inline size_t align8(size_t n) {
+    return (n + 7) & ~(size_t) 7;
+}
+
+static inline size_t value_size(uint32_t value_type) {
+    return value_type == GRID_FILE_I16 ? sizeof(int16_t) : sizeof(uint8_t);
+}
+
+/*
+ * Function:  grid_file_geometry_hash
+ * --------------------
+ * Hashes the number of rows and the number of bins in each row of a binning scheme with 64 bit FNV-1a, so that a file
+ * can be checked against the binning scheme it is read for.
+ */
+uint64_t grid_file_geometry_hash(int nrows, const int *n_bins_in_row) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = -1; i < nrows; i++) {
+        uint32_t value = (uint32_t) (i < 0 ? nrows : n_bins_in_row[i]);
+        for (int b = 0; b < 4; b++) {
+            hash ^= (value >> (8 * b)) & 0xff;
+            hash *= 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+/*
+ * Function:  payload_size
+ * --------------------
+ * Returns the size of a file with the given header.
+ */
+static size_t payload_size(const GridFileHeader *header) {
+    size_t values = align8((size_t) header->nvalues * value_size(header->value_type));
+    if (header->layout == GRID_FILE_DENSE) {
+        return sizeof(GridFileHeader) + values + bitset_words(header->nbins) * sizeof(uint64_t);
+    }
+    return sizeof(GridFileHeader) + align8((size_t) header->nspans * 2 * sizeof(int32_t)) + values;
+}
+
+/*
+ * Function:  pad
+ * --------------------
+ * Writes the zeros that follow n bytes of a part of the payload up to the next multiple of 8 bytes.
+ */
+static int pad(FILE *file, size_t n) {
+    static const char zeros[8] = {0};
+    size_t npad = align8(n) - n;
+    return npad > 0 && fwrite(zeros, 1, npad, file) != npad ? -1 : 0;
+}
+
+/*
+ * Function:  write_padded
+ * --------------------
+ * Writes n bytes followed by zeros up to the next multiple of 8 bytes.
+ */
+static int write_padded(FILE *file, const void *data, size_t n) {
+    if (n > 0 && fwrite(data, 1, n, file) != n) return -1;
+    return pad(file, n);
+}
+
+/*
+ * Function:  grid_file_write
+ * --------------------
+ * Writes an image of a binning scheme to a grid file. A GRID_FILE_DENSE file holds the values and bitset as they are
+ * and can be run straight from the mapped file. A GRID_FILE_SPANS file only holds the values of the bins with data,
+ * which is smaller for images that are mostly empty.
+ *
+ * args:
+ *      char *path: path of the file, which is replaced if it exists
+ *      int nrows: the number of rows in the binning scheme
+ *      int *n_bins_in_row: pointer to an array containing the number of bins in each row
+ *      int layout: GRID_FILE_DENSE or GRID_FILE_SPANS
+ *      int value_type: GRID_FILE_U8 or GRID_FILE_I16
+ *      void *values: pointer to the uint8_t or int16_t value of every bin
+ *      uint64_t *valid: pointer to the bitset of bins with data
+ *
+ * returns:
+ *      int: 0 on success or -1 if the arguments are not valid or the file could not be written
+ */
+int grid_file_write(const char *path, int nrows, const int *n_bins_in_row, int layout, int value_type,
+                    const void *values, const uint64_t *valid) {
+    if ((layout != GRID_FILE_DENSE && layout != GRID_FILE_SPANS) ||
+        (value_type != GRID_FILE_U8 && value_type != GRID_FILE_I16)) {
+        return -1;
+    }
+    GridFileHeader header;
+    memset(&header, 0, sizeof(GridFileHeader));
+    memcpy(header.magic, GRID_FILE_MAGIC, sizeof(header.magic));
+    header.version = GRID_FILE_VERSION;
+    header.layout = (uint32_t) layout;
+    header.value_type = (uint32_t) value_type;
+    header.nrows = nrows;
+    for (int i = 0; i < nrows; i++) header.nbins += n_bins_in_row[i];
+    header.geometry_hash = grid_file_geometry_hash(nrows, n_bins_in_row);
+    int nbins = header.nbins;
+    size_t size = value_size(header.value_type);
+    if (layout == GRID_FILE_DENSE) {
+        header.nvalues = nbins;
+    } else {
+        for (int j = bitset_next_set(valid, 0, nbins); j < nbins; ) {
+            int end = bitset_next_clear(valid, j, nbins);
+            header.nspans++;
+            header.nvalues += end - j;
+            j = bitset_next_set(valid, end, nbins);
+        }
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) return -1;
+    int failed = fwrite(&header, sizeof(GridFileHeader), 1, file) != 1;
+    if (layout == GRID_FILE_DENSE) {
+        failed = failed || write_padded(file, values, (size_t) nbins * size) != 0;
+        failed = failed || write_padded(file, valid, bitset_words(nbins) * sizeof(uint64_t)) != 0;
+    } else {
+        for (int j = bitset_next_set(valid, 0, nbins); j < nbins && !failed; ) {
+            int32_t span[2] = {j, bitset_next_clear(valid, j, nbins)};
+            failed = fwrite(span, sizeof(span), 1, file) != 1;
+            j = bitset_next_set(valid, span[1], nbins);
+        }
+        failed = failed || pad(file, (size_t) header.nspans * 2 * sizeof(int32_t)) != 0;
+        for (int j = bitset_next_set(valid, 0, nbins); j < nbins && !failed; ) {
+            int end = bitset_next_clear(valid, j, nbins);
+            failed = fwrite((const char *) values + (size_t) j * size, size, end - j, file) != (size_t) (end - j);
+            j = bitset_next_set(valid, end, nbins);
+        }
+        failed = failed || pad(file, (size_t) header.nvalues * size) != 0;
+    }
+    failed = fclose(file) != 0 || failed;
+    return failed ? -1 : 0;
+}
+
+/*
+ * Function:  grid_file_write_output
+ * --------------------
+ * Writes the output of a run in the layout of cayula_ctx_run_u8 to a grid file of 8 bit values, 1 for the fronts and
+ * 0 for the other bins with data.
+ *
+ * args:
+ *      char *path: path of the file, which is replaced if it exists
+ *      int nrows: the number of rows in the binning scheme
+ *      int *n_bins_in_row: pointer to an array containing the number of bins in each row
+ *      int layout: GRID_FILE_DENSE or GRID_FILE_SPANS
+ *      int8_t *out_data: pointer to the output of every bin. Fronts are 1, other valid bins 0 and bins without data -1
+ *
+ * returns:
+ *      int: 0 on success or -1 if memory could not be allocated or the file could not be written
+ */
+int grid_file_write_output(const char *path, int nrows, const int *n_bins_in_row, int layout,
+                           const int8_t *out_data) {
+    int nbins = 0;
+    for (int i = 0; i < nrows; i++) nbins += n_bins_in_row[i];
+    uint8_t *values = malloc(nbins > 0 ? nbins : 1);
+    uint64_t *valid = calloc(bitset_words(nbins) > 0 ? bitset_words(nbins) : 1, sizeof(uint64_t));
+    int result = -1;
+    if (values != NULL && valid != NULL) {
+        for (int i = 0; i < nbins; i++) {
+            values[i] = out_data[i] == 1;
+            if (out_data[i] >= 0) bitset_set(valid, i);
+        }
+        result = grid_file_write(path, nrows, n_bins_in_row, layout, GRID_FILE_U8, values, valid);
+    }
+    free(values);
+    free(valid);
+    return result;
+}
+
+/*
+ * Function:  grid_file_open
+ * --------------------
+ * Maps a grid file into memory read only and checks that its header and size agree, without reading the payload.
+ *
+ * returns:
+ *      GridFile *: the mapped file or NULL if it could not be mapped or is not a grid file
+ */
+GridFile * grid_file_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(GridFileHeader)) {
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    const GridFileHeader *header = map;
+    if (memcmp(header->magic, GRID_FILE_MAGIC, sizeof(header->magic)) != 0 || header->version != GRID_FILE_VERSION ||
+        (header->layout != GRID_FILE_DENSE && header->layout != GRID_FILE_SPANS) ||
+        (header->value_type != GRID_FILE_U8 && header->value_type != GRID_FILE_I16) || header->nbins < 0 ||
+        header->nspans < 0 || header->nvalues < 0 || header->nvalues > header->nbins ||
+        (header->layout == GRID_FILE_DENSE && header->nvalues != header->nbins) ||
+        payload_size(header) != (size_t) st.st_size) {
+        munmap(map, (size_t) st.st_size);
+        return NULL;
+    }
+    GridFile *file = calloc(1, sizeof(GridFile));
+    if (file == NULL) {
+        munmap(map, (size_t) st.st_size);
+        return NULL;
+    }
+    file->header = header;
+    file->map = map;
+    file->size = (size_t) st.st_size;
+    const char *payload = (const char *) map + sizeof(GridFileHeader);
+    size_t values = align8((size_t) header->nvalues * value_size(header->value_type));
+    if (header->layout == GRID_FILE_DENSE) {
+        file->values = payload;
+        file->valid = (const uint64_t *) (payload + values);
+    } else {
+        file->spans = (const int32_t *) payload;
+        file->values = payload + align8((size_t) header->nspans * 2 * sizeof(int32_t));
+    }
+    return file;
+}
+
+/*
+ * Function:  grid_file_matches
+ * --------------------
+ * Returns 1 if a grid file holds an image of the given binning scheme and 0 otherwise.
+ */
+int grid_file_matches(const GridFile *file, int nrows, const int *n_bins_in_row) {
+    return file->header->nrows == nrows &&
+           file->header->geometry_hash == grid_file_geometry_hash(nrows, n_bins_in_row);
+}
+
+/*
+ * Function:  grid_file_read
+ * --------------------
+ * Copies the image of a grid file into a value for every bin and a bitset of the bins with data. Bins without data
+ * are given 0. Spans that do not fit the bins or values of the file are skipped. Dense files can be used in place
+ * through file->values and file->valid instead.
+ *
+ * args:
+ *      GridFile *file: the mapped file
+ *      void *values: pointer to an output array of uint8_t or int16_t, as the value type of the file, for every bin
+ *      uint64_t *valid: pointer to the output bitset of bins with data
+ */
+void grid_file_read(const GridFile *file, void *values, uint64_t *valid) {
+    const GridFileHeader *header = file->header;
+    size_t size = value_size(header->value_type);
+    if (header->layout == GRID_FILE_DENSE) {
+        memcpy(values, file->values, (size_t) header->nbins * size);
+        memcpy(valid, file->valid, bitset_words(header->nbins) * sizeof(uint64_t));
+        return;
+    }
+    memset(values, 0, (size_t) header->nbins * size);
+    memset(valid, 0, bitset_words(header->nbins) * sizeof(uint64_t));
+    int64_t k = 0;
+    for (int s = 0; s < header->nspans; s++) {
+        int begin = file->spans[2 * s];
+        int end = file->spans[2 * s + 1];
+        if (begin < 0 || end > header->nbins || begin >= end || k + (end - begin) > header->nvalues) continue;
+        memcpy((char *) values + (size_t) begin * size, (const char *) file->values + (size_t) k * size,
+               (size_t) (end - begin) * size);
+        bitset_set_range(valid, begin, end - begin);
+        k += end - begin;
+    }
+}
+
+/*
+ * Function:  grid_file_read_output
+ * --------------------
+ * Reads a grid file written by grid_file_write_output back into the layout of cayula_ctx_run_u8.
+ *
+ * args:
+ *      GridFile *file: the mapped file
+ *      int8_t *out_data: pointer to an output array with an element for every bin. Fronts are 1, other valid bins 0
+ *      and bins without data -1
+ *
+ * returns:
+ *      int: 0 on success or -1 if the file does not hold 8 bit values or memory could not be allocated
+ */
+int grid_file_read_output(const GridFile *file, int8_t *out_data) {
+    const GridFileHeader *header = file->header;
+    if (header->value_type != GRID_FILE_U8) return -1;
+    int nbins = header->nbins;
+    if (header->layout == GRID_FILE_DENSE) {
+        const uint8_t *values = file->values;
+        for (int i = 0; i < nbins; i++) {
+            out_data[i] = bitset_get(file->valid, i) ? (int8_t) (values[i] != 0) : -1;
+        }
+        return 0;
+    }
+    uint64_t *valid = malloc((bitset_words(nbins) > 0 ? bitset_words(nbins) : 1) * sizeof(uint64_t));
+    if (valid == NULL) return -1;
+    grid_file_read(file, out_data, valid);
+    for (int i = 0; i < nbins; i++) {
+        out_data[i] = bitset_get(valid, i) ? (int8_t) (out_data[i] != 0) : -1;
+    }
+    free(valid);
+    return 0;
+}
+
+/*
+ * Function:  grid_file_close
+ * --------------------
+ * Unmaps a grid file. Pointers into the file are no longer valid afterwards.
+ */
+void grid_file_close(GridFile *file) {
+    if (file == NULL) return;
+    munmap(file->map, file->size);
+    free(file);
+}
@@ -0,0 +1,56 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef SIED_GRIDFILE_H
+#define SIED_GRIDFILE_H
+
+#define GRID_FILE_MAGIC "SIEDGRID"
+#define GRID_FILE_VERSION 1
+
+#define GRID_FILE_DENSE 0   // a value for every bin followed by the bitset of bins with data
+#define GRID_FILE_SPANS 1   // the begin and end of every run of bins with data followed by the values of those bins
+
+#define GRID_FILE_U8 0
+#define GRID_FILE_I16 1
+
+/*
+ * The 64 byte header at the start of a grid file, in the byte order of the machine that wrote it. The payload follows
+ * the header, with each of its parts starting on a multiple of 8 bytes so that they can be used in place once the file
+ * is mapped into memory.
+ */
+typedef struct grid_file_header {
+    char magic[8];          // GRID_FILE_MAGIC without its terminating zero
+    uint32_t version;
+    uint32_t layout;        // GRID_FILE_DENSE or GRID_FILE_SPANS
+    uint32_t value_type;    // GRID_FILE_U8 or GRID_FILE_I16
+    int32_t nbins;
+    int32_t nrows;
+    int32_t nspans;         // runs of bins with data of a GRID_FILE_SPANS file, 0 otherwise
+    int64_t nvalues;        // values stored, nbins for GRID_FILE_DENSE and the bins of the spans otherwise
+    uint64_t geometry_hash; // grid_file_geometry_hash of the binning scheme
+    uint64_t reserved[2];
+} GridFileHeader;
+
+/*
+ * A grid file mapped into memory. Every pointer points into the mapping.
+ */
+typedef struct grid_file {
+    const GridFileHeader *header;
+    const int32_t *spans;   // begin and end, past the last bin, of each span, NULL for GRID_FILE_DENSE
+    const void *values;     // uint8_t or int16_t values
+    const uint64_t *valid;  // bitset of the bins with data, NULL for GRID_FILE_SPANS
+    void *map;
+    size_t size;
+} GridFile;
+
+uint64_t grid_file_geometry_hash(int nrows, const int *n_bins_in_row);
+int grid_file_write(const char *path, int nrows, const int *n_bins_in_row, int layout, int value_type,
+                    const void *values, const uint64_t *valid);
+int grid_file_write_output(const char *path, int nrows, const int *n_bins_in_row, int layout,
+                           const int8_t *out_data);
+GridFile * grid_file_open(const char *path);
+int grid_file_matches(const GridFile *file, int nrows, const int *n_bins_in_row);
+void grid_file_read(const GridFile *file, void *values, uint64_t *valid);
+int grid_file_read_output(const GridFile *file, int8_t *out_data);
+void grid_file_close(GridFile *file);
+#endif //SIED_GRIDFILE_H
@@ -1,4 +1,5 @@
 #include "helpers.h"
+#include "bitset.h"
 #include "cayula.h"
 
 /*
@@ -79,4 +80,102 @@ void get_bin_window(int bin, int row, int width, const int *n_bins_in_row, const
             current_row++;
         }
     }
-}
\ No newline at end of file
+}
+
+/*
+ * Function:  get_window_starts
+ * --------------------
+ * Finds the first bin of each row of the window selected by get_window for the same arguments. Row i of the window
+ * then covers bins starts[i] to starts[i] + width - 1.
+ *
+ * args:
+ *      int bin: bin number of the center bin in the window
+ *      int row: the row number of the center bin
+ *      int width: the width of the window
+ *      int *n_bins_in_row: pointer to an array containing the number of bins in each row
+ *      int *basebins: pointer to an array containing the bin number for the first bin in each row
+ *      int *starts: pointer to output array for the first bin of each window row. The array should be width long
+ */
+void get_window_starts(int bin, int row, int width, const int *n_bins_in_row, const int *basebins, int starts[]) {
+    double ratio = ((double) bin - basebins[row]) /  n_bins_in_row[row];
+    int max_distance = width % 2 == 0 ? width >> 1 : (width - 1) >> 1;
+    int offset = width % 2 == 0 ? max_distance - 1 : max_distance;
+    int current_row = row - offset;
+    for (int i = 0; i < width; i++) {
+        starts[i] = (int) (ratio * n_bins_in_row[current_row] + 0.5) + basebins[current_row] - offset;
+        current_row++;
+    }
+}
+
+/*
+ * Function:  get_window_u8
+ * --------------------
+ * Selects the same window as get_window from data stored as 8 bit values with a separate set of valid bins. Bins that
+ * are not valid are given FILL_VALUE in the window.
+ *
+ * args:
+ *      int bin: bin number of the center bin in the window
+ *      int row: the row number of the center bin
+ *      int width: the width of the desired window
+ *      uint8_t *data: pointer to the array containing the data for every bin
+ *      uint64_t *valid: pointer to the bitset of bins containing data
+ *      int *n_bins_in_row: pointer to an array containing the number of bins in each row
+ *      int *basebins: pointer to an array containing the bin number for the first bin in each row
+ *      int *window: pointer to output array for the window. The array should be of width * width length
+ * returns:
+ *      int the number of fill values contained in the window
+ */
+int get_window_u8(int bin, int row, int width, const uint8_t *data, const uint64_t *valid, const int *n_bins_in_row,
+                  const int *basebins, int window[]) {
+    int starts[width];
+    int nfill_values = 0;
+    get_window_starts(bin, row, width, n_bins_in_row, basebins, starts);
+    for (int i = 0; i < width; i++) {
+        for (int j = 0; j < width; j++) {
+            int k = starts[i] + j;
+            if (bitset_get(valid, k)) {
+                window[i * width + j] = data[k];
+            } else {
+                window[i * width + j] = FILL_VALUE;
+                nfill_values++;
+            }
+        }
+    }
+    return nfill_values;
+}
+
+/*
+ * Function:  get_window_u16
+ * --------------------
+ * Selects the same window as get_window_u8 from data stored as 16 bit values.
+ *
+ * args:
+ *      int bin: bin number of the center bin in the window
+ *      int row: the row number of the center bin
+ *      int width: the width of the desired window
+ *      uint16_t *data: pointer to the array containing the data for every bin
+ *      uint64_t *valid: pointer to the bitset of bins containing data
+ *      int *n_bins_in_row: pointer to an array containing the number of bins in each row
+ *      int *basebins: pointer to an array containing the bin number for the first bin in each row
+ *      int *window: pointer to output array for the window. The array should be of width * width length
+ * returns:
+ *      int the number of fill values contained in the window
+ */
+int get_window_u16(int bin, int row, int width, const uint16_t *data, const uint64_t *valid, const int *n_bins_in_row,
+                   const int *basebins, int window[]) {
+    int starts[width];
+    int nfill_values = 0;
+    get_window_starts(bin, row, width, n_bins_in_row, basebins, starts);
+    for (int i = 0; i < width; i++) {
+        for (int j = 0; j < width; j++) {
+            int k = starts[i] + j;
+            if (bitset_get(valid, k)) {
+                window[i * width + j] = data[k];
+            } else {
+                window[i * width + j] = FILL_VALUE;
+                nfill_values++;
+            }
+        }
+    }
+    return nfill_values;
+}
@@ -4,7 +4,13 @@
 
 #ifndef SIED_HELPERS_H
 #define SIED_HELPERS_H
+#include <stdint.h>
 int get_window(int bin, int row, int width, const int *data, const int *n_bins_in_row,
                 const int *basebins, int window[]);
 void get_bin_window(int bin, int row, int width, const int *n_bins_in_row, const int *basebins, int window[]);
+int get_window_u8(int bin, int row, int width, const uint8_t *data, const uint64_t *valid, const int *n_bins_in_row,
+                  const int *basebins, int window[]);
+int get_window_u16(int bin, int row, int width, const uint16_t *data, const uint64_t *valid, const int *n_bins_in_row,
+                   const int *basebins, int window[]);
+void get_window_starts(int bin, int row, int width, const int *n_bins_in_row, const int *basebins, int starts[]);
 #endif //SIED_HELPERS_H
@@ -1,14 +1,14 @@
 /*
  * Functions for the implementation of the histogram analysis step of the single image edge detection algorithm.
  */
+#include <stdlib.h>
 #include <string.h>
 #include "helpers.h"
+#include "bitset.h"
 #include "histogram.h"
 #include "cayula.h"
 
-
-
-#define CRIT_VALUE 0.7
+#define HISTOGRAM_BANKS 4
 
 static inline double square(double a) {
     return a * a;
@@ -22,20 +22,39 @@ static inline int squarei(int a) {
  * Function: get_histogram
  * --------------------
  * Creates a histogram of the values in the window assuming the window contains integer values ranging from
- * 0 to 255.
+ * 0 to 255. Fill values and any other value outside of that range are left out of the histogram.
+ *
+ * Consecutive values are counted in separate banks that are summed at the end, so that runs of equal values do not
+ * wait on the store to the same count.
  *
  * args:
  *      int *data: the data contained within the window. Ranges from 0 to 255.
  *      int *histogram: pointer to a 256 element array for the output of the histogram
  */
 void get_histogram(const int *data, int *histogram) {
-    memset(histogram, 0, 256 * sizeof(int));
+    int banks[HISTOGRAM_BANKS][256];
+    memset(banks, 0, sizeof(banks));
     int area = squarei(WINDOW_WIDTH);
-    for (int i = 0; i < area; i++) {
-        if (data[i] != FILL_VALUE) {
-            histogram[data[i]]++;
+    int i = 0;
+    for (; i + HISTOGRAM_BANKS <= area; i += HISTOGRAM_BANKS) {
+        for (int k = 0; k < HISTOGRAM_BANKS; k++) {
+            if ((unsigned int) data[i + k] < 256) {
+                banks[k][data[i + k]]++;
+            }
         }
     }
+    for (; i < area; i++) {
+        if ((unsigned int) data[i] < 256) {
+            banks[0][data[i]]++;
+        }
+    }
+    for (int j = 0; j < 256; j++) {
+        int count = 0;
+        for (int k = 0; k < HISTOGRAM_BANKS; k++) {
+            count += banks[k][j];
+        }
+        histogram[j] = count;
+    }
 }
 
 /*
@@ -67,29 +86,120 @@ double within_group_variance(const int *histogram, double mu_low, double mu_high
     return (s_low * n_low / (n_low + n_high)) + (s_high * n_high / (n_low + n_high));
 }
 
+/*
+ * Function:  theta_margin
+ * --------------------
+ * Compares the ratio of the between group variance to the total variance of a division of a window with CRIT_VALUE
+ * exactly in integers. The within group variance is the total variance minus the between group variance, so with N
+ * values, n_low and n_high on either side, d = n_high * sum_low - n_low * sum_high and t = N * sum_squares - sum^2,
+ * the ratio reaches CRIT_VALUE exactly when CRIT_DENOMINATOR * d^2 >= CRIT_NUMERATOR * t * n_low * n_high.
+ *
+ * args:
+ *      int count: the number of values in the window
+ *      int64_t sum: the sum of the values in the window
+ *      int64_t sum_squares: the sum of the squares of the values in the window
+ *      int n_low: the number of values below the threshold
+ *      int64_t sum_low: the sum of the values below the threshold
+ *      __int128 *scale: pointer to the output for t * n_low * n_high, the scale of the margin
+ *
+ * returns:
+ *      __int128: CRIT_DENOMINATOR * d^2 - CRIT_NUMERATOR * t * n_low * n_high
+ */
+static __int128 theta_margin(int count, int64_t sum, int64_t sum_squares, int n_low, int64_t sum_low,
+                             __int128 *scale) {
+    int n_high = count - n_low;
+    int64_t d = (int64_t) n_high * sum_low - (int64_t) n_low * (sum - sum_low);
+    *scale = (__int128) (count * sum_squares - sum * sum) * n_low * n_high;
+    return (__int128) CRIT_DENOMINATOR * d * d - CRIT_NUMERATOR * *scale;
+}
 
 /*
- * Function:  too_large
+ * Function:  otsu_search
  * --------------------
- * Check to see if segmenting the window by the given threshold results in too small of a segment.
+ * Finds the threshold with the largest between group variance in a single pass over the bins of the histogram that
+ * contain values. The between group variance of each threshold is computed with the same floating point operations as
+ * the original analysis so that ties are broken the same way.
  *
  * args:
- *      int *histogram: pointer to an array containing a histogram of the values in the window
- *      int tau: the threshold by which to segment the window
+ *      int *histogram: pointer to a 256 element array containing the histogram of the window
+ *      int count: the number of values in the histogram
+ *      int64_t sum: the sum of the values in the histogram
+ *      int *n_low_max: pointer to the output for the number of values below the threshold
+ *      int *num_low_max: pointer to the output for the sum of the values below the threshold
+ *      double *max_between: pointer to the output for the between group variance of the threshold
  * returns:
- *      int: 1 if one of the segments is too large and 0 if both segments are of adequate size
+ *      int: the threshold or -1 if there is none or it leaves less than a quarter of the values on one side
  */
-int too_large(const int *histogram, int tau) {
-    int sum = 0;
-    int count = 0;
-    for (int i = 0; i < 256; i++) {
-        if (i < tau) {
-            sum += histogram[i];
+static int otsu_search(const int *histogram, int count, int64_t sum, int *n_low_max, int *num_low_max,
+                       double *max_between) {
+    int total = (int) sum;
+    int n_low = 0, num_low = 0;
+    int tau = -1;
+    *n_low_max = 0;
+    *num_low_max = 0;
+    *max_between = 0;
+    for (int i = 0; i < 254; i++) {
+        if (histogram[i] == 0) continue;
+        n_low += histogram[i];
+        num_low += i * histogram[i];
+        int n_high = count - n_low;
+        if (n_high == 0) break;
+        double mu_low = (double) num_low / n_low;
+        double mu_high = (double) (total - num_low) / n_high;
+        double between = (square(mu_low - mu_high) * n_low * n_high) / squarei(count);
+        if (between > *max_between) {
+            tau = i + 1;
+            *max_between = between;
+            *n_low_max = n_low;
+            *num_low_max = num_low;
         }
-        count += histogram[i];
     }
-    double ratio = (double) sum / count;
-    return (ratio < 0.25 ||  ratio > 0.75);
+    if (tau < 0 || 4 * *n_low_max < count || 4 * *n_low_max > 3 * count) return -1;
+    return tau;
+}
+
+/*
+ * Function:  otsu_theta
+ * --------------------
+ * Calculates the ratio of the between group variance to the total variance for a threshold found by otsu_search with
+ * the floating point operations of the original analysis.
+ */
+static double otsu_theta(const int *histogram, int count, int64_t sum, int tau, int n_low_max, int num_low_max,
+                         double max_between) {
+    int n_high_max = count - n_low_max;
+    double mu_low_max = (double) num_low_max / n_low_max;
+    double mu_high_max = (double) ((int) sum - num_low_max) / n_high_max;
+    double within = within_group_variance(histogram, mu_low_max, mu_high_max, n_low_max, n_high_max, tau);
+    return max_between / (max_between + within);
+}
+
+/*
+ * Function:  otsu_threshold
+ * --------------------
+ * Finds the threshold with otsu_search, then decides whether it divides the window well enough with theta_margin
+ * instead of another pass. Only when the margin is too small for the original floating point calculation to be sure of
+ * its answer is that calculation repeated.
+ *
+ * args:
+ *      int *histogram: pointer to a 256 element array containing the histogram of the window
+ *      int count: the number of values in the histogram
+ *      int64_t sum: the sum of the values in the histogram
+ *      int64_t sum_squares: the sum of the squares of the values in the histogram
+ * returns:
+ *      int: the threshold value that best divides the window or -1 if the window is unlikely to contain a front
+ */
+static int otsu_threshold(const int *histogram, int count, int64_t sum, int64_t sum_squares) {
+    int n_low_max, num_low_max;
+    double max_between;
+    int tau = otsu_search(histogram, count, sum, &n_low_max, &num_low_max, &max_between);
+    if (tau < 0) return -1;
+
+    __int128 scale;
+    __int128 margin = theta_margin(count, sum, sum_squares, n_low_max, num_low_max, &scale);
+    __int128 tolerance = scale >> 20;
+    if (margin > tolerance) return tau;
+    if (margin < -tolerance) return -1;
+    return otsu_theta(histogram, count, sum, tau, n_low_max, num_low_max, max_between) >= CRIT_VALUE ? tau : -1;
 }
 
 /*
@@ -107,40 +217,469 @@ int too_large(const int *histogram, int tau) {
 int histogram_analysis(const int *window) {
     int histogram[256];
     get_histogram(window, histogram);
-    int n_low = 0, num_low = 0, n_high = 0, num_high = 0;
-    double max_between = 0;
+    return histogram_threshold(histogram);
+}
+
+/*
+ * Function:  histogram_threshold
+ * --------------------
+ * Performs the histogram analysis of histogram_analysis on the histogram of a window rather than the window itself.
+ *
+ * args:
+ *      int *histogram: pointer to a 256 element array containing the histogram of the window
+ * returns:
+ *      int: the threshold value that best divides the window or -1 if the window is unlikely to contain a front
+ */
+int histogram_threshold(const int *histogram) {
+    int count = 0;
+    int64_t sum = 0, sum_squares = 0;
     for (int i = 0; i < 256; i++) {
-        n_high += histogram[i];
-        num_high += i * histogram[i];
+        count += histogram[i];
+        sum += i * histogram[i];
+        sum_squares += (int64_t) (i * i) * histogram[i];
     }
-    int tau = -1;
-    double n_low_max, n_high_max, mu_high, mu_low_max, mu_low, mu_high_max;
+    return otsu_threshold(histogram, count, sum, sum_squares);
+}
 
-    for (int i = 0; i  < 254; i++) {
-        n_high -= histogram[i];
-        num_high -= i * histogram[i];
-        n_low += histogram[i];
-        num_low += (i) * histogram[i];
-        if (n_low != 0 && n_high != 0) {
-            mu_low = (double) num_low / n_low;
-            mu_high = (double) num_high / n_high;
-            double between = (square(mu_low - mu_high) * n_low * n_high) / squarei(n_low + n_high);
-
-            if (between > max_between) {
-                tau = i + 1;
-                max_between = between;
-                n_low_max = n_low;
-                n_high_max = n_high;
-                mu_low_max = mu_low;
-                mu_high_max = mu_high;
+/*
+ * Function:  window_histogram_threshold
+ * --------------------
+ * Performs the histogram analysis on the histogram of a moving window using the totals kept with it, so the histogram
+ * is only read once.
+ *
+ * args:
+ *      WindowHistogram *h: pointer to the histogram of the window
+ * returns:
+ *      int: the threshold value that best divides the window or -1 if the window is unlikely to contain a front
+ */
+int window_histogram_threshold(const WindowHistogram *h) {
+    return otsu_threshold(h->histogram, h->count, h->sum, h->sum_squares);
+}
+
+/*
+ * Function:  window_histogram_theta
+ * --------------------
+ * Finds the threshold of window_histogram_threshold without comparing theta to CRIT_VALUE, for choosing the critical
+ * value later. The threshold is accepted by window_histogram_threshold exactly when theta >= CRIT_VALUE.
+ *
+ * args:
+ *      WindowHistogram *h: pointer to the histogram of the window
+ *      double *theta: pointer to the output for the ratio of the between group variance to the total variance
+ * returns:
+ *      int: the threshold value that best divides the window or -1 if no value divides it into large enough groups
+ */
+int window_histogram_theta(const WindowHistogram *h, double *theta) {
+    int n_low_max, num_low_max;
+    double max_between;
+    int tau = otsu_search(h->histogram, h->count, h->sum, &n_low_max, &num_low_max, &max_between);
+    if (tau < 0) return -1;
+    *theta = otsu_theta(h->histogram, h->count, h->sum, tau, n_low_max, num_low_max, max_between);
+    return tau;
+}
+
+/*
+ * Function:  add_row
+ * --------------------
+ * Adds the values of bins first to last - 1 to the histogram, or removes them if sign is -1.
+ */
+static void add_row(WindowHistogram *h, const uint8_t *data, const uint64_t *valid, int first, int last, int sign) {
+    for (int k = first; k < last; k++) {
+        if (bitset_get(valid, k)) {
+            int value = data[k];
+            h->histogram[value] += sign;
+            h->count += sign;
+            h->sum += sign * value;
+            h->sum_squares += sign * value * value;
+        } else {
+            h->nfill_values += sign;
+        }
+    }
+}
+
+/*
+ * Function:  window_histogram_init
+ * --------------------
+ * Creates the histogram of the window selected by get_window for the given center bin.
+ *
+ * args:
+ *      WindowHistogram *h: pointer to the histogram to initialize
+ *      int bin: bin number of the center bin in the window
+ *      int row: the row number of the center bin
+ *      int width: the width of the window. Must not be greater than HISTOGRAM_MAX_WIDTH
+ *      uint8_t *data: pointer to the array containing the data for every bin
+ *      uint64_t *valid: pointer to the bitset of bins containing data
+ *      int *n_bins_in_row: pointer to an array containing the number of bins in each row
+ *      int *basebins: pointer to an array containing the bin number for the first bin in each row
+ */
+void window_histogram_init(WindowHistogram *h, int bin, int row, int width, const uint8_t *data,
+                           const uint64_t *valid, const int *n_bins_in_row, const int *basebins) {
+    memset(h->histogram, 0, 256 * sizeof(int));
+    h->width = width;
+    h->nfill_values = 0;
+    h->count = 0;
+    h->sum = 0;
+    h->sum_squares = 0;
+    get_window_starts(bin, row, width, n_bins_in_row, basebins, h->starts);
+    for (int i = 0; i < width; i++) {
+        add_row(h, data, valid, h->starts[i], h->starts[i] + width, 1);
+    }
+}
+
+/*
+ * Function:  window_histogram_move
+ * --------------------
+ * Moves the window to a new center bin further along the same row. Only the bins that leave and enter each row of the
+ * window are counted, so moving by a fraction of the window width costs the same fraction of building the histogram
+ * from scratch. If the new window shares no bins with the old one the histogram is rebuilt instead.
+ *
+ * args:
+ *      WindowHistogram *h: pointer to a histogram initialized with window_histogram_init
+ *      int bin: bin number of the new center bin. Must not be before the current center bin
+ *      int row: the row number of the center bin
+ *      uint8_t *data: pointer to the array containing the data for every bin
+ *      uint64_t *valid: pointer to the bitset of bins containing data
+ *      int *n_bins_in_row: pointer to an array containing the number of bins in each row
+ *      int *basebins: pointer to an array containing the bin number for the first bin in each row
+ */
+void window_histogram_move(WindowHistogram *h, int bin, int row, const uint8_t *data, const uint64_t *valid,
+                           const int *n_bins_in_row, const int *basebins) {
+    int width = h->width;
+    int starts[HISTOGRAM_MAX_WIDTH];
+    get_window_starts(bin, row, width, n_bins_in_row, basebins, starts);
+    int overlap = 0;
+    for (int i = 0; i < width; i++) {
+        overlap |= starts[i] < h->starts[i] + width;
+    }
+    if (!overlap) {
+        window_histogram_init(h, bin, row, width, data, valid, n_bins_in_row, basebins);
+        return;
+    }
+    for (int i = 0; i < width; i++) {
+        int old_end = h->starts[i] + width;
+        if (starts[i] >= old_end) {
+            add_row(h, data, valid, h->starts[i], old_end, -1);
+            add_row(h, data, valid, starts[i], starts[i] + width, 1);
+        } else {
+            add_row(h, data, valid, h->starts[i], starts[i], -1);
+            add_row(h, data, valid, old_end, starts[i] + width, 1);
+        }
+        h->starts[i] = starts[i];
+    }
+}
+
+/*
+ * Function:  screen_totals
+ * --------------------
+ * Checks the valid fraction and variance bounds of a window from the count, sum and sum of squares of its values.
+ *
+ * returns:
+ *      int: SCREEN_PASS or the SCREEN_REJECT_ value of the first bound the window fails
+ */
+static int screen_totals(int width, int count, int64_t sum, int64_t sum_squares, const WindowScreen *screen) {
+    int area = width * width;
+    if (count < 2 || count < screen->min_valid_fraction * area) return SCREEN_REJECT_VALID;
+
+    /*
+     * count^2 times the variance, which is exact in integers
+     */
+    int64_t scaled_variance = count * sum_squares - sum * sum;
+    if (scaled_variance == 0 || scaled_variance <= screen->min_variance * count * count) {
+        return SCREEN_REJECT_VARIANCE;
+    }
+    return SCREEN_PASS;
+}
+
+/*
+ * Function:  window_histogram_screen
+ * --------------------
+ * Checks a window against cheap bounds before its histogram is analyzed, from the fewest valid values to the
+ * smallest spread of values. The valid fraction and variance come from the totals kept with the histogram, so only
+ * the range check looks at the histogram itself, and only when a minimum range is set.
+ *
+ * args:
+ *      WindowHistogram *h: pointer to the histogram of the window
+ *      WindowScreen *screen: the bounds to check
+ *
+ * returns:
+ *      int: SCREEN_PASS if the window meets every bound or the SCREEN_REJECT_ value of the first bound it fails
+ */
+int window_histogram_screen(const WindowHistogram *h, const WindowScreen *screen) {
+    int reject = screen_totals(h->width, h->count, h->sum, h->sum_squares, screen);
+    if (reject != SCREEN_PASS || screen->min_range <= 1) return reject;
+
+    int low = 0, high = 255;
+    while (h->histogram[low] == 0) low++;
+    while (h->histogram[high] == 0) high--;
+    return high - low < screen->min_range ? SCREEN_REJECT_RANGE : SCREEN_PASS;
+}
+
+/*
+ * Function:  window_histogram16_create
+ * --------------------
+ * Allocates an empty histogram for windows of 16 bit data with values less than the given number of levels.
+ *
+ * args:
+ *      int levels: the number of levels of the data. Must not be greater than HISTOGRAM_MAX_LEVELS
+ *
+ * returns:
+ *      WindowHistogram16 *: the new histogram or NULL if memory could not be allocated
+ */
+WindowHistogram16 * window_histogram16_create(int levels) {
+    WindowHistogram16 *h = calloc(1, sizeof(WindowHistogram16));
+    if (h == NULL) return NULL;
+    h->levels = levels;
+    h->fine = calloc(levels, sizeof(uint16_t));
+    h->occupied = calloc(bitset_words(levels), sizeof(uint64_t));
+    if (h->fine == NULL || h->occupied == NULL) {
+        window_histogram16_destroy(h);
+        return NULL;
+    }
+    return h;
+}
+
+/*
+ * Function:  window_histogram16_destroy
+ * --------------------
+ * Frees the histogram.
+ */
+void window_histogram16_destroy(WindowHistogram16 *h) {
+    if (h == NULL) return;
+    free(h->fine);
+    free(h->occupied);
+    free(h);
+}
+
+/*
+ * Function:  add_row16
+ * --------------------
+ * Adds the values of bins first to last - 1 to the histogram, or removes them if sign is -1.
+ */
+static void add_row16(WindowHistogram16 *h, const uint16_t *data, const uint64_t *valid, int first, int last,
+                      int sign) {
+    for (int k = first; k < last; k++) {
+        if (bitset_get(valid, k)) {
+            int value = data[k];
+            if (sign > 0) {
+                if (h->fine[value]++ == 0) bitset_set(h->occupied, value);
+            } else {
+                if (--h->fine[value] == 0) bitset_clear(h->occupied, value);
             }
+            h->coarse[value >> HISTOGRAM_COARSE_SHIFT] += sign;
+            h->count += sign;
+            h->sum += sign * value;
+            h->sum_squares += sign * (int64_t) value * value;
+        } else {
+            h->nfill_values += sign;
+        }
+    }
+}
+
+/*
+ * Function:  next_level
+ * --------------------
+ * Finds the smallest level of the histogram that is not less than the given value and occurs in the window, skipping
+ * whole coarse buckets without values.
+ *
+ * returns:
+ *      int: the level or -1 if there is none
+ */
+static int next_level(const WindowHistogram16 *h, int value) {
+    int words_per_bucket = (1 << HISTOGRAM_COARSE_SHIFT) >> 6;
+    int nwords = bitset_words(h->levels);
+    int w = value >> 6;
+    if (w >= nwords) return -1;
+    uint64_t bits = h->occupied[w] & (~0ULL << (value & 63));
+    while (bits == 0) {
+        w++;
+        while (w < nwords && w % words_per_bucket == 0 && h->coarse[w / words_per_bucket] == 0) {
+            w += words_per_bucket;
         }
+        if (w >= nwords) return -1;
+        bits = h->occupied[w];
+    }
+    return (w << 6) + __builtin_ctzll(bits);
+}
 
+/*
+ * Function:  window_histogram16_init
+ * --------------------
+ * Creates the histogram of the window selected by get_window for the given center bin, like window_histogram_init.
+ * The counts of the previous window are cleared through the bitset of levels that occur, so the cost does not grow
+ * with the number of levels.
+ *
+ * args:
+ *      WindowHistogram16 *h: pointer to a histogram from window_histogram16_create
+ *      int bin: bin number of the center bin in the window
+ *      int row: the row number of the center bin
+ *      int width: the width of the window. Must not be greater than HISTOGRAM_MAX_WIDTH
+ *      uint16_t *data: pointer to the array containing the data for every bin. Every value must be less than the
+ *      number of levels of the histogram
+ *      uint64_t *valid: pointer to the bitset of bins containing data
+ *      int *n_bins_in_row: pointer to an array containing the number of bins in each row
+ *      int *basebins: pointer to an array containing the bin number for the first bin in each row
+ */
+void window_histogram16_init(WindowHistogram16 *h, int bin, int row, int width, const uint16_t *data,
+                             const uint64_t *valid, const int *n_bins_in_row, const int *basebins) {
+    for (int value = next_level(h, 0); value >= 0; value = next_level(h, value + 1)) {
+        h->fine[value] = 0;
+        bitset_clear(h->occupied, value);
     }
-    double theta = 0;
-    if (!too_large(histogram, tau)) {
-        double within = within_group_variance(histogram, mu_low_max, mu_high_max, n_low_max, n_high_max, tau);
-        theta = max_between / (max_between + within);
+    memset(h->coarse, 0, sizeof(h->coarse));
+    h->width = width;
+    h->nfill_values = 0;
+    h->count = 0;
+    h->sum = 0;
+    h->sum_squares = 0;
+    get_window_starts(bin, row, width, n_bins_in_row, basebins, h->starts);
+    for (int i = 0; i < width; i++) {
+        add_row16(h, data, valid, h->starts[i], h->starts[i] + width, 1);
     }
-    return theta >= CRIT_VALUE ? tau : -1;
-}
\ No newline at end of file
+}
+
+/*
+ * Function:  window_histogram16_move
+ * --------------------
+ * Moves the window to a new center bin further along the same row, like window_histogram_move.
+ *
+ * args:
+ *      WindowHistogram16 *h: pointer to a histogram initialized with window_histogram16_init
+ *      int bin: bin number of the new center bin. Must not be before the current center bin
+ *      int row: the row number of the center bin
+ *      uint16_t *data: pointer to the array containing the data for every bin
+ *      uint64_t *valid: pointer to the bitset of bins containing data
+ *      int *n_bins_in_row: pointer to an array containing the number of bins in each row
+ *      int *basebins: pointer to an array containing the bin number for the first bin in each row
+ */
+void window_histogram16_move(WindowHistogram16 *h, int bin, int row, const uint16_t *data, const uint64_t *valid,
+                             const int *n_bins_in_row, const int *basebins) {
+    int width = h->width;
+    int starts[HISTOGRAM_MAX_WIDTH];
+    get_window_starts(bin, row, width, n_bins_in_row, basebins, starts);
+    int overlap = 0;
+    for (int i = 0; i < width; i++) {
+        overlap |= starts[i] < h->starts[i] + width;
+    }
+    if (!overlap) {
+        window_histogram16_init(h, bin, row, width, data, valid, n_bins_in_row, basebins);
+        return;
+    }
+    for (int i = 0; i < width; i++) {
+        int old_end = h->starts[i] + width;
+        if (starts[i] >= old_end) {
+            add_row16(h, data, valid, h->starts[i], old_end, -1);
+            add_row16(h, data, valid, starts[i], starts[i] + width, 1);
+        } else {
+            add_row16(h, data, valid, h->starts[i], starts[i], -1);
+            add_row16(h, data, valid, old_end, starts[i] + width, 1);
+        }
+        h->starts[i] = starts[i];
+    }
+}
+
+/*
+ * Function:  window_histogram16_screen
+ * --------------------
+ * Checks a window of 16 bit data against the bounds of window_histogram_screen.
+ *
+ * args:
+ *      WindowHistogram16 *h: pointer to the histogram of the window
+ *      WindowScreen *screen: the bounds to check
+ *
+ * returns:
+ *      int: SCREEN_PASS if the window meets every bound or the SCREEN_REJECT_ value of the first bound it fails
+ */
+int window_histogram16_screen(const WindowHistogram16 *h, const WindowScreen *screen) {
+    int reject = screen_totals(h->width, h->count, h->sum, h->sum_squares, screen);
+    if (reject != SCREEN_PASS || screen->min_range <= 1) return reject;
+
+    int low = next_level(h, 0);
+    int w = bitset_words(h->levels) - 1;
+    while (h->occupied[w] == 0) w--;
+    int high = (w << 6) + 63 - __builtin_clzll(h->occupied[w]);
+    return high - low < screen->min_range ? SCREEN_REJECT_RANGE : SCREEN_PASS;
+}
+
+/*
+ * Function:  otsu_search16
+ * --------------------
+ * Finds the threshold with the largest between group variance of a window of 16 bit data like otsu_search.
+ *
+ * args:
+ *      WindowHistogram16 *h: pointer to the histogram of the window
+ *      int *n_low_out: pointer to the output for the number of values below the threshold
+ *      int64_t *num_low_out: pointer to the output for the sum of the values below the threshold
+ * returns:
+ *      int: the threshold or -1 if there is none or it leaves less than a quarter of the values on one side
+ */
+static int otsu_search16(const WindowHistogram16 *h, int *n_low_out, int64_t *num_low_out) {
+    int count = h->count;
+    int n_low = 0, n_low_max = 0, tau = -1;
+    int64_t num_low = 0, num_low_max = 0;
+    double max_between = 0;
+    for (int value = next_level(h, 0); value >= 0 && value < h->levels - 2; value = next_level(h, value + 1)) {
+        n_low += h->fine[value];
+        num_low += (int64_t) value * h->fine[value];
+        int n_high = count - n_low;
+        if (n_high == 0) break;
+        double mu_low = (double) num_low / n_low;
+        double mu_high = (double) (h->sum - num_low) / n_high;
+        double between = (square(mu_low - mu_high) * n_low * n_high) / squarei(count);
+        if (between > max_between) {
+            tau = value + 1;
+            max_between = between;
+            n_low_max = n_low;
+            num_low_max = num_low;
+        }
+    }
+    if (tau < 0 || 4 * n_low_max < count || 4 * n_low_max > 3 * count) return -1;
+    *n_low_out = n_low_max;
+    *num_low_out = num_low_max;
+    return tau;
+}
+
+/*
+ * Function:  window_histogram16_threshold
+ * --------------------
+ * Performs the histogram analysis of histogram_threshold on a window of 16 bit data. Only the levels that occur in the
+ * window are visited, so the cost grows with the number of distinct values rather than the number of levels. Like
+ * histogram_threshold, the window is never divided between the last two levels. As there is no earlier floating point
+ * result to reproduce, the threshold is accepted exactly when theta_margin is not negative.
+ *
+ * args:
+ *      WindowHistogram16 *h: pointer to the histogram of the window
+ * returns:
+ *      int: the threshold value that best divides the window or -1 if the window is unlikely to contain a front
+ */
+int window_histogram16_threshold(const WindowHistogram16 *h) {
+    int n_low_max;
+    int64_t num_low_max;
+    int tau = otsu_search16(h, &n_low_max, &num_low_max);
+    if (tau < 0) return -1;
+
+    __int128 scale;
+    return theta_margin(h->count, h->sum, h->sum_squares, n_low_max, num_low_max, &scale) >= 0 ? tau : -1;
+}
+
+/*
+ * Function:  window_histogram16_theta
+ * --------------------
+ * Finds the threshold of window_histogram16_threshold without comparing theta to CRIT_VALUE, like
+ * window_histogram_theta. Theta is the exact ratio from theta_margin rounded to a double.
+ *
+ * args:
+ *      WindowHistogram16 *h: pointer to the histogram of the window
+ *      double *theta: pointer to the output for the ratio of the between group variance to the total variance
+ * returns:
+ *      int: the threshold value that best divides the window or -1 if no value divides it into large enough groups
+ */
+int window_histogram16_theta(const WindowHistogram16 *h, double *theta) {
+    int n_low_max;
+    int64_t num_low_max;
+    int tau = otsu_search16(h, &n_low_max, &num_low_max);
+    if (tau < 0) return -1;
+
+    __int128 scale;
+    __int128 margin = theta_margin(h->count, h->sum, h->sum_squares, n_low_max, num_low_max, &scale);
+    *theta = ((double) margin / (double) scale + CRIT_NUMERATOR) / CRIT_DENOMINATOR;
+    return tau;
+}
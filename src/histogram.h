@@ -2,8 +2,81 @@
 // Created by Christopher Berglund on 11/1/19.
 //
 #include <stdbool.h>
+#include <stdint.h>
 #ifndef SIED_HISTOGRAM_H
 #define SIED_HISTOGRAM_H
+#define CRIT_VALUE 0.7
+#define CRIT_NUMERATOR 7        // CRIT_VALUE as a fraction
+#define CRIT_DENOMINATOR 10
+#define HISTOGRAM_MAX_WIDTH 64
+#define HISTOGRAM_MAX_LEVELS 65536
+#define HISTOGRAM_COARSE_SHIFT 8
+
+#define SCREEN_PASS 0
+#define SCREEN_REJECT_VALID 1
+#define SCREEN_REJECT_VARIANCE 2
+#define SCREEN_REJECT_RANGE 3
+
+/*
+ * Histogram of a window that can be moved along a row of the map without recounting the bins it still covers. The
+ * number, sum and sum of squares of the valid values are kept along with it for screening the window.
+ */
+typedef struct window_histogram {
+    int histogram[256];
+    int starts[HISTOGRAM_MAX_WIDTH];
+    int width;
+    int nfill_values;
+    int count;
+    int64_t sum;
+    int64_t sum_squares;
+} WindowHistogram;
+
+/*
+ * Histogram of a window of 16 bit data that can be moved like WindowHistogram. Every level is counted in the fine
+ * histogram and every 1 << HISTOGRAM_COARSE_SHIFT levels in the coarse histogram, and the levels that occur are kept
+ * in a bitset, so that analyzing the histogram only visits the levels in the window rather than every level.
+ */
+typedef struct window_histogram16 {
+    uint16_t *fine;
+    uint64_t *occupied;
+    int coarse[HISTOGRAM_MAX_LEVELS >> HISTOGRAM_COARSE_SHIFT];
+    int levels;
+    int starts[HISTOGRAM_MAX_WIDTH];
+    int width;
+    int nfill_values;
+    int count;
+    int64_t sum;
+    int64_t sum_squares;
+} WindowHistogram16;
+
+/*
+ * Bounds a window must meet before its histogram is analyzed. Windows with fewer than two valid values or a single
+ * value can never have a threshold and are rejected whatever the bounds.
+ */
+typedef struct window_screen {
+    double min_valid_fraction;  // fraction of the bins of the window that must contain data
+    double min_variance;        // variance the values of the window must exceed
+    int min_range;              // difference between the largest and smallest value the window must reach
+} WindowScreen;
+
 double mean(const double *histogram, int threshold, bool high, int nvalues);
+void get_histogram(const int *data, int *histogram);
+int histogram_threshold(const int *histogram);
 int histogram_analysis(const int *window);
+int window_histogram_threshold(const WindowHistogram *h);
+int window_histogram_theta(const WindowHistogram *h, double *theta);
+void window_histogram_init(WindowHistogram *h, int bin, int row, int width, const uint8_t *data,
+                           const uint64_t *valid, const int *n_bins_in_row, const int *basebins);
+void window_histogram_move(WindowHistogram *h, int bin, int row, const uint8_t *data, const uint64_t *valid,
+                           const int *n_bins_in_row, const int *basebins);
+int window_histogram_screen(const WindowHistogram *h, const WindowScreen *screen);
+WindowHistogram16 * window_histogram16_create(int levels);
+void window_histogram16_init(WindowHistogram16 *h, int bin, int row, int width, const uint16_t *data,
+                             const uint64_t *valid, const int *n_bins_in_row, const int *basebins);
+void window_histogram16_move(WindowHistogram16 *h, int bin, int row, const uint16_t *data, const uint64_t *valid,
+                             const int *n_bins_in_row, const int *basebins);
+int window_histogram16_screen(const WindowHistogram16 *h, const WindowScreen *screen);
+int window_histogram16_threshold(const WindowHistogram16 *h);
+int window_histogram16_theta(const WindowHistogram16 *h, double *theta);
+void window_histogram16_destroy(WindowHistogram16 *h);
 #endif //SIED_HISTOGRAM_H
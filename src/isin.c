@@ -0,0 +1,163 @@
+/*
+ * Geometry of the ISIN grid of level 3 binned satellite products and of areas of interest within it.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include "isin.h"
+
+/*
+ * Function:  isin_rows
+ * --------------------
+ * Finds the rows of the full ISIN grid with the given number of rows. Each row has the number of bins nearest to
+ * 2 * nrows * cos(latitude), and at least one.
+ *
+ * args:
+ *      int nrows: the number of rows of the grid
+ *      int *n_bins_in_row: pointer to an output array of nrows elements for the number of bins in each row
+ *      int *basebins: pointer to an output array of nrows elements for the first bin of each row
+ *
+ * returns:
+ *      int: the number of bins of the grid
+ */
+int isin_rows(int nrows, int *n_bins_in_row, int *basebins) {
+    int nbins = 0;
+    for (int i = 0; i < nrows; i++) {
+        int n = (int) floor(2. * nrows * cos(isin_row_lat(nrows, i) * M_PI / 180.) + 0.5);
+        n_bins_in_row[i] = n > 1 ? n : 1;
+        basebins[i] = nbins;
+        nbins += n_bins_in_row[i];
+    }
+    return nbins;
+}
+
+/*
+ * Function:  first_col_from
+ * --------------------
+ * Finds the first column of a row whose center is at or east of the given longitude. The estimate from the inverse of
+ * isin_bin_lon is corrected with the same comparison a check of every bin would make, so rounding never moves a bin
+ * in or out of the area.
+ *
+ * returns:
+ *      int: the column, or n_bins_in_row if every bin is west of lon
+ */
+static int first_col_from(int n_bins_in_row, double lon) {
+    double estimate = ceil((lon + 180) * n_bins_in_row / 360. - 0.5);
+    int col = estimate < 0 ? 0 : estimate > n_bins_in_row ? n_bins_in_row : (int) estimate;
+    while (col > 0 && isin_bin_lon(n_bins_in_row, col - 1) >= lon) col--;
+    while (col < n_bins_in_row && isin_bin_lon(n_bins_in_row, col) < lon) col++;
+    return col;
+}
+
+/*
+ * Function:  isin_aoi_create
+ * --------------------
+ * Finds the bins of the ISIN grid with the given number of rows whose centers are inside a box of latitude and
+ * longitude, edges included. Only the rows are walked, so the cost does not depend on the number of bins.
+ *
+ * args:
+ *      int nrows: the number of rows of the grid
+ *      double min_lat, max_lat: the latitudes of the south and north edges of the box, from -90 to 90
+ *      double min_lon, max_lon: the longitudes of the west and east edges of the box, from -180 to 180
+ *
+ * returns:
+ *      IsinAoi *: the area, which has no bins if the box does not contain a bin center, or NULL if memory could not
+ *      be allocated
+ */
+IsinAoi * isin_aoi_create(int nrows, double min_lat, double max_lat, double min_lon, double max_lon) {
+    IsinAoi *aoi = calloc(1, sizeof(IsinAoi));
+    int *grid_n_bins_in_row = malloc(nrows * sizeof(int));
+    int *grid_basebins = malloc(nrows * sizeof(int));
+    if (aoi != NULL) {
+        aoi->n_bins_in_row = malloc(nrows * sizeof(int));
+        aoi->basebins = malloc(nrows * sizeof(int));
+        aoi->grid_nrows = nrows;
+        aoi->grid_rows = malloc(nrows * sizeof(int));
+        aoi->grid_n_bins_in_row = malloc(nrows * sizeof(int));
+        aoi->grid_cols = malloc(nrows * sizeof(int));
+        aoi->grid_basebins = malloc(nrows * sizeof(int));
+    }
+    if (aoi == NULL || grid_n_bins_in_row == NULL || grid_basebins == NULL || aoi->n_bins_in_row == NULL ||
+        aoi->basebins == NULL || aoi->grid_rows == NULL || aoi->grid_n_bins_in_row == NULL || aoi->grid_cols == NULL ||
+        aoi->grid_basebins == NULL) {
+        isin_aoi_destroy(aoi);
+        free(grid_n_bins_in_row);
+        free(grid_basebins);
+        return NULL;
+    }
+
+    isin_rows(nrows, grid_n_bins_in_row, grid_basebins);
+    for (int i = 0; i < nrows; i++) {
+        double lat = isin_row_lat(nrows, i);
+        if (lat < min_lat || lat > max_lat) continue;
+        int n = grid_n_bins_in_row[i];
+        int first = first_col_from(n, min_lon);
+        int last = first_col_from(n, max_lon);
+        if (last < n && isin_bin_lon(n, last) <= max_lon) last++;
+        if (last <= first) continue;
+        aoi->n_bins_in_row[aoi->nrows] = last - first;
+        aoi->basebins[aoi->nrows] = aoi->nbins;
+        aoi->grid_rows[aoi->nrows] = i;
+        aoi->grid_n_bins_in_row[aoi->nrows] = n;
+        aoi->grid_cols[aoi->nrows] = first;
+        aoi->grid_basebins[aoi->nrows] = grid_basebins[i] + first;
+        aoi->nbins += last - first;
+        aoi->nrows++;
+    }
+    free(grid_n_bins_in_row);
+    free(grid_basebins);
+    return aoi;
+}
+
+/*
+ * Function:  isin_aoi_bins
+ * --------------------
+ * Writes the bin number within the grid of every bin of the area, in increasing order.
+ *
+ * args:
+ *      IsinAoi *aoi: the area
+ *      int *bins: pointer to an output array of aoi->nbins elements
+ */
+void isin_aoi_bins(const IsinAoi *aoi, int *bins) {
+    for (int r = 0; r < aoi->nrows; r++) {
+        for (int k = 0; k < aoi->n_bins_in_row[r]; k++) {
+            bins[aoi->basebins[r] + k] = aoi->grid_basebins[r] + k;
+        }
+    }
+}
+
+/*
+ * Function:  isin_aoi_lat_lon
+ * --------------------
+ * Writes the latitude and longitude of the center of every bin of the area.
+ *
+ * args:
+ *      IsinAoi *aoi: the area
+ *      double *lats, *lons: pointers to output arrays of aoi->nbins elements. Either may be NULL to leave it out
+ */
+void isin_aoi_lat_lon(const IsinAoi *aoi, double *lats, double *lons) {
+    for (int r = 0; r < aoi->nrows; r++) {
+        double *row_lats = lats != NULL ? lats + aoi->basebins[r] : NULL;
+        double *row_lons = lons != NULL ? lons + aoi->basebins[r] : NULL;
+        double lat = isin_row_lat(aoi->grid_nrows, aoi->grid_rows[r]);
+        for (int k = 0; k < aoi->n_bins_in_row[r]; k++) {
+            if (row_lats != NULL) row_lats[k] = lat;
+            if (row_lons != NULL) row_lons[k] = isin_bin_lon(aoi->grid_n_bins_in_row[r], aoi->grid_cols[r] + k);
+        }
+    }
+}
+
+/*
+ * Function:  isin_aoi_destroy
+ * --------------------
+ * Frees the area and its arrays.
+ */
+void isin_aoi_destroy(IsinAoi *aoi) {
+    if (aoi == NULL) return;
+    free(aoi->n_bins_in_row);
+    free(aoi->basebins);
+    free(aoi->grid_rows);
+    free(aoi->grid_n_bins_in_row);
+    free(aoi->grid_cols);
+    free(aoi->grid_basebins);
+    free(aoi);
+}
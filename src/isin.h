@@ -0,0 +1,37 @@
+#ifndef SIED_ISIN_H
+#define SIED_ISIN_H
+
+/*
+ * The part of the ISIN grid inside a box of latitude and longitude, stored as a binning scheme of its own. Each row of
+ * the area is the run of bins of a row of the grid whose centers are inside the box. Rows of the grid without a bin
+ * inside the box are left out.
+ */
+typedef struct isin_aoi {
+    int nbins;              // number of bins of the area
+    int nrows;              // number of rows of the area
+    int *n_bins_in_row;     // number of bins in each row of the area
+    int *basebins;          // bin number within the area of the first bin of each row
+    int grid_nrows;         // number of rows of the grid
+    int *grid_rows;         // row of the grid of each row of the area
+    int *grid_n_bins_in_row; // number of bins in that row of the grid
+    int *grid_cols;         // column within that row of the grid of the first bin of each row
+    int *grid_basebins;     // bin number within the grid of the first bin of each row
+} IsinAoi;
+
+/*
+ * Latitude of the center of a row and longitude of the center of a bin in its row, in degrees.
+ */
+static inline double isin_row_lat(int nrows, int row) {
+    return (row + 0.5) * 180. / nrows - 90;
+}
+
+static inline double isin_bin_lon(int n_bins_in_row, int col) {
+    return 360. * (col + 0.5) / n_bins_in_row - 180;
+}
+
+int isin_rows(int nrows, int *n_bins_in_row, int *basebins);
+IsinAoi * isin_aoi_create(int nrows, double min_lat, double max_lat, double min_lon, double max_lon);
+void isin_aoi_bins(const IsinAoi *aoi, int *bins);
+void isin_aoi_lat_lon(const IsinAoi *aoi, double *lats, double *lons);
+void isin_aoi_destroy(IsinAoi *aoi);
+#endif //SIED_ISIN_H
@@ -0,0 +1,138 @@
+/*
+ * A minimal thread pool. Every call to pool_run runs the same task once on each thread of the pool, including the
+ * calling thread, and returns when all of them have finished. Tasks divide the work between themselves.
+ */
+#include <stdlib.h>
+#include <unistd.h>
+#include "pool.h"
+
+struct pool_worker {
+    ThreadPool *pool;
+    int thread;
+};
+
+/*
+ * Function:  pool_thread
+ * --------------------
+ * Thread entry point. Waits for a new generation of work, runs the task and reports back until the pool shuts down.
+ */
+static void *pool_thread(void *arg) {
+    struct pool_worker *worker = arg;
+    ThreadPool *pool = worker->pool;
+    int seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (pool->generation == seen && !pool->shutdown) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->shutdown) break;
+        seen = pool->generation;
+        PoolTask task = pool->task;
+        void *task_arg = pool->arg;
+        pthread_mutex_unlock(&pool->lock);
+
+        task(task_arg, worker->thread);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/*
+ * Function:  pool_create
+ * --------------------
+ * Starts a pool of threads. The calling thread counts as one of the threads of the pool, so nthreads - 1 threads are
+ * started. If some threads cannot be started the pool runs with the ones that could.
+ *
+ * args:
+ *      int nthreads: the number of threads in the pool. 0 uses one thread per online processor
+ *
+ * returns:
+ *      ThreadPool *: the new pool or NULL if memory could not be allocated
+ */
+ThreadPool * pool_create(int nthreads) {
+    if (nthreads <= 0) {
+        nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (nthreads <= 0) nthreads = 1;
+
+    ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+    if (pool == NULL) return NULL;
+    pool->threads = malloc(nthreads * sizeof(pthread_t));
+    pool->workers = malloc(nthreads * sizeof(struct pool_worker));
+    if (pool->threads == NULL || pool->workers == NULL) {
+        free(pool->threads);
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    pool->nthreads = 1;
+    while (pool->nthreads < nthreads) {
+        struct pool_worker *worker = &pool->workers[pool->nthreads];
+        worker->pool = pool;
+        worker->thread = pool->nthreads;
+        if (pthread_create(&pool->threads[pool->nthreads], NULL, pool_thread, worker) != 0) break;
+        pool->nthreads++;
+    }
+    return pool;
+}
+
+/*
+ * Function:  pool_run
+ * --------------------
+ * Runs the task on every thread of the pool and waits for all of them to finish. The calling thread runs the task as
+ * thread 0 and the threads of the pool as threads 1 to nthreads - 1.
+ *
+ * args:
+ *      ThreadPool *pool: the pool to run the task on
+ *      PoolTask task: the function to run
+ *      void *arg: the argument passed to every call of the task
+ */
+void pool_run(ThreadPool *pool, PoolTask task, void *arg) {
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->arg = arg;
+    pool->running = pool->nthreads - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    task(arg, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Function:  pool_destroy
+ * --------------------
+ * Stops the threads of the pool and frees it.
+ */
+void pool_destroy(ThreadPool *pool) {
+    if (pool == NULL) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (int t = 1; t < pool->nthreads; t++) {
+        pthread_join(pool->threads[t], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    free(pool->workers);
+    free(pool);
+}
@@ -0,0 +1,28 @@
+#include <pthread.h>
+
+#ifndef SIED_POOL_H
+#define SIED_POOL_H
+
+typedef void (*PoolTask)(void *arg, int thread);
+
+/*
+ * A fixed set of threads that is started once and then reused for every parallel step of the algorithm.
+ */
+typedef struct thread_pool {
+    int nthreads;
+    pthread_t *threads;
+    struct pool_worker *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    PoolTask task;
+    void *arg;
+    int generation;
+    int running;
+    int shutdown;
+} ThreadPool;
+
+ThreadPool * pool_create(int nthreads);
+void pool_run(ThreadPool *pool, PoolTask task, void *arg);
+void pool_destroy(ThreadPool *pool);
+#endif //SIED_POOL_H
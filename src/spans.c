@@ -0,0 +1,118 @@
+/*
+ * Spans of bins containing data, for skipping the parts of an image without data.
+ */
+#include <stdlib.h>
+#include "spans.h"
+#include "bitset.h"
+
+/*
+ * Function:  valid_spans_create
+ * --------------------
+ * Allocates an empty list of spans for a binning scheme with the given number of rows.
+ *
+ * returns:
+ *      ValidSpans *: the new list or NULL if memory could not be allocated
+ */
+ValidSpans * valid_spans_create(int nrows) {
+    ValidSpans *spans = calloc(1, sizeof(ValidSpans));
+    if (spans == NULL) return NULL;
+    spans->nrows = nrows;
+    spans->row_offsets = calloc(nrows + 1, sizeof(int));
+    if (spans->row_offsets == NULL) {
+        valid_spans_destroy(spans);
+        return NULL;
+    }
+    return spans;
+}
+
+/*
+ * Function:  valid_spans_grow
+ * --------------------
+ * Doubles the number of spans the list can hold.
+ *
+ * returns:
+ *      int: 0 on success or -1 if memory could not be allocated, leaving the list as it was
+ */
+static int valid_spans_grow(ValidSpans *spans) {
+    int capacity = spans->capacity > 0 ? 2 * spans->capacity : 1024;
+    int *begin = realloc(spans->begin, capacity * sizeof(int));
+    if (begin == NULL) return -1;
+    spans->begin = begin;
+    int *end = realloc(spans->end, capacity * sizeof(int));
+    if (end == NULL) return -1;
+    spans->end = end;
+    spans->capacity = capacity;
+    return 0;
+}
+
+/*
+ * Function:  valid_spans_build
+ * --------------------
+ * Finds the spans of every row of an image from its bitset of bins containing data. Words of the bitset without a set
+ * bit are skipped whole, so building the spans of a mostly empty image costs little more than reading the bitset.
+ * The list keeps its memory between images and only grows when an image has more spans than any before it.
+ *
+ * args:
+ *      ValidSpans *spans: the list to fill
+ *      IsinGrid *grid: the grid of the binning scheme, with the number of rows the list was created for
+ *      uint64_t *valid: pointer to the bitset of bins containing data
+ *
+ * returns:
+ *      int: 0 on success or -1 if memory could not be allocated, leaving the list empty
+ */
+int valid_spans_build(ValidSpans *spans, const IsinGrid *grid, const uint64_t *valid) {
+    spans->nspans = 0;
+    for (int i = 0; i < grid->nrows; i++) {
+        spans->row_offsets[i] = spans->nspans;
+        int row_end = grid->basebins[i] + grid->n_bins_in_row[i];
+        int j = bitset_next_set(valid, grid->basebins[i], row_end);
+        while (j < row_end) {
+            if (spans->nspans == spans->capacity && valid_spans_grow(spans) != 0) {
+                spans->nspans = 0;
+                for (int r = 0; r <= grid->nrows; r++) spans->row_offsets[r] = 0;
+                return -1;
+            }
+            spans->begin[spans->nspans] = j;
+            j = bitset_next_clear(valid, j, row_end);
+            spans->end[spans->nspans++] = j;
+            j = bitset_next_set(valid, j, row_end);
+        }
+    }
+    spans->row_offsets[grid->nrows] = spans->nspans;
+    return 0;
+}
+
+/*
+ * Function:  valid_spans_rows_empty
+ * --------------------
+ * Returns 1 if none of the rows first_row to last_row contains data, clamping the rows to the binning scheme.
+ */
+int valid_spans_rows_empty(const ValidSpans *spans, int first_row, int last_row) {
+    first_row = first_row > 0 ? first_row : 0;
+    last_row = last_row < spans->nrows - 1 ? last_row : spans->nrows - 1;
+    if (first_row > last_row) return 1;
+    return spans->row_offsets[first_row] == spans->row_offsets[last_row + 1];
+}
+
+/*
+ * Function:  valid_spans_bytes
+ * --------------------
+ * Returns the number of bytes held by the list.
+ */
+size_t valid_spans_bytes(const ValidSpans *spans) {
+    if (spans == NULL) return 0;
+    return sizeof(ValidSpans) + (spans->nrows + 1) * sizeof(int) + 2 * (size_t) spans->capacity * sizeof(int);
+}
+
+/*
+ * Function:  valid_spans_destroy
+ * --------------------
+ * Frees the list and its spans.
+ */
+void valid_spans_destroy(ValidSpans *spans) {
+    if (spans == NULL) return;
+    free(spans->row_offsets);
+    free(spans->begin);
+    free(spans->end);
+    free(spans);
+}
@@ -0,0 +1,27 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef SIED_SPANS_H
+#define SIED_SPANS_H
+#include "grid.h"
+
+/*
+ * The runs of adjacent bins containing data in each row of an image. Spans of row i are begin[k] to end[k] - 1 for k
+ * from row_offsets[i] to row_offsets[i + 1] - 1, in the order of their bins, so rows and stretches of a row without
+ * data can be skipped without looking at their bins.
+ */
+typedef struct valid_spans {
+    int nrows;
+    int *row_offsets;
+    int *begin;
+    int *end;
+    int nspans;
+    int capacity;
+} ValidSpans;
+
+ValidSpans * valid_spans_create(int nrows);
+int valid_spans_build(ValidSpans *spans, const IsinGrid *grid, const uint64_t *valid);
+int valid_spans_rows_empty(const ValidSpans *spans, int first_row, int last_row);
+size_t valid_spans_bytes(const ValidSpans *spans);
+void valid_spans_destroy(ValidSpans *spans);
+#endif //SIED_SPANS_H
@@ -0,0 +1,317 @@
+/*
+ * Running the algorithm on images too large to hold in memory at once, one band of rows at a time.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "stream.h"
+#include "bitset.h"
+
+/*
+ * An image being run in bands of rows. Each band is run as a binning scheme of its own made of its rows and halo rows
+ * above and below them. Its contours are those starting in its own rows, followed through contour_rows rows around
+ * them with the bins claimed by the contours of the bands before it, which are carried from band to band in bitsets of
+ * the rows the next band can reach. The input rows are buffered until every band that reads them has been run, so the
+ * memory used follows the number of bins in a band and its halo rather than the size of the image.
+ */
+struct cayula_stream {
+    CayulaOptions options;
+    int nrows;
+    int *n_bins_in_row;     // number of bins in each row of the image
+    int band_rows;          // rows of each band, a multiple of the stride of the scan
+    int halo;               // rows run above and below each band, a multiple of the stride of the scan
+    int contour_rows;       // rows above and below its own rows that the contours of a band are followed through
+    int *data;              // input rows first_row to first_row + nbuffered - 1
+    int first_row;
+    int nbuffered;
+    int nbuffered_bins;
+    int *band_basebins;     // first bin of each row of the band being run
+    int *out_data;          // output of the band being run
+    uint64_t *in_contour[2]; // bins in a contour of the last band run and of the band being run, in their layout
+    uint64_t *fronts[2];    // fronts of the last band run and of the band being run, in their layout
+    int last_row_begin;     // first row run for the last band
+    int band_row;           // first row of the next band to run
+    int next_row;           // first row whose output has not been given to the callback
+    long ncut;              // contours cut at the rows a band follows contours through
+    CayulaRowsCallback callback;
+    void *arg;
+};
+
+static inline int min(int a, int b) {
+    return a < b ? a : b;
+}
+
+static inline int max(int a, int b) {
+    return a > b ? a : b;
+}
+
+/*
+ * Function:  band_rows_of
+ * --------------------
+ * Finds the rows run for the band whose output starts at a row: the band's own rows and the halo around them.
+ */
+static void band_rows_of(const CayulaStream *stream, int first, int *row_begin, int *row_end) {
+    *row_begin = max(first - stream->halo, 0);
+    *row_end = min(first + stream->band_rows + stream->halo, stream->nrows);
+}
+
+/*
+ * Function:  cayula_stream_create
+ * --------------------
+ * Creates a stream for running the algorithm on an image pushed a few rows at a time. The image is run in bands of
+ * band_rows rows, each with cayula_stream_halo rows above and below it. Windows are placed as in a run of the whole
+ * image, so the edge pixels of every row are the same, and the contours are traced in the order a run of the whole
+ * image traces them, carrying on from the contours of the bands above. A contour that reaches contour_rows rows above
+ * or below the rows of the band it starts in is cut there, and cayula_stream_cut counts these. The output is the
+ * output of cayula() when no contour was cut. The output of the rows of a band is given to the callback once the band
+ * has been run, except for its last contour_rows rows, which the contours of the next band can still reach and which
+ * are given with the output of that band.
+ *
+ * Only a band and its halo are held in memory at a time, with a context made for each band. The stats of the options
+ * describe the last band run.
+ *
+ * args:
+ *      int nrows: the number of rows of the image
+ *      int *n_bins_in_row: pointer to an array containing the number of bins in each row
+ *      int band_rows: rows of the output of each band, rounded up to a multiple of the stride of the scan
+ *      int contour_rows: rows above and below a band that its contours are followed through. 0 or less uses
+ *      STREAM_CONTOUR_ROWS
+ *      CayulaOptions *options: options controlling how the algorithm is run. NULL uses cayula_default_options()
+ *      CayulaRowsCallback callback: the function the output of each band is given to
+ *      void *arg: passed to the callback
+ *
+ * returns:
+ *      CayulaStream *: the new stream or NULL if it could not be created
+ */
+CayulaStream * cayula_stream_create(int nrows, const int *n_bins_in_row, int band_rows, int contour_rows,
+                                    const CayulaOptions *options, CayulaRowsCallback callback, void *arg) {
+    CayulaStream *stream = calloc(1, sizeof(CayulaStream));
+    if (stream == NULL) return NULL;
+    stream->options = options != NULL ? *options : cayula_default_options();
+    stream->nrows = nrows;
+    stream->callback = callback;
+    stream->arg = arg;
+
+    /*
+     * The width and stride of the scan as cayula_ctx_create settles them. Bands start on window rows of the whole
+     * image so that their windows are the windows of the whole image
+     */
+    int width = stream->options.window_width > 0 ? stream->options.window_width : WINDOW_WIDTH;
+    width = (max(min(width, WINDOW_MAX_WIDTH), 2) + 1) & ~1;
+    int stride = stream->options.stride > 0 ? stream->options.stride : width;
+    int filter_half = (stream->options.filter_size > 0 ? stream->options.filter_size | 1 : 3) / 2;
+    stream->contour_rows = contour_rows > 0 ? contour_rows : STREAM_CONTOUR_ROWS;
+    int reach = width + filter_half + 1 + stream->contour_rows;
+    stream->halo = (reach + stride - 1) / stride * stride;
+    stream->band_rows = (max(band_rows, 1) + stride - 1) / stride * stride;
+
+    stream->n_bins_in_row = malloc(max(nrows, 1) * sizeof(int));
+    int nband_rows = min(stream->band_rows + 2 * stream->halo, nrows);
+    stream->band_basebins = malloc(max(nband_rows, 1) * sizeof(int));
+    if (stream->n_bins_in_row == NULL || stream->band_basebins == NULL) {
+        cayula_stream_destroy(stream);
+        return NULL;
+    }
+    memcpy(stream->n_bins_in_row, n_bins_in_row, nrows * sizeof(int));
+
+    int capacity = 0;
+    for (int first = 0; first < nrows; first += stream->band_rows) {
+        int row_begin, row_end;
+        band_rows_of(stream, first, &row_begin, &row_end);
+        int nbins = 0;
+        for (int i = row_begin; i < row_end; i++) nbins += n_bins_in_row[i];
+        capacity = max(capacity, nbins);
+    }
+    stream->data = malloc(max(capacity, 1) * sizeof(int));
+    stream->out_data = malloc(max(capacity, 1) * sizeof(int));
+    if (stream->data == NULL || stream->out_data == NULL) {
+        cayula_stream_destroy(stream);
+        return NULL;
+    }
+    for (int k = 0; k < 2; k++) {
+        stream->in_contour[k] = malloc(bitset_words(max(capacity, 1)) * sizeof(uint64_t));
+        stream->fronts[k] = malloc(bitset_words(max(capacity, 1)) * sizeof(uint64_t));
+        if (stream->in_contour[k] == NULL || stream->fronts[k] == NULL) {
+            cayula_stream_destroy(stream);
+            return NULL;
+        }
+    }
+    return stream;
+}
+
+/*
+ * Function:  cayula_stream_halo
+ * --------------------
+ * Returns the number of rows run above and below every band of the stream.
+ */
+int cayula_stream_halo(const CayulaStream *stream) {
+    return stream->halo;
+}
+
+/*
+ * Function:  cayula_stream_cut
+ * --------------------
+ * Returns the number of contours cut so far at the rows the contours of a band are followed through. The output of
+ * the stream is the output of cayula() while this is 0, and a larger contour_rows lets longer contours be followed.
+ */
+long cayula_stream_cut(const CayulaStream *stream) {
+    return stream->ncut;
+}
+
+/*
+ * Function:  carry_rows
+ * --------------------
+ * Copies the bits of rows first to last - 1 from a bitset in the layout of the band run from row from_begin to a
+ * bitset in the layout of the band run from row to_begin.
+ */
+static void carry_rows(const CayulaStream *stream, const uint64_t *from, int from_begin, uint64_t *to, int to_begin,
+                       int first, int last) {
+    int from_bin = 0, to_bin = 0;
+    for (int i = from_begin; i < first; i++) from_bin += stream->n_bins_in_row[i];
+    for (int i = to_begin; i < first; i++) to_bin += stream->n_bins_in_row[i];
+    int nbins = 0;
+    for (int i = first; i < last; i++) nbins += stream->n_bins_in_row[i];
+    for (int k = 0; k < nbins; k++) {
+        if (bitset_get(from, from_bin + k)) bitset_set(to, to_bin + k);
+    }
+}
+
+/*
+ * Function:  run_band
+ * --------------------
+ * Runs the next band once all of its rows and halo are buffered, gives the output of the rows that no later band can
+ * change to the callback and drops the rows that no later band reads.
+ *
+ * returns:
+ *      int: 0 on success or -1 if the context of the band could not be created
+ */
+static int run_band(CayulaStream *stream) {
+    int row_begin, row_end;
+    band_rows_of(stream, stream->band_row, &row_begin, &row_end);
+    int nrows = row_end - row_begin;
+    int nbins = 0;
+    int skipped = 0;
+    for (int i = stream->first_row; i < row_begin; i++) skipped += stream->n_bins_in_row[i];
+    for (int i = 0; i < nrows; i++) {
+        stream->band_basebins[i] = nbins;
+        nbins += stream->n_bins_in_row[row_begin + i];
+    }
+
+    /*
+     * The bins claimed by the contours of the bands above and their fronts, in the rows this band can reach
+     */
+    int first = stream->band_row;
+    int last = min(first + stream->band_rows, stream->nrows);
+    int contour_begin = max(first - stream->contour_rows, 0);
+    int contour_end = min(last + stream->contour_rows, stream->nrows);
+    uint64_t *in_contour = stream->in_contour[1];
+    uint64_t *fronts = stream->fronts[1];
+    memset(in_contour, 0, bitset_words(nbins) * sizeof(uint64_t));
+    memset(fronts, 0, bitset_words(nbins) * sizeof(uint64_t));
+    if (first > 0) {
+        int carried = min(first + stream->contour_rows, stream->nrows);
+        carry_rows(stream, stream->in_contour[0], stream->last_row_begin, in_contour, row_begin, contour_begin,
+                   carried);
+        carry_rows(stream, stream->fronts[0], stream->last_row_begin, fronts, row_begin, contour_begin, carried);
+    }
+
+    CayulaCtx *ctx = cayula_ctx_create(nbins, nrows, stream->n_bins_in_row + row_begin, stream->band_basebins,
+                                       &stream->options);
+    if (ctx == NULL) return -1;
+    int ncut = cayula_ctx_run_rows(ctx, stream->data + skipped, first - row_begin, last - row_begin,
+                                   contour_begin - row_begin, contour_end - row_begin, in_contour, fronts);
+    cayula_ctx_destroy(ctx);
+    if (ncut < 0) return -1;
+    stream->ncut += ncut;
+    stream->in_contour[1] = stream->in_contour[0];
+    stream->in_contour[0] = in_contour;
+    stream->fronts[1] = stream->fronts[0];
+    stream->fronts[0] = fronts;
+    stream->last_row_begin = row_begin;
+    stream->band_row = last;
+
+    /*
+     * The contours of the next band can reach the last contour_rows rows of this one
+     */
+    int done = last < stream->nrows ? last - stream->contour_rows : last;
+    if (done > stream->next_row) {
+        int begin = stream->band_basebins[stream->next_row - row_begin];
+        int end = stream->band_basebins[done - 1 - row_begin] + stream->n_bins_in_row[done - 1];
+        for (int i = begin; i < end; i++) {
+            stream->out_data[i] = stream->data[skipped + i] == FILL_VALUE ? -1 : bitset_get(fronts, i);
+        }
+        stream->callback(stream->arg, stream->next_row, done - stream->next_row, stream->out_data + begin);
+        stream->next_row = done;
+    }
+
+    /*
+     * Rows above the halo of the next band are no longer needed
+     */
+    int keep = max(stream->band_row - stream->halo, stream->first_row);
+    int dropped = 0;
+    for (int i = stream->first_row; i < keep; i++) dropped += stream->n_bins_in_row[i];
+    memmove(stream->data, stream->data + dropped, (stream->nbuffered_bins - dropped) * sizeof(int));
+    stream->nbuffered_bins -= dropped;
+    stream->nbuffered -= keep - stream->first_row;
+    stream->first_row = keep;
+    return 0;
+}
+
+/*
+ * Function:  cayula_stream_push
+ * --------------------
+ * Adds the next rows of the image to the stream, running every band whose rows and halo are then complete. The
+ * callback is called from this function, and the output of the last rows is given to it when the last row of the
+ * image is pushed.
+ *
+ * args:
+ *      CayulaStream *stream: the stream
+ *      int *data: pointer to the data of the rows, in the layout of cayula(), starting with the first bin of the
+ *      first row not pushed yet
+ *      int nrows: the number of rows to add
+ *
+ * returns:
+ *      int: 0 on success or -1 if more rows than the image has were pushed or a band could not be run
+ */
+int cayula_stream_push(CayulaStream *stream, const int *data, int nrows) {
+    int row = stream->first_row + stream->nbuffered;
+    if (nrows < 0 || row + nrows > stream->nrows) return -1;
+    int end = row + nrows;
+    while (row < end) {
+        int row_begin, row_end;
+        band_rows_of(stream, stream->band_row, &row_begin, &row_end);
+        int nadd = min(end, row_end) - row;
+        int nbins = 0;
+        for (int i = row; i < row + nadd; i++) nbins += stream->n_bins_in_row[i];
+        memcpy(stream->data + stream->nbuffered_bins, data, nbins * sizeof(int));
+        data += nbins;
+        stream->nbuffered_bins += nbins;
+        stream->nbuffered += nadd;
+        row += nadd;
+        /*
+         * The last bands of the image can all end on its last row
+         */
+        while (stream->band_row < stream->nrows && row == row_end) {
+            if (run_band(stream) != 0) return -1;
+            if (stream->band_row < stream->nrows) band_rows_of(stream, stream->band_row, &row_begin, &row_end);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Function:  cayula_stream_destroy
+ * --------------------
+ * Frees the stream along with the rows it holds.
+ */
+void cayula_stream_destroy(CayulaStream *stream) {
+    if (stream == NULL) return;
+    free(stream->n_bins_in_row);
+    free(stream->band_basebins);
+    free(stream->data);
+    free(stream->out_data);
+    for (int k = 0; k < 2; k++) {
+        free(stream->in_contour[k]);
+        free(stream->fronts[k]);
+    }
+    free(stream);
+}
@@ -0,0 +1,25 @@
+#ifndef SIED_STREAM_H
+#define SIED_STREAM_H
+#include "cayula.h"
+
+/*
+ * Rows above and below a band that its contours are followed through by default. Contours reaching further are cut,
+ * which cayula_stream_cut counts.
+ */
+#define STREAM_CONTOUR_ROWS 32
+
+/*
+ * Called by a stream with the output of rows first_row to first_row + nrows - 1 as soon as they are finished, in the
+ * layout of cayula(). out_data is only valid until the function returns.
+ */
+typedef void (*CayulaRowsCallback)(void *arg, int first_row, int nrows, const int *out_data);
+
+typedef struct cayula_stream CayulaStream;
+
+CayulaStream * cayula_stream_create(int nrows, const int *n_bins_in_row, int band_rows, int contour_rows,
+                                    const CayulaOptions *options, CayulaRowsCallback callback, void *arg);
+int cayula_stream_halo(const CayulaStream *stream);
+long cayula_stream_cut(const CayulaStream *stream);
+int cayula_stream_push(CayulaStream *stream, const int *data, int nrows);
+void cayula_stream_destroy(CayulaStream *stream);
+#endif //SIED_STREAM_H
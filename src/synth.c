@@ -0,0 +1,330 @@
+/*
+ * Deterministic synthetic images on the ISIN grid for benchmarks and tests. A field is a smooth background varying
+ * with latitude, with fronts, eddies, noise and clouds added to it.
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "synth.h"
+#include "isin.h"
+#include "cayula.h"
+
+#define SYNTH_FRONT 0
+#define SYNTH_EDDY 1
+#define SYNTH_CLOUD_WAVES 12
+#define SYNTH_CLOUD_SAMPLES 65536
+
+/*
+ * A front or eddy painted onto a field. Fronts run along direction (cos_angle, sin_angle) through their center.
+ */
+typedef struct synth_feature {
+    int kind;
+    double lat;
+    double lon;
+    double cos_angle;
+    double sin_angle;
+    double amplitude;
+    double radius;          // radius of an eddy, or how far the water masses on either side of a front reach
+    double length;
+    double width;
+} SynthFeature;
+
+/*
+ * A plane wave on the unit sphere. The sum of several of them thresholded at a quantile gives the clouds.
+ */
+typedef struct synth_wave {
+    double k[3];
+    double phase;
+} SynthWave;
+
+static inline int min(int a, int b) {
+    return a < b ? a : b;
+}
+
+static inline int max(int a, int b) {
+    return a > b ? a : b;
+}
+
+static inline double radians(double degrees) {
+    return degrees * M_PI / 180.;
+}
+
+/*
+ * Function:  splitmix
+ * --------------------
+ * Returns the next value of a splitmix64 generator.
+ */
+static uint64_t splitmix(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/*
+ * Function:  uniform
+ * --------------------
+ * Returns a value drawn uniformly from [0, 1).
+ */
+static double uniform(uint64_t *state) {
+    return (double) (splitmix(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * Function:  fade
+ * --------------------
+ * Returns 1 up to half way to the end of a feature and falls linearly to 0 at its end.
+ */
+static inline double fade(double x) {
+    return x < 0.5 ? 1 : x < 1 ? 2 * (1 - x) : 0;
+}
+
+/*
+ * Function:  synth_isin_rows
+ * --------------------
+ * Finds the rows of the full ISIN grid with the given number of rows with isin_rows.
+ *
+ * args:
+ *      int nrows: the number of rows of the grid
+ *      int *n_bins_in_row: pointer to an output array of nrows elements for the number of bins in each row
+ *      int *basebins: pointer to an output array of nrows elements for the first bin of each row
+ *
+ * returns:
+ *      int: the number of bins of the grid
+ */
+int synth_isin_rows(int nrows, int *n_bins_in_row, int *basebins) {
+    return isin_rows(nrows, n_bins_in_row, basebins);
+}
+
+/*
+ * Function:  synth_default_options
+ * --------------------
+ * Returns options for 8 bit fields with fronts a few bins wide at the resolutions of 2160 to 4320 rows and 30 percent
+ * cloud cover.
+ */
+SynthOptions synth_default_options(void) {
+    SynthOptions options;
+    options.seed = 1;
+    options.levels = 256;
+    options.nfronts = 600;
+    options.front_step = 40;
+    options.front_width = 0.1;
+    options.front_length = 8;
+    options.neddies = 3000;
+    options.eddy_amplitude = 30;
+    options.eddy_radius = 1;
+    options.noise = 4;
+    options.cloud_fraction = 0.3;
+    return options;
+}
+
+/*
+ * Function:  feature_value
+ * --------------------
+ * Returns the value a feature adds at a distance of x degrees east and y degrees north of its center.
+ */
+static double feature_value(const SynthFeature *f, double x, double y) {
+    if (f->kind == SYNTH_EDDY) {
+        double r2 = (x * x + y * y) / (f->radius * f->radius);
+        return r2 < 9 ? f->amplitude * exp(-r2) : 0;
+    }
+    double along = x * f->cos_angle + y * f->sin_angle;
+    double across = y * f->cos_angle - x * f->sin_angle;
+    double ramp = fmax(-1, fmin(1, across / f->width));
+    return f->amplitude / 2 * ramp * fade(fabs(across) / f->radius) * fade(fabs(along) / (f->length / 2));
+}
+
+/*
+ * Function:  paint_feature
+ * --------------------
+ * Adds a feature to the bins it reaches. Only the rows and columns within reach of the feature are visited.
+ */
+static void paint_feature(const SynthField *field, float *values, const SynthFeature *f) {
+    double extent = f->kind == SYNTH_EDDY ? 3 * f->radius : fmax(f->length / 2, f->radius);
+    int nrows = field->nrows;
+    int first = max((int) floor((f->lat - extent + 90) * nrows / 180), 0);
+    int last = min((int) ceil((f->lat + extent + 90) * nrows / 180), nrows - 1);
+    for (int i = first; i <= last; i++) {
+        double lat = isin_row_lat(nrows, i);
+        double coslat = cos(radians(lat));
+        int n = field->n_bins_in_row[i];
+        double lon_extent = coslat * 180 > extent ? extent / coslat : 180;
+        int half = (int) ceil(lon_extent * n / 360) + 1;
+        int count = min(2 * half + 1, n);
+        int center = (int) floor((f->lon + 180) * n / 360);
+        for (int k = 0; k < count; k++) {
+            int j = ((center - half + k) % n + n) % n;
+            double dlon = isin_bin_lon(n, j) - f->lon;
+            if (dlon >= 180) dlon -= 360;
+            if (dlon < -180) dlon += 360;
+            values[field->basebins[i] + j] += (float) feature_value(f, dlon * coslat, lat - f->lat);
+        }
+    }
+}
+
+/*
+ * Function:  cloud_value
+ * --------------------
+ * Returns the sum of the cloud waves at a point on the unit sphere.
+ */
+static double cloud_value(const SynthWave *waves, const double *p) {
+    double sum = 0;
+    for (int w = 0; w < SYNTH_CLOUD_WAVES; w++) {
+        sum += cos(waves[w].k[0] * p[0] + waves[w].k[1] * p[1] + waves[w].k[2] * p[2] + waves[w].phase);
+    }
+    return sum;
+}
+
+static inline void unit_vector(double lat, double lon, double *p) {
+    p[0] = cos(radians(lat)) * cos(radians(lon));
+    p[1] = cos(radians(lat)) * sin(radians(lon));
+    p[2] = sin(radians(lat));
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Function:  cloud_threshold
+ * --------------------
+ * Finds the value of the cloud waves below which the given fraction of the bins of a field lie, from a sample of the
+ * bins.
+ */
+static double cloud_threshold(const SynthField *field, const SynthWave *waves, double fraction, uint64_t *state) {
+    double *samples = malloc(SYNTH_CLOUD_SAMPLES * sizeof(double));
+    if (samples == NULL) return -INFINITY;
+    for (int s = 0; s < SYNTH_CLOUD_SAMPLES; s++) {
+        int bin = (int) (uniform(state) * field->nbins);
+        int row = 0;
+        int low = 0, high = field->nrows - 1;
+        while (low <= high) {
+            int mid = (low + high) / 2;
+            if (field->basebins[mid] <= bin) {
+                row = mid;
+                low = mid + 1;
+            } else {
+                high = mid - 1;
+            }
+        }
+        double p[3];
+        unit_vector(isin_row_lat(field->nrows, row), isin_bin_lon(field->n_bins_in_row[row], bin - field->basebins[row]), p);
+        samples[s] = cloud_value(waves, p);
+    }
+    qsort(samples, SYNTH_CLOUD_SAMPLES, sizeof(double), compare_doubles);
+    double threshold = samples[min((int) (fraction * SYNTH_CLOUD_SAMPLES), SYNTH_CLOUD_SAMPLES - 1)];
+    free(samples);
+    return threshold;
+}
+
+/*
+ * Function:  synth_field_create
+ * --------------------
+ * Makes a synthetic image on the full ISIN grid. The background warms from the poles to the equator across the range
+ * of levels. Fronts are straight steps of front_step between water masses reaching half their length to either side,
+ * placed at random positions and angles, and eddies are Gaussian anomalies. Clouds are smooth patches made from the
+ * sum of random waves on the sphere, thresholded so that they cover cloud_fraction of the bins.
+ *
+ * args:
+ *      int nrows: the number of rows of the grid
+ *      SynthOptions *options: the contents of the field. NULL uses synth_default_options
+ *
+ * returns:
+ *      SynthField *: the new field or NULL if memory could not be allocated
+ */
+SynthField * synth_field_create(int nrows, const SynthOptions *options) {
+    SynthOptions o = options != NULL ? *options : synth_default_options();
+    SynthField *field = calloc(1, sizeof(SynthField));
+    if (field == NULL) return NULL;
+    field->nrows = nrows;
+    field->n_bins_in_row = malloc(nrows * sizeof(int));
+    field->basebins = malloc(nrows * sizeof(int));
+    if (field->n_bins_in_row == NULL || field->basebins == NULL) {
+        synth_field_destroy(field);
+        return NULL;
+    }
+    field->nbins = synth_isin_rows(nrows, field->n_bins_in_row, field->basebins);
+    field->data = malloc(field->nbins * sizeof(int));
+    float *values = calloc(field->nbins, sizeof(float));
+    if (field->data == NULL || values == NULL) {
+        free(values);
+        synth_field_destroy(field);
+        return NULL;
+    }
+
+    uint64_t state = o.seed;
+    for (int f = 0; f < o.nfronts + o.neddies; f++) {
+        SynthFeature feature;
+        feature.kind = f < o.nfronts ? SYNTH_FRONT : SYNTH_EDDY;
+        feature.lat = asin(2 * uniform(&state) - 1) * 180 / M_PI;
+        feature.lon = 360 * uniform(&state) - 180;
+        double angle = M_PI * uniform(&state);
+        feature.cos_angle = cos(angle);
+        feature.sin_angle = sin(angle);
+        if (feature.kind == SYNTH_FRONT) {
+            feature.amplitude = (uniform(&state) < 0.5 ? -1 : 1) * o.front_step * (0.5 + 0.5 * uniform(&state));
+            feature.length = o.front_length * (0.5 + 0.5 * uniform(&state));
+            feature.radius = feature.length / 2;
+            feature.width = o.front_width;
+        } else {
+            feature.amplitude = (2 * uniform(&state) - 1) * o.eddy_amplitude;
+            feature.radius = o.eddy_radius * (0.25 + 0.75 * uniform(&state));
+            feature.length = 0;
+            feature.width = 0;
+        }
+        paint_feature(field, values, &feature);
+    }
+
+    SynthWave waves[SYNTH_CLOUD_WAVES];
+    for (int w = 0; w < SYNTH_CLOUD_WAVES; w++) {
+        double wavelength = radians(5 + 25 * uniform(&state));
+        double k[3] = {2 * uniform(&state) - 1, 2 * uniform(&state) - 1, 2 * uniform(&state) - 1};
+        double norm = sqrt(k[0] * k[0] + k[1] * k[1] + k[2] * k[2]) + 1e-12;
+        for (int d = 0; d < 3; d++) waves[w].k[d] = k[d] / norm * 2 * M_PI / wavelength;
+        waves[w].phase = 2 * M_PI * uniform(&state);
+    }
+    double threshold = -INFINITY;
+    if (o.cloud_fraction >= 1) {
+        threshold = INFINITY;
+    } else if (o.cloud_fraction > 0) {
+        threshold = cloud_threshold(field, waves, o.cloud_fraction, &state);
+    }
+
+    uint64_t noise_seed = splitmix(&state);
+    int top = o.levels - 1;
+    for (int i = 0; i < nrows; i++) {
+        double lat = isin_row_lat(nrows, i);
+        double background = top * (0.15 + 0.55 * cos(radians(lat)));
+        int n = field->n_bins_in_row[i];
+        for (int j = 0; j < n; j++) {
+            int bin = field->basebins[i] + j;
+            if (threshold > -INFINITY) {
+                double p[3];
+                unit_vector(lat, isin_bin_lon(n, j), p);
+                if (threshold == INFINITY || cloud_value(waves, p) < threshold) {
+                    field->data[bin] = FILL_VALUE;
+                    continue;
+                }
+            }
+            uint64_t bin_state = noise_seed ^ ((uint64_t) bin * 0xD1B54A32D192ED03ull);
+            double value = background + values[bin] + o.noise * (2 * uniform(&bin_state) - 1);
+            field->data[bin] = min(max((int) floor(value + 0.5), 0), top);
+        }
+    }
+    free(values);
+    return field;
+}
+
+/*
+ * Function:  synth_field_destroy
+ * --------------------
+ * Frees a field made by synth_field_create.
+ */
+void synth_field_destroy(SynthField *field) {
+    if (field == NULL) return;
+    free(field->n_bins_in_row);
+    free(field->basebins);
+    free(field->data);
+    free(field);
+}
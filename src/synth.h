@@ -0,0 +1,37 @@
+#ifndef SIED_SYNTH_H
+#define SIED_SYNTH_H
+
+/*
+ * Options of the synthetic fields made by synth_field_create. Values are in the levels of the data, distances in
+ * degrees.
+ */
+typedef struct synth_options {
+    unsigned int seed;      // fields made with the same seed and options are identical
+    int levels;             // number of levels of the data
+    int nfronts;            // number of fronts, each a straight step between two water masses
+    double front_step;      // difference in value across a front
+    double front_width;     // distance over which the value changes across a front
+    double front_length;    // length of each front
+    int neddies;            // number of eddies, each a round warm or cold anomaly
+    double eddy_amplitude;  // largest difference in value at the center of an eddy
+    double eddy_radius;     // largest radius of an eddy
+    double noise;           // amplitude of the uniform noise added to every bin
+    double cloud_fraction;  // fraction of the bins covered by cloud, which contain FILL_VALUE
+} SynthOptions;
+
+/*
+ * A synthetic image on the full ISIN grid with the given number of rows.
+ */
+typedef struct synth_field {
+    int nbins;
+    int nrows;
+    int *n_bins_in_row;
+    int *basebins;
+    int *data;              // value of every bin or FILL_VALUE
+} SynthField;
+
+int synth_isin_rows(int nrows, int *n_bins_in_row, int *basebins);
+SynthOptions synth_default_options(void);
+SynthField * synth_field_create(int nrows, const SynthOptions *options);
+void synth_field_destroy(SynthField *field);
+#endif //SIED_SYNTH_H
@@ -0,0 +1,144 @@
+/*
+ * Comparison of every step of a context run against the original implementation of the algorithm.
+ */
+#include <stdlib.h>
+#include "bitset.h"
+#include "reference.h"
+#include "golden.h"
+
+static const char *STEP_NAMES[GOLDEN_STEPS] = {"filtered_data", "thresholds", "edge_pixels", "out_data"};
+
+/*
+ * Function:  row_of
+ * --------------------
+ * Returns the row containing a bin.
+ */
+static int row_of(int bin, int nrows, const int *basebins) {
+    int low = 0, high = nrows - 1;
+    while (low < high) {
+        int middle = (low + high + 1) / 2;
+        if (basebins[middle] <= bin) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return low;
+}
+
+/*
+ * Function:  record
+ * --------------------
+ * Counts a mismatch of a step, keeping it if it is the first.
+ */
+static void record(GoldenMismatch *mismatch, int bin, int row, int expected, int actual) {
+    if (mismatch->count++ == 0) {
+        mismatch->bin = bin;
+        mismatch->row = row;
+        mismatch->expected = expected;
+        mismatch->actual = actual;
+    }
+}
+
+/*
+ * Function:  golden_compare
+ * --------------------
+ * Runs the original implementation of the algorithm and a context created with the given options on the same data
+ * and compares the filtered data, the threshold of every window, the edge pixels and the output of both. The context
+ * always runs 8 bit data with the window width, stride and filter size of the original, the other options are kept.
+ *
+ * args:
+ *      int *data: pointer to the array containing the data for every bin, with values from 0 to 255 or FILL_VALUE
+ *      int nbins, nrows, *n_bins_in_row, *basebins: the binning scheme
+ *      CayulaOptions *options: options of the context. NULL uses cayula_default_options()
+ *      GoldenReport *report: the mismatches of each step
+ *
+ * returns:
+ *      long: the number of mismatches of every step together or -1 if the buffers could not be allocated
+ */
+long golden_compare(const int *data, int nbins, int nrows, const int *n_bins_in_row, const int *basebins,
+                    const CayulaOptions *options, GoldenReport *report) {
+    for (int s = 0; s < GOLDEN_STEPS; s++) {
+        report->steps[s] = (GoldenMismatch) {0, -1, -1, 0, 0};
+    }
+    CayulaOptions ctx_options = options != NULL ? *options : cayula_default_options();
+    ctx_options.window_width = WINDOW_WIDTH;
+    ctx_options.stride = WINDOW_WIDTH;
+    ctx_options.filter_size = 3;
+    ctx_options.levels = 256;
+
+    int nwindows = reference_count_windows(nrows, n_bins_in_row);
+    int *expected_out = malloc(nbins * sizeof(int));
+    int *expected_filtered = malloc(nbins * sizeof(int));
+    int *expected_edges = malloc(nbins * sizeof(int));
+    int *expected_thresholds = malloc((nwindows + 1) * sizeof(int));
+    int *out = malloc(nbins * sizeof(int));
+    CayulaCtx *ctx = cayula_ctx_create(nbins, nrows, n_bins_in_row, basebins, &ctx_options);
+    long total = -1;
+    if (expected_out == NULL || expected_filtered == NULL || expected_edges == NULL || expected_thresholds == NULL ||
+        out == NULL || ctx == NULL) {
+        goto done;
+    }
+
+    reference_cayula(data, expected_out, expected_filtered, expected_thresholds, expected_edges, nbins, nrows,
+                     n_bins_in_row, basebins);
+    cayula_ctx_run(ctx, data, out);
+    CayulaIntermediates actual = cayula_ctx_intermediates(ctx);
+
+    for (int i = 0; i < nbins; i++) {
+        int filtered = bitset_get(actual.filtered_valid, i) ? actual.filtered_data[i] : FILL_VALUE;
+        int edge = bitset_get(actual.edge_pixels, i);
+        if (filtered != expected_filtered[i] || edge != expected_edges[i] || out[i] != expected_out[i]) {
+            int row = row_of(i, nrows, basebins);
+            if (filtered != expected_filtered[i]) {
+                record(&report->steps[GOLDEN_FILTERED], i, row, expected_filtered[i], filtered);
+            }
+            if (edge != expected_edges[i]) record(&report->steps[GOLDEN_EDGES], i, row, expected_edges[i], edge);
+            if (out[i] != expected_out[i]) record(&report->steps[GOLDEN_OUT], i, row, expected_out[i], out[i]);
+        }
+    }
+
+    int half_step = WINDOW_WIDTH / 2;
+    int w = 0;
+    for (int k = 0; k < actual.n_window_rows; k++) {
+        int i = half_step - 1 + k * WINDOW_WIDTH;
+        for (int j = half_step - 1; j < n_bins_in_row[i] - half_step; j += WINDOW_WIDTH, w++) {
+            int threshold = w < nwindows ? expected_thresholds[w] : -1;
+            if (actual.thresholds[w] != threshold) {
+                record(&report->steps[GOLDEN_THRESHOLDS], basebins[i] + j, i, threshold, actual.thresholds[w]);
+            }
+        }
+    }
+    if (w != nwindows) {
+        record(&report->steps[GOLDEN_THRESHOLDS], -1, -1, nwindows, w);
+    }
+
+    total = 0;
+    for (int s = 0; s < GOLDEN_STEPS; s++) total += report->steps[s].count;
+
+done:
+    cayula_ctx_destroy(ctx);
+    free(expected_out);
+    free(expected_filtered);
+    free(expected_edges);
+    free(expected_thresholds);
+    free(out);
+    return total;
+}
+
+/*
+ * Function:  golden_print
+ * --------------------
+ * Prints the number of mismatches of each step with the first one.
+ */
+void golden_print(const GoldenReport *report, FILE *stream) {
+    for (int s = 0; s < GOLDEN_STEPS; s++) {
+        const GoldenMismatch *mismatch = &report->steps[s];
+        if (mismatch->count == 0) {
+            fprintf(stream, "%-14s identical\n", STEP_NAMES[s]);
+        } else {
+            fprintf(stream, "%-14s %ld mismatches, first at bin %d row %d: expected %d, got %d\n", STEP_NAMES[s],
+                    mismatch->count, mismatch->bin, mismatch->row, mismatch->expected, mismatch->actual);
+        }
+    }
+}
@@ -0,0 +1,34 @@
+/*
+ * Comparison of every step of a context run against the original implementation of the algorithm.
+ */
+#ifndef SIED_GOLDEN_H
+#define SIED_GOLDEN_H
+#include <stdio.h>
+#include "cayula.h"
+
+#define GOLDEN_FILTERED 0
+#define GOLDEN_THRESHOLDS 1
+#define GOLDEN_EDGES 2
+#define GOLDEN_OUT 3
+#define GOLDEN_STEPS 4
+
+/*
+ * The mismatches of one step. The first mismatch is given by the bin and row of the mismatching bin, or of the center
+ * of the mismatching window for the thresholds.
+ */
+typedef struct golden_mismatch {
+    long count;     // number of bins or windows that differ
+    int bin;        // first bin that differs, -1 if none does
+    int row;
+    int expected;   // value of the original implementation
+    int actual;     // value of the context
+} GoldenMismatch;
+
+typedef struct golden_report {
+    GoldenMismatch steps[GOLDEN_STEPS];
+} GoldenReport;
+
+long golden_compare(const int *data, int nbins, int nrows, const int *n_bins_in_row, const int *basebins,
+                    const CayulaOptions *options, GoldenReport *report);
+void golden_print(const GoldenReport *report, FILE *stream);
+#endif //SIED_GOLDEN_H
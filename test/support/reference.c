@@ -0,0 +1,617 @@
+/*
+ * Copies of the original implementations of the steps of the algorithm, kept to check that optimized versions give the
+ * same results.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include "cayula.h"
+#include "reference.h"
+
+#define CRIT_VALUE 0.7
+#define CRIT_C1 0.90
+#define CRIT_C2 0.90
+#define CRIT_C 0.92
+
+static inline double square(double a) {
+    return a * a;
+}
+
+static inline int squarei(int a) {
+    return a * a;
+}
+
+static double within_group_variance(const int *histogram, double mu_low, double mu_high, int n_low, int n_high,
+                                    int tau) {
+    double num = 0;
+    for (int i = 0; i < tau; i++) {
+        num += square(i - mu_low) * histogram[i];
+    }
+    double s_low = num / n_low;
+    num = 0;
+    for (int i = tau; i < 256; i++) {
+        num += square(i - mu_high) * histogram[i];
+    }
+    double s_high = num / n_high;
+    return (s_low * n_low / (n_low + n_high)) + (s_high * n_high / (n_low + n_high));
+}
+
+static int too_large(const int *histogram, int tau) {
+    int sum = 0;
+    int count = 0;
+    for (int i = 0; i < 256; i++) {
+        if (i < tau) {
+            sum += histogram[i];
+        }
+        count += histogram[i];
+    }
+    double ratio = (double) sum / count;
+    return (ratio < 0.25 ||  ratio > 0.75);
+}
+
+/*
+ * Function:  reference_histogram_threshold
+ * --------------------
+ * The histogram analysis as it was before it was done in a single pass. A histogram without any values returns -1
+ * here rather than reading before the start of the histogram.
+ */
+int reference_histogram_threshold(const int *histogram) {
+    int n_low = 0, num_low = 0, n_high = 0, num_high = 0;
+    double max_between = 0;
+    for (int i = 0; i < 256; i++) {
+        n_high += histogram[i];
+        num_high += i * histogram[i];
+    }
+    if (n_high == 0) return -1;
+    int tau = -1;
+    double n_low_max, n_high_max, mu_high, mu_low_max, mu_low, mu_high_max;
+
+    for (int i = 0; i  < 254; i++) {
+        n_high -= histogram[i];
+        num_high -= i * histogram[i];
+        n_low += histogram[i];
+        num_low += (i) * histogram[i];
+        if (n_low != 0 && n_high != 0) {
+            mu_low = (double) num_low / n_low;
+            mu_high = (double) num_high / n_high;
+            double between = (square(mu_low - mu_high) * n_low * n_high) / squarei(n_low + n_high);
+
+            if (between > max_between) {
+                tau = i + 1;
+                max_between = between;
+                n_low_max = n_low;
+                n_high_max = n_high;
+                mu_low_max = mu_low;
+                mu_high_max = mu_high;
+            }
+        }
+
+    }
+    double theta = 0;
+    if (!too_large(histogram, tau)) {
+        double within = within_group_variance(histogram, mu_low_max, mu_high_max, n_low_max, n_high_max, tau);
+        theta = max_between / (max_between + within);
+    }
+    return theta >= CRIT_VALUE ? tau : -1;
+}
+
+static inline int min(int a, int b) {
+    return a < b ? a : b;
+}
+
+static inline int max(int a, int b) {
+    return a > b ? a : b;
+}
+
+static inline int mod(int a, int n) {
+    return a - floor(a / n) * n;
+}
+
+/*
+ * Function:  reference_get_window
+ * --------------------
+ * The original get_window, except that bins before the first or after the last bin of the data are read as
+ * FILL_VALUE rather than read out of bounds. Bins past either end of a row are still taken from the neighboring row.
+ *
+ * returns:
+ *      int: the number of fill values contained in the window
+ */
+int reference_get_window(int bin, int row, int width, const int *data, int nbins, const int *n_bins_in_row,
+                         const int *basebins, int *window) {
+    int nfill_values = 0;
+    double ratio = ((double) bin - basebins[row]) / n_bins_in_row[row];
+    int max_distance = width % 2 == 0 ? width >> 1 : (width - 1) >> 1;
+    int current_row = width % 2 == 0 ? row - max_distance + 1 : row - max_distance;
+    int offset = width % 2 == 0 ? -max_distance + 1 : -max_distance;
+    for (int i = 0; i < width * width; i += width) {
+        int column_neighbor = (int) (ratio * n_bins_in_row[current_row] + 0.5) + basebins[current_row];
+        for (int j = 0; j < width; j++) {
+            int b = column_neighbor + j + offset;
+            window[i + j] = b >= 0 && b < nbins ? data[b] : FILL_VALUE;
+            if (window[i + j] == FILL_VALUE) nfill_values++;
+        }
+        current_row++;
+    }
+    return nfill_values;
+}
+
+/*
+ * Function:  reference_get_bin_window
+ * --------------------
+ * The original get_bin_window for windows of even width.
+ */
+static void reference_get_bin_window(int bin, int row, int width, const int *n_bins_in_row, const int *basebins,
+                                     int *window) {
+    double ratio = (bin - basebins[row]) / (double) n_bins_in_row[row];
+    int max_distance = width >> 1;
+    int current_row = row - max_distance + 1;
+    for (int i = 0; i < width * width; i += width) {
+        int column_neighbor = (int) (ratio * n_bins_in_row[current_row] + 0.5) + basebins[current_row];
+        for (int j = 0; j < width; j++) {
+            window[i + j] = column_neighbor + j - max_distance + 1;
+        }
+        current_row++;
+    }
+}
+
+#define BIN_SORT(a,b) { if ((a)>(b)) BIN_SWAP((a),(b)); }
+#define BIN_SWAP(a,b) { int temp=(a);(a)=(b);(b)=temp; }
+
+static int median9(int *p) {
+    BIN_SORT(p[1], p[2]);  BIN_SORT(p[4], p[5]);  BIN_SORT(p[7], p[8]);
+    BIN_SORT(p[0], p[1]);  BIN_SORT(p[3], p[4]);  BIN_SORT(p[6], p[7]);
+    BIN_SORT(p[1], p[2]);  BIN_SORT(p[4], p[5]);  BIN_SORT(p[7], p[8]);
+    BIN_SORT(p[0], p[3]);  BIN_SORT(p[5], p[8]);  BIN_SORT(p[4], p[7]);
+    BIN_SORT(p[3], p[6]);  BIN_SORT(p[1], p[4]);  BIN_SORT(p[2], p[5]);
+    BIN_SORT(p[4], p[7]);  BIN_SORT(p[4], p[2]);  BIN_SORT(p[6], p[4]);
+    BIN_SORT(p[4], p[2]);  return(p[4]);
+}
+
+#define MIN(a,b) ((int)(fmin(a,b)))
+#define MAX(a,b) ((int)(fmax(a,b)))
+#define SWAP(i,j) do { int s = MIN(a##i,a##j); int t = MAX(a##i,a##j); a##i = s; a##j = t; } while (0)
+
+static void sort9(int *a) {
+    int a0, a1, a2, a3, a4, a5, a6, a7, a8;
+    a0=a[0];a1=a[1];a2=a[2];a3=a[3];a4=a[4];a5=a[5];a6=a[6];a7=a[7];a8=a[8];
+
+    SWAP (0, 1);   SWAP (3, 4);   SWAP (6, 7);   SWAP (1, 2);   SWAP (4, 5);
+    SWAP (7, 8);   SWAP (0, 1);   SWAP (3, 4);   SWAP (6, 7);   SWAP (0, 3);
+    SWAP (3, 6);   SWAP (0, 3);   SWAP (1, 4);   SWAP (4, 7);   SWAP (1, 4);
+    SWAP (5, 8);   SWAP (2, 5);   SWAP (5, 8);   SWAP (2, 4);   SWAP (4, 6);
+    SWAP (2, 4);   SWAP (1, 3);   SWAP (2, 3);   SWAP (5, 7);   SWAP (5, 6);
+
+    a[0]=a0;a[1]=a1;a[2]=a2;a[3]=a3;a[4]=a4;a[5]=a5;a[6]=a6;a[7]=a7;a[8]=a8;
+}
+
+static int medianN(int *p, int n_invalid) {
+    if (n_invalid == 9) return FILL_VALUE;
+    sort9(p);
+    int n = 9 - n_invalid;
+    int arr[9];
+    for (int i = n_invalid; i < 9; i++) {
+        arr[i - n_invalid] = p[i];
+    }
+    return n & 1 ? arr[(n - 1) >> 1] : (arr[n >> 1] + arr[(n >> 1) - 1] + 1) >> 1;
+}
+
+/*
+ * Function:  reference_median_filter
+ * --------------------
+ * The original 3x3 median filter on int data.
+ */
+void reference_median_filter(const int *data, int *filtered_data, int nbins, int nrows, const int *n_bins_in_row,
+                             const int *basebins) {
+    int last_row = nrows - 1;
+    for (int i = 0; i < basebins[0] + n_bins_in_row[0]; i++) filtered_data[i] = FILL_VALUE;
+    for (int i = basebins[last_row]; i < basebins[last_row] + n_bins_in_row[last_row]; i++) {
+        filtered_data[i] = FILL_VALUE;
+    }
+
+    for (int i = 1; i < nrows - 1; i++) {
+        filtered_data[basebins[i]] = FILL_VALUE;
+        filtered_data[basebins[i] + n_bins_in_row[i] - 1] = FILL_VALUE;
+        for (int j = basebins[i] + 1; j < basebins[i] + n_bins_in_row[i] - 1; j++) {
+            if (data[j] == FILL_VALUE) {
+                filtered_data[j] = FILL_VALUE;
+            } else {
+                int window[9];
+                int n_invalid = reference_get_window(j, i, 3, data, nbins, n_bins_in_row, basebins, window);
+                filtered_data[j] = n_invalid == 0 ? median9(window) : medianN(window, n_invalid);
+            }
+        }
+    }
+}
+
+/*
+ * Function:  reference_histogram_analysis
+ * --------------------
+ * The original histogram analysis of a WINDOW_WIDTH window.
+ */
+int reference_histogram_analysis(const int *window) {
+    int histogram[256] = {0};
+    for (int i = 0; i < WINDOW_AREA; i++) {
+        if (window[i] != FILL_VALUE) histogram[window[i]]++;
+    }
+    return reference_histogram_threshold(histogram);
+}
+
+/*
+ * Function:  reference_cohesive
+ * --------------------
+ * The original cohesion test of a WINDOW_WIDTH window.
+ */
+int reference_cohesive(const int *window, int threshold) {
+    int copy[WINDOW_AREA];
+    for (int i = 0; i < WINDOW_AREA; i++) {
+        copy[i] = window[i] == FILL_VALUE ? FILL_VALUE : window[i] >= threshold;
+    }
+    double r1 = 0, t1 = 0, r2 = 0, t2 = 0;
+    for (int i = 0; i < WINDOW_WIDTH; i++) {
+        for (int j = 0; j < WINDOW_WIDTH; j++) {
+            int sum = 0;
+            int count = 0;
+            if (copy[i * WINDOW_WIDTH + j] != FILL_VALUE) {
+                for (int k = max(i - 1, 0); k < min(i + 2, WINDOW_WIDTH); k++) {
+                    for (int l = max(j - 1, 0); l < min(j + 2, WINDOW_WIDTH); l++) {
+                        if (k != i && l != j && copy[k * WINDOW_WIDTH + l] != FILL_VALUE) {
+                            sum += copy[k * WINDOW_WIDTH + l];
+                            count++;
+                        }
+                    }
+                }
+                if (copy[i * WINDOW_WIDTH + j] == 0) {
+                    r1 += count - sum;
+                    t1 += count;
+                } else {
+                    r2 += sum;
+                    t2 += count;
+                }
+            }
+        }
+    }
+    double c = (r1 + r2) / (t1 + t2);
+    return (r1 / t1 >= CRIT_C1 && r2 / t2 >= CRIT_C2 && c >= CRIT_C);
+}
+
+static int neighbor_is_different(const int *window, int row, int col) {
+    int center = window[row * WINDOW_WIDTH + col];
+    for (int i = max(row - 1, 0); i < min(row + 2, WINDOW_WIDTH); i++) {
+        for (int j = max(col - 1, 0); j < min(col + 2, WINDOW_WIDTH); j++) {
+            if (window[i * WINDOW_WIDTH + j] != FILL_VALUE && center != window[i * WINDOW_WIDTH + j]) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * Function:  reference_find_edge
+ * --------------------
+ * The original location of the edge pixels of a WINDOW_WIDTH window.
+ */
+void reference_find_edge(const int *window, int *out, int threshold) {
+    int bodies[WINDOW_AREA];
+    for (int i = 0; i < WINDOW_AREA; i++) {
+        bodies[i] = window[i] == FILL_VALUE ? FILL_VALUE : window[i] >= threshold;
+    }
+    for (int i = 0; i < WINDOW_WIDTH; i++) {
+        for (int j = 0; j < WINDOW_WIDTH; j++) {
+            if (bodies[i * WINDOW_WIDTH + j] != FILL_VALUE) {
+                out[i * WINDOW_WIDTH + j] = neighbor_is_different(bodies, i, j);
+            } else {
+                out[i * WINDOW_WIDTH + j] = 0;
+            }
+        }
+    }
+}
+
+/*
+ * The original contour step, with the grid passed around in a struct rather than as separate arguments. The two fixes
+ * made along with the neighbor tables are kept: index 5 of a window is the bin to the right rather than falling through
+ * to index 6, and the gradient of a neighbor is taken from the row of the neighbor.
+ */
+static const int ANGLES[9] = {135, 90, 45,
+                              180, 360, 0,
+                              225, 270, 315};
+
+typedef struct reference_point {
+    int bin;
+    int angle;
+    struct reference_point *prev;
+    struct reference_point *next;
+} ReferencePoint;
+
+typedef struct reference_vector {
+    double x;
+    double y;
+} ReferenceVector;
+
+typedef struct reference_map {
+    const int *edge_pixels;
+    const int *filtered_data;
+    int *pixel_in_contour;
+    int nbins;
+    int nrows;
+    const int *n_bins_in_row;
+    const int *basebins;
+} ReferenceMap;
+
+static inline int dot(ReferenceVector a, ReferenceVector b) {
+    return a.x * b.x + a.y * b.y;
+}
+
+static ReferenceVector gradient(int *window) {
+    if (window[5] == FILL_VALUE) window[5] = window[4];
+    if (window[3] == FILL_VALUE) window[3] = window[4];
+    if (window[7] == FILL_VALUE) window[7] = window[4];
+    if (window[1] == FILL_VALUE) window[1] = window[4];
+    ReferenceVector g;
+    g.x = (double) (window[5] - window[3]) / 2;
+    g.y = (double) (window[7] - window[1]) / 2;
+    return g;
+}
+
+static int turn_too_sharp(const ReferencePoint *tail, int next_theta) {
+    int counter = 0;
+    const ReferencePoint *tmp = tail;
+    while (tmp->prev->prev != NULL && counter < 5) {
+        int dtheta = mod(tmp->angle - next_theta + 180, 360) - 180;
+        dtheta = dtheta < -180 ? dtheta + 360 : dtheta;
+        if (abs(dtheta) > 90) return 1;
+        tmp = tmp->prev;
+        counter++;
+    }
+    return 0;
+}
+
+static double gradient_ratio(const int *window) {
+    double sum_magnitude = 0, sum_x = 0, sum_y = 0;
+    for (int i = -1; i < 2; i++) {
+        for (int j = -1; j < 2; j++) {
+            int inner_window[9];
+            inner_window[0] = window[i * 5 + 6 + j];
+            inner_window[1] = window[i * 5 + 7 + j];
+            inner_window[2] = window[i * 5 + 8 + j];
+            inner_window[3] = window[i * 5 + 11 + j];
+            inner_window[4] = window[i * 5 + 12 + j];
+            inner_window[5] = window[i * 5 + 13 + j];
+            inner_window[6] = window[i * 5 + 16 + j];
+            inner_window[7] = window[i * 5 + 17 + j];
+            inner_window[8] = window[i * 5 + 18 + j];
+
+            ReferenceVector g = gradient(inner_window);
+            sum_magnitude += sqrt(square(g.x) + square(g.y));
+            sum_x += g.x;
+            sum_y += g.y;
+        }
+    }
+    return sqrt(square(sum_x) + square(sum_y)) / sum_magnitude;
+}
+
+static ReferencePoint * new_point(ReferencePoint *prev, int bin, int angle) {
+    ReferencePoint *c = malloc(sizeof(ReferencePoint));
+    c->bin = bin;
+    c->angle = angle;
+    c->prev = prev;
+    c->next = NULL;
+    if (prev != NULL) prev->next = c;
+    return c;
+}
+
+static int get_bin_number(int bin, int i, int row, const int *basebins, const int *n_bins_in_row) {
+    double ratio = (bin - basebins[row]) / (double) n_bins_in_row[row];
+    int next_bin = bin;
+    switch (i) {
+        case 0:
+            next_bin = (int) (ratio * n_bins_in_row[row - 1] + 0.5) + basebins[row - 1] - 1;
+            break;
+        case 1:
+            next_bin = (int) (ratio * n_bins_in_row[row - 1] + 0.5) + basebins[row - 1];
+            break;
+        case 2:
+            next_bin = (int) (ratio * n_bins_in_row[row - 1] + 0.5) + basebins[row - 1] + 1;
+            break;
+        case 3:
+            next_bin = bin - 1;
+            break;
+        case 5:
+            next_bin = bin + 1;
+            break;
+        case 6:
+            next_bin = (int) (ratio * n_bins_in_row[row + 1] + 0.5) + basebins[row + 1] - 1;
+            break;
+        case 7:
+            next_bin = (int) (ratio * n_bins_in_row[row + 1] + 0.5) + basebins[row + 1];
+            break;
+        case 8:
+            next_bin = (int) (ratio * n_bins_in_row[row + 1] + 0.5) + basebins[row + 1] + 1;
+            break;
+    }
+    return next_bin;
+}
+
+static ReferencePoint * find_best_front(ReferencePoint *prev, const ReferenceMap *map, int row) {
+    int edge_window[9];
+    reference_get_window(prev->bin, row, 3, map->edge_pixels, map->nbins, map->n_bins_in_row, map->basebins,
+                         edge_window);
+    int next_bin = -1;
+    int min_dtheta = 180;
+    int next_angle = 0;
+    for (int i = 0; i < 9; i++) {
+        int dtheta = 180;
+        if (i != 4 && edge_window[i]) {
+            if (prev->prev == NULL) {
+                dtheta = 0;
+            } else {
+                dtheta = prev->angle - ANGLES[i];
+                dtheta = mod(dtheta + 180, 360) - 180;
+                dtheta = dtheta < -180 ? dtheta + 360 : dtheta;
+                dtheta = abs(dtheta);
+            }
+            if (dtheta == 0 || dtheta < min_dtheta) {
+                min_dtheta = dtheta;
+                next_angle = ANGLES[i];
+                next_bin = get_bin_number(prev->bin, i, row, map->basebins, map->n_bins_in_row);
+            }
+        }
+    }
+    if (next_bin != -1 && (prev->prev == NULL || !turn_too_sharp(prev, next_angle))) {
+        return new_point(prev, next_bin, next_angle);
+    }
+    return NULL;
+}
+
+static int follow_contour(ReferencePoint *prev, const ReferenceMap *map, int row) {
+    const int *n_bins_in_row = map->n_bins_in_row;
+    const int *basebins = map->basebins;
+    ReferencePoint *next_point = find_best_front(prev, map, row);
+    int count = 1;
+    if (next_point == NULL) {
+        int outer_window[25];
+        reference_get_window(prev->bin, row, 5, map->filtered_data, map->nbins, n_bins_in_row, basebins,
+                             outer_window);
+        if (gradient_ratio(outer_window) > 0.7) {
+            int bin_window[9];
+            double max_product = -1;
+            int max_idx = -1;
+            int max_bin = -1;
+            reference_get_window(prev->bin, row, 3, map->filtered_data, map->nbins, n_bins_in_row, basebins,
+                                 bin_window);
+            ReferenceVector gradient0 = gradient(bin_window);
+            for (int i = 0; i < 3; i++) {
+                for (int j = 0; j < 3; j++) {
+                    if (i != 1 || j != 1) {
+                        int bin = get_bin_number(prev->bin, i * 3 + j, row, basebins, n_bins_in_row);
+                        if (!map->pixel_in_contour[bin]) {
+                            reference_get_window(bin, row + i - 1, 3, map->filtered_data, map->nbins, n_bins_in_row,
+                                                 basebins, bin_window);
+                            ReferenceVector gradient1 = gradient(bin_window);
+                            double product = dot(gradient0, gradient1);
+                            if (product > max_product) {
+                                max_product = product;
+                                max_idx = i * 3 + j;
+                                max_bin = bin;
+                            }
+                        }
+                    }
+                }
+            }
+            if (max_product > 0) {
+                next_point = new_point(prev, max_bin, ANGLES[max_idx]);
+            }
+        }
+    }
+
+    if (next_point != NULL && !map->pixel_in_contour[next_point->bin]) {
+        int next_row = row;
+        map->pixel_in_contour[next_point->bin] = 1;
+        if (next_point->angle > 0 && next_point->angle < 180) {
+            next_row = row - 1;
+        } else if (next_point->angle > 180 && next_point->angle < 360) {
+            next_row = row + 1;
+        }
+        if (next_row < map->nrows - 2 && next_row > 1 && next_point->bin > basebins[next_row] + 1 &&
+            next_point->bin < basebins[next_row + 1] - 2) {
+            count += follow_contour(next_point, map, next_row);
+        } else {
+            count++;
+        }
+    }
+    return count;
+}
+
+/*
+ * Function:  reference_contour
+ * --------------------
+ * The original contour step. Every point of a contour of at least 15 points is set to 1 in out_data, other bins are
+ * left as they are.
+ */
+void reference_contour(const int *edge_pixels, const int *filtered_data, int *out_data, int nbins, int nrows,
+                       const int *n_bins_in_row, const int *basebins) {
+    ReferenceMap map = {edge_pixels, filtered_data, malloc(nbins * sizeof(int)), nbins, nrows, n_bins_in_row,
+                        basebins};
+    for (int i = 0; i < nbins; i++) {
+        map.pixel_in_contour[i] = filtered_data[i] == FILL_VALUE ? 1 : 0;
+    }
+    for (int i = 2; i < nrows - 2; i++) {
+        for (int j = basebins[i] + 2; j < basebins[i] + n_bins_in_row[i] - 2; j++) {
+            if (edge_pixels[j] && !map.pixel_in_contour[j]) {
+                map.pixel_in_contour[j] = 1;
+                ReferencePoint *first = new_point(NULL, j, 0);
+                int length = follow_contour(first, &map, i);
+                for (ReferencePoint *point = first; point != NULL;) {
+                    ReferencePoint *next = point->next;
+                    if (length >= 15) out_data[point->bin] = 1;
+                    free(point);
+                    point = next;
+                }
+            }
+        }
+    }
+    free(map.pixel_in_contour);
+}
+
+/*
+ * Function:  reference_count_windows
+ * --------------------
+ * Returns the number of windows of the scan of reference_cayula, counting the windows of rows that are skipped.
+ */
+int reference_count_windows(int nrows, const int *n_bins_in_row) {
+    int half_step = WINDOW_WIDTH / 2;
+    int nwindows = 0;
+    for (int i = half_step - 1; i < nrows - half_step; i += WINDOW_WIDTH) {
+        for (int j = half_step - 1; j < n_bins_in_row[i] - half_step; j += WINDOW_WIDTH) nwindows++;
+    }
+    return nwindows;
+}
+
+/*
+ * Function:  reference_cayula
+ * --------------------
+ * The original algorithm on int data, keeping the result of every step. The first and last window rows check the
+ * length of the first and last row of the grid rather than reading before or after n_bins_in_row.
+ *
+ * args:
+ *      int *data: pointer to the array containing the data for every bin. Bins without data contain FILL_VALUE
+ *      int *out_data: pointer to an output array. Fronts are 1, other valid bins 0 and bins without data -1
+ *      int *filtered_data: pointer to an output array for the filtered data
+ *      int *thresholds: pointer to an output array with an element for every window counted by
+ *      reference_count_windows, set to the threshold of the window or -1 for windows without one
+ *      int *edge_pixels: pointer to an output array set to 1 for edge pixels and 0 otherwise
+ */
+void reference_cayula(const int *data, int *out_data, int *filtered_data, int *thresholds, int *edge_pixels,
+                      int nbins, int nrows, const int *n_bins_in_row, const int *basebins) {
+    reference_median_filter(data, filtered_data, nbins, nrows, n_bins_in_row, basebins);
+    for (int i = 0; i < nbins; i++) {
+        out_data[i] = data[i] == FILL_VALUE ? -1 : 0;
+        edge_pixels[i] = 0;
+    }
+
+    int half_step = WINDOW_WIDTH / 2;
+    int window[WINDOW_AREA];
+    int bin_window[WINDOW_AREA];
+    int edge_window[WINDOW_AREA];
+    int w = 0;
+    for (int i = half_step - 1; i < nrows - half_step; i += WINDOW_WIDTH) {
+        for (int j = half_step - 1; j < n_bins_in_row[i] - half_step; j += WINDOW_WIDTH, w++) {
+            thresholds[w] = -1;
+            if (n_bins_in_row[max(i - WINDOW_WIDTH + 1, 0)] < WINDOW_WIDTH ||
+                n_bins_in_row[min(i + WINDOW_WIDTH, nrows - 1)] < WINDOW_WIDTH) {
+                continue;
+            }
+            reference_get_window(basebins[i] + j, i, WINDOW_WIDTH, filtered_data, nbins, n_bins_in_row, basebins,
+                                 window);
+            int threshold = reference_histogram_analysis(window);
+            if (threshold <= 0) continue;
+            thresholds[w] = threshold;
+            if (!reference_cohesive(window, threshold)) continue;
+            reference_get_bin_window(basebins[i] + j, i, WINDOW_WIDTH, n_bins_in_row, basebins, bin_window);
+            reference_find_edge(window, edge_window, threshold);
+            for (int k = 0; k < WINDOW_AREA; k++) {
+                if (edge_window[k]) edge_pixels[bin_window[k]] = 1;
+            }
+        }
+    }
+    reference_contour(edge_pixels, filtered_data, out_data, nbins, nrows, n_bins_in_row, basebins);
+}
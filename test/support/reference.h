@@ -0,0 +1,21 @@
+/*
+ * Copies of the original implementations of the steps of the algorithm, kept to check that optimized versions give the
+ * same results.
+ */
+#ifndef SIED_REFERENCE_H
+#define SIED_REFERENCE_H
+
+int reference_histogram_threshold(const int *histogram);
+int reference_get_window(int bin, int row, int width, const int *data, int nbins, const int *n_bins_in_row,
+                         const int *basebins, int *window);
+void reference_median_filter(const int *data, int *filtered_data, int nbins, int nrows, const int *n_bins_in_row,
+                             const int *basebins);
+int reference_histogram_analysis(const int *window);
+int reference_cohesive(const int *window, int threshold);
+void reference_find_edge(const int *window, int *out, int threshold);
+void reference_contour(const int *edge_pixels, const int *filtered_data, int *out_data, int nbins, int nrows,
+                       const int *n_bins_in_row, const int *basebins);
+int reference_count_windows(int nrows, const int *n_bins_in_row);
+void reference_cayula(const int *data, int *out_data, int *filtered_data, int *thresholds, int *edge_pixels,
+                      int nbins, int nrows, const int *n_bins_in_row, const int *basebins);
+#endif //SIED_REFERENCE_H
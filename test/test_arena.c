@@ -0,0 +1,41 @@
+#include "unity.h"
+#include <stdint.h>
+#include <string.h>
+#include "arena.h"
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_arena_alloc(void) {
+    Arena *arena = arena_create(64);
+    TEST_ASSERT_NOT_NULL(arena);
+    char *first = arena_alloc(arena, 24);
+    char *second = arena_alloc(arena, 24);
+    char *large = arena_alloc(arena, 1000);
+    TEST_ASSERT_NOT_NULL(first);
+    TEST_ASSERT_NOT_NULL(second);
+    TEST_ASSERT_NOT_NULL(large);
+    TEST_ASSERT_EQUAL_INT(0, (uintptr_t) first % 16);
+    TEST_ASSERT_EQUAL_INT(0, (uintptr_t) second % 16);
+    TEST_ASSERT_TRUE(second >= first + 24 || first >= second + 24);
+    memset(first, 1, 24);
+    memset(second, 2, 24);
+    memset(large, 3, 1000);
+    TEST_ASSERT_EQUAL_INT(1, first[23]);
+    TEST_ASSERT_EQUAL_INT(2, second[0]);
+    arena_destroy(arena);
+}
+
+void test_arena_reset_reuses_blocks(void) {
+    Arena *arena = arena_create(256);
+    void *before[40];
+    for (int i = 0; i < 40; i++) before[i] = arena_alloc(arena, 32);
+    arena_reset(arena);
+    for (int i = 0; i < 40; i++) {
+        TEST_ASSERT_EQUAL_PTR(before[i], arena_alloc(arena, 32));
+    }
+    arena_destroy(arena);
+}
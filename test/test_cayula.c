@@ -1,11 +1,21 @@
 #include "unity.h"
+#include <math.h>
+#include <stdlib.h>
 
 #include "cayula.h"
 #include "helpers.h"
+#include "grid.h"
+#include "pool.h"
+#include "bitset.h"
+#include "arena.h"
+#include "gradient.h"
 #include "cohesion.h"
 #include "contour.h"
 #include "filter.h"
+#include "spans.h"
 #include "histogram.h"
+#include "synth.h"
+#include "isin.h"
 
 void setUp(void)
 {
@@ -1278,3 +1288,671 @@ void test_cayula_cayula(void)
     cayula(data, out, 16384, 128, nbins_in_row, basebins);
     TEST_ASSERT_EQUAL_INT(0, out[2300]);
 }
+
+
+/*
+ * Fills a 160 row map with a noisy front running diagonally across it and scattered missing bins.
+ */
+static int synthetic_front(unsigned int seed, int offset, int *basebins, int *nbins_in_row, int **data) {
+    int nrows = 160;
+    int n_bins = 0;
+    for (int i = 0; i < nrows; i++) {
+        basebins[i] = n_bins;
+        nbins_in_row[i] = 96 + i / 4;
+        n_bins += nbins_in_row[i];
+    }
+    *data = malloc(n_bins * sizeof(int));
+    for (int i = 0; i < nrows; i++) {
+        for (int j = 0; j < nbins_in_row[i]; j++) {
+            seed = seed * 1103515245 + 12345;
+            int noise = (seed >> 16) % 21;
+            int value = (j * 96 / nbins_in_row[i] + i / 3 > offset ? 180 : 60) + noise;
+            (*data)[basebins[i] + j] = (seed >> 8) % 50 == 0 ? FILL_VALUE : value;
+        }
+    }
+    return n_bins;
+}
+
+void test_cayula_threads_match_serial(void)
+{
+    int nrows = 160;
+    int basebins[160];
+    int nbins_in_row[160];
+    int *data;
+    int n_bins = synthetic_front(7, 70, basebins, nbins_in_row, &data);
+    int *serial = malloc(n_bins * sizeof(int));
+    int *threaded = malloc(n_bins * sizeof(int));
+    CayulaOptions options = cayula_default_options();
+    options.nthreads = 1;
+    cayula_with_options(data, serial, n_bins, nrows, nbins_in_row, basebins, &options);
+    options.nthreads = 4;
+    cayula_with_options(data, threaded, n_bins, nrows, nbins_in_row, basebins, &options);
+    TEST_ASSERT_EQUAL_INT_ARRAY(serial, threaded, n_bins);
+
+    options.stride = 16;
+    options.nthreads = 1;
+    cayula_with_options(data, serial, n_bins, nrows, nbins_in_row, basebins, &options);
+    options.nthreads = 4;
+    cayula_with_options(data, threaded, n_bins, nrows, nbins_in_row, basebins, &options);
+    TEST_ASSERT_EQUAL_INT_ARRAY(serial, threaded, n_bins);
+    free(data);
+    free(serial);
+    free(threaded);
+}
+
+void test_cayula_ctx_reuse(void)
+{
+    int nrows = 160;
+    int basebins[160];
+    int nbins_in_row[160];
+    int *first;
+    int *second;
+    int n_bins = synthetic_front(7, 70, basebins, nbins_in_row, &first);
+    synthetic_front(11, 50, basebins, nbins_in_row, &second);
+    int *expected = malloc(n_bins * sizeof(int));
+    int *out = malloc(n_bins * sizeof(int));
+
+    CayulaCtx *ctx = cayula_ctx_create(n_bins, nrows, nbins_in_row, basebins, NULL);
+    TEST_ASSERT_NOT_NULL(ctx);
+    cayula(first, expected, n_bins, nrows, nbins_in_row, basebins);
+    cayula_ctx_run(ctx, first, out);
+    TEST_ASSERT_EQUAL_INT_ARRAY(expected, out, n_bins);
+    cayula(second, expected, n_bins, nrows, nbins_in_row, basebins);
+    cayula_ctx_run(ctx, second, out);
+    TEST_ASSERT_EQUAL_INT_ARRAY(expected, out, n_bins);
+    cayula_ctx_destroy(ctx);
+    free(first);
+    free(second);
+    free(expected);
+    free(out);
+}
+
+void test_cayula_ctx_run_u8(void)
+{
+    int nrows = 160;
+    int basebins[160];
+    int nbins_in_row[160];
+    int *data;
+    int n_bins = synthetic_front(7, 70, basebins, nbins_in_row, &data);
+    int *expected = malloc(n_bins * sizeof(int));
+    uint8_t *values = malloc(n_bins);
+    uint64_t *valid = calloc(bitset_words(n_bins), sizeof(uint64_t));
+    int8_t *out = malloc(n_bins);
+    for (int i = 0; i < n_bins; i++) {
+        values[i] = data[i] == FILL_VALUE ? 0 : (uint8_t) data[i];
+        if (data[i] != FILL_VALUE) bitset_set(valid, i);
+    }
+
+    CayulaCtx *ctx = cayula_ctx_create(n_bins, nrows, nbins_in_row, basebins, NULL);
+    TEST_ASSERT_NOT_NULL(ctx);
+    cayula_ctx_run(ctx, data, expected);
+    cayula_ctx_run_u8(ctx, values, valid, out);
+    for (int i = 0; i < n_bins; i++) {
+        TEST_ASSERT_EQUAL_INT(expected[i], out[i]);
+    }
+    cayula_ctx_destroy(ctx);
+    free(data);
+    free(expected);
+    free(values);
+    free(valid);
+    free(out);
+}
+
+void test_cayula_ctx_run_sparse(void)
+{
+    int nrows = 160;
+    int basebins[160];
+    int nbins_in_row[160];
+    int *data;
+    int n_bins = synthetic_front(7, 70, basebins, nbins_in_row, &data);
+    int *bin_numbers = malloc(n_bins * sizeof(int));
+    int *bins = malloc(2 * n_bins * sizeof(int));
+    double *values = malloc(2 * n_bins * sizeof(double));
+    int *dense = malloc(n_bins * sizeof(int));
+    int *expected = malloc(n_bins * sizeof(int));
+    int8_t *out = malloc(n_bins);
+    int low = 255, high = 0;
+    for (int i = 0; i < n_bins; i++) {
+        if (data[i] == FILL_VALUE) continue;
+        low = data[i] < low ? data[i] : low;
+        high = data[i] > high ? data[i] : high;
+    }
+    /*
+     * Every bin of the context is every third bin of the full grid, and the list holds bins of the grid in between
+     * that must be ignored along with a value that is not a number
+     */
+    int nvalues = 0;
+    for (int i = 0; i < n_bins; i++) {
+        bin_numbers[i] = 3 * i + 5;
+        dense[i] = FILL_VALUE;
+        if (data[i] == FILL_VALUE) continue;
+        double value = 0.5 * data[i] - 10;
+        bins[nvalues] = bin_numbers[i];
+        values[nvalues++] = value;
+        bins[nvalues] = bin_numbers[i] + 1;
+        values[nvalues++] = i == 1000 ? NAN : value;
+        dense[i] = (int) floor(255 * (value - (0.5 * low - 10)) / (0.5 * (high - low)));
+    }
+
+    CayulaCtx *ctx = cayula_ctx_create(n_bins, nrows, nbins_in_row, basebins, NULL);
+    TEST_ASSERT_NOT_NULL(ctx);
+    TEST_ASSERT_EQUAL_INT(-1, cayula_ctx_run_sparse(ctx, bins, values, nvalues, out));
+    bin_numbers[1] = bin_numbers[0];
+    TEST_ASSERT_EQUAL_INT(-1, cayula_ctx_set_bin_numbers(ctx, bin_numbers));
+    bin_numbers[1] = 8;
+    TEST_ASSERT_EQUAL_INT(0, cayula_ctx_set_bin_numbers(ctx, bin_numbers));
+    cayula_ctx_run(ctx, dense, expected);
+    TEST_ASSERT_EQUAL_INT(0, cayula_ctx_run_sparse(ctx, bins, values, nvalues, out));
+    for (int i = 0; i < n_bins; i++) {
+        TEST_ASSERT_EQUAL_INT(expected[i], out[i]);
+    }
+
+    /*
+     * An unsorted list gives the same result
+     */
+    for (int k = 0; k < nvalues / 2; k++) {
+        int bin = bins[k];
+        double value = values[k];
+        bins[k] = bins[nvalues - 1 - k];
+        values[k] = values[nvalues - 1 - k];
+        bins[nvalues - 1 - k] = bin;
+        values[nvalues - 1 - k] = value;
+    }
+    TEST_ASSERT_EQUAL_INT(0, cayula_ctx_run_sparse(ctx, bins, values, nvalues, out));
+    for (int i = 0; i < n_bins; i++) {
+        TEST_ASSERT_EQUAL_INT(expected[i], out[i]);
+    }
+    cayula_ctx_destroy(ctx);
+    free(data);
+    free(bin_numbers);
+    free(bins);
+    free(values);
+    free(dense);
+    free(expected);
+    free(out);
+}
+
+void test_cayula_valid_spans(void)
+{
+    int nrows = 160;
+    int basebins[160];
+    int nbins_in_row[160];
+    int *data;
+    int n_bins = synthetic_front(7, 70, basebins, nbins_in_row, &data);
+    int *expected = malloc(n_bins * sizeof(int));
+    int *out = malloc(n_bins * sizeof(int));
+    /*
+     * Clouds over whole rows and over most of the rows below them
+     */
+    for (int i = 40; i < 160; i++) {
+        for (int j = 0; j < nbins_in_row[i]; j++) {
+            if (i < 80 || (j > 20 && j < nbins_in_row[i] - 40)) data[basebins[i] + j] = FILL_VALUE;
+        }
+    }
+
+    for (int levels = 256; levels <= 1024; levels *= 4) {
+        CayulaOptions options = cayula_default_options();
+        options.levels = levels;
+        options.stride = 16;
+        CayulaCtx *dense = cayula_ctx_create(n_bins, nrows, nbins_in_row, basebins, &options);
+        options.valid_spans = 1;
+        CayulaCtx *sparse = cayula_ctx_create(n_bins, nrows, nbins_in_row, basebins, &options);
+        TEST_ASSERT_NOT_NULL(dense);
+        TEST_ASSERT_NOT_NULL(sparse);
+        cayula_ctx_run(dense, data, expected);
+        cayula_ctx_run(sparse, data, out);
+        TEST_ASSERT_EQUAL_INT_ARRAY(expected, out, n_bins);
+        CayulaScreenCounts dense_counts = cayula_ctx_screen_counts(dense);
+        CayulaScreenCounts sparse_counts = cayula_ctx_screen_counts(sparse);
+        TEST_ASSERT_EQUAL_INT(dense_counts.windows, sparse_counts.windows);
+        TEST_ASSERT_EQUAL_INT(dense_counts.rejected_valid, sparse_counts.rejected_valid);
+        TEST_ASSERT_EQUAL_INT(dense_counts.rejected_histogram, sparse_counts.rejected_histogram);
+        TEST_ASSERT_EQUAL_INT(dense_counts.rejected_cohesion, sparse_counts.rejected_cohesion);
+        TEST_ASSERT_TRUE(sparse_counts.rejected_valid > 0);
+        cayula_ctx_destroy(dense);
+        cayula_ctx_destroy(sparse);
+    }
+    free(data);
+    free(expected);
+    free(out);
+}
+
+void test_cayula_gradient_field(void)
+{
+    SynthOptions synth = synth_default_options();
+    synth.cloud_fraction = 0.2;
+    SynthField *field = synth_field_create(360, &synth);
+    TEST_ASSERT_NOT_NULL(field);
+    int *expected = malloc(field->nbins * sizeof(int));
+    int *out = malloc(field->nbins * sizeof(int));
+    for (int levels = 256; levels <= 4096; levels *= 16) {
+        CayulaOptions options = cayula_default_options();
+        options.levels = levels;
+        cayula_with_options(field->data, expected, field->nbins, field->nrows, field->n_bins_in_row,
+                            field->basebins, &options);
+        options.gradient_field = 1;
+        cayula_with_options(field->data, out, field->nbins, field->nrows, field->n_bins_in_row, field->basebins,
+                            &options);
+        TEST_ASSERT_EQUAL_INT_ARRAY(expected, out, field->nbins);
+    }
+    int nfronts = 0;
+    for (int i = 0; i < field->nbins; i++) nfronts += out[i] == 1;
+    TEST_ASSERT_TRUE(nfronts > 0);
+    synth_field_destroy(field);
+    free(expected);
+    free(out);
+}
+
+void test_cayula_filter_size_levels(void)
+{
+    SynthOptions synth = synth_default_options();
+    synth.cloud_fraction = 0.2;
+    SynthField *field = synth_field_create(180, &synth);
+    TEST_ASSERT_NOT_NULL(field);
+    int *expected = malloc(field->nbins * sizeof(int));
+    int *out = malloc(field->nbins * sizeof(int));
+
+    /*
+     * 8 bit data gives the same fronts through the 8 and 16 bit histograms of a 5x5 median filter, and the 16 bit
+     * histogram is reused from run to run
+     */
+    CayulaOptions options = cayula_default_options();
+    options.filter_size = 5;
+    cayula_with_options(field->data, expected, field->nbins, field->nrows, field->n_bins_in_row, field->basebins,
+                        &options);
+    options.levels = 4096;
+    CayulaCtx *ctx = cayula_ctx_create(field->nbins, field->nrows, field->n_bins_in_row, field->basebins, &options);
+    TEST_ASSERT_NOT_NULL(ctx);
+    for (int run = 0; run < 2; run++) {
+        cayula_ctx_run(ctx, field->data, out);
+        TEST_ASSERT_EQUAL_INT_ARRAY(expected, out, field->nbins);
+    }
+    int nfronts = 0;
+    for (int i = 0; i < field->nbins; i++) nfronts += out[i] == 1;
+    TEST_ASSERT_TRUE(nfronts > 0);
+    cayula_ctx_destroy(ctx);
+    synth_field_destroy(field);
+    free(expected);
+    free(out);
+}
+
+void test_cayula_contour_bands_match_across_threads(void)
+{
+    int nrows = 160;
+    int basebins[160];
+    int nbins_in_row[160];
+    int *data;
+    int n_bins = synthetic_front(7, 70, basebins, nbins_in_row, &data);
+    int *serial = malloc(n_bins * sizeof(int));
+    int *banded = malloc(n_bins * sizeof(int));
+    int *threaded = malloc(n_bins * sizeof(int));
+    CayulaOptions options = cayula_default_options();
+    options.nthreads = 1;
+    cayula_with_options(data, serial, n_bins, nrows, nbins_in_row, basebins, &options);
+    options.contour_band_rows = nrows;
+    cayula_with_options(data, banded, n_bins, nrows, nbins_in_row, basebins, &options);
+    TEST_ASSERT_EQUAL_INT_ARRAY(serial, banded, n_bins);
+
+    options.contour_band_rows = 10;
+    cayula_with_options(data, banded, n_bins, nrows, nbins_in_row, basebins, &options);
+    TEST_ASSERT_EQUAL_INT_ARRAY(serial, banded, n_bins);
+    options.nthreads = 4;
+    cayula_with_options(data, threaded, n_bins, nrows, nbins_in_row, basebins, &options);
+    TEST_ASSERT_EQUAL_INT_ARRAY(banded, threaded, n_bins);
+    int nfronts = 0;
+    for (int i = 0; i < n_bins; i++) nfronts += banded[i] == 1;
+    TEST_ASSERT_TRUE(nfronts > 0);
+    free(data);
+    free(serial);
+    free(banded);
+    free(threaded);
+}
+
+void test_cayula_contour_bands_match_serial(void)
+{
+    SynthOptions synth = synth_default_options();
+    synth.cloud_fraction = 0.3;
+    SynthField *field = synth_field_create(360, &synth);
+    TEST_ASSERT_NOT_NULL(field);
+    int *serial = malloc(field->nbins * sizeof(int));
+    int *banded = malloc(field->nbins * sizeof(int));
+    CayulaOptions options = cayula_default_options();
+    options.nthreads = 1;
+    cayula_with_options(field->data, serial, field->nbins, field->nrows, field->n_bins_in_row, field->basebins,
+                        &options);
+
+    /*
+     * Contours cross the edges of bands of every height, which the merge follows them across
+     */
+    int band_rows[4] = {4, 7, 10, 64};
+    for (int k = 0; k < 4; k++) {
+        for (int nthreads = 1; nthreads <= 4; nthreads += 3) {
+            options.contour_band_rows = band_rows[k];
+            options.nthreads = nthreads;
+            cayula_with_options(field->data, banded, field->nbins, field->nrows, field->n_bins_in_row,
+                                field->basebins, &options);
+            TEST_ASSERT_EQUAL_INT_ARRAY(serial, banded, field->nbins);
+        }
+    }
+    int nfronts = 0;
+    for (int i = 0; i < field->nbins; i++) nfronts += serial[i] == 1;
+    TEST_ASSERT_TRUE(nfronts > 0);
+    synth_field_destroy(field);
+    free(serial);
+    free(banded);
+}
+
+void test_cayula_screen_counts(void)
+{
+    int nrows = 160;
+    int basebins[160];
+    int nbins_in_row[160];
+    int *data;
+    int n_bins = synthetic_front(7, 70, basebins, nbins_in_row, &data);
+    int *expected = malloc(n_bins * sizeof(int));
+    int *out = malloc(n_bins * sizeof(int));
+    cayula(data, expected, n_bins, nrows, nbins_in_row, basebins);
+
+    CayulaOptions options = cayula_default_options();
+    options.min_valid_fraction = 0.5;
+    options.min_range = 2;
+    CayulaCtx *ctx = cayula_ctx_create(n_bins, nrows, nbins_in_row, basebins, &options);
+    TEST_ASSERT_NOT_NULL(ctx);
+    cayula_ctx_run(ctx, data, out);
+    TEST_ASSERT_EQUAL_INT_ARRAY(expected, out, n_bins);
+    CayulaScreenCounts counts = cayula_ctx_screen_counts(ctx);
+    TEST_ASSERT_TRUE(counts.windows > 0);
+    TEST_ASSERT_EQUAL_INT(0, counts.rejected_valid);
+    TEST_ASSERT_TRUE(counts.rejected_histogram > 0);
+    TEST_ASSERT_TRUE(counts.rejected_valid + counts.rejected_variance + counts.rejected_range +
+                     counts.rejected_histogram + counts.rejected_cohesion < counts.windows);
+    cayula_ctx_destroy(ctx);
+
+    options.min_variance = 1e6;
+    ctx = cayula_ctx_create(n_bins, nrows, nbins_in_row, basebins, &options);
+    TEST_ASSERT_NOT_NULL(ctx);
+    cayula_ctx_run(ctx, data, out);
+    counts = cayula_ctx_screen_counts(ctx);
+    TEST_ASSERT_EQUAL_INT(counts.windows, counts.rejected_variance);
+    for (int i = 0; i < n_bins; i++) {
+        TEST_ASSERT_TRUE(out[i] != 1);
+    }
+    cayula_ctx_destroy(ctx);
+    free(data);
+    free(expected);
+    free(out);
+}
+
+void test_cayula_ctx_run_u16(void)
+{
+    int nrows = 160;
+    int basebins[160];
+    int nbins_in_row[160];
+    int *data;
+    int n_bins = synthetic_front(7, 70, basebins, nbins_in_row, &data);
+    int *expected = malloc(n_bins * sizeof(int));
+    int *out = malloc(n_bins * sizeof(int));
+    uint16_t *values = malloc(n_bins * sizeof(uint16_t));
+    uint64_t *valid = calloc(bitset_words(n_bins), sizeof(uint64_t));
+    int8_t *out8 = malloc(n_bins);
+    cayula(data, expected, n_bins, nrows, nbins_in_row, basebins);
+
+    CayulaOptions options = cayula_default_options();
+    options.levels = 4096;
+    cayula_with_options(data, out, n_bins, nrows, nbins_in_row, basebins, &options);
+    TEST_ASSERT_EQUAL_INT_ARRAY(expected, out, n_bins);
+
+    /*
+     * A front of 3 levels out of 65536 with noise of 2 levels is lost when the data is reduced to 8 bits
+     */
+    options.levels = 65536;
+    CayulaCtx *ctx = cayula_ctx_create(n_bins, nrows, nbins_in_row, basebins, &options);
+    TEST_ASSERT_NOT_NULL(ctx);
+    for (int i = 0; i < n_bins; i++) {
+        if (data[i] == FILL_VALUE) {
+            values[i] = 0;
+        } else {
+            values[i] = (uint16_t) (30000 + (data[i] >= 120 ? 3 : 0) + data[i] % 2);
+            bitset_set(valid, i);
+        }
+    }
+    cayula_ctx_run_u16(ctx, values, valid, out8);
+    int nfronts = 0;
+    for (int i = 0; i < n_bins; i++) nfronts += out8[i] == 1;
+    TEST_ASSERT_TRUE(nfronts > 0);
+    cayula_ctx_destroy(ctx);
+
+    options.levels = 256;
+    ctx = cayula_ctx_create(n_bins, nrows, nbins_in_row, basebins, &options);
+    TEST_ASSERT_NOT_NULL(ctx);
+    for (int i = 0; i < n_bins; i++) values[i] >>= 8;
+    cayula_ctx_run_u16(ctx, values, valid, out8);
+    for (int i = 0; i < n_bins; i++) {
+        TEST_ASSERT_TRUE(out8[i] != 1);
+    }
+    cayula_ctx_destroy(ctx);
+    free(data);
+    free(expected);
+    free(out);
+    free(values);
+    free(valid);
+    free(out8);
+}
+
+void test_cayula_window_width(void)
+{
+    int nrows = 160;
+    int basebins[160];
+    int nbins_in_row[160];
+    int *data;
+    int n_bins = synthetic_front(7, 70, basebins, nbins_in_row, &data);
+    int *expected = malloc(n_bins * sizeof(int));
+    int *serial = malloc(n_bins * sizeof(int));
+    int *threaded = malloc(n_bins * sizeof(int));
+    cayula(data, expected, n_bins, nrows, nbins_in_row, basebins);
+
+    CayulaOptions options = cayula_default_options();
+    options.window_width = 32;
+    cayula_with_options(data, serial, n_bins, nrows, nbins_in_row, basebins, &options);
+    TEST_ASSERT_EQUAL_INT_ARRAY(expected, serial, n_bins);
+
+    int widths[] = {16, 24, 64};
+    for (int w = 0; w < 3; w++) {
+        options.window_width = widths[w];
+        options.stride = widths[w] / 2;
+        options.nthreads = 1;
+        cayula_with_options(data, serial, n_bins, nrows, nbins_in_row, basebins, &options);
+        options.nthreads = 4;
+        cayula_with_options(data, threaded, n_bins, nrows, nbins_in_row, basebins, &options);
+        TEST_ASSERT_EQUAL_INT_ARRAY(serial, threaded, n_bins);
+        int nfronts = 0;
+        for (int i = 0; i < n_bins; i++) nfronts += serial[i] == 1;
+        TEST_ASSERT_TRUE(nfronts > 0);
+    }
+    free(data);
+    free(expected);
+    free(serial);
+    free(threaded);
+}
+
+void test_cayula_with_options_status(void)
+{
+    /*
+     * Neighboring rows whose lengths are too far apart for the grid make the context fail, and every bin is then
+     * given -1 rather than being left as it was
+     */
+    int nbins_in_row[3] = {10, 400, 10};
+    int basebins[3] = {0, 10, 410};
+    int n_bins = 420;
+    int *data = malloc(n_bins * sizeof(int));
+    int *out = malloc(n_bins * sizeof(int));
+    for (int i = 0; i < n_bins; i++) {
+        data[i] = i % 200;
+        out[i] = 1;
+    }
+    CayulaOptions options = cayula_default_options();
+    TEST_ASSERT_EQUAL_INT(-1, cayula_with_options(data, out, n_bins, 3, nbins_in_row, basebins, &options));
+    for (int i = 0; i < n_bins; i++) TEST_ASSERT_EQUAL_INT(-1, out[i]);
+    TEST_ASSERT_EQUAL_INT(-1, cayula(data, out, n_bins, 3, nbins_in_row, basebins));
+
+    nbins_in_row[0] = nbins_in_row[2] = 400;
+    basebins[1] = 400;
+    basebins[2] = 800;
+    int *wide_data = malloc(1200 * sizeof(int));
+    int *wide_out = malloc(1200 * sizeof(int));
+    for (int i = 0; i < 1200; i++) wide_data[i] = i % 200;
+    TEST_ASSERT_EQUAL_INT(0, cayula(wide_data, wide_out, 1200, 3, nbins_in_row, basebins));
+    for (int i = 0; i < 1200; i++) TEST_ASSERT_TRUE(wide_out[i] == 0 || wide_out[i] == 1);
+    free(data);
+    free(out);
+    free(wide_data);
+    free(wide_out);
+}
+
+void test_cayula_odd_window_width(void)
+{
+    SynthOptions synth = synth_default_options();
+    synth.cloud_fraction = 0.2;
+    SynthField *field = synth_field_create(180, &synth);
+    TEST_ASSERT_NOT_NULL(field);
+    int *expected = malloc(field->nbins * sizeof(int));
+    int *out = malloc(field->nbins * sizeof(int));
+
+    /*
+     * Odd widths run as the next even width on rows of every length, down to the 3 bins of the polar rows
+     */
+    int widths[] = {3, 15, 17, 63};
+    for (int w = 0; w < 4; w++) {
+        CayulaOptions options = cayula_default_options();
+        options.window_width = widths[w] + 1;
+        options.stride = (widths[w] + 1) / 2;
+        cayula_with_options(field->data, expected, field->nbins, field->nrows, field->n_bins_in_row,
+                            field->basebins, &options);
+        options.window_width = widths[w];
+        cayula_with_options(field->data, out, field->nbins, field->nrows, field->n_bins_in_row, field->basebins,
+                            &options);
+        TEST_ASSERT_EQUAL_INT_ARRAY(expected, out, field->nbins);
+    }
+    synth_field_destroy(field);
+    free(expected);
+    free(out);
+}
+
+void test_cayula_sweep(void)
+{
+    int nrows = 160;
+    int basebins[160];
+    int nbins_in_row[160];
+    int *data;
+    int n_bins = synthetic_front(7, 70, basebins, nbins_in_row, &data);
+    int *expected = malloc(n_bins * sizeof(int));
+    int *swept = malloc(3 * n_bins * sizeof(int));
+    cayula(data, expected, n_bins, nrows, nbins_in_row, basebins);
+
+    CayulaSweepPoint points[3];
+    points[0] = cayula_default_sweep_point();
+    points[1] = points[0];
+    points[1].crit_value = 1.1;
+    points[2] = points[0];
+    points[2].crit_value = 0;
+    points[2].crit_c1 = points[2].crit_c2 = points[2].crit_c = 0;
+    CayulaOptions options = cayula_default_options();
+    options.stride = 16;
+    CayulaCtx *ctx = cayula_ctx_create(n_bins, nrows, nbins_in_row, basebins, &options);
+    TEST_ASSERT_NOT_NULL(ctx);
+    TEST_ASSERT_EQUAL_INT(0, cayula_ctx_sweep(ctx, data, points, 3, swept));
+    int *out = malloc(n_bins * sizeof(int));
+    cayula_ctx_run(ctx, data, out);
+    TEST_ASSERT_EQUAL_INT_ARRAY(out, swept, n_bins);
+    int nfronts = 0, nloose = 0;
+    for (int i = 0; i < n_bins; i++) {
+        TEST_ASSERT_EQUAL_INT(expected[i] == -1 ? -1 : 0, swept[n_bins + i]);
+        nfronts += swept[i] == 1;
+        nloose += swept[2 * n_bins + i] == 1;
+    }
+    TEST_ASSERT_TRUE(nfronts > 0);
+    TEST_ASSERT_TRUE(nloose >= nfronts);
+    cayula_ctx_destroy(ctx);
+
+    /*
+     * The same sweep on a 16 bit context and from 8 bit data
+     */
+    options.levels = 4096;
+    ctx = cayula_ctx_create(n_bins, nrows, nbins_in_row, basebins, &options);
+    TEST_ASSERT_NOT_NULL(ctx);
+    int *swept16 = malloc(3 * n_bins * sizeof(int));
+    TEST_ASSERT_EQUAL_INT(0, cayula_ctx_sweep(ctx, data, points, 3, swept16));
+    TEST_ASSERT_EQUAL_INT_ARRAY(swept, swept16, 3 * n_bins);
+    cayula_ctx_destroy(ctx);
+
+    options.levels = 256;
+    ctx = cayula_ctx_create(n_bins, nrows, nbins_in_row, basebins, &options);
+    TEST_ASSERT_NOT_NULL(ctx);
+    uint8_t *values = malloc(n_bins);
+    uint64_t *valid = calloc(bitset_words(n_bins), sizeof(uint64_t));
+    int8_t *swept8 = malloc(3 * n_bins);
+    for (int i = 0; i < n_bins; i++) {
+        values[i] = data[i] == FILL_VALUE ? 0 : (uint8_t) data[i];
+        if (data[i] != FILL_VALUE) bitset_set(valid, i);
+    }
+    TEST_ASSERT_EQUAL_INT(0, cayula_ctx_sweep_u8(ctx, values, valid, points, 3, swept8));
+    for (int i = 0; i < 3 * n_bins; i++) {
+        TEST_ASSERT_EQUAL_INT(swept[i], swept8[i]);
+    }
+    cayula_ctx_destroy(ctx);
+    free(data);
+    free(expected);
+    free(swept);
+    free(swept16);
+    free(out);
+    free(values);
+    free(valid);
+    free(swept8);
+}
+
+void test_cayula_stats(void)
+{
+    int nrows = 160;
+    int basebins[160];
+    int nbins_in_row[160];
+    int *data;
+    int n_bins = synthetic_front(7, 70, basebins, nbins_in_row, &data);
+    int *expected = malloc(n_bins * sizeof(int));
+    int *out = malloc(n_bins * sizeof(int));
+    cayula(data, expected, n_bins, nrows, nbins_in_row, basebins);
+
+    CayulaStats stats;
+    CayulaOptions options = cayula_default_options();
+    options.stats = &stats;
+    CayulaCtx *ctx = cayula_ctx_create(n_bins, nrows, nbins_in_row, basebins, &options);
+    TEST_ASSERT_NOT_NULL(ctx);
+    cayula_ctx_run(ctx, data, out);
+    TEST_ASSERT_EQUAL_INT_ARRAY(expected, out, n_bins);
+
+    CayulaScreenCounts counts = cayula_ctx_screen_counts(ctx);
+    TEST_ASSERT_TRUE(stats.windows == counts.windows);
+    TEST_ASSERT_TRUE(stats.rejected_histogram == counts.rejected_histogram);
+    TEST_ASSERT_TRUE(stats.rejected_cohesion == counts.rejected_cohesion);
+    TEST_ASSERT_TRUE(stats.windows > stats.rejected_histogram + stats.rejected_cohesion);
+    TEST_ASSERT_TRUE(stats.edge_pixels > 0);
+    TEST_ASSERT_TRUE(stats.contours_started > 0);
+    TEST_ASSERT_TRUE(stats.contour_points >= stats.contours_started);
+    TEST_ASSERT_TRUE(stats.contours_kept > 0 && stats.contours_kept <= stats.contours_started);
+    int nfronts = 0;
+    for (int i = 0; i < n_bins; i++) nfronts += out[i] == 1;
+    TEST_ASSERT_TRUE(nfronts <= stats.contour_points);
+    TEST_ASSERT_TRUE(stats.bytes_allocated > n_bins);
+    TEST_ASSERT_TRUE(stats.filter_wall >= 0 && stats.scan_wall >= 0 && stats.contour_wall >= 0);
+    TEST_ASSERT_TRUE(stats.filter_cpu >= 0 && stats.scan_cpu >= 0 && stats.contour_cpu >= 0);
+
+    /*
+     * A second run starts the counts over
+     */
+    long started = stats.contours_started;
+    cayula_ctx_run(ctx, data, out);
+    TEST_ASSERT_TRUE(stats.contours_started == started);
+    cayula_ctx_destroy(ctx);
+    free(data);
+    free(expected);
+    free(out);
+}
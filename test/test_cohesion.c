@@ -1,6 +1,7 @@
 #include "unity.h"
 
 #include "cohesion.h"
+#include "bitset.h"
 #define FILL_VALUE -999
 void setUp(void)
 {
@@ -315,3 +316,80 @@ void test_cohesion_find_edge(void)
     TEST_ASSERT_EQUAL_INT_ARRAY(expected, output, 1024);
 }
 
+
+void test_cohesion_mask_matches_window(void) {
+    int window[1024];
+    int out[1024];
+    uint8_t data[1024];
+    uint64_t valid[16] = {0};
+    int starts[32];
+    uint64_t edges[32];
+    WindowMask mask;
+    for (int i = 0; i < 32; i++) starts[i] = i * 32;
+
+    unsigned seed = 9;
+    int ncohesive = 0;
+    for (int trial = 0; trial < 200; trial++) {
+        int boundary = 8 + trial % 16;
+        for (int i = 0; i < 1024; i++) {
+            seed = seed * 1103515245 + 12345;
+            int noise = (seed >> 16) % (10 + trial);
+            data[i] = (uint8_t) ((i % 32 + i / 64 > boundary ? 150 : 80) + noise);
+            valid[i >> 6] &= ~((uint64_t) 1 << (i & 63));
+            if ((seed >> 8) % 11 != 0) bitset_set(valid, i);
+            window[i] = bitset_get(valid, i) ? data[i] : FILL_VALUE;
+        }
+        int threshold = 100 + trial % 50;
+        window_mask_u8(&mask, 32, starts, data, valid, threshold);
+        TEST_ASSERT_EQUAL_INT(cohesive(window, threshold), cohesive_mask(&mask));
+        ncohesive += cohesive_mask(&mask);
+
+        find_edge(window, out, threshold);
+        find_edge_mask(&mask, edges);
+        for (int i = 0; i < 1024; i++) {
+            TEST_ASSERT_EQUAL_INT(out[i], (int) ((edges[i / 32] >> (i % 32)) & 1));
+        }
+    }
+    TEST_ASSERT_TRUE(ncohesive > 0);
+}
+
+void test_cohesion_mask_matches_window_widths(void) {
+    int widths[] = {16, 24, 64};
+    int window[4096];
+    int out[4096];
+    uint8_t data[4096];
+    uint64_t valid[64];
+    int starts[64];
+    uint64_t edges[64];
+    WindowMask mask;
+
+    unsigned seed = 5;
+    for (int w = 0; w < 3; w++) {
+        int width = widths[w];
+        int area = width * width;
+        for (int i = 0; i < width; i++) starts[i] = i * width;
+        int ncohesive = 0;
+        for (int trial = 0; trial < 100; trial++) {
+            int boundary = width / 4 + trial % (width / 2);
+            for (int i = 0; i < 64; i++) valid[i] = 0;
+            for (int i = 0; i < area; i++) {
+                seed = seed * 1103515245 + 12345;
+                int noise = (seed >> 16) % (10 + trial);
+                data[i] = (uint8_t) ((i % width + i / (2 * width) > boundary ? 150 : 80) + noise);
+                if ((seed >> 8) % 11 != 0) bitset_set(valid, i);
+                window[i] = bitset_get(valid, i) ? data[i] : FILL_VALUE;
+            }
+            int threshold = 100 + trial % 50;
+            window_mask_u8(&mask, width, starts, data, valid, threshold);
+            TEST_ASSERT_EQUAL_INT(cohesive_width(window, width, threshold), cohesive_mask(&mask));
+            ncohesive += cohesive_mask(&mask);
+
+            find_edge_width(window, width, out, threshold);
+            find_edge_mask(&mask, edges);
+            for (int i = 0; i < area; i++) {
+                TEST_ASSERT_EQUAL_INT(out[i], (int) ((edges[i / width] >> (i % width)) & 1));
+            }
+        }
+        TEST_ASSERT_TRUE(ncohesive > 0);
+    }
+}
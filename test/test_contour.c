@@ -2,6 +2,9 @@
 #include <stdlib.h>
 #include "contour.h"
 #include "helpers.h"
+#include "grid.h"
+#include "bitset.h"
+#include "arena.h"
 
 
 void setUp(void) {
@@ -10,6 +13,13 @@ void setUp(void) {
 void tearDown(void) {
 }
 
+static void pack_flags(const int *flags, int n, uint64_t *bits) {
+    for (int i = 0; i < bitset_words(n); i++) bits[i] = 0;
+    for (int i = 0; i < n; i++) {
+        if (flags[i]) bitset_set(bits, i);
+    }
+}
+
 void test_contour_gradient_ratio(void) {
     int arr[25] = { 50,  83, 100, 248, 118,
                     110,  67,  95, 168, 149,
@@ -60,6 +70,7 @@ void test_contour_del_contour(void) {
     point4->prev = point3;
     point4->angle = 0;
     point4->next = NULL;
+    point3->next = point4;
 
     c2->first_point = point1;
 
@@ -94,34 +105,36 @@ void test_contour_find_best_front(void) {
         basebins[i] = i * 9;
         nbins_in_row[i] = 9;
     }
+    IsinGrid *grid = grid_create(81, 9, nbins_in_row, basebins);
+    uint64_t edges[2];
+    pack_flags(data, 81, edges);
+    Arena *arena = arena_create(CONTOUR_ARENA_BLOCK_SIZE);
+    ContourMap map = {.grid = grid, .edges = edges, .arena = arena, .row_begin = 0, .row_end = 9};
     ContourPoint point = {13, 1, NULL, NULL};
-    ContourPoint *point2 = find_best_front(&point, data, 1, basebins, nbins_in_row);
+    ContourPoint *point2 = find_best_front(&point, &map, 1);
 
     TEST_ASSERT_EQUAL_INT(22, point2->bin);
     TEST_ASSERT_EQUAL_INT(270, point2->angle);
 
-    ContourPoint *point3 = find_best_front(point2, data, 2, basebins, nbins_in_row);
+    ContourPoint *point3 = find_best_front(point2, &map, 2);
     TEST_ASSERT_EQUAL_INT(31, point3->bin);
     TEST_ASSERT_EQUAL_INT(270, point3->angle);
 
-    ContourPoint *point4 = find_best_front(point3, data, 3, basebins, nbins_in_row);
+    ContourPoint *point4 = find_best_front(point3, &map, 3);
 
     TEST_ASSERT_EQUAL_INT(39, point4->bin);
     TEST_ASSERT_EQUAL_INT(225, point4->angle);
 
-    ContourPoint *point5 = find_best_front(point4, data, 4, basebins, nbins_in_row);
+    ContourPoint *point5 = find_best_front(point4, &map, 4);
 
     TEST_ASSERT_EQUAL_INT(38, point5->bin);
     TEST_ASSERT_EQUAL_INT(180, point5->angle);
 
-    ContourPoint *point6 = find_best_front(point5, data, 4, basebins, nbins_in_row);
+    ContourPoint *point6 = find_best_front(point5, &map, 4);
     TEST_ASSERT_NULL(point6);
 
-    while (point2->next != NULL) {
-        ContourPoint *tmp = point2->next;
-        free(point2);
-        point2 = tmp;
-    }
+    arena_destroy(arena);
+    grid_destroy(grid);
 }
 
 void test_contour_follow_contour(void) {
@@ -153,24 +166,32 @@ void test_contour_follow_contour(void) {
             100, 100, 100, 100, 100, 100, 100, 100, 100,
             100, 100, 100, 100, 100, 100, 100, 100, 100
     };
-    int pixel_in_contour[81] = { 0 };
-    pixel_in_contour[13] = 1;
+    uint8_t filtered[81];
+    int all_valid[81];
+    for (int i = 0; i < 81; i++) {
+        filtered[i] = (uint8_t) filtered_data[i];
+        all_valid[i] = 1;
+    }
+    uint64_t edges[2], filtered_valid[2], in_contour[2] = {0};
+    pack_flags(data, 81, edges);
+    pack_flags(all_valid, 81, filtered_valid);
+    bitset_set(in_contour, 13);
     ContourPoint point = {13, 1, NULL, NULL};
-    int count = follow_contour(&point, data, filtered_data, pixel_in_contour, 1, 9, basebins, nbins_in_row);
+    IsinGrid *grid = grid_create(81, 9, nbins_in_row, basebins);
+    Arena *arena = arena_create(CONTOUR_ARENA_BLOCK_SIZE);
+    ContourMap map = {.grid = grid, .edges = edges, .filtered_data = filtered, .filtered_valid = filtered_valid,
+                      .in_contour = in_contour, .arena = arena, .row_begin = 0, .row_end = 9};
+    int count = follow_contour(&point, &map, 1);
+    grid_destroy(grid);
 
     ContourPoint *pt = point.next;
-    ContourPoint *tmp;
-    int c = 0;
-    while (tmp->next != NULL) {
-        tmp = pt->next;
-        free(pt);
-        pt = tmp;
-        c++;
+    while (pt->next != NULL) {
+        pt = pt->next;
     }
-    TEST_ASSERT_EQUAL_INT(6, count);
-    TEST_ASSERT_EQUAL_INT(1, pixel_in_contour[28]);
+    TEST_ASSERT_EQUAL_INT(7, count);
+    TEST_ASSERT_EQUAL_INT(1, bitset_get(in_contour, 28));
     TEST_ASSERT_EQUAL_INT(28, pt->bin);
-    free(pt);
+    arena_destroy(arena);
 }
 /*
 void test_contour_NeedToImplement(void)
@@ -1,7 +1,10 @@
 #include "unity.h"
 #include <stdlib.h>
 #include "helpers.h"
+#include "grid.h"
 #include "filter.h"
+#include "spans.h"
+#include "bitset.h"
 
 const int FILL_VALUE = -999;
 
@@ -117,3 +120,285 @@ void test_filter_median_filter_yes_fill(void) {
     TEST_ASSERT_EQUAL_INT_ARRAY(arr_expected, filtered_data, 144);
 }
 
+
+void test_filter_median_filter_u8_matches_median_filter(void) {
+    int nrows = 60;
+    int basebins[60];
+    int nbins_in_row[60];
+    int nbins = 0;
+    for (int i = 0; i < nrows; i++) {
+        basebins[i] = nbins;
+        nbins_in_row[i] = 40 + 3 * (i < 30 ? i : 59 - i);
+        nbins += nbins_in_row[i];
+    }
+    int *data = malloc(nbins * sizeof(int));
+    int *expected = malloc(nbins * sizeof(int));
+    uint8_t *values = malloc(nbins);
+    uint8_t *filtered = malloc(nbins);
+    uint64_t *valid = calloc(bitset_words(nbins), sizeof(uint64_t));
+    uint64_t *filtered_valid = malloc(bitset_words(nbins) * sizeof(uint64_t));
+    unsigned seed = 3;
+    for (int i = 0; i < nbins; i++) {
+        seed = seed * 1103515245 + 12345;
+        values[i] = (uint8_t) (seed >> 16);
+        /* long runs without fill values for the vector code with a few fill values in some rows */
+        data[i] = (i / 200) % 3 == 0 && (seed >> 8) % 13 == 0 ? FILL_VALUE : values[i];
+        if (data[i] != FILL_VALUE) bitset_set(valid, i);
+    }
+
+    IsinGrid *grid = grid_create(nbins, nrows, nbins_in_row, basebins);
+    median_filter_grid(grid, data, expected);
+    median_filter_u8(grid, values, valid, filtered, filtered_valid);
+    for (int i = 0; i < nbins; i++) {
+        TEST_ASSERT_EQUAL_INT(expected[i] != FILL_VALUE, bitset_get(filtered_valid, i));
+        if (expected[i] != FILL_VALUE) {
+            TEST_ASSERT_EQUAL_INT(expected[i], filtered[i]);
+        }
+    }
+    grid_destroy(grid);
+    free(data);
+    free(expected);
+    free(values);
+    free(filtered);
+    free(valid);
+    free(filtered_valid);
+}
+
+static int sorted_median(int *values, int n) {
+    for (int i = 1; i < n; i++) {
+        for (int j = i; j > 0 && values[j - 1] > values[j]; j--) {
+            int tmp = values[j];
+            values[j] = values[j - 1];
+            values[j - 1] = tmp;
+        }
+    }
+    return n & 1 ? values[(n - 1) >> 1] : (values[n >> 1] + values[(n >> 1) - 1] + 1) >> 1;
+}
+
+void test_filter_median_filter_size_u8(void) {
+    int nrows = 40;
+    int basebins[40];
+    int nbins_in_row[40];
+    int nbins = 0;
+    for (int i = 0; i < nrows; i++) {
+        basebins[i] = nbins;
+        nbins_in_row[i] = 30 + (i < 20 ? i : 39 - i);
+        nbins += nbins_in_row[i];
+    }
+    uint8_t *values = malloc(nbins);
+    uint8_t *filtered = malloc(nbins);
+    uint64_t *valid = calloc(bitset_words(nbins), sizeof(uint64_t));
+    uint64_t *filtered_valid = malloc(bitset_words(nbins) * sizeof(uint64_t));
+    unsigned seed = 5;
+    for (int i = 0; i < nbins; i++) {
+        seed = seed * 1103515245 + 12345;
+        values[i] = (uint8_t) (seed >> 16);
+        if ((seed >> 8) % 7 != 0) bitset_set(valid, i);
+    }
+
+    IsinGrid *grid = grid_create(nbins, nrows, nbins_in_row, basebins);
+    for (int size = 5; size <= 7; size += 2) {
+        int half = size / 2;
+        int window[49];
+        median_filter_size_u8(grid, size, values, valid, filtered, filtered_valid);
+        for (int i = half; i < nrows - half; i++) {
+            for (int j = basebins[i] + half; j < basebins[i] + nbins_in_row[i] - half; j++) {
+                int n_valid = 0;
+                get_window_u8(j, i, size, values, valid, nbins_in_row, basebins, window);
+                for (int k = 0; k < size * size; k++) {
+                    if (window[k] != -999) window[n_valid++] = window[k];
+                }
+                TEST_ASSERT_EQUAL_INT(bitset_get(valid, j), bitset_get(filtered_valid, j));
+                if (bitset_get(valid, j)) {
+                    TEST_ASSERT_EQUAL_INT(sorted_median(window, n_valid), filtered[j]);
+                }
+            }
+        }
+    }
+    grid_destroy(grid);
+    free(values);
+    free(filtered);
+    free(valid);
+    free(filtered_valid);
+}
+
+void test_filter_median_filter_size_u16(void) {
+    int nrows = 40;
+    int basebins[40];
+    int nbins_in_row[40];
+    int nbins = 0;
+    for (int i = 0; i < nrows; i++) {
+        basebins[i] = nbins;
+        nbins_in_row[i] = 60 + (i < 20 ? i : 39 - i);
+        nbins += nbins_in_row[i];
+    }
+    uint16_t *values = malloc(nbins * sizeof(uint16_t));
+    uint16_t *filtered = malloc(nbins * sizeof(uint16_t));
+    uint64_t *valid = calloc(bitset_words(nbins), sizeof(uint64_t));
+    uint64_t *filtered_valid = malloc(bitset_words(nbins) * sizeof(uint64_t));
+    unsigned seed = 9;
+    for (int i = 0; i < nbins; i++) {
+        seed = seed * 1103515245 + 12345;
+        values[i] = (uint16_t) (seed >> 12);
+        if ((seed >> 8) % 40 != 0) bitset_set(valid, i);
+    }
+
+    IsinGrid *grid = grid_create(nbins, nrows, nbins_in_row, basebins);
+    int *counts = malloc(MEDIAN_FILTER_COUNTS(65536) * sizeof(int));
+    for (int size = 3; size <= 5; size += 2) {
+        int half = size / 2;
+        int window[25];
+        median_filter_size_u16(grid, size, 65536, values, valid, filtered, filtered_valid,
+                               size > 3 ? counts : NULL);
+        for (int i = half; i < nrows - half; i++) {
+            for (int j = basebins[i] + half; j < basebins[i] + nbins_in_row[i] - half; j++) {
+                int n_valid = 0;
+                get_window_u16(j, i, size, values, valid, nbins_in_row, basebins, window);
+                for (int k = 0; k < size * size; k++) {
+                    if (window[k] != -999) window[n_valid++] = window[k];
+                }
+                TEST_ASSERT_EQUAL_INT(bitset_get(valid, j), bitset_get(filtered_valid, j));
+                if (bitset_get(valid, j)) {
+                    TEST_ASSERT_EQUAL_INT(sorted_median(window, n_valid), filtered[j]);
+                }
+            }
+        }
+    }
+    free(counts);
+    grid_destroy(grid);
+    free(values);
+    free(filtered);
+    free(valid);
+    free(filtered_valid);
+}
+
+void test_filter_median_filter_size_row_ends(void) {
+    /*
+     * Rows as narrow as the polar rows of the ISIN grid, where kernels reach past the ends of their rows
+     */
+    int nrows = 24;
+    int basebins[24];
+    int nbins_in_row[24];
+    int nbins = 0;
+    for (int i = 0; i < nrows; i++) {
+        basebins[i] = nbins;
+        nbins_in_row[i] = 3 + 2 * (i < 12 ? i : 23 - i);
+        nbins += nbins_in_row[i];
+    }
+    uint8_t *values = malloc(nbins);
+    uint16_t *values16 = malloc(nbins * sizeof(uint16_t));
+    uint8_t *filtered = malloc(nbins);
+    uint16_t *filtered16 = malloc(nbins * sizeof(uint16_t));
+    uint64_t *valid = calloc(bitset_words(nbins), sizeof(uint64_t));
+    uint64_t *filtered_valid = malloc(bitset_words(nbins) * sizeof(uint64_t));
+    uint64_t *filtered_valid16 = malloc(bitset_words(nbins) * sizeof(uint64_t));
+    int *counts = malloc(MEDIAN_FILTER_COUNTS(1024) * sizeof(int));
+    unsigned seed = 3;
+    for (int i = 0; i < nbins; i++) {
+        seed = seed * 1103515245 + 12345;
+        values[i] = (uint8_t) (seed >> 16);
+        values16[i] = (uint16_t) ((seed >> 12) % 1024);
+        if ((seed >> 8) % 9 != 0) bitset_set(valid, i);
+    }
+
+    IsinGrid *grid = grid_create(nbins, nrows, nbins_in_row, basebins);
+    for (int size = 5; size <= 7; size += 2) {
+        int half = size / 2;
+        int starts[7];
+        int window[49];
+        int window16[49];
+        median_filter_size_u8(grid, size, values, valid, filtered, filtered_valid);
+        median_filter_size_u16(grid, size, 1024, values16, valid, filtered16, filtered_valid16, counts);
+        for (int i = 0; i < nrows; i++) {
+            for (int j = basebins[i]; j < basebins[i] + nbins_in_row[i]; j++) {
+                int inside = i >= half && i < nrows - half && j >= basebins[i] + half &&
+                             j < basebins[i] + nbins_in_row[i] - half;
+                TEST_ASSERT_EQUAL_INT(inside && bitset_get(valid, j), bitset_get(filtered_valid, j));
+                TEST_ASSERT_EQUAL_INT(inside && bitset_get(valid, j), bitset_get(filtered_valid16, j));
+                if (!inside || !bitset_get(valid, j)) continue;
+
+                /*
+                 * Kernel rows read on into the next row of the map like the 3x3 kernel does
+                 */
+                get_window_starts(j, i, size, nbins_in_row, basebins, starts);
+                int n_valid = 0;
+                for (int r = 0; r < size; r++) {
+                    for (int k = starts[r]; k < starts[r] + size; k++) {
+                        if (k >= 0 && k < nbins && bitset_get(valid, k)) {
+                            window[n_valid] = values[k];
+                            window16[n_valid++] = values16[k];
+                        }
+                    }
+                }
+                TEST_ASSERT_EQUAL_INT(sorted_median(window16, n_valid), filtered16[j]);
+                TEST_ASSERT_EQUAL_INT(sorted_median(window, n_valid), filtered[j]);
+            }
+        }
+    }
+    grid_destroy(grid);
+    free(values);
+    free(values16);
+    free(filtered);
+    free(filtered16);
+    free(valid);
+    free(filtered_valid);
+    free(filtered_valid16);
+    free(counts);
+}
+
+void test_filter_median_filter_spans(void) {
+    int nrows = 60;
+    int basebins[60];
+    int nbins_in_row[60];
+    int nbins = 0;
+    for (int i = 0; i < nrows; i++) {
+        basebins[i] = nbins;
+        nbins_in_row[i] = 80 + 3 * (i < 30 ? i : 59 - i);
+        nbins += nbins_in_row[i];
+    }
+    uint8_t *values = malloc(nbins);
+    uint16_t *values16 = malloc(nbins * sizeof(uint16_t));
+    uint8_t *expected = malloc(nbins);
+    uint8_t *filtered = malloc(nbins);
+    uint16_t *expected16 = malloc(nbins * sizeof(uint16_t));
+    uint16_t *filtered16 = malloc(nbins * sizeof(uint16_t));
+    uint64_t *valid = calloc(bitset_words(nbins), sizeof(uint64_t));
+    uint64_t *expected_valid = malloc(bitset_words(nbins) * sizeof(uint64_t));
+    uint64_t *filtered_valid = malloc(bitset_words(nbins) * sizeof(uint64_t));
+    unsigned seed = 13;
+    for (int i = 0; i < nrows; i++) {
+        for (int j = 0; j < nbins_in_row[i]; j++) {
+            int bin = basebins[i] + j;
+            seed = seed * 1103515245 + 12345;
+            values[bin] = (uint8_t) (seed >> 16);
+            values16[bin] = (uint16_t) (seed >> 12);
+            /* empty rows, clouds covering most of some rows and scattered fill values elsewhere */
+            int cloud = (i >= 20 && i < 26) || (i >= 40 && j > 10 && j < nbins_in_row[i] - 30);
+            if (!cloud && (seed >> 8) % 9 != 0) bitset_set(valid, bin);
+        }
+    }
+
+    IsinGrid *grid = grid_create(nbins, nrows, nbins_in_row, basebins);
+    ValidSpans *spans = valid_spans_create(nrows);
+    TEST_ASSERT_NOT_NULL(spans);
+    TEST_ASSERT_EQUAL_INT(0, valid_spans_build(spans, grid, valid));
+    median_filter_u8(grid, values, valid, expected, expected_valid);
+    median_filter_spans_u8(grid, spans, values, valid, filtered, filtered_valid);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, filtered, nbins);
+    TEST_ASSERT_EQUAL_UINT64_ARRAY(expected_valid, filtered_valid, bitset_words(nbins));
+    median_filter_u16(grid, values16, valid, expected16, expected_valid);
+    median_filter_spans_u16(grid, spans, values16, valid, filtered16, filtered_valid);
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(expected16, filtered16, nbins);
+    TEST_ASSERT_EQUAL_UINT64_ARRAY(expected_valid, filtered_valid, bitset_words(nbins));
+    valid_spans_destroy(spans);
+    grid_destroy(grid);
+    free(values);
+    free(values16);
+    free(expected);
+    free(filtered);
+    free(expected16);
+    free(filtered16);
+    free(valid);
+    free(expected_valid);
+    free(filtered_valid);
+}
@@ -0,0 +1,91 @@
+#include "unity.h"
+#include <stdlib.h>
+#include "golden.h"
+#include "reference.h"
+#include "synth.h"
+#include "isin.h"
+#include "cayula.h"
+#include "helpers.h"
+#include "grid.h"
+#include "pool.h"
+#include "bitset.h"
+#include "arena.h"
+#include "gradient.h"
+#include "cohesion.h"
+#include "contour.h"
+#include "filter.h"
+#include "spans.h"
+#include "histogram.h"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void assert_golden(const SynthField *field, const CayulaOptions *options) {
+    GoldenReport report;
+    long mismatches = golden_compare(field->data, field->nbins, field->nrows, field->n_bins_in_row, field->basebins,
+                                     options, &report);
+    if (mismatches != 0) golden_print(&report, stdout);
+    TEST_ASSERT_EQUAL_INT(0, mismatches);
+}
+
+void test_golden_synthetic(void) {
+    SynthOptions synth = synth_default_options();
+    synth.cloud_fraction = 0.2;
+    SynthField *field = synth_field_create(720, &synth);
+    TEST_ASSERT_NOT_NULL(field);
+    CayulaOptions options = cayula_default_options();
+    assert_golden(field, &options);
+
+    options.nthreads = 3;
+    assert_golden(field, &options);
+    options.gradient_field = 1;
+    assert_golden(field, &options);
+    options.contour_band_rows = 64;
+    assert_golden(field, &options);
+    synth_field_destroy(field);
+}
+
+void test_golden_random(void) {
+    SynthOptions synth = synth_default_options();
+    SynthField *field = synth_field_create(360, &synth);
+    TEST_ASSERT_NOT_NULL(field);
+    srand(7);
+    for (int i = 0; i < field->nbins; i++) {
+        field->data[i] = rand() % 16 == 0 ? FILL_VALUE : rand() % 256;
+    }
+    assert_golden(field, NULL);
+
+    /*
+     * Two flat water masses make windows with thresholds and edges, with noise so that contours wander
+     */
+    for (int i = 0; i < field->nbins; i++) {
+        if (field->data[i] != FILL_VALUE) field->data[i] = (i / 97) % 3 == 0 ? 40 + rand() % 8 : 200 + rand() % 8;
+    }
+    assert_golden(field, NULL);
+    synth_field_destroy(field);
+}
+
+void test_golden_reports_mismatch(void) {
+    SynthOptions synth = synth_default_options();
+    SynthField *field = synth_field_create(360, &synth);
+    TEST_ASSERT_NOT_NULL(field);
+    CayulaOptions options = cayula_default_options();
+    options.min_range = 256;
+    GoldenReport report;
+    long mismatches = golden_compare(field->data, field->nbins, field->nrows, field->n_bins_in_row, field->basebins,
+                                     &options, &report);
+    TEST_ASSERT_TRUE(mismatches > 0);
+    TEST_ASSERT_EQUAL_INT(0, report.steps[GOLDEN_FILTERED].count);
+    TEST_ASSERT_TRUE(report.steps[GOLDEN_THRESHOLDS].count > 0);
+    const GoldenMismatch *first = &report.steps[GOLDEN_THRESHOLDS];
+    TEST_ASSERT_TRUE(first->expected > 0);
+    TEST_ASSERT_EQUAL_INT(-1, first->actual);
+    TEST_ASSERT_TRUE(first->bin >= field->basebins[first->row]);
+    TEST_ASSERT_TRUE(first->bin < field->basebins[first->row] + field->n_bins_in_row[first->row]);
+    synth_field_destroy(field);
+}
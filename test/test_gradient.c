@@ -0,0 +1,92 @@
+#include "unity.h"
+#include <stdlib.h>
+#include "grid.h"
+#include "gradient.h"
+#include "bitset.h"
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_gradient_field_matches_window(void) {
+    int nrows = 30;
+    int basebins[30];
+    int nbins_in_row[30];
+    int nbins = 0;
+    for (int i = 0; i < nrows; i++) {
+        basebins[i] = nbins;
+        nbins_in_row[i] = 20 + 2 * (i < 15 ? i : 29 - i);
+        nbins += nbins_in_row[i];
+    }
+    uint8_t *data = malloc(nbins);
+    uint64_t *valid = calloc(bitset_words(nbins), sizeof(uint64_t));
+    unsigned seed = 1;
+    for (int i = 0; i < nbins; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (uint8_t) (seed >> 16);
+        if ((seed >> 8) % 5 != 0) bitset_set(valid, i);
+    }
+
+    IsinGrid *grid = grid_create(nbins, nrows, nbins_in_row, basebins);
+    GradientField *field = gradient_field_create(nbins);
+    TEST_ASSERT_NOT_NULL(field);
+    gradient_field_compute(field, grid, data, valid);
+    for (int i = 1; i < nrows - 1; i++) {
+        for (int j = basebins[i] + 1; j < basebins[i] + nbins_in_row[i] - 1; j++) {
+            int window[9];
+            grid_window3_u8(grid, j, i, data, valid, window);
+            for (int k = 1; k < 9; k += 2) {
+                if (window[k] == -999) window[k] = window[4];
+            }
+            TEST_ASSERT_EQUAL_INT(window[5] - window[3], field->dx[j]);
+            TEST_ASSERT_EQUAL_INT(window[7] - window[1], field->dy[j]);
+        }
+    }
+    gradient_field_destroy(field);
+    grid_destroy(grid);
+    free(data);
+    free(valid);
+}
+
+void test_gradient_field_u16_matches_u8(void) {
+    int nrows = 20;
+    int basebins[20];
+    int nbins_in_row[20];
+    int nbins = 0;
+    for (int i = 0; i < nrows; i++) {
+        basebins[i] = nbins;
+        nbins_in_row[i] = 30 + i;
+        nbins += nbins_in_row[i];
+    }
+    uint8_t *data = malloc(nbins);
+    uint16_t *wide = malloc(nbins * sizeof(uint16_t));
+    uint64_t *valid = calloc(bitset_words(nbins), sizeof(uint64_t));
+    unsigned seed = 3;
+    for (int i = 0; i < nbins; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (uint8_t) (seed >> 16);
+        wide[i] = (uint16_t) (data[i] * 257);
+        if ((seed >> 8) % 5 != 0) bitset_set(valid, i);
+    }
+
+    IsinGrid *grid = grid_create(nbins, nrows, nbins_in_row, basebins);
+    GradientField *field = gradient_field_create(nbins);
+    GradientField *field16 = gradient_field_create(nbins);
+    TEST_ASSERT_NOT_NULL(field);
+    TEST_ASSERT_NOT_NULL(field16);
+    gradient_field_compute(field, grid, data, valid);
+    gradient_field_compute_u16(field16, grid, wide, valid);
+    for (int i = 0; i < nbins; i++) {
+        if (!bitset_get(valid, i)) continue;
+        TEST_ASSERT_EQUAL_INT(field->dx[i] * 257, field16->dx[i]);
+        TEST_ASSERT_EQUAL_INT(field->dy[i] * 257, field16->dy[i]);
+    }
+    gradient_field_destroy(field);
+    gradient_field_destroy(field16);
+    grid_destroy(grid);
+    free(data);
+    free(wide);
+    free(valid);
+}
@@ -0,0 +1,50 @@
+#include "unity.h"
+#include <stdlib.h>
+#include "grid.h"
+#include "helpers.h"
+
+#define FILL_VALUE -999
+
+static int nbins_in_row[12] = {6, 7, 8, 9, 10, 11, 11, 10, 9, 8, 7, 6};
+static int basebins[12] = {0, 6, 13, 21, 30, 40, 51, 62, 72, 81, 89, 96};
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_grid_window3_matches_get_window(void) {
+    int data[102];
+    for (int i = 0; i < 102; i++) {
+        data[i] = i % 7 == 0 ? FILL_VALUE : i;
+    }
+    IsinGrid *grid = grid_create(102, 12, nbins_in_row, basebins);
+    TEST_ASSERT_NOT_NULL(grid);
+    for (int row = 1; row < 11; row++) {
+        for (int bin = basebins[row] + 1; bin < basebins[row] + nbins_in_row[row] - 1; bin++) {
+            int expected[9];
+            int window[9];
+            int expected_fill = get_window(bin, row, 3, data, nbins_in_row, basebins, expected);
+            int nfill = grid_window3(grid, bin, row, data, window);
+            TEST_ASSERT_EQUAL_INT_ARRAY(expected, window, 9);
+            TEST_ASSERT_EQUAL_INT(expected_fill, nfill);
+        }
+    }
+    grid_destroy(grid);
+}
+
+void test_grid_neighbor(void) {
+    IsinGrid *grid = grid_create(102, 12, nbins_in_row, basebins);
+    int expected[9] = {23, 24, 25, 32, 33, 34, 42, 43, 44};
+    for (int i = 0; i < 9; i++) {
+        TEST_ASSERT_EQUAL_INT(expected[i], grid_neighbor(grid, 33, 4, i));
+    }
+    grid_destroy(grid);
+}
+
+void test_grid_create_abrupt_rows(void) {
+    int rows[3] = {10, 400, 10};
+    int bases[3] = {0, 10, 410};
+    TEST_ASSERT_NULL(grid_create(420, 3, rows, bases));
+}
@@ -0,0 +1,149 @@
+#include "unity.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "gridfile.h"
+#include "synth.h"
+#include "isin.h"
+#include "cayula.h"
+#include "helpers.h"
+#include "grid.h"
+#include "pool.h"
+#include "bitset.h"
+#include "arena.h"
+#include "gradient.h"
+#include "cohesion.h"
+#include "contour.h"
+#include "filter.h"
+#include "spans.h"
+#include "histogram.h"
+
+static char path[64];
+
+void setUp(void)
+{
+    strcpy(path, "/tmp/sied_gridfile_XXXXXX");
+    int fd = mkstemp(path);
+    if (fd >= 0) close(fd);
+}
+
+void tearDown(void)
+{
+    unlink(path);
+}
+
+/*
+ * Converts a synthetic field to 8 bit values and a bitset of bins with data.
+ */
+static void field_u8(const SynthField *field, uint8_t **values, uint64_t **valid) {
+    *values = malloc(field->nbins);
+    *valid = calloc(bitset_words(field->nbins), sizeof(uint64_t));
+    for (int i = 0; i < field->nbins; i++) {
+        (*values)[i] = field->data[i] == FILL_VALUE ? 0 : (uint8_t) field->data[i];
+        if (field->data[i] != FILL_VALUE) bitset_set(*valid, i);
+    }
+}
+
+void test_gridfile_dense_runs_in_place(void) {
+    SynthOptions synth = synth_default_options();
+    synth.cloud_fraction = 0.3;
+    SynthField *field = synth_field_create(360, &synth);
+    TEST_ASSERT_NOT_NULL(field);
+    uint8_t *values;
+    uint64_t *valid;
+    field_u8(field, &values, &valid);
+    TEST_ASSERT_EQUAL_INT(0, grid_file_write(path, field->nrows, field->n_bins_in_row, GRID_FILE_DENSE,
+                                             GRID_FILE_U8, values, valid));
+
+    GridFile *file = grid_file_open(path);
+    TEST_ASSERT_NOT_NULL(file);
+    TEST_ASSERT_EQUAL_INT(field->nbins, file->header->nbins);
+    TEST_ASSERT_EQUAL_INT(field->nrows, file->header->nrows);
+    TEST_ASSERT_TRUE(grid_file_matches(file, field->nrows, field->n_bins_in_row));
+    TEST_ASSERT_TRUE(!grid_file_matches(file, field->nrows - 1, field->n_bins_in_row));
+    TEST_ASSERT_NULL(file->spans);
+    TEST_ASSERT_EQUAL_INT(0, (uintptr_t) file->valid % 8);
+
+    /*
+     * The mapped file is run without copying it
+     */
+    int8_t *expected = malloc(field->nbins);
+    int8_t *out = malloc(field->nbins);
+    CayulaCtx *ctx = cayula_ctx_create(field->nbins, field->nrows, field->n_bins_in_row, field->basebins, NULL);
+    TEST_ASSERT_NOT_NULL(ctx);
+    cayula_ctx_run_u8(ctx, values, valid, expected);
+    cayula_ctx_run_u8(ctx, file->values, file->valid, out);
+    TEST_ASSERT_EQUAL_INT8_ARRAY(expected, out, field->nbins);
+    grid_file_close(file);
+
+    /*
+     * And so is its output
+     */
+    TEST_ASSERT_EQUAL_INT(0, grid_file_write_output(path, field->nrows, field->n_bins_in_row, GRID_FILE_SPANS,
+                                                    expected));
+    file = grid_file_open(path);
+    TEST_ASSERT_NOT_NULL(file);
+    memset(out, 2, field->nbins);
+    TEST_ASSERT_EQUAL_INT(0, grid_file_read_output(file, out));
+    TEST_ASSERT_EQUAL_INT8_ARRAY(expected, out, field->nbins);
+    grid_file_close(file);
+
+    cayula_ctx_destroy(ctx);
+    synth_field_destroy(field);
+    free(values);
+    free(valid);
+    free(expected);
+    free(out);
+}
+
+void test_gridfile_spans(void) {
+    int n_bins_in_row[3] = {50, 100, 50};
+    int nbins = 200;
+    int16_t values[200];
+    uint64_t valid[4] = {0, 0, 0, 0};
+    for (int i = 0; i < nbins; i++) values[i] = (int16_t) (i * 37 % 1000 - 500);
+    bitset_set_range(valid, 3, 10);
+    bitset_set_range(valid, 45, 80);
+    bitset_set(valid, 199);
+    TEST_ASSERT_EQUAL_INT(0, grid_file_write(path, 3, n_bins_in_row, GRID_FILE_SPANS, GRID_FILE_I16, values,
+                                             valid));
+
+    GridFile *file = grid_file_open(path);
+    TEST_ASSERT_NOT_NULL(file);
+    TEST_ASSERT_EQUAL_INT(3, file->header->nspans);
+    TEST_ASSERT_EQUAL_INT(91, file->header->nvalues);
+    TEST_ASSERT_NULL(file->valid);
+    TEST_ASSERT_EQUAL_INT(45, file->spans[2]);
+    TEST_ASSERT_EQUAL_INT(125, file->spans[3]);
+    int16_t read_values[200];
+    uint64_t read_valid[4];
+    grid_file_read(file, read_values, read_valid);
+    TEST_ASSERT_EQUAL_UINT64_ARRAY(valid, read_valid, 4);
+    for (int i = 0; i < nbins; i++) {
+        TEST_ASSERT_EQUAL_INT(bitset_get(valid, i) ? values[i] : 0, read_values[i]);
+    }
+    int8_t out[200];
+    TEST_ASSERT_EQUAL_INT(-1, grid_file_read_output(file, out));
+    grid_file_close(file);
+}
+
+void test_gridfile_rejects_other_files(void) {
+    int n_bins_in_row[2] = {8, 8};
+    uint8_t values[16] = {0};
+    uint64_t valid[1] = {0xffff};
+    TEST_ASSERT_EQUAL_INT(-1, grid_file_write(path, 2, n_bins_in_row, 7, GRID_FILE_U8, values, valid));
+    TEST_ASSERT_EQUAL_INT(0, grid_file_write(path, 2, n_bins_in_row, GRID_FILE_DENSE, GRID_FILE_U8, values, valid));
+
+    /*
+     * A truncated file and a file that is not a grid file
+     */
+    TEST_ASSERT_EQUAL_INT(0, truncate(path, sizeof(GridFileHeader) + 8));
+    TEST_ASSERT_NULL(grid_file_open(path));
+    FILE *f = fopen(path, "wb");
+    TEST_ASSERT_NOT_NULL(f);
+    for (int i = 0; i < 100; i++) fputs("Data,Latitude,Longitude\n", f);
+    fclose(f);
+    TEST_ASSERT_NULL(grid_file_open(path));
+    TEST_ASSERT_NULL(grid_file_open("/nonexistent/sied.grid"));
+}
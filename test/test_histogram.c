@@ -3,7 +3,11 @@
 
 #include "unity.h"
 #include <stdio.h>
+#include <string.h>
 #include "histogram.h"
+#include "reference.h"
+#include "helpers.h"
+#include "bitset.h"
 
 
 void setUp(void) {
@@ -152,3 +156,197 @@ void test_histogram_analysis_too_small(void) {
     int threshold = histogram_analysis(window);
     TEST_ASSERT_EQUAL_INT(-1, threshold);
 }
+
+void test_histogram_window_histogram_move(void) {
+    int nrows = 40;
+    int basebins[40];
+    int nbins_in_row[40];
+    int data[4000];
+    uint8_t values[4000];
+    uint64_t valid[63] = {0};
+    int n_bins = 0;
+    for (int i = 0; i < nrows; i++) {
+        basebins[i] = n_bins;
+        nbins_in_row[i] = 80 + i / 2;
+        n_bins += nbins_in_row[i];
+    }
+    for (int i = 0; i < n_bins; i++) {
+        data[i] = i % 17 == 0 ? -999 : (i * 37) % 256;
+        values[i] = (uint8_t) ((i * 37) % 256);
+        if (data[i] != -999) bitset_set(valid, i);
+    }
+    int row = 20;
+    WindowHistogram h;
+    window_histogram_init(&h, basebins[row] + 15, row, 32, values, valid, nbins_in_row, basebins);
+    for (int j = 15 + 5; j < nbins_in_row[row] - 16; j += 5) {
+        int window[1024];
+        int expected[256];
+        window_histogram_move(&h, basebins[row] + j, row, values, valid, nbins_in_row, basebins);
+        int nfill = get_window(basebins[row] + j, row, 32, data, nbins_in_row, basebins, window);
+        get_histogram(window, expected);
+        TEST_ASSERT_EQUAL_INT_ARRAY(expected, h.histogram, 256);
+        TEST_ASSERT_EQUAL_INT(nfill, h.nfill_values);
+    }
+}
+
+void test_histogram_window_histogram_screen(void) {
+    int nrows = 40;
+    int basebins[40];
+    int nbins_in_row[40];
+    uint8_t values[3200];
+    uint64_t valid[50] = {0};
+    for (int i = 0; i < nrows; i++) {
+        basebins[i] = i * 80;
+        nbins_in_row[i] = 80;
+    }
+    for (int i = 0; i < 3200; i++) {
+        values[i] = (uint8_t) (100 + i % 3);
+        if (i % 80 < 40) bitset_set(valid, i);
+    }
+    int row = 20;
+    WindowHistogram h;
+    WindowScreen screen = {0, 0, 0};
+    window_histogram_init(&h, basebins[row] + 30, row, 32, values, valid, nbins_in_row, basebins);
+    int64_t sum = 0;
+    for (int i = 0; i < 256; i++) sum += (int64_t) i * h.histogram[i];
+    TEST_ASSERT_EQUAL_INT(1024 - h.nfill_values, h.count);
+    TEST_ASSERT_TRUE(sum == h.sum);
+    TEST_ASSERT_EQUAL_INT(SCREEN_PASS, window_histogram_screen(&h, &screen));
+    screen.min_range = 3;
+    TEST_ASSERT_EQUAL_INT(SCREEN_REJECT_RANGE, window_histogram_screen(&h, &screen));
+    screen.min_variance = 1;
+    TEST_ASSERT_EQUAL_INT(SCREEN_REJECT_VARIANCE, window_histogram_screen(&h, &screen));
+    screen.min_valid_fraction = 0.9;
+    TEST_ASSERT_EQUAL_INT(SCREEN_REJECT_VALID, window_histogram_screen(&h, &screen));
+
+    for (int i = 0; i < 3200; i++) values[i] = 100;
+    screen = (WindowScreen) {0, 0, 0};
+    window_histogram_init(&h, basebins[row] + 30, row, 32, values, valid, nbins_in_row, basebins);
+    TEST_ASSERT_EQUAL_INT(SCREEN_REJECT_VARIANCE, window_histogram_screen(&h, &screen));
+}
+
+void test_histogram_threshold_matches_reference(void) {
+    int histogram[256] = {0};
+    int levels[3];
+    int counts[4][3] = {{300, 400, 324}, {512, 1, 511}, {700, 24, 300}, {100, 724, 200}};
+    for (levels[0] = 0; levels[0] < 256; levels[0] += 3) {
+        for (levels[1] = levels[0] + 3; levels[1] < 256; levels[1] += 3) {
+            for (levels[2] = levels[1] + 3; levels[2] < 256; levels[2] += 3) {
+                for (int k = 0; k < 4; k++) {
+                    for (int i = 0; i < 3; i++) histogram[levels[i]] = counts[k][i];
+                    TEST_ASSERT_EQUAL_INT(reference_histogram_threshold(histogram), histogram_threshold(histogram));
+                }
+                for (int i = 0; i < 3; i++) histogram[levels[i]] = 0;
+            }
+        }
+    }
+
+    for (int middle = 1; middle < 255; middle++) {
+        for (int n_low = 0; n_low <= 48; n_low++) {
+            for (int n_middle = 0; n_low + n_middle <= 48; n_middle++) {
+                histogram[0] = n_low;
+                histogram[middle] = n_middle;
+                histogram[255] = 48 - n_low - n_middle;
+                TEST_ASSERT_EQUAL_INT(reference_histogram_threshold(histogram), histogram_threshold(histogram));
+            }
+        }
+        histogram[middle] = 0;
+    }
+}
+
+void test_histogram_analysis_matches_reference(void) {
+    int window[1024];
+    int histogram[256];
+    unsigned int seed = 3;
+    for (int n = 0; n < 20000; n++) {
+        seed = seed * 1103515245 + 12345;
+        int low = (seed >> 16) % 200;
+        int step = 1 + (seed >> 8) % 40;
+        int noise = 1 + (seed >> 4) % 24;
+        int split = (seed >> 20) % 33;
+        for (int i = 0; i < 1024; i++) {
+            seed = seed * 1103515245 + 12345;
+            int value = low + (i % 32 < split ? step : 0) + (int) ((seed >> 16) % noise);
+            window[i] = (seed >> 8) % 40 == 0 || value > 255 ? -999 : value;
+        }
+        get_histogram(window, histogram);
+        TEST_ASSERT_EQUAL_INT(reference_histogram_threshold(histogram), histogram_analysis(window));
+    }
+}
+
+void test_histogram_window_histogram16_matches_8_bit(void) {
+    int nrows = 40;
+    int basebins[40];
+    int nbins_in_row[40];
+    uint8_t values[4000];
+    uint16_t wide[4000];
+    uint64_t valid[63] = {0};
+    int n_bins = 0;
+    for (int i = 0; i < nrows; i++) {
+        basebins[i] = n_bins;
+        nbins_in_row[i] = 80 + i / 2;
+        n_bins += nbins_in_row[i];
+    }
+    for (int i = 0; i < nrows; i++) {
+        for (int j = 0; j < nbins_in_row[i]; j++) {
+            int k = basebins[i] + j;
+            values[k] = (uint8_t) ((j + i < 60 ? 60 : 180) + (k * 37) % 23);
+            wide[k] = (uint16_t) (values[k] << 8);
+            if (k % 17 != 0) bitset_set(valid, k);
+        }
+    }
+    int row = 20;
+    int positive = 0;
+    WindowHistogram h;
+    WindowHistogram16 *h16 = window_histogram16_create(65536);
+    TEST_ASSERT_NOT_NULL(h16);
+    WindowScreen screen = {0, 0, 2};
+    for (int j = 15; j < nbins_in_row[row] - 16; j += 3) {
+        if (j == 15) {
+            window_histogram_init(&h, basebins[row] + j, row, 32, values, valid, nbins_in_row, basebins);
+            window_histogram16_init(h16, basebins[row] + j, row, 32, wide, valid, nbins_in_row, basebins);
+        } else {
+            window_histogram_move(&h, basebins[row] + j, row, values, valid, nbins_in_row, basebins);
+            window_histogram16_move(h16, basebins[row] + j, row, wide, valid, nbins_in_row, basebins);
+        }
+        TEST_ASSERT_EQUAL_INT(h.count, h16->count);
+        TEST_ASSERT_EQUAL_INT(h.nfill_values, h16->nfill_values);
+        TEST_ASSERT_TRUE(h.sum * 256 == h16->sum);
+        TEST_ASSERT_EQUAL_INT(window_histogram_screen(&h, &screen), window_histogram16_screen(h16, &screen));
+        int threshold = window_histogram_threshold(&h);
+        int threshold16 = window_histogram16_threshold(h16);
+        TEST_ASSERT_EQUAL_INT(threshold > 0 ? ((threshold - 1) << 8) + 1 : -1, threshold16);
+        positive += threshold > 0;
+    }
+    TEST_ASSERT_TRUE(positive > 0);
+    window_histogram16_destroy(h16);
+}
+
+void test_histogram_window_histogram_theta(void) {
+    WindowHistogram h;
+    unsigned int seed = 11;
+    int positive = 0;
+    for (int n = 0; n < 5000; n++) {
+        seed = seed * 1103515245 + 12345;
+        int low = (seed >> 16) % 200;
+        int step = 1 + (seed >> 8) % 40;
+        int noise = 1 + (seed >> 4) % 24;
+        int split = (seed >> 20) % 33;
+        memset(&h, 0, sizeof(h));
+        for (int i = 0; i < 1024; i++) {
+            seed = seed * 1103515245 + 12345;
+            int value = low + (i % 32 < split ? step : 0) + (int) ((seed >> 16) % noise);
+            if (value > 255) continue;
+            h.histogram[value]++;
+            h.count++;
+            h.sum += value;
+            h.sum_squares += value * value;
+        }
+        double theta = 0;
+        int tau = window_histogram_theta(&h, &theta);
+        int threshold = window_histogram_threshold(&h);
+        TEST_ASSERT_EQUAL_INT(tau > 0 && theta >= CRIT_VALUE ? tau : -1, threshold);
+        positive += threshold > 0;
+    }
+    TEST_ASSERT_TRUE(positive > 0);
+}
@@ -0,0 +1,77 @@
+#include "unity.h"
+#include <stdlib.h>
+#include "isin.h"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_isin_rows(void) {
+    int n_bins_in_row[180];
+    int basebins[180];
+    int nbins = isin_rows(180, n_bins_in_row, basebins);
+    TEST_ASSERT_EQUAL_INT(3, n_bins_in_row[0]);
+    TEST_ASSERT_EQUAL_INT(360, n_bins_in_row[90]);
+    TEST_ASSERT_EQUAL_INT(basebins[179] + n_bins_in_row[179], nbins);
+}
+
+void test_isin_aoi_matches_every_bin(void) {
+    int nrows = 180;
+    int n_bins_in_row[180];
+    int basebins[180];
+    int nbins = isin_rows(nrows, n_bins_in_row, basebins);
+    double min_lat = 20, max_lat = 80, min_lon = -180, max_lon = -120;
+    IsinAoi *aoi = isin_aoi_create(nrows, min_lat, max_lat, min_lon, max_lon);
+    TEST_ASSERT_NOT_NULL(aoi);
+    int *bins = malloc(aoi->nbins * sizeof(int));
+    double *lats = malloc(aoi->nbins * sizeof(double));
+    double *lons = malloc(aoi->nbins * sizeof(double));
+    isin_aoi_bins(aoi, bins);
+    isin_aoi_lat_lon(aoi, lats, lons);
+
+    int k = 0;
+    for (int i = 0; i < nrows; i++) {
+        double lat = isin_row_lat(nrows, i);
+        for (int col = 0; col < n_bins_in_row[i]; col++) {
+            double lon = isin_bin_lon(n_bins_in_row[i], col);
+            if (lat >= min_lat && lat <= max_lat && lon >= min_lon && lon <= max_lon) {
+                TEST_ASSERT_TRUE(k < aoi->nbins);
+                TEST_ASSERT_EQUAL_INT(basebins[i] + col, bins[k]);
+                TEST_ASSERT_EQUAL_DOUBLE(lat, lats[k]);
+                TEST_ASSERT_EQUAL_DOUBLE(lon, lons[k]);
+                k++;
+            }
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(aoi->nbins, k);
+    TEST_ASSERT_EQUAL_INT(60, aoi->nrows);
+    TEST_ASSERT_EQUAL_INT(aoi->basebins[59] + aoi->n_bins_in_row[59], aoi->nbins);
+    TEST_ASSERT_TRUE(aoi->nbins < nbins / 6);
+    free(bins);
+    free(lats);
+    free(lons);
+    isin_aoi_destroy(aoi);
+}
+
+void test_isin_aoi_whole_grid_and_empty(void) {
+    int n_bins_in_row[36];
+    int basebins[36];
+    int nbins = isin_rows(36, n_bins_in_row, basebins);
+    IsinAoi *aoi = isin_aoi_create(36, -90, 90, -180, 180);
+    TEST_ASSERT_NOT_NULL(aoi);
+    TEST_ASSERT_EQUAL_INT(nbins, aoi->nbins);
+    TEST_ASSERT_EQUAL_INT(36, aoi->nrows);
+    TEST_ASSERT_EQUAL_INT_ARRAY(n_bins_in_row, aoi->n_bins_in_row, 36);
+    TEST_ASSERT_EQUAL_INT_ARRAY(basebins, aoi->grid_basebins, 36);
+    isin_aoi_destroy(aoi);
+
+    aoi = isin_aoi_create(36, 10, 20, 50, 40);
+    TEST_ASSERT_NOT_NULL(aoi);
+    TEST_ASSERT_EQUAL_INT(0, aoi->nbins);
+    TEST_ASSERT_EQUAL_INT(0, aoi->nrows);
+    isin_aoi_destroy(aoi);
+}
@@ -0,0 +1,35 @@
+#include "unity.h"
+#include "pool.h"
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+static void count_task(void *arg, int thread) {
+    int *counts = arg;
+    __atomic_fetch_add(&counts[thread], 1, __ATOMIC_RELAXED);
+}
+
+void test_pool_run_every_thread(void) {
+    int counts[4] = {0};
+    ThreadPool *pool = pool_create(4);
+    TEST_ASSERT_NOT_NULL(pool);
+    TEST_ASSERT_EQUAL_INT(4, pool->nthreads);
+    for (int i = 0; i < 10; i++) {
+        pool_run(pool, count_task, counts);
+    }
+    for (int t = 0; t < 4; t++) {
+        TEST_ASSERT_EQUAL_INT(10, counts[t]);
+    }
+    pool_destroy(pool);
+}
+
+void test_pool_single_thread(void) {
+    int counts[1] = {0};
+    ThreadPool *pool = pool_create(1);
+    pool_run(pool, count_task, counts);
+    TEST_ASSERT_EQUAL_INT(1, counts[0]);
+    pool_destroy(pool);
+}
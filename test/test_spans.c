@@ -0,0 +1,64 @@
+#include "unity.h"
+#include <stdlib.h>
+#include "spans.h"
+#include "grid.h"
+#include "bitset.h"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_spans_bitset_next(void) {
+    uint64_t set[3] = {0, 0, 0};
+    bitset_set(set, 5);
+    bitset_set_range(set, 62, 70);
+    TEST_ASSERT_EQUAL_INT(5, bitset_next_set(set, 0, 192));
+    TEST_ASSERT_EQUAL_INT(62, bitset_next_set(set, 6, 192));
+    TEST_ASSERT_EQUAL_INT(60, bitset_next_set(set, 6, 60));
+    TEST_ASSERT_EQUAL_INT(192, bitset_next_set(set, 132, 192));
+    TEST_ASSERT_EQUAL_INT(0, bitset_next_clear(set, 0, 192));
+    TEST_ASSERT_EQUAL_INT(6, bitset_next_clear(set, 5, 192));
+    TEST_ASSERT_EQUAL_INT(132, bitset_next_clear(set, 62, 192));
+    TEST_ASSERT_EQUAL_INT(100, bitset_next_clear(set, 62, 100));
+}
+
+void test_spans_build(void) {
+    int nrows = 4;
+    int n_bins_in_row[4] = {10, 80, 80, 10};
+    int basebins[4] = {0, 10, 90, 170};
+    int nbins = 180;
+    uint64_t valid[3] = {0, 0, 0};
+    bitset_set_range(valid, 8, 4);      // across the end of the first row
+    bitset_set_range(valid, 60, 40);    // the rest of the second row and the start of the third
+    bitset_set(valid, 120);
+    IsinGrid *grid = grid_create(nbins, nrows, n_bins_in_row, basebins);
+    ValidSpans *spans = valid_spans_create(nrows);
+    TEST_ASSERT_NOT_NULL(spans);
+    TEST_ASSERT_EQUAL_INT(0, valid_spans_build(spans, grid, valid));
+
+    int row_offsets[5] = {0, 1, 3, 5, 5};
+    int begin[5] = {8, 10, 60, 90, 120};
+    int end[5] = {10, 12, 90, 100, 121};
+    TEST_ASSERT_EQUAL_INT(5, spans->nspans);
+    TEST_ASSERT_EQUAL_INT_ARRAY(row_offsets, spans->row_offsets, 5);
+    TEST_ASSERT_EQUAL_INT_ARRAY(begin, spans->begin, 5);
+    TEST_ASSERT_EQUAL_INT_ARRAY(end, spans->end, 5);
+    TEST_ASSERT_TRUE(valid_spans_rows_empty(spans, 3, 3));
+    TEST_ASSERT_TRUE(valid_spans_rows_empty(spans, 3, 10));
+    TEST_ASSERT_TRUE(!valid_spans_rows_empty(spans, -5, 0));
+    TEST_ASSERT_TRUE(!valid_spans_rows_empty(spans, 2, 3));
+
+    /*
+     * The list is reused for the next image
+     */
+    valid[0] = valid[1] = valid[2] = 0;
+    TEST_ASSERT_EQUAL_INT(0, valid_spans_build(spans, grid, valid));
+    TEST_ASSERT_EQUAL_INT(0, spans->nspans);
+    TEST_ASSERT_TRUE(valid_spans_rows_empty(spans, 0, 3));
+    valid_spans_destroy(spans);
+    grid_destroy(grid);
+}
@@ -0,0 +1,150 @@
+#include "unity.h"
+#include <stdlib.h>
+#include <string.h>
+#include "stream.h"
+#include "synth.h"
+#include "isin.h"
+#include "cayula.h"
+#include "helpers.h"
+#include "grid.h"
+#include "pool.h"
+#include "bitset.h"
+#include "arena.h"
+#include "gradient.h"
+#include "cohesion.h"
+#include "contour.h"
+#include "filter.h"
+#include "spans.h"
+#include "histogram.h"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/*
+ * Output of a stream gathered into the layout of the whole image.
+ */
+typedef struct gathered {
+    const SynthField *field;
+    int *out;
+    int next_row;
+    int ncalls;
+    int in_order;
+} Gathered;
+
+static void gather(void *arg, int first_row, int nrows, const int *out_data) {
+    Gathered *g = arg;
+    g->in_order &= first_row == g->next_row;
+    memcpy(g->out + g->field->basebins[first_row], out_data,
+           (g->field->basebins[first_row + nrows - 1] + g->field->n_bins_in_row[first_row + nrows - 1] -
+            g->field->basebins[first_row]) * sizeof(int));
+    g->next_row = first_row + nrows;
+    g->ncalls++;
+}
+
+void test_stream_matches_whole_image(void) {
+    SynthOptions synth = synth_default_options();
+    synth.cloud_fraction = 0.2;
+    SynthField *field = synth_field_create(720, &synth);
+    TEST_ASSERT_NOT_NULL(field);
+    int *expected = malloc(field->nbins * sizeof(int));
+    Gathered g = {field, malloc(field->nbins * sizeof(int)), 0, 0, 1};
+    cayula(field->data, expected, field->nbins, field->nrows, field->n_bins_in_row, field->basebins);
+
+    CayulaStream *stream = cayula_stream_create(field->nrows, field->n_bins_in_row, 100, 0, NULL, gather, &g);
+    TEST_ASSERT_NOT_NULL(stream);
+    TEST_ASSERT_EQUAL_INT(0, cayula_stream_halo(stream) % WINDOW_WIDTH);
+    for (int row = 0; row < field->nrows; row += 37) {
+        int nrows = row + 37 < field->nrows ? 37 : field->nrows - row;
+        TEST_ASSERT_EQUAL_INT(0, cayula_stream_push(stream, field->data + field->basebins[row], nrows));
+    }
+    TEST_ASSERT_EQUAL_INT(field->nrows, g.next_row);
+    TEST_ASSERT_EQUAL_INT(6, g.ncalls);
+    TEST_ASSERT_TRUE(g.in_order);
+    TEST_ASSERT_EQUAL_INT(-1, cayula_stream_push(stream, field->data, 1));
+
+    /*
+     * No contour of this image reaches far enough to be cut, so the contours are those of the whole image
+     */
+    TEST_ASSERT_EQUAL_INT(0, cayula_stream_cut(stream));
+    TEST_ASSERT_EQUAL_INT_ARRAY(expected, g.out, field->nbins);
+    int nfronts = 0;
+    for (int i = 0; i < field->nbins; i++) nfronts += expected[i] == 1;
+    TEST_ASSERT_TRUE(nfronts > 0);
+    cayula_stream_destroy(stream);
+    synth_field_destroy(field);
+    free(expected);
+    free(g.out);
+}
+
+void test_stream_single_band(void) {
+    SynthOptions synth = synth_default_options();
+    SynthField *field = synth_field_create(180, &synth);
+    TEST_ASSERT_NOT_NULL(field);
+    int *expected = malloc(field->nbins * sizeof(int));
+    Gathered g = {field, malloc(field->nbins * sizeof(int)), 0, 0, 1};
+    cayula(field->data, expected, field->nbins, field->nrows, field->n_bins_in_row, field->basebins);
+
+    /*
+     * A band as tall as the image runs the whole image at once
+     */
+    CayulaStream *stream = cayula_stream_create(field->nrows, field->n_bins_in_row, field->nrows, 0, NULL, gather, &g);
+    TEST_ASSERT_NOT_NULL(stream);
+    TEST_ASSERT_EQUAL_INT(0, cayula_stream_push(stream, field->data, field->nrows - 1));
+    TEST_ASSERT_EQUAL_INT(0, g.ncalls);
+    TEST_ASSERT_EQUAL_INT(0, cayula_stream_push(stream, field->data + field->basebins[field->nrows - 1], 1));
+    TEST_ASSERT_EQUAL_INT(1, g.ncalls);
+    TEST_ASSERT_EQUAL_INT_ARRAY(expected, g.out, field->nbins);
+    cayula_stream_destroy(stream);
+    synth_field_destroy(field);
+    free(expected);
+    free(g.out);
+}
+
+void test_stream_contour_rows(void) {
+    SynthOptions synth = synth_default_options();
+    synth.cloud_fraction = 0.2;
+    SynthField *field = synth_field_create(720, &synth);
+    TEST_ASSERT_NOT_NULL(field);
+    int *expected = malloc(field->nbins * sizeof(int));
+    Gathered g = {field, malloc(field->nbins * sizeof(int)), 0, 0, 1};
+    cayula(field->data, expected, field->nbins, field->nrows, field->n_bins_in_row, field->basebins);
+
+    /*
+     * Contours followed only 4 rows around bands of 32 rows are cut, and the output of the rows they reach differs
+     */
+    CayulaStream *stream = cayula_stream_create(field->nrows, field->n_bins_in_row, 32, 4, NULL, gather, &g);
+    TEST_ASSERT_NOT_NULL(stream);
+    TEST_ASSERT_EQUAL_INT(0, cayula_stream_push(stream, field->data, field->nrows));
+    TEST_ASSERT_EQUAL_INT(field->nrows, g.next_row);
+    TEST_ASSERT_TRUE(g.in_order);
+    TEST_ASSERT_TRUE(cayula_stream_cut(stream) > 0);
+    int ndifferent = 0;
+    for (int i = 0; i < field->nbins; i++) ndifferent += expected[i] != g.out[i];
+    TEST_ASSERT_TRUE(ndifferent > 0);
+    cayula_stream_destroy(stream);
+
+    /*
+     * Following them further makes the output that of the whole image again, with bands smaller than the rows
+     * followed
+     */
+    g = (Gathered) {field, g.out, 0, 0, 1};
+    memset(g.out, 2, field->nbins * sizeof(int));
+    stream = cayula_stream_create(field->nrows, field->n_bins_in_row, 32, 64, NULL, gather, &g);
+    TEST_ASSERT_NOT_NULL(stream);
+    for (int row = 0; row < field->nrows; row++) {
+        TEST_ASSERT_EQUAL_INT(0, cayula_stream_push(stream, field->data + field->basebins[row], 1));
+    }
+    TEST_ASSERT_EQUAL_INT(field->nrows, g.next_row);
+    TEST_ASSERT_TRUE(g.in_order);
+    TEST_ASSERT_EQUAL_INT(0, cayula_stream_cut(stream));
+    TEST_ASSERT_EQUAL_INT_ARRAY(expected, g.out, field->nbins);
+    cayula_stream_destroy(stream);
+    synth_field_destroy(field);
+    free(expected);
+    free(g.out);
+}
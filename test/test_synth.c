@@ -0,0 +1,89 @@
+#include "unity.h"
+#include <math.h>
+#include <stdlib.h>
+#include "synth.h"
+#include "isin.h"
+#include "cayula.h"
+#include "helpers.h"
+#include "grid.h"
+#include "pool.h"
+#include "bitset.h"
+#include "arena.h"
+#include "gradient.h"
+#include "cohesion.h"
+#include "contour.h"
+#include "filter.h"
+#include "spans.h"
+#include "histogram.h"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_synth_isin_rows(void) {
+    int n_bins_in_row[2160];
+    int basebins[2160];
+    int nbins = synth_isin_rows(2160, n_bins_in_row, basebins);
+    TEST_ASSERT_EQUAL_INT(3, n_bins_in_row[0]);
+    TEST_ASSERT_EQUAL_INT(4320, n_bins_in_row[1080]);
+    TEST_ASSERT_EQUAL_INT(n_bins_in_row[0], n_bins_in_row[2159]);
+    TEST_ASSERT_EQUAL_INT(0, basebins[0]);
+    TEST_ASSERT_EQUAL_INT(basebins[2159] + n_bins_in_row[2159], nbins);
+    TEST_ASSERT_TRUE(fabs(nbins - 4 * 2160. * 2160. / M_PI) < 2160);
+}
+
+void test_synth_field_deterministic(void) {
+    SynthOptions options = synth_default_options();
+    SynthField *a = synth_field_create(360, &options);
+    SynthField *b = synth_field_create(360, &options);
+    TEST_ASSERT_NOT_NULL(a);
+    TEST_ASSERT_NOT_NULL(b);
+    TEST_ASSERT_EQUAL_INT(a->nbins, b->nbins);
+    TEST_ASSERT_EQUAL_INT_ARRAY(a->data, b->data, a->nbins);
+
+    options.seed = 2;
+    SynthField *c = synth_field_create(360, &options);
+    TEST_ASSERT_NOT_NULL(c);
+    int ndifferent = 0;
+    for (int i = 0; i < a->nbins; i++) ndifferent += a->data[i] != c->data[i];
+    TEST_ASSERT_TRUE(ndifferent > a->nbins / 2);
+    synth_field_destroy(a);
+    synth_field_destroy(b);
+    synth_field_destroy(c);
+}
+
+void test_synth_field_clouds_and_fronts(void) {
+    SynthOptions options = synth_default_options();
+    options.cloud_fraction = 0.4;
+    SynthField *field = synth_field_create(720, &options);
+    TEST_ASSERT_NOT_NULL(field);
+    int nclouds = 0;
+    for (int i = 0; i < field->nbins; i++) {
+        if (field->data[i] == FILL_VALUE) {
+            nclouds++;
+        } else {
+            TEST_ASSERT_TRUE(field->data[i] >= 0 && field->data[i] < options.levels);
+        }
+    }
+    TEST_ASSERT_TRUE(fabs((double) nclouds / field->nbins - 0.4) < 0.03);
+
+    int *out = malloc(field->nbins * sizeof(int));
+    cayula(field->data, out, field->nbins, field->nrows, field->n_bins_in_row, field->basebins);
+    int nfronts = 0;
+    for (int i = 0; i < field->nbins; i++) nfronts += out[i] == 1;
+    TEST_ASSERT_TRUE(nfronts > 0);
+    free(out);
+    synth_field_destroy(field);
+
+    options.cloud_fraction = 0;
+    field = synth_field_create(180, &options);
+    TEST_ASSERT_NOT_NULL(field);
+    for (int i = 0; i < field->nbins; i++) {
+        TEST_ASSERT_TRUE(field->data[i] != FILL_VALUE);
+    }
+    synth_field_destroy(field);
+}